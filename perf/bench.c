@@ -0,0 +1,542 @@
+/*
+    Copyright (c) 2012 250bpm s.r.o.  All rights reserved.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom
+    the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included
+    in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+#include "../src/nn.h"
+#include "../src/pair.h"
+#include "../src/pubsub.h"
+#include "../src/pipeline.h"
+#include "../src/reqrep.h"
+#include "../src/survey.h"
+#include "../src/bus.h"
+#include "../src/tcp.h"
+
+#include "../src/utils/attr.h"
+
+#include "../src/utils/err.c"
+#include "../src/utils/thread.c"
+#include "../src/utils/sleep.c"
+
+#include "hist.c"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*  Runs all the messaging patterns over all the transports (or a selected
+    subset) within a single process and prints the results as a JSON array.
+    Each message carries the time it was sent at so that the latency can be
+    measured by the receiver. */
+
+/*  Byte 0 of each message is the header of a binary WebSocket frame, which
+    is what the ws transport expects. The timestamp follows at offset 8. */
+#define BENCH_WS_BINARY 0x82
+#define BENCH_STAMP_OFFSET 8
+#define BENCH_MIN_SIZE 16
+
+/*  Receivers give up after not getting a message for this long (in ms). */
+#define BENCH_TIMEOUT 1000
+
+/*  Time given to the peers to connect before the measurement starts
+    (in ms). */
+#define BENCH_SETTLE 200
+
+/*  Default TCP/WebSocket port of the first run. Each run uses a port of its
+    own so that lingering connections of the previous run don't interfere. */
+#define BENCH_PORT 5610
+
+#define BENCH_PAIR 0
+#define BENCH_PUBSUB 1
+#define BENCH_PIPELINE 2
+#define BENCH_REQREP 3
+#define BENCH_SURVEY 4
+#define BENCH_BUS 5
+#define BENCH_PATTERNS 6
+
+static const char *bench_patterns [BENCH_PATTERNS] = {
+    "pair", "pubsub", "pipeline", "reqrep", "survey", "bus"
+};
+
+#define BENCH_TRANSPORTS 4
+
+static const char *bench_transports [BENCH_TRANSPORTS] = {
+    "inproc", "ipc", "tcp", "ws"
+};
+
+/******************************************************************************/
+/*  The benchmark.                                                            */
+/******************************************************************************/
+
+struct bench;
+
+struct bench_peer {
+    struct bench *bench;
+    struct nn_thread thread;
+
+    /*  Latencies measured by the peer. */
+    struct perf_hist hist;
+
+    /*  Number of messages received and the time the last one was received
+        at. */
+    uint64_t received;
+    uint64_t last;
+};
+
+struct bench {
+    int pattern;
+    int transport;
+    char addr [64];
+    size_t size;
+    int count;
+    int npeers;
+    struct bench_peer *peers;
+};
+
+static void bench_stamp (void *buf)
+{
+    uint64_t now;
+
+    now = perf_now ();
+    memcpy (((char*) buf) + BENCH_STAMP_OFFSET, &now, sizeof (now));
+}
+
+/*  Returns the time elapsed since the message was stamped. */
+static uint64_t bench_latency (void *buf, uint64_t now)
+{
+    uint64_t stamp;
+
+    memcpy (&stamp, ((char*) buf) + BENCH_STAMP_OFFSET, sizeof (stamp));
+    return now > stamp ? now - stamp : 0;
+}
+
+static int bench_socket (struct bench *self, int protocol)
+{
+    int rc;
+    int s;
+    int opt;
+
+    s = nn_socket (AF_SP, protocol);
+    errno_assert (s >= 0);
+    if (strcmp (bench_transports [self->transport], "tcp") == 0) {
+        opt = 1;
+        rc = nn_setsockopt (s, NN_TCP, NN_TCP_NODELAY, &opt, sizeof (opt));
+        errno_assert (rc == 0);
+    }
+    opt = BENCH_TIMEOUT;
+    rc = nn_setsockopt (s, NN_SOL_SOCKET, NN_RCVTIMEO, &opt, sizeof (opt));
+    errno_assert (rc == 0);
+    return s;
+}
+
+/*  Receives messages till there are none for BENCH_TIMEOUT. Used by
+    the receiving side of the one-way patterns. */
+static void bench_receive (struct bench_peer *self, int s)
+{
+    int nbytes;
+    void *buf;
+    uint64_t now;
+
+    while (1) {
+        nbytes = nn_recv (s, &buf, NN_MSG, 0);
+        if (nbytes < 0) {
+            errno_assert (nn_errno () == EAGAIN);
+            break;
+        }
+        now = perf_now ();
+        nn_assert (nbytes == (int) self->bench->size);
+        perf_hist_record (&self->hist, bench_latency (buf, now));
+        nn_freemsg (buf);
+        ++self->received;
+        self->last = now;
+    }
+}
+
+static void bench_peer_routine (void *arg)
+{
+    int rc;
+    int s;
+    int i;
+    int nbytes;
+    void *buf;
+    uint64_t now;
+    struct bench_peer *self;
+    struct bench *bench;
+
+    self = (struct bench_peer*) arg;
+    bench = self->bench;
+
+    switch (bench->pattern) {
+    case BENCH_PAIR:
+        s = bench_socket (bench, NN_PAIR);
+        break;
+    case BENCH_PUBSUB:
+        s = bench_socket (bench, NN_SUB);
+        rc = nn_setsockopt (s, NN_SUB, NN_SUB_SUBSCRIBE, "", 0);
+        errno_assert (rc == 0);
+        break;
+    case BENCH_PIPELINE:
+        s = bench_socket (bench, NN_PULL);
+        break;
+    case BENCH_REQREP:
+        s = bench_socket (bench, NN_REQ);
+        break;
+    case BENCH_SURVEY:
+        s = bench_socket (bench, NN_RESPONDENT);
+        break;
+    case BENCH_BUS:
+        s = bench_socket (bench, NN_BUS);
+        break;
+    default:
+        nn_assert (0);
+    }
+    rc = nn_connect (s, bench->addr);
+    errno_assert (rc >= 0);
+
+    switch (bench->pattern) {
+    case BENCH_REQREP:
+
+        /*  The client sends requests one at a time and measures
+            the round-trip time. */
+        buf = nn_allocmsg (bench->size, 0);
+        alloc_assert (buf);
+        memset (buf, 111, bench->size);
+        ((unsigned char*) buf) [0] = BENCH_WS_BINARY;
+        nn_sleep (BENCH_SETTLE);
+        for (i = 0; i != bench->count / bench->npeers; ++i) {
+            bench_stamp (buf);
+            nbytes = nn_send (s, &buf, NN_MSG, 0);
+            errno_assert (nbytes == (int) bench->size);
+            nbytes = nn_recv (s, &buf, NN_MSG, 0);
+            if (nbytes < 0) {
+                errno_assert (nn_errno () == EAGAIN);
+                break;
+            }
+            now = perf_now ();
+            perf_hist_record (&self->hist, bench_latency (buf, now));
+            ++self->received;
+            self->last = now;
+        }
+        if (nbytes >= 0)
+            nn_freemsg (buf);
+        break;
+
+    case BENCH_SURVEY:
+
+        /*  The respondent sends the surveys back as they are. */
+        while (1) {
+            nbytes = nn_recv (s, &buf, NN_MSG, 0);
+            if (nbytes < 0) {
+                errno_assert (nn_errno () == EAGAIN);
+                break;
+            }
+            nbytes = nn_send (s, &buf, NN_MSG, 0);
+            if (nbytes < 0) {
+                nn_freemsg (buf);
+                continue;
+            }
+        }
+        break;
+
+    default:
+        bench_receive (self, s);
+    }
+
+    rc = nn_close (s);
+    errno_assert (rc == 0);
+}
+
+/*  The socket the peers connect to. Depending on the pattern it either
+    sends messages to the peers or serves them. Returns the time at which
+    the measurement started. */
+static uint64_t bench_hub (struct bench *self, struct perf_hist *hist,
+    uint64_t *received, uint64_t *last)
+{
+    int rc;
+    int s;
+    int i;
+    int j;
+    int nbytes;
+    int opt;
+    void *buf;
+    void *msg;
+    uint64_t start;
+    uint64_t now;
+
+    switch (self->pattern) {
+    case BENCH_PAIR:
+        s = bench_socket (self, NN_PAIR);
+        break;
+    case BENCH_PUBSUB:
+        s = bench_socket (self, NN_PUB);
+        break;
+    case BENCH_PIPELINE:
+        s = bench_socket (self, NN_PUSH);
+        break;
+    case BENCH_REQREP:
+        s = bench_socket (self, NN_REP);
+        break;
+    case BENCH_SURVEY:
+        s = bench_socket (self, NN_SURVEYOR);
+        opt = BENCH_TIMEOUT;
+        rc = nn_setsockopt (s, NN_SURVEYOR, NN_SURVEYOR_DEADLINE,
+            &opt, sizeof (opt));
+        errno_assert (rc == 0);
+        break;
+    case BENCH_BUS:
+        s = bench_socket (self, NN_BUS);
+        break;
+    default:
+        nn_assert (0);
+    }
+    rc = nn_bind (s, self->addr);
+    errno_assert (rc >= 0);
+
+    for (i = 0; i != self->npeers; ++i)
+        nn_thread_init (&self->peers [i].thread, bench_peer_routine,
+            &self->peers [i]);
+    nn_sleep (BENCH_SETTLE);
+
+    buf = malloc (self->size);
+    alloc_assert (buf);
+    memset (buf, 111, self->size);
+    ((unsigned char*) buf) [0] = BENCH_WS_BINARY;
+
+    start = perf_now ();
+    switch (self->pattern) {
+    case BENCH_REQREP:
+
+        /*  Echo the requests back to the clients. */
+        for (i = 0; i != (self->count / self->npeers) * self->npeers; ++i) {
+            nbytes = nn_recv (s, &msg, NN_MSG, 0);
+            if (nbytes < 0) {
+                errno_assert (nn_errno () == EAGAIN);
+                break;
+            }
+            nbytes = nn_send (s, &msg, NN_MSG, 0);
+            errno_assert (nbytes >= 0);
+        }
+        break;
+
+    case BENCH_SURVEY:
+
+        /*  Each survey is complete once all the respondents answered or
+            the deadline expired. */
+        for (i = 0; i != self->count; ++i) {
+            bench_stamp (buf);
+            nbytes = nn_send (s, buf, self->size, 0);
+            errno_assert (nbytes == (int) self->size);
+            for (j = 0; j != self->npeers; ++j) {
+                nbytes = nn_recv (s, &msg, NN_MSG, 0);
+                if (nbytes < 0) {
+                    errno_assert (nn_errno () == ETIMEDOUT ||
+                        nn_errno () == EAGAIN);
+                    break;
+                }
+                now = perf_now ();
+                perf_hist_record (hist, bench_latency (msg, now));
+                nn_freemsg (msg);
+                ++*received;
+                *last = now;
+            }
+        }
+        break;
+
+    default:
+        for (i = 0; i != self->count; ++i) {
+            bench_stamp (buf);
+            nbytes = nn_send (s, buf, self->size, 0);
+            errno_assert (nbytes == (int) self->size);
+        }
+    }
+
+    for (i = 0; i != self->npeers; ++i)
+        nn_thread_term (&self->peers [i].thread);
+
+    free (buf);
+    rc = nn_close (s);
+    errno_assert (rc == 0);
+
+    return start;
+}
+
+static void bench_run (int pattern, int transport, size_t size, int count,
+    int npeers, int port, int first)
+{
+    int i;
+    uint64_t start;
+    uint64_t last;
+    uint64_t received;
+    uint64_t expected;
+    double elapsed;
+    struct bench self;
+    struct perf_hist *hist;
+
+    self.pattern = pattern;
+    self.transport = transport;
+    self.size = size;
+    self.count = count;
+    self.npeers = pattern == BENCH_PAIR ? 1 : npeers;
+    if (strcmp (bench_transports [transport], "inproc") == 0 ||
+          strcmp (bench_transports [transport], "ipc") == 0)
+        sprintf (self.addr, "%s://bench-%d", bench_transports [transport],
+            port);
+    else
+        sprintf (self.addr, "%s://127.0.0.1:%d", bench_transports [transport],
+            port);
+    self.peers = malloc (sizeof (struct bench_peer) * self.npeers);
+    alloc_assert (self.peers);
+    for (i = 0; i != self.npeers; ++i) {
+        self.peers [i].bench = &self;
+        perf_hist_init (&self.peers [i].hist);
+        self.peers [i].received = 0;
+        self.peers [i].last = 0;
+    }
+    hist = malloc (sizeof (struct perf_hist));
+    alloc_assert (hist);
+    perf_hist_init (hist);
+    received = 0;
+    last = 0;
+
+    start = bench_hub (&self, hist, &received, &last);
+
+    /*  Merge the results of the peers. */
+    for (i = 0; i != self.npeers; ++i) {
+        perf_hist_add (hist, &self.peers [i].hist);
+        received += self.peers [i].received;
+        if (self.peers [i].last > last)
+            last = self.peers [i].last;
+    }
+    switch (pattern) {
+    case BENCH_PAIR:
+    case BENCH_PIPELINE:
+        expected = count;
+        break;
+    case BENCH_REQREP:
+        expected = (count / self.npeers) * self.npeers;
+        break;
+    default:
+        expected = (uint64_t) count * self.npeers;
+    }
+    elapsed = last > start ? (double) (last - start) / 1000000000.0 : 0.0;
+
+    printf ("%s  {\"pattern\": \"%s\", \"transport\": \"%s\", "
+        "\"peers\": %d, \"size\": %d, \"count\": %d, "
+        "\"expected\": %llu, \"received\": %llu, \"elapsed\": %.6f, "
+        "\"msgs_per_sec\": %.1f, \"mb_per_sec\": %.3f, "
+        "\"latency_us\": {\"p50\": %.3f, \"p99\": %.3f, \"p999\": %.3f, "
+        "\"max\": %.3f}}",
+        first ? "" : ",\n", bench_patterns [pattern],
+        bench_transports [transport], self.npeers, (int) size, count,
+        (unsigned long long) expected, (unsigned long long) received, elapsed,
+        elapsed > 0 ? (double) received / elapsed : 0.0,
+        elapsed > 0 ? (double) received * size / elapsed / 1000000 : 0.0,
+        (double) perf_hist_percentile (hist, 0.5) / 1000,
+        (double) perf_hist_percentile (hist, 0.99) / 1000,
+        (double) perf_hist_percentile (hist, 0.999) / 1000,
+        (double) hist->max / 1000);
+    fflush (stdout);
+
+    free (hist);
+    free (self.peers);
+}
+
+/*  The ws transport passes the SP header to the receiver as a part of
+    the message body, so patterns that rely on the header don't work over it. */
+static int bench_supported (int pattern, int transport)
+{
+    if (strcmp (bench_transports [transport], "ws") == 0 &&
+          (pattern == BENCH_REQREP || pattern == BENCH_SURVEY))
+        return 0;
+    return 1;
+}
+
+static int bench_lookup (const char *name, const char **names, int count)
+{
+    int i;
+
+    if (strcmp (name, "all") == 0)
+        return -1;
+    for (i = 0; i != count; ++i)
+        if (strcmp (name, names [i]) == 0)
+            return i;
+    return -2;
+}
+
+int main (int argc, char *argv [])
+{
+    int pattern;
+    int transport;
+    size_t size;
+    int count;
+    int npeers;
+    int port;
+    int first;
+    int p;
+    int t;
+
+    if (argc > 7) {
+        printf ("usage: bench [pattern|all] [transport|all] [msg-size] "
+            "[msg-count] [peers] [port]\n");
+        return 1;
+    }
+    pattern = bench_lookup (argc > 1 ? argv [1] : "all", bench_patterns,
+        BENCH_PATTERNS);
+    transport = bench_lookup (argc > 2 ? argv [2] : "all", bench_transports,
+        BENCH_TRANSPORTS);
+    size = argc > 3 ? atoi (argv [3]) : 64;
+    count = argc > 4 ? atoi (argv [4]) : 10000;
+    npeers = argc > 5 ? atoi (argv [5]) : 4;
+    port = argc > 6 ? atoi (argv [6]) : BENCH_PORT;
+    if (pattern == -2 || transport == -2 || size < BENCH_MIN_SIZE ||
+          count <= 0 || npeers <= 0 || npeers > count) {
+        printf ("usage: bench [pattern|all] [transport|all] [msg-size] "
+            "[msg-count] [peers] [port]\n");
+        printf ("patterns: pair pubsub pipeline reqrep survey bus\n");
+        printf ("transports: inproc ipc tcp ws\n");
+        printf ("message size must be at least %d bytes\n", BENCH_MIN_SIZE);
+        return 1;
+    }
+
+    if (pattern >= 0 && transport >= 0 &&
+          !bench_supported (pattern, transport)) {
+        printf ("%s is not supported over %s\n", bench_patterns [pattern],
+            bench_transports [transport]);
+        return 1;
+    }
+
+    printf ("[\n");
+    first = 1;
+    for (p = 0; p != BENCH_PATTERNS; ++p) {
+        if (pattern >= 0 && p != pattern)
+            continue;
+        for (t = 0; t != BENCH_TRANSPORTS; ++t) {
+            if ((transport >= 0 && t != transport) ||
+                  !bench_supported (p, t))
+                continue;
+            bench_run (p, t, size, count, npeers, port++, first);
+            first = 0;
+        }
+    }
+    printf ("\n]\n");
+
+    return 0;
+}
@@ -0,0 +1,119 @@
+/*
+    Copyright (c) 2013 250bpm s.r.o.  All rights reserved.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom
+    the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included
+    in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+#include "hist.h"
+
+#include "../src/utils/err.h"
+
+#include <string.h>
+
+#if defined NN_HAVE_WINDOWS
+#include "../src/utils/win.h"
+#else
+#include <time.h>
+#endif
+
+void perf_hist_init (struct perf_hist *self)
+{
+    memset (self, 0, sizeof (struct perf_hist));
+}
+
+void perf_hist_record (struct perf_hist *self, uint64_t value)
+{
+    int mag;
+    int index;
+
+    if (value < PERF_HIST_SUB)
+        index = (int) value;
+    else {
+        mag = 0;
+        while ((value >> mag) >= PERF_HIST_SUB)
+            ++mag;
+        if (mag > PERF_HIST_MAGS)
+            index = PERF_HIST_SIZE - 1;
+        else
+            index = PERF_HIST_SUB + (mag - 1) * PERF_HIST_HALF +
+                (int) (value >> mag) - PERF_HIST_HALF;
+    }
+    ++self->counts [index];
+    ++self->total;
+    if (value > self->max)
+        self->max = value;
+}
+
+void perf_hist_add (struct perf_hist *self, struct perf_hist *other)
+{
+    int i;
+
+    for (i = 0; i != PERF_HIST_SIZE; ++i)
+        self->counts [i] += other->counts [i];
+    self->total += other->total;
+    if (other->max > self->max)
+        self->max = other->max;
+}
+
+uint64_t perf_hist_percentile (struct perf_hist *self, double percentile)
+{
+    uint64_t target;
+    uint64_t sum;
+    uint64_t value;
+    int index;
+    int mag;
+
+    if (self->total == 0)
+        return 0;
+    target = (uint64_t) (percentile * (double) self->total + 0.5);
+    if (target == 0)
+        target = 1;
+    sum = 0;
+    for (index = 0; index != PERF_HIST_SIZE; ++index) {
+        sum += self->counts [index];
+        if (sum >= target)
+            break;
+    }
+    if (index < PERF_HIST_SUB)
+        return (uint64_t) index;
+    mag = (index - PERF_HIST_SUB) / PERF_HIST_HALF + 1;
+    value = ((uint64_t) ((index - PERF_HIST_SUB) % PERF_HIST_HALF +
+        PERF_HIST_HALF) << mag) + (((uint64_t) 1 << mag) >> 1);
+    return value < self->max ? value : self->max;
+}
+
+uint64_t perf_now (void)
+{
+#if defined NN_HAVE_WINDOWS
+    LARGE_INTEGER tps;
+    LARGE_INTEGER time;
+
+    QueryPerformanceFrequency (&tps);
+    QueryPerformanceCounter (&time);
+    return (uint64_t) ((double) time.QuadPart * 1000000000.0 /
+        (double) tps.QuadPart);
+#else
+    int rc;
+    struct timespec ts;
+
+    rc = clock_gettime (CLOCK_MONOTONIC, &ts);
+    errno_assert (rc == 0);
+    return (uint64_t) ts.tv_sec * 1000000000 + (uint64_t) ts.tv_nsec;
+#endif
+}
@@ -0,0 +1,56 @@
+/*
+    Copyright (c) 2013 250bpm s.r.o.  All rights reserved.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom
+    the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included
+    in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+#ifndef PERF_HIST_INCLUDED
+#define PERF_HIST_INCLUDED
+
+#include "../src/utils/int.h"
+
+/*  Latency histogram in the spirit of HdrHistogram. Values (in nanoseconds)
+    below PERF_HIST_SUB are recorded exactly, bigger values with relative
+    error below 1/PERF_HIST_HALF. Values above ~2^48 ns are clamped. */
+#define PERF_HIST_SUBBITS 7
+#define PERF_HIST_SUB (1 << PERF_HIST_SUBBITS)
+#define PERF_HIST_HALF (PERF_HIST_SUB / 2)
+#define PERF_HIST_MAGS 41
+#define PERF_HIST_SIZE (PERF_HIST_SUB + PERF_HIST_MAGS * PERF_HIST_HALF)
+
+struct perf_hist {
+    uint64_t counts [PERF_HIST_SIZE];
+    uint64_t total;
+    uint64_t max;
+};
+
+void perf_hist_init (struct perf_hist *self);
+void perf_hist_record (struct perf_hist *self, uint64_t value);
+
+/*  Adds the values recorded in 'other' to 'self'. */
+void perf_hist_add (struct perf_hist *self, struct perf_hist *other);
+
+/*  Returns the value below which 'percentile' (0..1) of the recorded values
+    lie. Within a bucket, its midpoint is reported. */
+uint64_t perf_hist_percentile (struct perf_hist *self, double percentile);
+
+/*  Monotonic time in nanoseconds. */
+uint64_t perf_now (void);
+
+#endif
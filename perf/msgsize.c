@@ -0,0 +1,155 @@
+/*
+    Copyright (c) 2012 250bpm s.r.o.  All rights reserved.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom
+    the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included
+    in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+#include "../src/nn.h"
+#include "../src/pair.h"
+
+#include "../src/utils/chunkref.h"
+#include "../src/utils/attr.h"
+
+#include "../src/utils/err.c"
+
+#include "hist.c"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*  Measures the per-message cost of small messages as a function of their
+    size. For each size it reports the cost of nn_allocmsg/nn_freemsg next to
+    that of plain malloc/free, and the cost of passing the message through
+    an inproc PAIR socket in a single thread, which is dominated by the
+    allocation and copying of the message. Messages shorter than
+    NN_CHUNKREF_MAX are stored inline and don't allocate at all; up to the
+    largest size class of the chunk cache the memory is reused, beyond it
+    every message goes to the heap. To compare with the uncached allocator
+    rebuild the library with -DNN_CHUNK_CACHE_SIZE=0. */
+
+static double msgsize_allocmsg (size_t size, int count)
+{
+    int i;
+    uint64_t start;
+    void *msg;
+
+    start = perf_now ();
+    for (i = 0; i != count; ++i) {
+        msg = nn_allocmsg (size, 0);
+        alloc_assert (msg);
+        *(volatile char*) msg = 0;
+        nn_freemsg (msg);
+    }
+    return (double) (perf_now () - start) / count;
+}
+
+static double msgsize_malloc (size_t size, int count)
+{
+    int i;
+    uint64_t start;
+    void *msg;
+
+    start = perf_now ();
+    for (i = 0; i != count; ++i) {
+        msg = malloc (size ? size : 1);
+        alloc_assert (msg);
+        *(volatile char*) msg = 0;
+        free (msg);
+    }
+    return (double) (perf_now () - start) / count;
+}
+
+static double msgsize_inproc (int sin, int sout, char *buf, size_t size,
+    int count)
+{
+    int i;
+    int nbytes;
+    uint64_t start;
+
+    start = perf_now ();
+    for (i = 0; i != count; ++i) {
+        nbytes = nn_send (sout, buf, size, 0);
+        errno_assert (nbytes == (int) size);
+        nbytes = nn_recv (sin, buf, size, 0);
+        errno_assert (nbytes == (int) size);
+    }
+    return (double) (perf_now () - start) / count;
+}
+
+int main (int argc, char *argv [])
+{
+    int rc;
+    int sin;
+    int sout;
+    size_t max;
+    size_t step;
+    size_t size;
+    int count;
+    char *buf;
+
+    if (argc != 4) {
+        printf ("usage: msgsize <max-size> <step> <msg-count>\n");
+        return 1;
+    }
+    max = atoi (argv [1]);
+    step = atoi (argv [2]);
+    count = atoi (argv [3]);
+    if (step == 0 || count <= 0) {
+        printf ("invalid arguments\n");
+        return 1;
+    }
+
+    sin = nn_socket (AF_SP, NN_PAIR);
+    errno_assert (sin >= 0);
+    rc = nn_bind (sin, "inproc://msgsize");
+    errno_assert (rc >= 0);
+    sout = nn_socket (AF_SP, NN_PAIR);
+    errno_assert (sout >= 0);
+    rc = nn_connect (sout, "inproc://msgsize");
+    errno_assert (rc >= 0);
+
+    buf = malloc (max ? max : 1);
+    alloc_assert (buf);
+    memset (buf, 111, max);
+
+    /*  Warm up the allocators. */
+    msgsize_inproc (sin, sout, buf, max, count);
+
+    printf ("{\"inline_max\": %d, \"count\": %d, \"sizes\": [\n",
+        NN_CHUNKREF_MAX - 1, count);
+    for (size = 0; size <= max; size += step) {
+        printf ("%s    {\"size\": %d, \"allocmsg_ns\": %.1f, "
+            "\"malloc_ns\": %.1f, \"inproc_ns\": %.1f}",
+            size ? ",\n" : "", (int) size,
+            msgsize_allocmsg (size, count), msgsize_malloc (size, count),
+            msgsize_inproc (sin, sout, buf, size, count));
+        fflush (stdout);
+    }
+    printf ("\n]}\n");
+
+    free (buf);
+    rc = nn_close (sout);
+    errno_assert (rc == 0);
+    rc = nn_close (sin);
+    errno_assert (rc == 0);
+
+    return 0;
+}
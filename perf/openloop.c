@@ -0,0 +1,289 @@
+/*
+    Copyright (c) 2012 250bpm s.r.o.  All rights reserved.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom
+    the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included
+    in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+#include "../src/nn.h"
+#include "../src/pipeline.h"
+
+#include "../src/utils/attr.h"
+
+#include "../src/utils/err.c"
+#include "../src/utils/thread.c"
+#include "../src/utils/sleep.c"
+
+#include "hist.c"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*  Open-loop latency generator. Unlike local_lat/remote_lat, which send
+    the next message only once the previous one came back, messages are sent
+    on a fixed schedule irrespective of how fast the system under test
+    processes them. Each message carries the time it was *scheduled* to be
+    sent at rather than the time it was actually sent at, so when the sender
+    falls behind, the queueing delay shows up in the measured latency instead
+    of being silently omitted. The measurement is repeated for a range of
+    rates to find the point where the latency starts to grow. */
+
+/*  Byte 0 of each message is the header of a binary WebSocket frame, which
+    is what the ws transport expects. The timestamp follows at offset 8. */
+#define OPENLOOP_WS_BINARY 0x82
+#define OPENLOOP_STAMP_OFFSET 8
+#define OPENLOOP_MIN_SIZE 16
+
+/*  Receiver gives up after not getting a message for this long (in ms). */
+#define OPENLOOP_TIMEOUT 1000
+
+/*  Time given to the sockets to connect before the first run (in ms). */
+#define OPENLOOP_SETTLE 200
+
+/*  Rate is considered to be past the knee once its p99 latency exceeds
+    the p99 latency at the lowest rate this many times, or once the messages
+    can't be delivered at the target rate anymore. */
+#define OPENLOOP_KNEE_FACTOR 10
+#define OPENLOOP_KNEE_THROUGHPUT 0.95
+
+struct openloop_run {
+
+    /*  Receiving socket. */
+    int s;
+
+    /*  Message size and the number of messages to receive. */
+    size_t size;
+    uint64_t count;
+
+    /*  Latencies measured by the receiver. */
+    struct perf_hist hist;
+
+    /*  Number of messages received and the time the last one was received
+        at. */
+    uint64_t received;
+    uint64_t last;
+};
+
+static void openloop_receiver (void *arg)
+{
+    int nbytes;
+    void *buf;
+    uint64_t now;
+    uint64_t stamp;
+    struct openloop_run *self;
+
+    self = (struct openloop_run*) arg;
+
+    while (self->received != self->count) {
+        nbytes = nn_recv (self->s, &buf, NN_MSG, 0);
+        if (nbytes < 0) {
+            errno_assert (nn_errno () == EAGAIN);
+            break;
+        }
+        now = perf_now ();
+        nn_assert (nbytes == (int) self->size);
+        memcpy (&stamp, ((char*) buf) + OPENLOOP_STAMP_OFFSET,
+            sizeof (stamp));
+        perf_hist_record (&self->hist, now > stamp ? now - stamp : 0);
+        nn_freemsg (buf);
+        ++self->received;
+        self->last = now;
+    }
+}
+
+/*  Sends messages at 'rate' messages per second for 'duration' ms. Results
+    of the warm-up run (first == -1) are thrown away. */
+static void openloop_run (int sin, int sout, size_t size, uint64_t rate,
+    int duration, int first, struct perf_hist *baseline, uint64_t *knee)
+{
+    int nbytes;
+    uint64_t i;
+    uint64_t start;
+    uint64_t scheduled;
+    uint64_t now;
+    uint64_t lag;
+    uint64_t p99;
+    double elapsed;
+    double achieved;
+    char *buf;
+    struct nn_thread thread;
+    struct openloop_run *run;
+    struct perf_hist *lags;
+
+    run = malloc (sizeof (struct openloop_run));
+    alloc_assert (run);
+    run->s = sin;
+    run->size = size;
+    run->count = rate * duration / 1000;
+    if (run->count == 0)
+        run->count = 1;
+    perf_hist_init (&run->hist);
+    run->received = 0;
+    run->last = 0;
+    lags = malloc (sizeof (struct perf_hist));
+    alloc_assert (lags);
+    perf_hist_init (lags);
+
+    buf = malloc (size);
+    alloc_assert (buf);
+    memset (buf, 111, size);
+    buf [0] = (char) OPENLOOP_WS_BINARY;
+
+    nn_thread_init (&thread, openloop_receiver, run);
+
+    /*  Message i is due at start + i / rate. If the sender is late it sends
+        the message straight away but the timestamp stays the same. */
+    start = perf_now ();
+    for (i = 0; i != run->count; ++i) {
+        scheduled = start + i * 1000000000 / rate;
+        while (1) {
+            now = perf_now ();
+            if (now >= scheduled)
+                break;
+            if (scheduled - now > 2000000)
+                nn_sleep (1);
+        }
+        perf_hist_record (lags, now - scheduled);
+        memcpy (buf + OPENLOOP_STAMP_OFFSET, &scheduled, sizeof (scheduled));
+        nbytes = nn_send (sout, buf, size, 0);
+        errno_assert (nbytes == (int) size);
+    }
+    lag = perf_now () - (start + (run->count - 1) * 1000000000 / rate);
+
+    nn_thread_term (&thread);
+
+    /*  The knee is the first rate that isn't sustained or at which the tail
+        latency explodes compared to the lowest rate. */
+    p99 = perf_hist_percentile (&run->hist, 0.99);
+    elapsed = run->last > start ?
+        (double) (run->last - start) / 1000000000.0 : 0.0;
+    achieved = elapsed > 0 ? (double) run->received / elapsed : 0.0;
+    if (first < 0)
+        goto done;
+    if (first)
+        *baseline = run->hist;
+    else if (*knee == 0 && (run->received < run->count ||
+          achieved < OPENLOOP_KNEE_THROUGHPUT * rate ||
+          p99 > OPENLOOP_KNEE_FACTOR *
+          perf_hist_percentile (baseline, 0.99)))
+        *knee = rate;
+
+    printf ("%s    {\"rate\": %llu, \"achieved\": %.1f, \"sent\": %llu, "
+        "\"received\": %llu, \"final_lag_us\": %.3f, "
+        "\"send_lag_us\": {\"p50\": %.3f, \"p99\": %.3f, \"max\": %.3f}, "
+        "\"latency_us\": {\"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f, "
+        "\"p999\": %.3f, \"max\": %.3f}}",
+        first ? "" : ",\n", (unsigned long long) rate, achieved,
+        (unsigned long long) run->count, (unsigned long long) run->received,
+        (double) lag / 1000,
+        (double) perf_hist_percentile (lags, 0.5) / 1000,
+        (double) perf_hist_percentile (lags, 0.99) / 1000,
+        (double) lags->max / 1000,
+        (double) perf_hist_percentile (&run->hist, 0.5) / 1000,
+        (double) perf_hist_percentile (&run->hist, 0.9) / 1000,
+        (double) p99 / 1000,
+        (double) perf_hist_percentile (&run->hist, 0.999) / 1000,
+        (double) run->hist.max / 1000);
+    fflush (stdout);
+
+done:
+    free (buf);
+    free (lags);
+    free (run);
+}
+
+int main (int argc, char *argv [])
+{
+    int rc;
+    int sin;
+    int sout;
+    int opt;
+    const char *addr;
+    size_t size;
+    int duration;
+    int steps;
+    int i;
+    uint64_t from;
+    uint64_t to;
+    uint64_t rate;
+    uint64_t knee;
+    struct perf_hist *baseline;
+
+    if (argc != 5 && argc != 7) {
+        printf ("usage: openloop <address> <msg-size> <duration-ms> "
+            "<rate> [<max-rate> <steps>]\n");
+        return 1;
+    }
+    addr = argv [1];
+    size = atoi (argv [2]);
+    duration = atoi (argv [3]);
+    from = atoi (argv [4]);
+    to = argc == 7 ? atoi (argv [5]) : from;
+    steps = argc == 7 ? atoi (argv [6]) : 1;
+    if (size < OPENLOOP_MIN_SIZE || duration <= 0 || from == 0 || to < from ||
+          steps <= 0) {
+        printf ("invalid arguments; message size must be at least %d bytes\n",
+            OPENLOOP_MIN_SIZE);
+        return 1;
+    }
+
+    /*  Both ends live in this process so that they share the clock. */
+    sin = nn_socket (AF_SP, NN_PULL);
+    errno_assert (sin >= 0);
+    opt = OPENLOOP_TIMEOUT;
+    rc = nn_setsockopt (sin, NN_SOL_SOCKET, NN_RCVTIMEO, &opt, sizeof (opt));
+    errno_assert (rc == 0);
+    rc = nn_bind (sin, addr);
+    errno_assert (rc >= 0);
+    sout = nn_socket (AF_SP, NN_PUSH);
+    errno_assert (sout >= 0);
+    rc = nn_connect (sout, addr);
+    errno_assert (rc >= 0);
+    nn_sleep (OPENLOOP_SETTLE);
+
+    baseline = malloc (sizeof (struct perf_hist));
+    alloc_assert (baseline);
+    knee = 0;
+
+    /*  Let the connections and the allocator warm up at the lowest rate so
+        that it doesn't skew the baseline. */
+    openloop_run (sin, sout, size, from, duration, -1, baseline, &knee);
+
+    /*  Rates are spread evenly between 'from' and 'to'. */
+    printf ("{\"address\": \"%s\", \"size\": %d, \"duration_ms\": %d, "
+        "\"runs\": [\n", addr, (int) size, duration);
+    for (i = 0; i != steps; ++i) {
+        rate = steps == 1 ? from : from + (to - from) * i / (steps - 1);
+        openloop_run (sin, sout, size, rate, duration, i == 0, baseline,
+            &knee);
+    }
+    if (knee)
+        printf ("\n], \"knee\": %llu}\n", (unsigned long long) knee);
+    else
+        printf ("\n], \"knee\": null}\n");
+
+    free (baseline);
+    rc = nn_close (sout);
+    errno_assert (rc == 0);
+    rc = nn_close (sin);
+    errno_assert (rc == 0);
+
+    return 0;
+}
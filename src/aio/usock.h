@@ -26,6 +26,8 @@
 /*  Import the definition of nn_iovec. */
 #include "../nn.h"
 
+#include "../utils/msg.h"
+
 /*  OS-level sockets. */
 
 /*  Event types generated by nn_usock. */
@@ -37,9 +39,11 @@
 #define NN_USOCK_ACCEPT_ERROR 6
 #define NN_USOCK_STOPPED 7
 #define NN_USOCK_SHUTDOWN 8
+#define NN_USOCK_SECURED 9
 
-/*  Maximum number of iovecs that can be passed to nn_usock_send function. */
-#define NN_USOCK_MAX_IOVCNT 3
+/*  Maximum number of iovecs that can be passed to nn_usock_send function.
+    That's enough for two headers followed by the parts of a message body. */
+#define NN_USOCK_MAX_IOVCNT (2 + NN_MSG_MAXPARTS)
 
 /*  Size of the buffer used for batch-reads of inbound data. To keep the
     performance optimal make sure that this value is larger than network MTU. */
@@ -62,6 +66,8 @@ void nn_usock_swap_owner (struct nn_usock *self, struct nn_fsm_owner *owner);
 
 int nn_usock_setsockopt (struct nn_usock *self, int level, int optname,
     const void *optval, size_t optlen);
+int nn_usock_getsockopt (struct nn_usock *self, int level, int optname,
+    void *optval, size_t *optlen);
 
 int nn_usock_bind (struct nn_usock *self, const struct sockaddr *addr,
     size_t addrlen);
@@ -83,10 +89,24 @@ void nn_usock_activate (struct nn_usock *self);
 void nn_usock_connect (struct nn_usock *self, const struct sockaddr *addr,
     size_t addrlen);
 
+/*  Run TLS over the connected socket. 'ssl' is an OpenSSL SSL object that
+    the socket takes ownership of. When the handshake is done NN_USOCK_SECURED
+    event will be raised; if it fails NN_USOCK_ERROR will be raised instead.
+    Afterwards, nn_usock_send and nn_usock_recv transfer plaintext. Each
+    buffer passed to nn_usock_send is sent in as few TLS records as possible,
+    so a message up to 16kB is carried by a single record. */
+void nn_usock_tls (struct nn_usock *self, void *ssl);
+
 void nn_usock_send (struct nn_usock *self, const struct nn_iovec *iov,
     int iovcnt);
 void nn_usock_recv (struct nn_usock *self, void *buf, size_t len);
 
+/*  If len bytes of inbound data were already read from the OS socket in
+    advance, copy them to buf and return 1. No event is raised in such case.
+    Otherwise, return 0 and leave the data untouched. Can't be called while
+    nn_usock_recv is in progress. */
+int nn_usock_recv_buffered (struct nn_usock *self, void *buf, size_t len);
+
 int nn_usock_geterrno (struct nn_usock *self);
 
 #endif
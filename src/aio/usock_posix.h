@@ -66,8 +66,23 @@ struct nn_usock {
 
         /*  List of buffers being sent at the moment. Referenced from 'hdr'. */
         struct iovec iov [NN_USOCK_MAX_IOVCNT];
+
+        /*  With TLS, small buffers are coalesced into 'tlsbuf' so that they
+            are encrypted as a single record. 'tlsdata' and 'tlslen' refer
+            to the data that is being written to the TLS session at the
+            moment, either in 'tlsbuf' or in one of the user's buffers. */
+        uint8_t *tlsbuf;
+        uint8_t *tlsdata;
+        size_t tlslen;
     } out;
 
+    /*  TLS session (OpenSSL's SSL object), NULL if data are sent in clear. */
+    void *ssl;
+
+    /*  Set if TCP_QUICKACK was requested. The OS clears the flag by itself
+        so it has to be set anew each time data are received. */
+    int quickack;
+
     /*  Asynchronous tasks for the worker. */
     struct nn_worker_task task_connecting;
     struct nn_worker_task task_connected;
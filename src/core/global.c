@@ -42,10 +42,14 @@
 #include "../utils/chunk.h"
 #include "../utils/msg.h"
 #include "../utils/attr.h"
+#include "../utils/clock.h"
 
+#include "../transports/utils/dns.h"
 #include "../transports/inproc/inproc.h"
 #include "../transports/ipc/ipc.h"
+#include "../transports/shm/shm.h"
 #include "../transports/tcp/tcp.h"
+#include "../transports/tls/tls.h"
 #include "../transports/websocket/ws.h"
 
 #include "../protocols/pair/pair.h"
@@ -72,6 +76,7 @@
 #include "../pubsub.h"
 #include "../pipeline.h"
 
+#include <limits.h>
 #include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
@@ -177,6 +182,10 @@ static int nn_global_create_ep (int s, const char *addr, int bind);
     does no locking by itself */
 static int nn_global_create_socket (int domain, int protocol);
 
+/*  Builds message body out of a scatter array. */
+static int nn_global_chain (struct nn_msg *msg,
+    const struct nn_msghdr *msghdr);
+
 /*  FSM callbacks  */
 static void nn_global_handler (struct nn_fsm *self,
     int src, int type, void *srcptr);
@@ -254,8 +263,11 @@ static void nn_global_init (void)
     /*  Plug in individual transports. */
     nn_global_add_transport (nn_inproc);
     nn_global_add_transport (nn_ipc);
+    nn_global_add_transport (nn_shm);
     nn_global_add_transport (nn_tcp);
+    nn_global_add_transport (nn_tls);
     nn_global_add_transport (nn_ws);
+    nn_global_add_transport (nn_wss);
 
     /*  Plug in individual socktypes. */
     nn_global_add_socktype (nn_pair_socktype);
@@ -279,6 +291,9 @@ static void nn_global_init (void)
     nn_global_add_socktype (nn_bus_socktype);
     nn_global_add_socktype (nn_xbus_socktype);
 
+    /*  Initialise the DNS cache. The resolver thread is started lazily. */
+    nn_dns_cache_init ();
+
     /*  Start the worker threads. */
     nn_pool_init (&self.pool);
 
@@ -354,6 +369,9 @@ static void nn_global_term (void)
     /*  Shut down the worker threads. */
     nn_pool_term (&self.pool);
 
+    /*  Shut down the resolver thread and drop the cached DNS results. */
+    nn_dns_cache_term ();
+
     /* Terminate ctx mutex */
     nn_ctx_term (&self.ctx);
 
@@ -380,6 +398,7 @@ static void nn_global_term (void)
     self.socks = NULL;
 
     /*  Shut down the memory allocation subsystem. */
+    nn_chunk_cache_term ();
     nn_alloc_term ();
 
     /*  On Windows, uninitialise the socket library. */
@@ -437,6 +456,12 @@ int nn_freemsg (void *msg)
     return 0;
 }
 
+void *nn_refmsg (void *msg)
+{
+    nn_chunk_addref (msg, 1);
+    return msg;
+}
+
 struct nn_cmsghdr *nn_cmsg_nxthdr_ (const struct nn_msghdr *mhdr,
     const struct nn_cmsghdr *cmsg)
 {
@@ -713,12 +738,19 @@ int nn_sendmsg (int s, const struct nn_msghdr *msghdr, int flags)
 {
     int rc;
     size_t sz;
+    size_t len;
     int i;
     struct nn_iovec *iov;
     struct nn_msg msg;
     void *chunk;
-    int nnmsg;
+    int nparts;
+    int run;
+    int usermask;
+    int copied;
     struct nn_cmsghdr *cmsg;
+    struct nn_cmsghdr *sphdr;
+    int ttl;
+    struct nn_clock clock;
 
     NN_BASIC_CHECKS;
 
@@ -740,58 +772,101 @@ int nn_sendmsg (int s, const struct nn_msghdr *msghdr, int flags)
         }
         sz = nn_chunk_size (chunk);
         nn_msg_init_chunk (&msg, chunk);
-        nnmsg = 1;
+        usermask = 1;
+        copied = 0;
     }
     else {
 
-        /*  Compute the total size of the message. */
+        /*  Compute the total size of the message and the number of parts
+            its body will consist of. Each zero-copy buffer becomes a part
+            of its own, runs of ordinary buffers are copied into one part. */
         sz = 0;
+        nparts = 0;
+        run = 0;
         for (i = 0; i != msghdr->msg_iovlen; ++i) {
             iov = &msghdr->msg_iov [i];
-            if (nn_slow (iov->iov_len == NN_MSG)) {
-               errno = EINVAL;
-               return -1;
+            if (iov->iov_len == NN_MSG) {
+                if (nn_slow (!iov->iov_base || !*(void**) iov->iov_base)) {
+                    errno = EFAULT;
+                    return -1;
+                }
+                len = nn_chunk_size (*(void**) iov->iov_base);
+                ++nparts;
+                run = 0;
             }
-            if (nn_slow (!iov->iov_base && iov->iov_len)) {
-                errno = EFAULT;
-                return -1;
+            else {
+                if (nn_slow (!iov->iov_base && iov->iov_len)) {
+                    errno = EFAULT;
+                    return -1;
+                }
+                len = iov->iov_len;
+                if (len && !run) {
+                    ++nparts;
+                    run = 1;
+                }
             }
-            if (nn_slow (sz + iov->iov_len < sz)) {
+            if (nn_slow (sz + len < sz)) {
                 errno = EINVAL;
                 return -1;
             }
-            sz += iov->iov_len;
+            sz += len;
         }
 
-        /*  Create a message object from the supplied scatter array. */
-        nn_msg_init (&msg, sz);
-        sz = 0;
-        for (i = 0; i != msghdr->msg_iovlen; ++i) {
-            iov = &msghdr->msg_iov [i];
-            memcpy (((uint8_t*) nn_chunkref_data (&msg.body)) + sz,
-                iov->iov_base, iov->iov_len);
-            sz += iov->iov_len;
+        if (nn_fast (nparts <= NN_MSG_MAXPARTS)) {
+            usermask = nn_global_chain (&msg, msghdr);
+            copied = 0;
         }
+        else {
 
-        nnmsg = 0;
+            /*  Too many parts to chain. Copy everything into a single chunk
+                and release the zero-copy buffers once the message is sent. */
+            nn_msg_init (&msg, sz);
+            sz = 0;
+            for (i = 0; i != msghdr->msg_iovlen; ++i) {
+                iov = &msghdr->msg_iov [i];
+                if (iov->iov_len == NN_MSG) {
+                    chunk = *(void**) iov->iov_base;
+                    len = nn_chunk_size (chunk);
+                }
+                else {
+                    chunk = iov->iov_base;
+                    len = iov->iov_len;
+                }
+                memcpy (((uint8_t*) nn_chunkref_data (&msg.body)) + sz,
+                    chunk, len);
+                sz += len;
+            }
+            usermask = 0;
+            copied = 1;
+        }
     }
 
     /*  Add ancillary data to the message. */
     if (msghdr->msg_control) {
 
-        /* Find SP_HDR property. */
+        /* Find SP_HDR and SP_TTL properties. */
+        sphdr = NULL;
+        ttl = -1;
         cmsg = NN_CMSG_FIRSTHDR (msghdr);
-        while (1) {
-            if (!cmsg)
-                return -1;
+        while (cmsg) {
             if (cmsg->cmsg_level == PROTO_SP && cmsg->cmsg_type == SP_HDR)
-                break;
+                sphdr = cmsg;
+            if (cmsg->cmsg_level == PROTO_SP && cmsg->cmsg_type == SP_TTL &&
+                  cmsg->cmsg_len == sizeof (int))
+                memcpy (&ttl, NN_CMSG_DATA (cmsg), sizeof (int));
             cmsg = NN_CMSG_NXTHDR (msghdr, cmsg);
         }
 
-        if (!cmsg) {
+        /*  The message expires in SP_TTL milliseconds. */
+        if (ttl > 0) {
+            nn_clock_init (&clock);
+            msg.deadline = nn_clock_now (&clock) + ttl;
+            nn_clock_term (&clock);
+        }
+
+        if (!sphdr && ttl < 0) {
 
-            /* If there is no SP_HDR property we'll just use the ancillary
+            /* If there is no SP property we'll just use the ancillary
                data with no modification */
             if (msghdr->msg_controllen == NN_MSG) {
                 chunk = *((void**) msghdr->msg_control);
@@ -808,10 +883,12 @@ int nn_sendmsg (int s, const struct nn_msghdr *msghdr, int flags)
         else {
 
             /*  Copy body of SP_HDR property into 'sphdr'. */
-            nn_chunkref_term (&msg.sphdr);
-            nn_chunkref_init (&msg.sphdr, cmsg->cmsg_len);
-            memcpy (nn_chunkref_data (&msg.sphdr),
-                NN_CMSG_DATA (cmsg), cmsg->cmsg_len);
+            if (sphdr) {
+                nn_chunkref_term (&msg.sphdr);
+                nn_chunkref_init (&msg.sphdr, sphdr->cmsg_len);
+                memcpy (nn_chunkref_data (&msg.sphdr),
+                    NN_CMSG_DATA (sphdr), sphdr->cmsg_len);
+            }
 
             /* TODO: Copy all remaining properties into 'hdrs'. */
 
@@ -825,16 +902,27 @@ int nn_sendmsg (int s, const struct nn_msghdr *msghdr, int flags)
     rc = nn_sock_send (self.socks [s], &msg, flags);
     if (nn_slow (rc < 0)) {
 
-        /*  If we are dealing with user-supplied buffer, detach it from
+        /*  If we are dealing with user-supplied buffers, detach them from
             the message object. */
-        if (nnmsg)
+        if (usermask & 1)
             nn_chunkref_init (&msg.body, 0);
+        for (i = 0; i != msg.nparts; ++i)
+            if (!(usermask & (2 << i)))
+                nn_chunk_free (msg.parts [i]);
+        msg.nparts = 0;
 
         nn_msg_term (&msg);
         errno = -rc;
         return -1;
     }
 
+    /*  The zero-copy buffers were copied into the message. */
+    if (nn_slow (copied)) {
+        for (i = 0; i != msghdr->msg_iovlen; ++i)
+            if (msghdr->msg_iov [i].iov_len == NN_MSG)
+                nn_chunk_free (*(void**) msghdr->msg_iov [i].iov_base);
+    }
+
     /*  Adjust the statistics. */
     nn_sock_stat_increment (self.socks [s], NN_STAT_MESSAGES_SENT, 1);
     nn_sock_stat_increment (self.socks [s], NN_STAT_BYTES_SENT, sz);
@@ -856,7 +944,11 @@ int nn_recvmsg (int s, struct nn_msghdr *msghdr, int flags)
     size_t ctrlsz;
     size_t spsz;
     size_t sptotalsz;
+    size_t ttltotalsz;
     struct nn_cmsghdr *chdr;
+    int ttl;
+    uint64_t now;
+    struct nn_clock clock;
 
     NN_BASIC_CHECKS;
 
@@ -878,13 +970,47 @@ int nn_recvmsg (int s, struct nn_msghdr *msghdr, int flags)
     }
 
     if (msghdr->msg_iovlen == 1 && msghdr->msg_iov [0].iov_len == NN_MSG) {
+        nn_msg_linearize (&msg);
         chunk = nn_chunkref_getchunk (&msg.body);
         *(void**) (msghdr->msg_iov [0].iov_base) = chunk;
         sz = nn_chunk_size (chunk);
     }
+    else if (msghdr->msg_iovlen > 1 &&
+          msghdr->msg_iov [0].iov_len == NN_MSG) {
+
+        /*  Hand the parts of the body to the user one by one. If there are
+            more parts than buffers, the body is merged into a single part.
+            Unused buffers are set to NULL. */
+        for (i = 0; i != msghdr->msg_iovlen; ++i) {
+            if (nn_slow (msghdr->msg_iov [i].iov_len != NN_MSG)) {
+                nn_msg_term (&msg);
+                errno = EINVAL;
+                return -1;
+            }
+        }
+        sz = nn_msg_bodysize (&msg);
+        if (msg.nparts >= msghdr->msg_iovlen)
+            nn_msg_linearize (&msg);
+        for (i = 0; i != msghdr->msg_iovlen; ++i) {
+            iov = &msghdr->msg_iov [i];
+            if (i == 0) {
+                chunk = nn_chunkref_getchunk (&msg.body);
+            }
+            else if (i <= msg.nparts) {
+                chunk = msg.parts [i - 1];
+            }
+            else {
+                chunk = NULL;
+            }
+            *(void**) iov->iov_base = chunk;
+            iov->iov_len = chunk ? nn_chunk_size (chunk) : 0;
+        }
+        msg.nparts = 0;
+    }
     else {
 
         /*  Copy the message content into the supplied gather array. */
+        nn_msg_linearize (&msg);
         data = nn_chunkref_data (&msg.body);
         sz = nn_chunkref_size (&msg.body);
         for (i = 0; i != msghdr->msg_iovlen; ++i) {
@@ -910,7 +1036,21 @@ int nn_recvmsg (int s, struct nn_msghdr *msghdr, int flags)
 
         spsz = nn_chunkref_size (&msg.sphdr);
         sptotalsz = NN_CMSG_SPACE (spsz);
-        ctrlsz = sptotalsz + nn_chunkref_size (&msg.hdrs);
+
+        /*  If the message expires, pass the remaining time to live to the
+            user so that devices can forward it further. */
+        ttl = -1;
+        ttltotalsz = 0;
+        if (msg.deadline) {
+            nn_clock_init (&clock);
+            now = nn_clock_now (&clock);
+            nn_clock_term (&clock);
+            ttl = now >= msg.deadline ? 1 :
+                (msg.deadline - now > INT_MAX ? INT_MAX :
+                (int) (msg.deadline - now));
+            ttltotalsz = NN_CMSG_SPACE (sizeof (int));
+        }
+        ctrlsz = sptotalsz + ttltotalsz + nn_chunkref_size (&msg.hdrs);
 
         if (msghdr->msg_controllen == NN_MSG) {
 
@@ -939,6 +1079,16 @@ int nn_recvmsg (int s, struct nn_msghdr *msghdr, int flags)
             chdr->cmsg_type = SP_HDR;
             memcpy (chdr + 1, nn_chunkref_data (&msg.sphdr), spsz);
 
+            /*  Fill in SP_TTL property, if there's space for it. */
+            if (ttltotalsz && ctrlsz >= sptotalsz + ttltotalsz) {
+                chdr = (struct nn_cmsghdr*) (((char*) ctrl) + sptotalsz);
+                chdr->cmsg_len = sizeof (int);
+                chdr->cmsg_level = PROTO_SP;
+                chdr->cmsg_type = SP_TTL;
+                memcpy (NN_CMSG_DATA (chdr), &ttl, sizeof (int));
+                sptotalsz += ttltotalsz;
+            }
+
             /*  Fill in as many remaining properties as possible.
                 Truncate the trailing properties if necessary. */
             hdrssz = nn_chunkref_size (&msg.hdrs);
@@ -954,6 +1104,80 @@ int nn_recvmsg (int s, struct nn_msghdr *msghdr, int flags)
     return (int) sz;
 }
 
+static int nn_global_chain (struct nn_msg *msg,
+    const struct nn_msghdr *msghdr)
+{
+    int rc;
+    int i;
+    int j;
+    int k;
+    int usermask;
+    size_t sz;
+    uint8_t *dst;
+    void *chunk;
+    struct nn_iovec *iov;
+
+    /*  Returns mask of the parts that are zero-copy buffers supplied by
+        the user. Bit 0 stands for the first part stored in 'body'. */
+    nn_msg_init (msg, 0);
+    usermask = 0;
+    k = 0;
+    for (i = 0; i != msghdr->msg_iovlen; i = j) {
+        iov = &msghdr->msg_iov [i];
+        j = i + 1;
+
+        if (iov->iov_len == NN_MSG) {
+            chunk = *(void**) iov->iov_base;
+            usermask |= 1 << k;
+        }
+        else {
+
+            /*  Copy the whole run of ordinary buffers. Leading run is stored
+                directly in 'body' so that a short header doesn't need
+                an allocation. */
+            sz = iov->iov_len;
+            while (j != msghdr->msg_iovlen &&
+                  msghdr->msg_iov [j].iov_len != NN_MSG) {
+                sz += msghdr->msg_iov [j].iov_len;
+                ++j;
+            }
+            if (sz == 0)
+                continue;
+            if (k == 0) {
+                nn_chunkref_term (&msg->body);
+                nn_chunkref_init (&msg->body, sz);
+                dst = nn_chunkref_data (&msg->body);
+                chunk = NULL;
+            }
+            else {
+                rc = nn_chunk_alloc (sz, 0, &chunk);
+                errnum_assert (rc == 0, -rc);
+                dst = chunk;
+            }
+            for (; i != j; ++i) {
+                memcpy (dst, msghdr->msg_iov [i].iov_base,
+                    msghdr->msg_iov [i].iov_len);
+                dst += msghdr->msg_iov [i].iov_len;
+            }
+            if (k == 0) {
+                ++k;
+                continue;
+            }
+        }
+
+        if (k == 0) {
+            nn_chunkref_term (&msg->body);
+            nn_chunkref_init_chunk (&msg->body, chunk);
+        }
+        else {
+            nn_msg_append (msg, chunk);
+        }
+        ++k;
+    }
+
+    return usermask;
+}
+
 static void nn_global_add_transport (struct nn_transport *transport)
 {
     if (transport->init)
@@ -1148,6 +1372,14 @@ static void nn_global_submit_statistics () {
             "bytes_sent", s->statistics.bytes_sent);
         nn_global_submit_counter (i, s,
             "bytes_received", s->statistics.bytes_received);
+        nn_global_submit_counter (i, s,
+            "messages_forwarded", s->statistics.messages_forwarded);
+        nn_global_submit_counter (i, s,
+            "bytes_forwarded", s->statistics.bytes_forwarded);
+        nn_global_submit_counter (i, s,
+            "messages_dropped", s->statistics.messages_dropped);
+        nn_global_submit_counter (i, s,
+            "messages_expired", s->statistics.messages_expired);
         nn_global_submit_level (i, s,
             "current_connections", s->statistics.current_connections);
         nn_global_submit_level (i, s,
@@ -1212,9 +1444,12 @@ struct nn_transport *nn_global_transport (int id)
     struct nn_transport *tp;
     struct nn_list_item *it;
 
-    /*  Find the specified protocol. */
+    /*  Find the specified protocol. The list of transports is filled in by
+        nn_global_init and emptied by nn_global_term, i.e. it never changes
+        while there are sockets around. Thus, it can be walked without
+        taking the global lock, which may be already held by the caller
+        (e.g. when an endpoint queries its options during nn_bind). */
     tp = NULL;
-    nn_glock_lock ();
     for (it = nn_list_begin (&self.transports);
           it != nn_list_end (&self.transports);
           it = nn_list_next (&self.transports, it)) {
@@ -1223,11 +1458,17 @@ struct nn_transport *nn_global_transport (int id)
             break;
         tp = NULL;
     }
-    nn_glock_unlock ();
 
     return tp;
 }
 
+struct nn_sock *nn_global_getsock (int s)
+{
+    if (nn_slow (!self.socks || s < 0 || s >= NN_MAX_SOCKETS))
+        return NULL;
+    return self.socks [s];
+}
+
 struct nn_pool *nn_global_getpool ()
 {
     return &self.pool;
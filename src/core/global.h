@@ -26,6 +26,10 @@
 /*  Provides access to the list of available transports. */
 struct nn_transport *nn_global_transport (int id);
 
+/*  Returns the socket object associated with the file descriptor or NULL
+    if there is no such socket. */
+struct nn_sock *nn_global_getsock (int s);
+
 /*  Returns the global worker thread pool. */
 struct nn_pool *nn_global_getpool ();
 int nn_global_print_errors();
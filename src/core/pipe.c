@@ -29,6 +29,8 @@
 #include "../utils/err.h"
 #include "../utils/fast.h"
 
+#include <limits.h>
+
 /*  Internal pipe states. */
 #define NN_PIPEBASE_STATE_IDLE 1
 #define NN_PIPEBASE_STATE_ACTIVE 2
@@ -56,6 +58,7 @@ void nn_pipebase_init (struct nn_pipebase *self,
     self->state = NN_PIPEBASE_STATE_IDLE;
     self->instate = NN_PIPEBASE_INSTATE_DEACTIVATED;
     self->outstate = NN_PIPEBASE_OUTSTATE_DEACTIVATED;
+    self->throttled = 0;
     self->sock = epbase->ep->sock;
     memcpy (&self->options, &epbase->ep->options,
         sizeof (struct nn_ep_options));
@@ -81,6 +84,7 @@ int nn_pipebase_start (struct nn_pipebase *self)
     self->state = NN_PIPEBASE_STATE_ACTIVE;
     self->instate = NN_PIPEBASE_INSTATE_ASYNC;
     self->outstate = NN_PIPEBASE_OUTSTATE_IDLE;
+    self->throttled = 0;
     rc = nn_sock_add (self->sock, (struct nn_pipe*) self);
     if (nn_slow (rc < 0)) {
         self->state = NN_PIPEBASE_STATE_FAILED;
@@ -113,6 +117,7 @@ void nn_pipebase_received (struct nn_pipebase *self)
 
 void nn_pipebase_sent (struct nn_pipebase *self)
 {
+    self->throttled = 0;
     if (nn_fast (self->outstate == NN_PIPEBASE_OUTSTATE_SENDING)) {
         self->outstate = NN_PIPEBASE_OUTSTATE_SENT;
         return;
@@ -123,6 +128,11 @@ void nn_pipebase_sent (struct nn_pipebase *self)
         nn_fsm_raise (&self->fsm, &self->out, NN_PIPE_OUT);
 }
 
+void nn_pipebase_throttle (struct nn_pipebase *self, int throttled)
+{
+    self->throttled = throttled ? 1 : 0;
+}
+
 void nn_pipebase_getopt (struct nn_pipebase *self, int level, int option,
     void *optval, size_t *optvallen)
 {
@@ -177,6 +187,32 @@ void *nn_pipe_getdata (struct nn_pipe *self)
     return ((struct nn_pipebase*) self)->data;
 }
 
+int nn_pipebase_expired (struct nn_pipebase *self, struct nn_msg *msg)
+{
+    return nn_sock_expired (self->sock, msg);
+}
+
+int nn_pipebase_ttl (struct nn_pipebase *self, struct nn_msg *msg)
+{
+    uint64_t now;
+
+    if (!msg->deadline)
+        return -1;
+    now = nn_clock_now (&self->sock->clock);
+    if (now >= msg->deadline)
+        return 0;
+    if (msg->deadline - now > INT_MAX)
+        return INT_MAX;
+    return (int) (msg->deadline - now);
+}
+
+void nn_pipebase_setttl (struct nn_pipebase *self, struct nn_msg *msg,
+    int ttl)
+{
+    nn_assert (ttl >= 0);
+    msg->deadline = nn_clock_now (&self->sock->clock) + ttl;
+}
+
 int nn_pipe_send (struct nn_pipe *self, struct nn_msg *msg)
 {
     int rc;
@@ -184,6 +220,14 @@ int nn_pipe_send (struct nn_pipe *self, struct nn_msg *msg)
 
     pipebase = (struct nn_pipebase*) self;
     nn_assert (pipebase->outstate == NN_PIPEBASE_OUTSTATE_IDLE);
+
+    /*  Don't waste the bandwidth on messages nobody is waiting for anymore.
+        The pipe remains writable. */
+    if (nn_slow (nn_sock_expired (pipebase->sock, msg))) {
+        nn_msg_term (msg);
+        return 0;
+    }
+
     pipebase->outstate = NN_PIPEBASE_OUTSTATE_SENDING;
     rc = pipebase->vfptr->send (pipebase, msg);
     errnum_assert (rc >= 0, -rc);
@@ -216,6 +260,11 @@ int nn_pipe_recv (struct nn_pipe *self, struct nn_msg *msg)
     return rc | NN_PIPEBASE_RELEASE;
 }
 
+int nn_pipe_throttled (struct nn_pipe *self)
+{
+    return ((struct nn_pipebase*) self)->throttled;
+}
+
 void nn_pipe_getopt (struct nn_pipe *self, int level, int option,
     void *optval, size_t *optvallen)
 {
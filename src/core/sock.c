@@ -113,6 +113,7 @@ int nn_sock_init (struct nn_sock *self, struct nn_socktype *socktype, int fd)
     }
 
     self->flags = 0;
+    self->fwd = NULL;
     nn_clock_init (&self->clock);
     nn_list_init (&self->eps);
     nn_list_init (&self->sdeps);
@@ -126,6 +127,9 @@ int nn_sock_init (struct nn_sock *self, struct nn_socktype *socktype, int fd)
     self->rcvtimeo = -1;
     self->reconnect_ivl = 100;
     self->reconnect_ivl_max = 0;
+    self->reconnect_policy = NN_RECONNECT_EXPONENTIAL;
+    self->flowctl = 0;
+    self->msgttl = -1;
     self->ep_template.sndprio = 8;
     self->ep_template.rcvprio = 8;
     self->ep_template.ipv4only = 1;
@@ -143,6 +147,10 @@ int nn_sock_init (struct nn_sock *self, struct nn_socktype *socktype, int fd)
     self->statistics.messages_received = 0;
     self->statistics.bytes_sent = 0;
     self->statistics.bytes_received = 0;
+    self->statistics.messages_forwarded = 0;
+    self->statistics.bytes_forwarded = 0;
+    self->statistics.messages_dropped = 0;
+    self->statistics.messages_expired = 0;
 
     self->statistics.current_connections = 0;
     self->statistics.inprogress_connections = 0;
@@ -329,6 +337,22 @@ static int nn_sock_setopt_inner (struct nn_sock *self, int level,
                 return -EINVAL;
             dst = &self->reconnect_ivl_max;
             break;
+        case NN_RECONNECT_POLICY:
+            if (nn_slow (val < NN_RECONNECT_EXPONENTIAL ||
+                  val > NN_RECONNECT_DECORRELATED_JITTER))
+                return -EINVAL;
+            dst = &self->reconnect_policy;
+            break;
+        case NN_FLOWCTL:
+            if (nn_slow (val != 0 && val != 1))
+                return -EINVAL;
+            dst = &self->flowctl;
+            break;
+        case NN_MSGTTL:
+            if (nn_slow (val < -1 || val == 0))
+                return -EINVAL;
+            dst = &self->msgttl;
+            break;
         case NN_SNDPRIO:
             if (nn_slow (val < 1 || val > 16))
                 return -EINVAL;
@@ -409,6 +433,15 @@ int nn_sock_getopt_inner (struct nn_sock *self, int level,
         case NN_RECONNECT_IVL_MAX:
             intval = self->reconnect_ivl_max;
             break;
+        case NN_RECONNECT_POLICY:
+            intval = self->reconnect_policy;
+            break;
+        case NN_FLOWCTL:
+            intval = self->flowctl;
+            break;
+        case NN_MSGTTL:
+            intval = self->msgttl;
+            break;
         case NN_SNDPRIO:
             intval = self->ep_template.sndprio;
             break;
@@ -548,6 +581,11 @@ int nn_sock_send (struct nn_sock *self, struct nn_msg *msg, int flags)
 
     nn_ctx_enter (&self->ctx);
 
+    /*  Unless the user have specified the deadline explicitly, the message
+        expires NN_MSGTTL milliseconds from now. */
+    if (nn_slow (self->msgttl > 0 && !msg->deadline))
+        msg->deadline = nn_clock_now (&self->clock) + self->msgttl;
+
     /*  Compute the deadline for SNDTIMEO timer. */
     if (self->sndtimeo < 0) {
         deadline = -1;
@@ -644,9 +682,14 @@ int nn_sock_recv (struct nn_sock *self, struct nn_msg *msg, int flags)
             return -ETERM;
         }
 
-        /*  Try to receive the message in a non-blocking way. */
+        /*  Try to receive the message in a non-blocking way. Messages that
+            have expired on the way are dropped and next one is tried. */
         rc = self->sockbase->vfptr->recv (self->sockbase, msg);
         if (nn_fast (rc == 0)) {
+            if (nn_slow (nn_sock_expired (self, msg))) {
+                nn_msg_term (msg);
+                continue;
+            }
             nn_ctx_leave (&self->ctx);
             return 0;
         }
@@ -691,6 +734,114 @@ int nn_sock_recv (struct nn_sock *self, struct nn_msg *msg, int flags)
     }
 }
 
+int nn_sock_sendmany (struct nn_sock *self, struct nn_msg *msgs, int count)
+{
+    int rc;
+    int i;
+
+    nn_assert (count > 0);
+
+    if (nn_slow (self->socktype->flags & NN_SOCKTYPE_FLAG_NOSEND))
+        return -ENOTSUP;
+
+    nn_ctx_enter (&self->ctx);
+    if (nn_slow (self->state == NN_SOCK_STATE_ZOMBIE)) {
+        nn_ctx_leave (&self->ctx);
+        return -ETERM;
+    }
+    rc = 0;
+    for (i = 0; i != count; ++i) {
+        if (nn_slow (self->msgttl > 0 && !msgs [i].deadline))
+            msgs [i].deadline = nn_clock_now (&self->clock) + self->msgttl;
+        rc = self->sockbase->vfptr->send (self->sockbase, &msgs [i]);
+        if (nn_slow (rc < 0))
+            break;
+    }
+    nn_ctx_leave (&self->ctx);
+
+    return i == 0 ? rc : i;
+}
+
+int nn_sock_recvmany (struct nn_sock *self, struct nn_msg *msgs, int count)
+{
+    int rc;
+    int i;
+
+    nn_assert (count > 0);
+
+    if (nn_slow (self->socktype->flags & NN_SOCKTYPE_FLAG_NORECV))
+        return -ENOTSUP;
+
+    nn_ctx_enter (&self->ctx);
+    if (nn_slow (self->state == NN_SOCK_STATE_ZOMBIE)) {
+        nn_ctx_leave (&self->ctx);
+        return -ETERM;
+    }
+    rc = 0;
+    for (i = 0; i != count; ++i) {
+        rc = self->sockbase->vfptr->recv (self->sockbase, &msgs [i]);
+        if (nn_slow (rc < 0))
+            break;
+        if (nn_slow (nn_sock_expired (self, &msgs [i]))) {
+            nn_msg_term (&msgs [i]);
+            --i;
+        }
+    }
+    nn_ctx_leave (&self->ctx);
+
+    return i == 0 ? rc : i;
+}
+
+int nn_sock_expired (struct nn_sock *self, struct nn_msg *msg)
+{
+    if (nn_fast (!msg->deadline))
+        return 0;
+    if (nn_clock_now (&self->clock) < msg->deadline)
+        return 0;
+    nn_sock_stat_increment (self, NN_STAT_MESSAGES_EXPIRED, 1);
+    return 1;
+}
+
+int nn_sock_attach_fwd (struct nn_sock *self, struct nn_sock_fwd *fwd)
+{
+    nn_ctx_enter (&self->ctx);
+    if (nn_slow (self->state == NN_SOCK_STATE_ZOMBIE)) {
+        nn_ctx_leave (&self->ctx);
+        return -ETERM;
+    }
+    if (nn_slow (self->fwd != NULL)) {
+        nn_ctx_leave (&self->ctx);
+        return -EBUSY;
+    }
+
+    /*  Unsignal the efds. The flags now track the edges reported to
+        the device. Leaving the context reports the current state. */
+    if (self->flags & NN_SOCK_FLAG_IN)
+        nn_efd_unsignal (&self->rcvfd);
+    if (self->flags & NN_SOCK_FLAG_OUT)
+        nn_efd_unsignal (&self->sndfd);
+    self->flags = 0;
+    self->fwd = fwd;
+    nn_ctx_leave (&self->ctx);
+
+    return 0;
+}
+
+void nn_sock_detach_fwd (struct nn_sock *self)
+{
+    nn_ctx_enter (&self->ctx);
+    nn_assert (self->fwd);
+    self->fwd = NULL;
+
+    /*  The efds are unsignalled at this point. Leaving the context signals
+        them as needed. Terminated socket has to be signalled here as it
+        won't be adjusted on leaving the context. */
+    self->flags = 0;
+    if (self->state == NN_SOCK_STATE_ZOMBIE)
+        nn_sock_action_zombify (self);
+    nn_ctx_leave (&self->ctx);
+}
+
 int nn_sock_add (struct nn_sock *self, struct nn_pipe *pipe)
 {
     int rc;
@@ -712,6 +863,7 @@ static void nn_sock_onleave (struct nn_ctx *self)
 {
     struct nn_sock *sock;
     int events;
+    int fwdevents;
 
     sock = nn_cont (self, struct nn_sock, ctx);
 
@@ -724,6 +876,27 @@ static void nn_sock_onleave (struct nn_ctx *self)
     events = sock->sockbase->vfptr->events (sock->sockbase);
     errnum_assert (events >= 0, -events);
 
+    /*  With in-core device attached, the efds are left alone and
+        the device is notified about the socket becoming readable or
+        writable instead. */
+    if (sock->fwd) {
+        fwdevents = 0;
+        if ((events & NN_SOCKBASE_EVENT_IN) &&
+              !(sock->flags & NN_SOCK_FLAG_IN))
+            fwdevents |= NN_SOCKBASE_EVENT_IN;
+        if ((events & NN_SOCKBASE_EVENT_OUT) &&
+              !(sock->flags & NN_SOCK_FLAG_OUT))
+            fwdevents |= NN_SOCKBASE_EVENT_OUT;
+        sock->flags = 0;
+        if (events & NN_SOCKBASE_EVENT_IN)
+            sock->flags |= NN_SOCK_FLAG_IN;
+        if (events & NN_SOCKBASE_EVENT_OUT)
+            sock->flags |= NN_SOCK_FLAG_OUT;
+        if (fwdevents)
+            sock->fwd->notify (sock->fwd, sock, fwdevents);
+        return;
+    }
+
     /*  Signal/unsignal IN as needed. */
     if (!(sock->socktype->flags & NN_SOCKTYPE_FLAG_NORECV)) {
         if (events & NN_SOCKBASE_EVENT_IN) {
@@ -970,6 +1143,14 @@ static void nn_sock_action_zombify (struct nn_sock *self)
         functions will return ETERM. */
     self->state = NN_SOCK_STATE_ZOMBIE;
 
+    /*  In-core device is told directly. The efds will be signalled once
+        it detaches from the socket. */
+    if (self->fwd) {
+        self->fwd->notify (self->fwd, self,
+            NN_SOCKBASE_EVENT_IN | NN_SOCKBASE_EVENT_OUT);
+        return;
+    }
+
     /*  Set IN and OUT events to unblock any polling function. */
     if (!(self->flags & NN_SOCK_FLAG_IN)) {
         self->flags |= NN_SOCK_FLAG_IN;
@@ -1047,6 +1228,22 @@ void nn_sock_stat_increment (struct nn_sock *self, int name, int64_t increment)
             nn_assert (increment >= 0);
             self->statistics.bytes_received += increment;
             break;
+        case NN_STAT_MESSAGES_FORWARDED:
+            nn_assert (increment > 0);
+            self->statistics.messages_forwarded += increment;
+            break;
+        case NN_STAT_BYTES_FORWARDED:
+            nn_assert (increment >= 0);
+            self->statistics.bytes_forwarded += increment;
+            break;
+        case NN_STAT_MESSAGES_DROPPED:
+            nn_assert (increment > 0);
+            self->statistics.messages_dropped += increment;
+            break;
+        case NN_STAT_MESSAGES_EXPIRED:
+            nn_assert (increment > 0);
+            self->statistics.messages_expired += increment;
+            break;
 
         case NN_STAT_CURRENT_CONNECTIONS:
             nn_assert (increment > 0 ||
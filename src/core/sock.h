@@ -35,15 +35,28 @@
 #include "../utils/list.h"
 
 struct nn_pipe;
+struct nn_sock;
+
+/*  In-core device attached to the socket. While it is attached, NN_SNDFD and
+    NN_RCVFD are not signalled. Instead, 'notify' is invoked from within
+    the socket's context when the socket becomes readable
+    (NN_SOCKBASE_EVENT_IN) or writable (NN_SOCKBASE_EVENT_OUT). When
+    the library is being terminated it is invoked with both events. */
+struct nn_sock_fwd {
+    void (*notify) (struct nn_sock_fwd *self, struct nn_sock *sock,
+        int events);
+};
 
 /*  The maximum implemented transport ID. */
-#define NN_MAX_TRANSPORT 4
+#define NN_MAX_TRANSPORT 7
 
 /*  The socket-internal statistics  */
 #define NN_STAT_MESSAGES_SENT          301
 #define NN_STAT_MESSAGES_RECEIVED      302
 #define NN_STAT_BYTES_SENT             303
 #define NN_STAT_BYTES_RECEIVED         304
+#define NN_STAT_MESSAGES_FORWARDED     305
+#define NN_STAT_BYTES_FORWARDED        306
 
 
 struct nn_sock
@@ -60,6 +73,9 @@ struct nn_sock
 
     int flags;
 
+    /*  In-core device forwarding messages from/to this socket, if any. */
+    struct nn_sock_fwd *fwd;
+
     struct nn_ctx ctx;
     struct nn_efd sndfd;
     struct nn_efd rcvfd;
@@ -86,6 +102,9 @@ struct nn_sock
     int rcvtimeo;
     int reconnect_ivl;
     int reconnect_ivl_max;
+    int reconnect_policy;
+    int flowctl;
+    int msgttl;
 
     /*  Endpoint-specific options.  */
     struct nn_ep_options ep_template;
@@ -120,6 +139,14 @@ struct nn_sock
         uint64_t bytes_sent;
         /*  Bytes recevied (sum length of data in messages received)  */
         uint64_t bytes_received;
+        /*  Messages received and passed on by an in-core device  */
+        uint64_t messages_forwarded;
+        /*  Bytes received and passed on by an in-core device  */
+        uint64_t bytes_forwarded;
+        /*  Message copies not delivered to a peer that wasn't writable  */
+        uint64_t messages_dropped;
+        /*  Messages discarded because their deadline has passed  */
+        uint64_t messages_expired;
 
         /*****  Level-style values *****/
 
@@ -171,6 +198,25 @@ int nn_sock_send (struct nn_sock *self, struct nn_msg *msg, int flags);
 /*  Receive a message from the socket. */
 int nn_sock_recv (struct nn_sock *self, struct nn_msg *msg, int flags);
 
+/*  Send up to 'count' messages without blocking, entering the socket's
+    context only once. Returns the number of messages sent. The first message
+    that couldn't be sent stops the batch; if it's the first one in the batch
+    the error is returned instead. */
+int nn_sock_sendmany (struct nn_sock *self, struct nn_msg *msgs, int count);
+
+/*  Receive up to 'count' messages without blocking, entering the socket's
+    context only once. Returns the number of messages received or an error
+    (e.g. -EAGAIN) if no message was received. */
+int nn_sock_recvmany (struct nn_sock *self, struct nn_msg *msgs, int count);
+
+/*  Attach an in-core device to the socket. Returns -EBUSY if there's one
+    attached already, -ETERM if the library is being terminated. */
+int nn_sock_attach_fwd (struct nn_sock *self, struct nn_sock_fwd *fwd);
+
+/*  Detach the in-core device. Once the function returns, 'notify' won't be
+    invoked anymore. */
+void nn_sock_detach_fwd (struct nn_sock *self);
+
 /*  Set a socket option. */
 int nn_sock_setopt (struct nn_sock *self, int level, int option,
     const void *optval, size_t optvallen);
@@ -184,6 +230,10 @@ int nn_sock_getopt (struct nn_sock *self, int level, int option,
 int nn_sock_getopt_inner (struct nn_sock *self, int level, int option,
     void *optval, size_t *optvallen);
 
+/*  Returns 1 if the message's deadline has already passed. The caller is
+    expected to drop such message; the drop is accounted for here. */
+int nn_sock_expired (struct nn_sock *self, struct nn_msg *msg);
+
 /*  Used by pipes. */
 int nn_sock_add (struct nn_sock *self, struct nn_pipe *pipe);
 void nn_sock_rm (struct nn_sock *self, struct nn_pipe *pipe);
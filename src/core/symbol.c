@@ -26,6 +26,7 @@
 #include "../inproc.h"
 #include "../ipc.h"
 #include "../tcp.h"
+#include "../tls.h"
 
 #include "../pair.h"
 #include "../pubsub.h"
@@ -100,6 +101,8 @@ static const struct nn_symbol_properties sym_value_names [] = {
         NN_TYPE_NONE, NN_UNIT_NONE},
     {NN_TCP, "NN_TCP", NN_NS_TRANSPORT,
         NN_TYPE_NONE, NN_UNIT_NONE},
+    {NN_TLS, "NN_TLS", NN_NS_TRANSPORT,
+        NN_TYPE_NONE, NN_UNIT_NONE},
 
     {NN_PAIR, "NN_PAIR", NN_NS_PROTOCOL,
         NN_TYPE_NONE, NN_UNIT_NONE},
@@ -156,17 +159,61 @@ static const struct nn_symbol_properties sym_value_names [] = {
         NN_TYPE_INT, NN_UNIT_BOOLEAN},
     {NN_SOCKET_NAME, "NN_SOCKET_NAME", NN_NS_SOCKET_OPTION,
         NN_TYPE_STR, NN_UNIT_NONE},
+    {NN_RECONNECT_POLICY, "NN_RECONNECT_POLICY", NN_NS_SOCKET_OPTION,
+        NN_TYPE_INT, NN_UNIT_NONE},
+    {NN_FLOWCTL, "NN_FLOWCTL", NN_NS_SOCKET_OPTION,
+        NN_TYPE_INT, NN_UNIT_BOOLEAN},
+    {NN_MSGTTL, "NN_MSGTTL", NN_NS_SOCKET_OPTION,
+        NN_TYPE_INT, NN_UNIT_MILLISECONDS},
 
     {NN_SUB_SUBSCRIBE, "NN_SUB_SUBSCRIBE", NN_NS_TRANSPORT_OPTION,
         NN_TYPE_STR, NN_UNIT_NONE},
     {NN_SUB_UNSUBSCRIBE, "NN_SUB_UNSUBSCRIBE", NN_NS_TRANSPORT_OPTION,
         NN_TYPE_STR, NN_UNIT_NONE},
+    {NN_PUB_CONFLATE, "NN_PUB_CONFLATE", NN_NS_TRANSPORT_OPTION,
+        NN_TYPE_INT, NN_UNIT_BYTES},
+    {NN_PUB_CACHE, "NN_PUB_CACHE", NN_NS_TRANSPORT_OPTION,
+        NN_TYPE_INT, NN_UNIT_BYTES},
     {NN_REQ_RESEND_IVL, "NN_REQ_RESEND_IVL", NN_NS_TRANSPORT_OPTION,
         NN_TYPE_INT, NN_UNIT_MILLISECONDS},
     {NN_SURVEYOR_DEADLINE, "NN_SURVEYOR_DEADLINE", NN_NS_TRANSPORT_OPTION,
         NN_TYPE_INT, NN_UNIT_MILLISECONDS},
     {NN_TCP_NODELAY, "NN_TCP_NODELAY", NN_NS_TRANSPORT_OPTION,
         NN_TYPE_INT, NN_UNIT_BOOLEAN},
+    {NN_TCP_SNDBUF, "NN_TCP_SNDBUF", NN_NS_TRANSPORT_OPTION,
+        NN_TYPE_INT, NN_UNIT_BYTES},
+    {NN_TCP_RCVBUF, "NN_TCP_RCVBUF", NN_NS_TRANSPORT_OPTION,
+        NN_TYPE_INT, NN_UNIT_BYTES},
+    {NN_TCP_KEEPALIVE_IDLE, "NN_TCP_KEEPALIVE_IDLE", NN_NS_TRANSPORT_OPTION,
+        NN_TYPE_INT, NN_UNIT_MILLISECONDS},
+    {NN_TCP_KEEPALIVE_INTVL, "NN_TCP_KEEPALIVE_INTVL", NN_NS_TRANSPORT_OPTION,
+        NN_TYPE_INT, NN_UNIT_MILLISECONDS},
+    {NN_TCP_KEEPALIVE_CNT, "NN_TCP_KEEPALIVE_CNT", NN_NS_TRANSPORT_OPTION,
+        NN_TYPE_INT, NN_UNIT_NONE},
+    {NN_TCP_BUSY_POLL, "NN_TCP_BUSY_POLL", NN_NS_TRANSPORT_OPTION,
+        NN_TYPE_INT, NN_UNIT_NONE},
+    {NN_TCP_QUICKACK, "NN_TCP_QUICKACK", NN_NS_TRANSPORT_OPTION,
+        NN_TYPE_INT, NN_UNIT_BOOLEAN},
+    {NN_TCP_NOTSENT_LOWAT, "NN_TCP_NOTSENT_LOWAT", NN_NS_TRANSPORT_OPTION,
+        NN_TYPE_INT, NN_UNIT_BYTES},
+    {NN_TCP_USER_TIMEOUT, "NN_TCP_USER_TIMEOUT", NN_NS_TRANSPORT_OPTION,
+        NN_TYPE_INT, NN_UNIT_MILLISECONDS},
+    {NN_TCP_ACCEPT_IVL, "NN_TCP_ACCEPT_IVL", NN_NS_TRANSPORT_OPTION,
+        NN_TYPE_INT, NN_UNIT_MILLISECONDS},
+    {NN_TCP_CONNECTIONS, "NN_TCP_CONNECTIONS", NN_NS_TRANSPORT_OPTION,
+        NN_TYPE_INT, NN_UNIT_NONE},
+
+    {NN_IPC_PEERCRED, "NN_IPC_PEERCRED", NN_NS_TRANSPORT_OPTION,
+        NN_TYPE_INT, NN_UNIT_BOOLEAN},
+
+    {NN_TLS_CA_FILE, "NN_TLS_CA_FILE", NN_NS_TRANSPORT_OPTION,
+        NN_TYPE_STR, NN_UNIT_NONE},
+    {NN_TLS_CERT_FILE, "NN_TLS_CERT_FILE", NN_NS_TRANSPORT_OPTION,
+        NN_TYPE_STR, NN_UNIT_NONE},
+    {NN_TLS_KEY_FILE, "NN_TLS_KEY_FILE", NN_NS_TRANSPORT_OPTION,
+        NN_TYPE_STR, NN_UNIT_NONE},
+    {NN_TLS_AUTH_MODE, "NN_TLS_AUTH_MODE", NN_NS_TRANSPORT_OPTION,
+        NN_TYPE_INT, NN_UNIT_NONE},
 
     {NN_DONTWAIT, "NN_DONTWAIT", NN_NS_FLAG,
         NN_TYPE_NONE, NN_UNIT_NONE},
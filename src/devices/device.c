@@ -23,10 +23,13 @@
 #include "../nn.h"
 
 #include "../utils/err.h"
+#include "../utils/alloc.h"
 #include "../utils/fast.h"
 #include "../utils/fd.h"
 #include "../utils/attr.h"
+#include "../core/global.h"
 #include "device.h"
+#include "fwd.h"
 
 #include <string.h>
 
@@ -38,6 +41,33 @@
 #error
 #endif
 
+/*  Unless the recipe intercepts the messages, they are moved between
+    the sockets inside the library rather than via nn_recvmsg/nn_sendmsg. */
+static int nn_device_isnative (struct nn_device_recipe *device)
+{
+    return device->nn_device_mvmsg == nn_device_mvmsg &&
+        device->nn_device_rewritemsg == nn_device_rewritemsg;
+}
+
+static int nn_device_forward (struct nn_device_recipe *device,
+    int s1, int s2, int twoway)
+{
+    int rc;
+    struct nn_sock *sock1;
+    struct nn_sock *sock2;
+
+    sock1 = nn_global_getsock (s1);
+    sock2 = nn_global_getsock (s2);
+    if (nn_slow (!sock1 || !sock2)) {
+        errno = EBADF;
+        return -1;
+    }
+    rc = nn_fwd_run (sock1, sock2, twoway, device->batch,
+        device->flags & NN_DEVICE_THREADED);
+    errno = -rc;
+    return -1;
+}
+
 int nn_custom_device(struct nn_device_recipe *device, int s1, int s2,
     int flags) 
 {
@@ -49,6 +79,83 @@ int nn_device (int s1, int s2)
     return nn_custom_device (&nn_ordinary_device, s1, s2, 0);
 }
 
+int nn_device_batch (int s1, int s2, int batch, int flags)
+{
+    struct nn_device_recipe device;
+
+    if (nn_slow (batch < 0 || (flags & ~NN_DEVICE_THREADED))) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    device = nn_ordinary_device;
+    device.batch = batch;
+    device.flags = flags;
+    return nn_custom_device (&device, s1, s2, 0);
+}
+
+int nn_device_route (const int *socks, int nsocks, nn_device_route_fn fn,
+    void *arg, int flags)
+{
+    int rc;
+    int i;
+    int j;
+    int op;
+    int protocol;
+    size_t opsz;
+    struct nn_sock **ss;
+
+    if (nn_slow (!socks || nsocks <= 0 || !fn ||
+          (flags & ~NN_DEVICE_THREADED))) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    /*  All the sockets must be distinct "raw" sockets of the same
+        protocol. */
+    protocol = -1;
+    for (i = 0; i != nsocks; ++i) {
+        opsz = sizeof (op);
+        rc = nn_getsockopt (socks [i], NN_SOL_SOCKET, NN_DOMAIN, &op, &opsz);
+        if (nn_slow (rc < 0))
+            return -1;
+        if (op != AF_SP_RAW) {
+            errno = EINVAL;
+            return -1;
+        }
+        opsz = sizeof (op);
+        rc = nn_getsockopt (socks [i], NN_SOL_SOCKET, NN_PROTOCOL,
+            &op, &opsz);
+        errno_assert (rc == 0);
+        if (protocol >= 0 && op / 16 != protocol / 16) {
+            errno = EINVAL;
+            return -1;
+        }
+        protocol = op;
+        for (j = 0; j != i; ++j) {
+            if (socks [j] == socks [i]) {
+                errno = EINVAL;
+                return -1;
+            }
+        }
+    }
+
+    ss = nn_alloc (sizeof (struct nn_sock*) * nsocks, "device socks");
+    alloc_assert (ss);
+    for (i = 0; i != nsocks; ++i) {
+        ss [i] = nn_global_getsock (socks [i]);
+        if (nn_slow (!ss [i])) {
+            nn_free (ss);
+            errno = EBADF;
+            return -1;
+        }
+    }
+    rc = nn_fwd_route (ss, nsocks, fn, arg, 0, flags & NN_DEVICE_THREADED);
+    nn_free (ss);
+    errno = -rc;
+    return -1;
+}
+
 int nn_device_entry (struct nn_device_recipe *device, int s1, int s2,
     int flags) 
 {
@@ -203,6 +310,9 @@ int nn_device_loopback (struct nn_device_recipe *device, int s)
         return -1;
     }
 
+    if (nn_device_isnative (device))
+        return nn_device_forward (device, s, s, 0);
+
     while (1) {
         rc = nn_device_mvmsg (device,s, s, 0);
         if (nn_slow (rc < 0))
@@ -223,6 +333,9 @@ int nn_device_twoway (struct nn_device_recipe *device,
     int s2rcv_isready = 0;
     int s2snd_isready = 0;
 
+    if (nn_device_isnative (device))
+        return nn_device_forward (device, s1, s2, 1);
+
     /*  Initialise the pollset. */
     FD_ZERO (&fds);
 
@@ -286,6 +399,9 @@ int nn_device_twoway (struct nn_device_recipe *device,
     int rc;
     struct pollfd pfd [4];
 
+    if (nn_device_isnative (device))
+        return nn_device_forward (device, s1, s2, 1);
+
     /*  Initialise the pollset. */
     pfd [0].fd = s1rcv;
     pfd [0].events = POLLIN;
@@ -346,6 +462,9 @@ int nn_device_oneway (struct nn_device_recipe *device,
 {
     int rc;
 
+    if (nn_device_isnative (device))
+        return nn_device_forward (device, s1, s2, 0);
+
     while (1) {
         rc = nn_device_mvmsg (device, s1, s2, 0);
         if (nn_slow (rc < 0))
@@ -68,6 +68,14 @@ struct nn_device_recipe {
     */
     int (*nn_device_rewritemsg) (struct nn_device_recipe *device,
         int from, int to, int flags, struct nn_msghdr *msghdr, int bytes);
+
+    /*  Maximum number of messages moved per wakeup when the messages are
+        forwarded inside the library. Zero means the default. */
+    int batch;
+
+    /*  NN_DEVICE_* flags used when the messages are forwarded inside
+        the library. */
+    int flags;
 };
 
 /*  Default implementations of the functions. */
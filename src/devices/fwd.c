@@ -0,0 +1,554 @@
+/*
+    Copyright (c) 2013 250bpm s.r.o.  All rights reserved.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom
+    the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included
+    in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+#include "fwd.h"
+
+#include "../protocol.h"
+
+#include "../core/sock.h"
+#include "../core/global.h"
+
+#include "../aio/ctx.h"
+#include "../aio/fsm.h"
+#include "../aio/worker.h"
+
+#include "../utils/err.h"
+#include "../utils/alloc.h"
+#include "../utils/attr.h"
+#include "../utils/cont.h"
+#include "../utils/fast.h"
+#include "../utils/msg.h"
+#include "../utils/mutex.h"
+#include "../utils/sem.h"
+
+/*  Default maximum number of messages moved in one go. Afterwards, the worker
+    thread gets a chance to process other events before the rest is
+    forwarded. */
+#define NN_FWD_BATCH 256
+
+#define NN_FWD_SRC_TASK 1
+#define NN_FWD_SRC_STOP 2
+
+struct nn_fwd;
+
+/*  One direction of the message flow, i.e. messages received from one
+    socket. Each direction has its own context so that the directions never
+    wait for each other. */
+struct nn_fwd_dir {
+
+    /*  The device this direction belongs to. */
+    struct nn_fwd *fwd;
+
+    /*  Messages are received from 'from', which is the 'index'-th socket of
+        the device. */
+    struct nn_sock *from;
+    int index;
+
+    /*  The socket the messages are being sent to at the moment. Unless
+        the device routes the messages, it never changes. Guarded by nn_fwd's
+        'sync' mutex. */
+    struct nn_sock *to;
+
+    /*  The state machine. */
+    struct nn_ctx ctx;
+    struct nn_fsm fsm;
+
+    /*  Worker thread the forwarding is done in. It's either one of the
+        pool's workers or 'thread'. */
+    struct nn_worker *worker;
+    struct nn_worker thread;
+
+    /*  Executed in the worker thread to move the messages. */
+    struct nn_worker_task task;
+
+    /*  Set if the task was posted to the worker thread but haven't been
+        executed yet. Guarded by nn_fwd's 'sync' mutex. */
+    int scheduled;
+
+    /*  Used to stop the direction in the worker thread. */
+    struct nn_worker_task stop;
+
+    /*  Messages that were received but not sent yet. 'npending' messages
+        starting at 'head' are waiting for the destination sockets to accept
+        them. 'sizes' holds the lengths of the bodies of the messages and
+        'dests' the sockets they are sent to. */
+    struct nn_msg *msgs;
+    size_t *sizes;
+    struct nn_sock **dests;
+    int head;
+    int npending;
+};
+
+struct nn_fwd {
+
+    /*  Callback invoked by the sockets. */
+    struct nn_sock_fwd hook;
+
+    /*  The sockets the device is attached to. */
+    struct nn_sock **socks;
+    int nsocks;
+
+    /*  Directions of the message flow. */
+    struct nn_fwd_dir *dirs;
+    int ndirs;
+
+    /*  If set, the messages are sent to the socket chosen by 'fn'. */
+    nn_device_route_fn fn;
+    void *arg;
+
+    /*  Maximum number of messages moved per wakeup. */
+    int batch;
+
+    /*  If set, each direction runs in a thread of its own. */
+    int threaded;
+
+    /*  Guards the 'to' and 'scheduled' fields of the directions and
+        'terminated'. The sockets notify the device from within their own
+        contexts. */
+    struct nn_mutex sync;
+
+    /*  Set once one of the sockets was terminated. */
+    int terminated;
+
+    /*  Posted when the sockets are terminated and then once again per
+        direction when it is stopped. */
+    struct nn_sem done;
+};
+
+/*  Private functions. */
+static void nn_fwd_init (struct nn_fwd *self, struct nn_sock **socks,
+    int nsocks, int ndirs, int batch, int threaded);
+static void nn_fwd_term (struct nn_fwd *self);
+static int nn_fwd_loop (struct nn_fwd *self);
+static void nn_fwd_dir_init (struct nn_fwd_dir *self, struct nn_fwd *fwd,
+    struct nn_sock *from, int index, struct nn_sock *to);
+static void nn_fwd_dir_term (struct nn_fwd_dir *self);
+static void nn_fwd_handler (struct nn_fsm *self, int src, int type,
+    void *srcptr);
+static void nn_fwd_shutdown (struct nn_fsm *self, int src, int type,
+    void *srcptr);
+static void nn_fwd_notify (struct nn_sock_fwd *self, struct nn_sock *sock,
+    int events);
+static void nn_fwd_schedule (struct nn_fwd *self, struct nn_fwd_dir *dir);
+static int nn_fwd_route_batch (struct nn_fwd *self, struct nn_fwd_dir *dir,
+    int count);
+static int nn_fwd_move (struct nn_fwd *self, struct nn_fwd_dir *dir);
+
+int nn_fwd_run (struct nn_sock *s1, struct nn_sock *s2, int twoway,
+    int batch, int threaded)
+{
+    int rc;
+    struct nn_sock *socks [2];
+    struct nn_fwd self;
+
+    socks [0] = s1;
+    socks [1] = s2;
+    nn_fwd_init (&self, socks, s1 == s2 ? 1 : 2, twoway ? 2 : 1,
+        batch, threaded);
+    nn_fwd_dir_init (&self.dirs [0], &self, s1, 0, s2);
+    if (twoway)
+        nn_fwd_dir_init (&self.dirs [1], &self, s2, 1, s1);
+    rc = nn_fwd_loop (&self);
+    nn_fwd_term (&self);
+
+    return rc;
+}
+
+int nn_fwd_route (struct nn_sock **socks, int nsocks, nn_device_route_fn fn,
+    void *arg, int batch, int threaded)
+{
+    int rc;
+    int i;
+    int ndirs;
+    struct nn_fwd self;
+
+    nn_assert (fn);
+
+    /*  Messages are received from all the sockets that allow for it. */
+    ndirs = 0;
+    for (i = 0; i != nsocks; ++i)
+        if (!(socks [i]->socktype->flags & NN_SOCKTYPE_FLAG_NORECV))
+            ++ndirs;
+    if (nn_slow (ndirs == 0))
+        return -EINVAL;
+
+    nn_fwd_init (&self, socks, nsocks, ndirs, batch, threaded);
+    self.fn = fn;
+    self.arg = arg;
+    ndirs = 0;
+    for (i = 0; i != nsocks; ++i)
+        if (!(socks [i]->socktype->flags & NN_SOCKTYPE_FLAG_NORECV))
+            nn_fwd_dir_init (&self.dirs [ndirs++], &self, socks [i], i, NULL);
+    rc = nn_fwd_loop (&self);
+    nn_fwd_term (&self);
+
+    return rc;
+}
+
+static void nn_fwd_init (struct nn_fwd *self, struct nn_sock **socks,
+    int nsocks, int ndirs, int batch, int threaded)
+{
+    nn_assert (batch >= 0);
+
+    self->hook.notify = nn_fwd_notify;
+    self->socks = socks;
+    self->nsocks = nsocks;
+    self->dirs = nn_alloc (sizeof (struct nn_fwd_dir) * ndirs, "fwd dirs");
+    alloc_assert (self->dirs);
+    self->ndirs = ndirs;
+    self->fn = NULL;
+    self->arg = NULL;
+    self->batch = batch ? batch : NN_FWD_BATCH;
+    self->threaded = threaded;
+    nn_mutex_init (&self->sync);
+    self->terminated = 0;
+    nn_sem_init (&self->done);
+}
+
+static void nn_fwd_term (struct nn_fwd *self)
+{
+    int i;
+
+    for (i = 0; i != self->ndirs; ++i)
+        nn_fwd_dir_term (&self->dirs [i]);
+    nn_sem_term (&self->done);
+    nn_mutex_term (&self->sync);
+    nn_free (self->dirs);
+}
+
+/*  Runs the device till the library is terminated. */
+static int nn_fwd_loop (struct nn_fwd *self)
+{
+    int rc;
+    int i;
+
+    /*  Hook into the sockets. From now on, the messages are moved in
+        the worker thread(s) and this thread only waits for the termination. */
+    rc = 0;
+    for (i = 0; i != self->nsocks; ++i) {
+        rc = nn_sock_attach_fwd (self->socks [i], &self->hook);
+        if (nn_slow (rc < 0))
+            break;
+    }
+    if (nn_fast (rc == 0)) {
+        while (1) {
+            rc = nn_sem_wait (&self->done);
+            if (nn_fast (rc != -EINTR))
+                break;
+        }
+        errnum_assert (rc == 0, -rc);
+        rc = -ETERM;
+    }
+    while (i--)
+        nn_sock_detach_fwd (self->socks [i]);
+
+    /*  The sockets don't post any new tasks at this point. Stop the state
+        machines in the worker threads so that all the tasks already posted
+        are processed before they are deallocated. */
+    for (i = 0; i != self->ndirs; ++i) {
+        nn_ctx_enter (&self->dirs [i].ctx);
+        nn_fsm_stop (&self->dirs [i].fsm);
+        nn_ctx_leave (&self->dirs [i].ctx);
+    }
+    for (i = 0; i != self->ndirs; ++i)
+        while (nn_sem_wait (&self->done) == -EINTR)
+            ;
+
+    return rc;
+}
+
+static void nn_fwd_dir_init (struct nn_fwd_dir *self, struct nn_fwd *fwd,
+    struct nn_sock *from, int index, struct nn_sock *to)
+{
+    int rc;
+
+    self->fwd = fwd;
+    self->from = from;
+    self->index = index;
+    self->to = to;
+    nn_ctx_init (&self->ctx, nn_global_getpool (), NULL);
+    nn_fsm_init_root (&self->fsm, nn_fwd_handler, nn_fwd_shutdown,
+        &self->ctx);
+    if (fwd->threaded) {
+        rc = nn_worker_init (&self->thread);
+        errnum_assert (rc == 0, -rc);
+        self->worker = &self->thread;
+    }
+    else
+        self->worker = nn_ctx_choose_worker (&self->ctx);
+    nn_worker_task_init (&self->task, NN_FWD_SRC_TASK, &self->fsm);
+    self->scheduled = 0;
+    nn_worker_task_init (&self->stop, NN_FWD_SRC_STOP, &self->fsm);
+    self->msgs = nn_alloc (sizeof (struct nn_msg) * fwd->batch, "fwd msgs");
+    alloc_assert (self->msgs);
+    self->sizes = nn_alloc (sizeof (size_t) * fwd->batch, "fwd sizes");
+    alloc_assert (self->sizes);
+    self->dests = nn_alloc (sizeof (struct nn_sock*) * fwd->batch,
+        "fwd dests");
+    alloc_assert (self->dests);
+    self->head = 0;
+    self->npending = 0;
+
+    nn_ctx_enter (&self->ctx);
+    nn_fsm_start (&self->fsm);
+    nn_ctx_leave (&self->ctx);
+}
+
+static void nn_fwd_dir_term (struct nn_fwd_dir *self)
+{
+    int i;
+
+    /*  Make sure the worker thread has left the context. */
+    nn_ctx_enter (&self->ctx);
+    nn_ctx_leave (&self->ctx);
+
+    if (self->fwd->threaded)
+        nn_worker_term (&self->thread);
+    for (i = 0; i != self->npending; ++i)
+        nn_msg_term (&self->msgs [self->head + i]);
+    nn_free (self->dests);
+    nn_free (self->sizes);
+    nn_free (self->msgs);
+    nn_worker_task_term (&self->stop);
+    nn_worker_task_term (&self->task);
+    nn_fsm_stopped_noevent (&self->fsm);
+    nn_fsm_term (&self->fsm);
+    nn_ctx_term (&self->ctx);
+}
+
+static void nn_fwd_notify (struct nn_sock_fwd *self, struct nn_sock *sock,
+    int events)
+{
+    struct nn_fwd *fwd;
+    int i;
+    struct nn_fwd_dir *dir;
+
+    fwd = nn_cont (self, struct nn_fwd, hook);
+
+    /*  Messages can be moved if the source socket has become readable, or,
+        if there are messages waiting to be sent, the destination socket has
+        become writable. */
+    nn_mutex_lock (&fwd->sync);
+    for (i = 0; i != fwd->ndirs; ++i) {
+        dir = &fwd->dirs [i];
+        if ((dir->from == sock && (events & NN_SOCKBASE_EVENT_IN)) ||
+              (dir->to == sock && (events & NN_SOCKBASE_EVENT_OUT)))
+            nn_fwd_schedule (fwd, dir);
+    }
+    nn_mutex_unlock (&fwd->sync);
+}
+
+/*  Posts the direction's task to its worker thread unless it's posted
+    already. Must be called with 'sync' locked. */
+static void nn_fwd_schedule (struct nn_fwd *self, struct nn_fwd_dir *dir)
+{
+    if (!dir->scheduled) {
+        dir->scheduled = 1;
+        nn_worker_execute (dir->worker, &dir->task);
+    }
+}
+
+/*  Chooses the destinations of 'count' freshly received messages. Messages
+    that are dropped are removed from the batch. Returns the number of
+    messages left. */
+static int nn_fwd_route_batch (struct nn_fwd *self, struct nn_fwd_dir *dir,
+    int count)
+{
+    int i;
+    int n;
+    int dest;
+    struct nn_device_msg msg;
+
+    /*  Without routing, all the messages go to the same socket. */
+    if (!self->fn) {
+        for (i = 0; i != count; ++i)
+            dir->dests [i] = dir->to;
+        return count;
+    }
+
+    n = 0;
+    for (i = 0; i != count; ++i) {
+        nn_msg_linearize (&dir->msgs [i]);
+        msg.hdr = nn_chunkref_data (&dir->msgs [i].sphdr);
+        msg.hdrlen = nn_chunkref_size (&dir->msgs [i].sphdr);
+        msg.body = nn_chunkref_data (&dir->msgs [i].body);
+        msg.bodylen = dir->sizes [i];
+        dest = self->fn (self->arg, dir->index, &msg);
+        if (dest < 0 || dest >= self->nsocks) {
+            nn_msg_term (&dir->msgs [i]);
+            continue;
+        }
+        if (n != i) {
+            nn_msg_mv (&dir->msgs [n], &dir->msgs [i]);
+            dir->sizes [n] = dir->sizes [i];
+        }
+        dir->dests [n] = self->socks [dest];
+        ++n;
+    }
+    return n;
+}
+
+/*  Moves one batch of messages. Messages are received only when all
+    the previously received ones were sent, so that when a destination
+    socket pushes back the messages stay queued in the source socket's
+    pipes and the pushback propagates to the peers. Returns -EAGAIN if
+    there may be more messages to move. */
+static int nn_fwd_move (struct nn_fwd *self, struct nn_fwd_dir *dir)
+{
+    int rc;
+    int i;
+    int more;
+    int count;
+    size_t bytes;
+    struct nn_sock *to;
+
+    /*  Get the next batch of messages unless there are some left over from
+        the last time. In the latter case the source socket's readiness
+        may have been signalled in the meantime, so check it afterwards. */
+    if (dir->npending == 0) {
+        rc = nn_sock_recvmany (dir->from, dir->msgs, self->batch);
+        if (rc == -EAGAIN)
+            return 0;
+        if (nn_slow (rc < 0))
+            return rc;
+        more = rc == self->batch;
+        for (i = 0; i != rc; ++i)
+            dir->sizes [i] = nn_msg_bodysize (&dir->msgs [i]);
+        dir->head = 0;
+        dir->npending = nn_fwd_route_batch (self, dir, rc);
+    }
+    else
+        more = 1;
+
+    /*  Pass the messages to the destination sockets, a run of messages with
+        the same destination at a time. The SP header (e.g. request's
+        backtrace) travels along with the message. */
+    while (dir->npending) {
+        to = dir->dests [dir->head];
+        for (count = 1; count != dir->npending; ++count)
+            if (dir->dests [dir->head + count] != to)
+                break;
+        if (self->fn && dir->to != to) {
+            nn_mutex_lock (&self->sync);
+            dir->to = to;
+            nn_mutex_unlock (&self->sync);
+        }
+        rc = nn_sock_sendmany (to, dir->msgs + dir->head, count);
+        if (rc == -EAGAIN)
+            return 0;
+        if (nn_slow (rc == -ETERM))
+            return rc;
+
+        /*  Message that the destination socket refuses is dropped. */
+        if (nn_slow (rc < 0)) {
+            nn_msg_term (&dir->msgs [dir->head]);
+            ++dir->head;
+            --dir->npending;
+            continue;
+        }
+
+        count = rc;
+        bytes = 0;
+        for (i = 0; i != count; ++i)
+            bytes += dir->sizes [dir->head + i];
+        dir->head += count;
+        dir->npending -= count;
+        nn_sock_stat_increment (dir->from, NN_STAT_MESSAGES_RECEIVED, count);
+        nn_sock_stat_increment (dir->from, NN_STAT_BYTES_RECEIVED, bytes);
+        nn_sock_stat_increment (dir->from, NN_STAT_MESSAGES_FORWARDED, count);
+        nn_sock_stat_increment (dir->from, NN_STAT_BYTES_FORWARDED, bytes);
+        nn_sock_stat_increment (to, NN_STAT_MESSAGES_SENT, count);
+        nn_sock_stat_increment (to, NN_STAT_BYTES_SENT, bytes);
+    }
+
+    return more ? -EAGAIN : 0;
+}
+
+static void nn_fwd_handler (struct nn_fsm *self, int src, int type,
+    NN_UNUSED void *srcptr)
+{
+    struct nn_fwd_dir *dir;
+    struct nn_fwd *fwd;
+    int rc;
+
+    dir = nn_cont (self, struct nn_fwd_dir, fsm);
+    fwd = dir->fwd;
+
+    if (src == NN_FSM_ACTION && type == NN_FSM_START)
+        return;
+
+    nn_assert (src == NN_FWD_SRC_TASK && type == NN_WORKER_TASK_EXECUTE);
+
+    /*  Notifications arriving from now on will post the task anew. */
+    nn_mutex_lock (&fwd->sync);
+    dir->scheduled = 0;
+    rc = fwd->terminated;
+    nn_mutex_unlock (&fwd->sync);
+    if (nn_slow (rc))
+        return;
+
+    rc = nn_fwd_move (fwd, dir);
+
+    /*  The batch is full. Continue later on. */
+    if (rc == -EAGAIN) {
+        nn_mutex_lock (&fwd->sync);
+        nn_fwd_schedule (fwd, dir);
+        nn_mutex_unlock (&fwd->sync);
+        return;
+    }
+
+    /*  The library is being terminated. Wake up the user's thread, unless
+        another direction did so already. */
+    if (nn_slow (rc == -ETERM)) {
+        nn_mutex_lock (&fwd->sync);
+        if (!fwd->terminated) {
+            fwd->terminated = 1;
+            nn_sem_post (&fwd->done);
+        }
+        nn_mutex_unlock (&fwd->sync);
+        return;
+    }
+    errnum_assert (rc == 0, -rc);
+}
+
+static void nn_fwd_shutdown (struct nn_fsm *self, int src, int type,
+    NN_UNUSED void *srcptr)
+{
+    struct nn_fwd_dir *dir;
+
+    dir = nn_cont (self, struct nn_fwd_dir, fsm);
+
+    if (nn_slow (src == NN_FSM_ACTION && type == NN_FSM_STOP)) {
+        nn_worker_execute (dir->worker, &dir->stop);
+        return;
+    }
+
+    /*  All the tasks posted before are processed by now. */
+    if (nn_slow (src == NN_FWD_SRC_STOP)) {
+        nn_assert (type == NN_WORKER_TASK_EXECUTE);
+        nn_sem_post (&dir->fwd->done);
+        return;
+    }
+
+    /*  Tasks posted before the device was stopped are ignored. */
+    nn_assert (type == NN_WORKER_TASK_EXECUTE);
+}
@@ -0,0 +1,50 @@
+/*
+    Copyright (c) 2013 250bpm s.r.o.  All rights reserved.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom
+    the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included
+    in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+#ifndef NN_FWD_INCLUDED
+#define NN_FWD_INCLUDED
+
+#include "../nn.h"
+
+struct nn_sock;
+
+/*  In-core device. Messages are moved from one socket to the other in
+    the worker thread, straight from the inbound pipes of one socket to
+    the outbound pipes of the other, without ever passing them to the user.
+    Messages from 's1' are forwarded to 's2'. If 'twoway' is set, messages
+    from 's2' are forwarded to 's1' as well. 's1' and 's2' may be the same
+    socket. Each direction moves up to 'batch' messages per wakeup (zero
+    means the default). If 'threaded' is set, each direction runs in
+    a dedicated thread rather than in the worker thread shared with
+    the sockets. The function blocks until the library is terminated, at
+    which point it returns -ETERM. */
+int nn_fwd_run (struct nn_sock *s1, struct nn_sock *s2, int twoway,
+    int batch, int threaded);
+
+/*  Routing in-core device. Messages received from any of the 'nsocks'
+    sockets are passed to 'fn' which chooses the socket to send each one
+    to. 'fn' is invoked in the worker thread. The sockets must be distinct.
+    Otherwise, works the same way as nn_fwd_run. */
+int nn_fwd_route (struct nn_sock **socks, int nsocks, nn_device_route_fn fn,
+    void *arg, int batch, int threaded);
+
+#endif
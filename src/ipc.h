@@ -29,6 +29,17 @@ extern "C" {
 
 #define NN_IPC -2
 
+#define NN_IPC_PEERCRED 1
+
+/*  Credentials of the peer process. If NN_IPC_PEERCRED option is set,
+    they are attached to each received message as an ancillary property
+    with level NN_IPC and type NN_IPC_PEERCRED. */
+struct nn_ipc_peercred {
+    int pid;
+    unsigned int uid;
+    unsigned int gid;
+};
+
 #ifdef __cplusplus
 }
 #endif
@@ -259,6 +259,7 @@ NN_EXPORT void nn_term (void);
 NN_EXPORT void *nn_allocmsg (size_t size, int type);
 NN_EXPORT void *nn_reallocmsg (void *msg, size_t size);
 NN_EXPORT int nn_freemsg (void *msg);
+NN_EXPORT void *nn_refmsg (void *msg);
 
 /******************************************************************************/
 /*  Socket definition.                                                        */
@@ -335,6 +336,15 @@ NN_EXPORT  struct nn_cmsghdr *nn_cmsg_nxthdr_ (
 #define NN_PROTOCOL 13
 #define NN_IPV4ONLY 14
 #define NN_SOCKET_NAME 15
+#define NN_RECONNECT_POLICY 16
+#define NN_FLOWCTL 17
+#define NN_MSGTTL 18
+
+/*  Values of NN_RECONNECT_POLICY socket option.                              */
+#define NN_RECONNECT_EXPONENTIAL 0
+#define NN_RECONNECT_FULL_JITTER 1
+#define NN_RECONNECT_EQUAL_JITTER 2
+#define NN_RECONNECT_DECORRELATED_JITTER 3
 
 /*  Send/recv options.                                                        */
 #define NN_DONTWAIT 1
@@ -342,6 +352,7 @@ NN_EXPORT  struct nn_cmsghdr *nn_cmsg_nxthdr_ (
 /*  Ancillary data.                                                           */
 #define PROTO_SP 1
 #define SP_HDR 1
+#define SP_TTL 2
 
 NN_EXPORT int nn_socket (int domain, int protocol);
 NN_EXPORT int nn_close (int s);
@@ -378,6 +389,35 @@ NN_EXPORT int nn_poll (struct nn_pollfd *fds, int nfds, int timeout);
 
 NN_EXPORT int nn_device (int s1, int s2);
 
+/*  Flags for nn_device_batch. Each direction of the device is run in
+    a thread of its own. */
+#define NN_DEVICE_THREADED 1
+
+NN_EXPORT int nn_device_batch (int s1, int s2, int batch, int flags);
+
+/*  Message as seen by the routing function of nn_device_route. 'hdr' and
+    'body' point directly to the SP header and the body of the message being
+    forwarded. They are valid only till the routing function returns and
+    must not be modified. */
+struct nn_device_msg {
+    const void *hdr;
+    size_t hdrlen;
+    const void *body;
+    size_t bodylen;
+};
+
+/*  Returned from the routing function to drop the message. */
+#define NN_DEVICE_DROP -1
+
+/*  Chooses the socket to forward the message to. 'from' is the index of
+    the socket the message was received from. Returns the index of
+    the destination socket or NN_DEVICE_DROP. */
+typedef int (*nn_device_route_fn) (void *arg, int from,
+    const struct nn_device_msg *msg);
+
+NN_EXPORT int nn_device_route (const int *socks, int nsocks,
+    nn_device_route_fn fn, void *arg, int flags);
+
 #ifdef __cplusplus
 }
 #endif
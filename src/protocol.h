@@ -69,6 +69,11 @@ int nn_pipe_send (struct nn_pipe *self, struct nn_msg *msg);
     the call. It will be initialised when the call succeeds. */
 int nn_pipe_recv (struct nn_pipe *self, struct nn_msg *msg);
 
+/*  Returns 1 if the pipe is not writable because the peer haven't granted
+    enough flow control credit, i.e. it doesn't keep up with the messages.
+    Returns 0 otherwise. */
+int nn_pipe_throttled (struct nn_pipe *self);
+
 /*  Get option for pipe. Mostly useful for endpoint-specific options  */
 void nn_pipe_getopt (struct nn_pipe *self, int level, int option,
     void *optval, size_t *optvallen);
@@ -154,6 +159,8 @@ int nn_sockbase_getopt (struct nn_sockbase *self, int option,
 void nn_sockbase_stat_increment (struct nn_sockbase *self, int name,
     int increment);
 
+#define NN_STAT_MESSAGES_DROPPED 307
+#define NN_STAT_MESSAGES_EXPIRED 308
 #define NN_STAT_CURRENT_SND_PRIORITY 401
 
 /******************************************************************************/
@@ -26,6 +26,7 @@
 #include "../../pubsub.h"
 
 #include "../utils/dist.h"
+#include "../utils/conflate.h"
 
 #include "../../utils/err.h"
 #include "../../utils/cont.h"
@@ -38,6 +39,14 @@
 
 struct nn_xpub_data {
     struct nn_dist_data item;
+
+    /*  Item in the list of all the pipes. */
+    struct nn_list_item pipesitem;
+
+    /*  Newest message per topic that the pipe wasn't able to accept, or
+        the snapshot of the cache for a new pipe. The pipe is handed over to
+        the distributor once these are sent. */
+    struct nn_conflate pending;
 };
 
 struct nn_xpub {
@@ -47,6 +56,18 @@ struct nn_xpub {
 
     /*  Distributor. */
     struct nn_dist outpipes;
+
+    /*  All the attached pipes, including those that are not writable. */
+    struct nn_list pipes;
+
+    /*  Length of the topic for conflation purposes. 0 if the messages for
+        pipes that are not writable are simply dropped. */
+    int conflate;
+
+    /*  Length of the topic for the last value cache, 0 if there's no cache,
+        and the last message of each topic. New pipes get these first. */
+    int cache;
+    struct nn_conflate lastvals;
 };
 
 /*  Private functions. */
@@ -85,10 +106,16 @@ static void nn_xpub_init (struct nn_xpub *self,
 {
     nn_sockbase_init (&self->sockbase, vfptr, hint);
     nn_dist_init (&self->outpipes);
+    nn_list_init (&self->pipes);
+    self->conflate = 0;
+    self->cache = 0;
+    nn_conflate_init (&self->lastvals);
 }
 
 static void nn_xpub_term (struct nn_xpub *self)
 {
+    nn_conflate_term (&self->lastvals);
+    nn_list_term (&self->pipes);
     nn_dist_term (&self->outpipes);
     nn_sockbase_term (&self->sockbase);
 }
@@ -113,6 +140,11 @@ static int nn_xpub_add (struct nn_sockbase *self, struct nn_pipe *pipe)
     data = nn_alloc (sizeof (struct nn_xpub_data), "pipe data (pub)");
     alloc_assert (data);
     nn_dist_add (&xpub->outpipes, &data->item, pipe);
+    nn_list_item_init (&data->pipesitem);
+    nn_list_insert (&xpub->pipes, &data->pipesitem,
+        nn_list_end (&xpub->pipes));
+    nn_conflate_init (&data->pending);
+    nn_conflate_cp (&data->pending, &xpub->lastvals);
     nn_pipe_setdata (pipe, data);
 
     return 0;
@@ -127,6 +159,9 @@ static void nn_xpub_rm (struct nn_sockbase *self, struct nn_pipe *pipe)
     data = nn_pipe_getdata (pipe);
 
     nn_dist_rm (&xpub->outpipes, &data->item);
+    nn_list_erase (&xpub->pipes, &data->pipesitem);
+    nn_list_item_term (&data->pipesitem);
+    nn_conflate_term (&data->pending);
 
     nn_free (data);
 }
@@ -140,12 +175,25 @@ static void nn_xpub_in (NN_UNUSED struct nn_sockbase *self,
 
 static void nn_xpub_out (struct nn_sockbase *self, struct nn_pipe *pipe)
 {
+    int rc;
     struct nn_xpub *xpub;
     struct nn_xpub_data *data;
+    struct nn_msg msg;
 
     xpub = nn_cont (self, struct nn_xpub, sockbase);
     data = nn_pipe_getdata (pipe);
 
+    /*  Send the conflated messages or the snapshot first. If the pipe becomes
+        unwritable before all of them are sent, wait for it to become writable
+        again. The snapshot is thus sent as fast as the connection is able to
+        take it, without piling up in the buffers. */
+    while (nn_conflate_pop (&data->pending, &msg) == 0) {
+        rc = nn_pipe_send (pipe, &msg);
+        errnum_assert (rc >= 0, -rc);
+        if (rc & NN_PIPE_RELEASE)
+            return;
+    }
+
     nn_dist_out (&xpub->outpipes, &data->item);
 }
 
@@ -156,21 +204,127 @@ static int nn_xpub_events (NN_UNUSED struct nn_sockbase *self)
 
 static int nn_xpub_send (struct nn_sockbase *self, struct nn_msg *msg)
 {
-    return nn_dist_send (&nn_cont (self, struct nn_xpub, sockbase)->outpipes,
-        msg, NULL);
+    struct nn_xpub *xpub;
+    struct nn_list_item *it;
+    struct nn_xpub_data *data;
+    struct nn_msg copy;
+    int keylen;
+    int dropped;
+
+    xpub = nn_cont (self, struct nn_xpub, sockbase);
+
+    /*  Remember the message as the last value of its topic. */
+    if (nn_slow (xpub->cache)) {
+        nn_msg_pullup (msg, xpub->cache);
+        nn_msg_cp (&copy, msg);
+        nn_conflate_push (&xpub->lastvals, &copy, xpub->cache);
+    }
+
+    if (nn_slow (xpub->outpipes.total != xpub->outpipes.count)) {
+
+        /*  Subscribers that are not writable at the moment miss the message.
+            With conflation, the message is stored for them instead, replacing
+            any older message with the same topic. The same applies to new
+            pipes that haven't got the whole snapshot yet, so that they don't
+            end up with stale values. Pipes that are not in the distributor
+            are those that are not writable. */
+        nn_msg_pullup (msg, xpub->conflate);
+        dropped = 0;
+        for (it = nn_list_begin (&xpub->pipes);
+              it != nn_list_end (&xpub->pipes);
+              it = nn_list_next (&xpub->pipes, it)) {
+            data = nn_cont (it, struct nn_xpub_data, pipesitem);
+            if (nn_list_item_isinlist (&data->item.item))
+                continue;
+            keylen = xpub->conflate;
+            if (!keylen && !nn_conflate_empty (&data->pending))
+                keylen = xpub->cache;
+            if (!keylen) {
+
+                /*  Pipe that is in the middle of sending a message becomes
+                    writable again shortly. Only subscribers that don't keep
+                    up with the flow of messages are reported. */
+                if (nn_pipe_throttled (data->item.pipe))
+                    ++dropped;
+                continue;
+            }
+            nn_msg_cp (&copy, msg);
+            if (nn_conflate_push (&data->pending, &copy, keylen))
+                ++dropped;
+        }
+        if (dropped)
+            nn_sockbase_stat_increment (self, NN_STAT_MESSAGES_DROPPED,
+                dropped);
+    }
+
+    return nn_dist_send (&xpub->outpipes, msg, NULL);
 }
 
-static int nn_xpub_setopt (NN_UNUSED struct nn_sockbase *self,
-    NN_UNUSED int level, NN_UNUSED int option,
-    NN_UNUSED const void *optval, NN_UNUSED size_t optvallen)
+static int nn_xpub_setopt (struct nn_sockbase *self, int level, int option,
+    const void *optval, size_t optvallen)
 {
+    struct nn_xpub *xpub;
+    int val;
+
+    xpub = nn_cont (self, struct nn_xpub, sockbase);
+
+    if (level != NN_PUB)
+        return -ENOPROTOOPT;
+
+    if (option == NN_PUB_CONFLATE) {
+        if (nn_slow (optvallen != sizeof (int)))
+            return -EINVAL;
+        val = *(int*) optval;
+        if (nn_slow (val < 0))
+            return -EINVAL;
+        xpub->conflate = val;
+        return 0;
+    }
+
+    /*  Changing the length of the topic invalidates the cached values. */
+    if (option == NN_PUB_CACHE) {
+        if (nn_slow (optvallen != sizeof (int)))
+            return -EINVAL;
+        val = *(int*) optval;
+        if (nn_slow (val < 0))
+            return -EINVAL;
+        if (val != xpub->cache) {
+            nn_conflate_term (&xpub->lastvals);
+            nn_conflate_init (&xpub->lastvals);
+        }
+        xpub->cache = val;
+        return 0;
+    }
+
     return -ENOPROTOOPT;
 }
 
-static int nn_xpub_getopt (NN_UNUSED struct nn_sockbase *self,
-    NN_UNUSED int level, NN_UNUSED int option,
-    NN_UNUSED void *optval, NN_UNUSED size_t *optvallen)
+static int nn_xpub_getopt (struct nn_sockbase *self, int level, int option,
+    void *optval, size_t *optvallen)
 {
+    struct nn_xpub *xpub;
+
+    xpub = nn_cont (self, struct nn_xpub, sockbase);
+
+    if (level != NN_PUB)
+        return -ENOPROTOOPT;
+
+    if (option == NN_PUB_CONFLATE) {
+        if (nn_slow (*optvallen < sizeof (int)))
+            return -EINVAL;
+        *(int*) optval = xpub->conflate;
+        *optvallen = sizeof (int);
+        return 0;
+    }
+
+    if (option == NN_PUB_CACHE) {
+        if (nn_slow (*optvallen < sizeof (int)))
+            return -EINVAL;
+        *(int*) optval = xpub->cache;
+        *optvallen = sizeof (int);
+        return 0;
+    }
+
     return -ENOPROTOOPT;
 }
 
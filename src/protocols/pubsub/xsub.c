@@ -173,6 +173,7 @@ static int nn_xsub_recv (struct nn_sockbase *self, struct nn_msg *msg)
         if (nn_slow (rc == -EAGAIN))
             return -EAGAIN;
         errnum_assert (rc >= 0, -rc);
+        nn_msg_linearize (msg);
         rc = nn_trie_match (&xsub->trie, nn_chunkref_data (&msg->body),
             nn_chunkref_size (&msg->body));
         if (rc == 0) {
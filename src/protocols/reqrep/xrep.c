@@ -206,6 +206,7 @@ int nn_xrep_recv (struct nn_sockbase *self, struct nn_msg *msg)
     if (!(rc & NN_PIPE_PARSED)) {
 
         /*  Determine the size of the message header. */
+        nn_msg_linearize (msg);
         data = nn_chunkref_data (&msg->body);
         sz = nn_chunkref_size (&msg->body);
         i = 0;
@@ -187,6 +187,7 @@ int nn_xreq_recv (struct nn_sockbase *self, struct nn_msg *msg)
     if (!(rc & NN_PIPE_PARSED)) {
 
         /*  Ignore malformed replies. */
+        nn_msg_pullup (msg, sizeof (uint32_t));
         if (nn_slow (nn_chunkref_size (&msg->body) < sizeof (uint32_t))) {
             nn_msg_term (msg);
             return -EAGAIN;
@@ -171,6 +171,7 @@ int nn_xsurveyor_recv (struct nn_sockbase *self, struct nn_msg *msg)
 
     /*  Split the header from the body, if needed. */
     if (!(rc & NN_PIPE_PARSED)) {
+        nn_msg_pullup (msg, sizeof (uint32_t));
         if (nn_slow (nn_chunkref_size (&msg->body) < sizeof (uint32_t))) {
             nn_msg_term (msg);
             return -EAGAIN;
@@ -0,0 +1,177 @@
+/*
+    Copyright (c) 2012 250bpm s.r.o.  All rights reserved.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom
+    the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included
+    in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+#include "conflate.h"
+
+#include "../../utils/err.h"
+#include "../../utils/cont.h"
+#include "../../utils/fast.h"
+#include "../../utils/alloc.h"
+
+#include <string.h>
+
+struct nn_conflate_entry {
+    struct nn_hash_item hitem;
+    struct nn_list_item item;
+
+    /*  Next entry with the same hash of the topic. */
+    struct nn_conflate_entry *next;
+
+    /*  The topic is stored as the prefix of the message body. */
+    size_t keylen;
+    struct nn_msg msg;
+};
+
+/*  FNV-1a hash of the topic. */
+static uint32_t nn_conflate_hash (const uint8_t *key, size_t keylen)
+{
+    uint32_t h;
+
+    h = 2166136261u;
+    while (keylen--) {
+        h ^= *key++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+void nn_conflate_init (struct nn_conflate *self)
+{
+    nn_hash_init (&self->topics);
+    nn_list_init (&self->queue);
+}
+
+void nn_conflate_term (struct nn_conflate *self)
+{
+    struct nn_msg msg;
+
+    while (nn_conflate_pop (self, &msg) == 0)
+        nn_msg_term (&msg);
+    nn_list_term (&self->queue);
+    nn_hash_term (&self->topics);
+}
+
+int nn_conflate_empty (struct nn_conflate *self)
+{
+    return nn_list_empty (&self->queue);
+}
+
+int nn_conflate_push (struct nn_conflate *self, struct nn_msg *msg,
+    size_t keylen)
+{
+    uint8_t *key;
+    uint32_t hash;
+    struct nn_hash_item *hitem;
+    struct nn_conflate_entry *head;
+    struct nn_conflate_entry *entry;
+
+    nn_msg_pullup (msg, keylen);
+    if (keylen > nn_chunkref_size (&msg->body))
+        keylen = nn_chunkref_size (&msg->body);
+    key = nn_chunkref_data (&msg->body);
+    hash = nn_conflate_hash (key, keylen);
+
+    /*  If there's a message with the same topic, replace it. */
+    hitem = nn_hash_get (&self->topics, hash);
+    head = hitem ? nn_cont (hitem, struct nn_conflate_entry, hitem) : NULL;
+    for (entry = head; entry; entry = entry->next) {
+        if (entry->keylen == keylen &&
+              memcmp (nn_chunkref_data (&entry->msg.body), key, keylen) == 0) {
+            nn_msg_term (&entry->msg);
+            nn_msg_mv (&entry->msg, msg);
+            return 1;
+        }
+    }
+
+    /*  New topic. Hash collisions are rare so it's simply chained behind
+        the entry that's in the hash table already. */
+    entry = nn_alloc (sizeof (struct nn_conflate_entry), "conflated message");
+    alloc_assert (entry);
+    nn_hash_item_init (&entry->hitem);
+    nn_list_item_init (&entry->item);
+    entry->keylen = keylen;
+    nn_msg_mv (&entry->msg, msg);
+    if (head) {
+        entry->next = head->next;
+        head->next = entry;
+    }
+    else {
+        entry->next = NULL;
+        nn_hash_insert (&self->topics, hash, &entry->hitem);
+    }
+    nn_list_insert (&self->queue, &entry->item, nn_list_end (&self->queue));
+
+    return 0;
+}
+
+int nn_conflate_pop (struct nn_conflate *self, struct nn_msg *msg)
+{
+    uint32_t hash;
+    struct nn_hash_item *hitem;
+    struct nn_conflate_entry *entry;
+    struct nn_conflate_entry *prev;
+
+    if (nn_list_empty (&self->queue))
+        return -EAGAIN;
+    entry = nn_cont (nn_list_begin (&self->queue),
+        struct nn_conflate_entry, item);
+    nn_list_erase (&self->queue, &entry->item);
+
+    /*  Unlink the entry from the chain. If it's the one in the hash table
+        the next one in the chain takes its place. */
+    hash = nn_conflate_hash (nn_chunkref_data (&entry->msg.body),
+        entry->keylen);
+    hitem = nn_hash_get (&self->topics, hash);
+    nn_assert (hitem);
+    prev = nn_cont (hitem, struct nn_conflate_entry, hitem);
+    if (prev == entry) {
+        nn_hash_erase (&self->topics, &entry->hitem);
+        if (entry->next)
+            nn_hash_insert (&self->topics, hash, &entry->next->hitem);
+    }
+    else {
+        while (prev->next != entry)
+            prev = prev->next;
+        prev->next = entry->next;
+    }
+
+    nn_msg_mv (msg, &entry->msg);
+    nn_list_item_term (&entry->item);
+    nn_hash_item_term (&entry->hitem);
+    nn_free (entry);
+
+    return 0;
+}
+
+void nn_conflate_cp (struct nn_conflate *self, struct nn_conflate *src)
+{
+    struct nn_list_item *it;
+    struct nn_conflate_entry *entry;
+    struct nn_msg msg;
+
+    for (it = nn_list_begin (&src->queue); it != nn_list_end (&src->queue);
+          it = nn_list_next (&src->queue, it)) {
+        entry = nn_cont (it, struct nn_conflate_entry, item);
+        nn_msg_cp (&msg, &entry->msg);
+        nn_conflate_push (self, &msg, entry->keylen);
+    }
+}
@@ -0,0 +1,69 @@
+/*
+    Copyright (c) 2012 250bpm s.r.o.  All rights reserved.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom
+    the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included
+    in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+#ifndef NN_CONFLATE_INCLUDED
+#define NN_CONFLATE_INCLUDED
+
+#include "../../protocol.h"
+
+#include "../../utils/hash.h"
+#include "../../utils/list.h"
+
+#include <stddef.h>
+
+/*  Holds the newest message per topic, i.e. per first 'keylen' bytes of
+    the message body. Messages are retrieved in the order in which their
+    topics were first stored. To be used for pipes that can't keep up with
+    the message rate where only the latest value of each topic matters. */
+
+struct nn_conflate {
+
+    /*  Messages indexed by hash of the topic. Messages with the same hash
+        are chained to the one in the hash table. */
+    struct nn_hash topics;
+
+    /*  Messages in the order they are to be retrieved. */
+    struct nn_list queue;
+};
+
+void nn_conflate_init (struct nn_conflate *self);
+
+/*  Terminates the object. Messages that weren't retrieved are dropped. */
+void nn_conflate_term (struct nn_conflate *self);
+
+/*  Returns 1 if there are no messages stored. */
+int nn_conflate_empty (struct nn_conflate *self);
+
+/*  Stores the message, taking ownership of it. Topic is made of first
+    'keylen' bytes of the body, or of the whole body if it's shorter.
+    If there's a message with the same topic already it's replaced by
+    the new one and 1 is returned. Otherwise, 0 is returned. */
+int nn_conflate_push (struct nn_conflate *self, struct nn_msg *msg,
+    size_t keylen);
+
+/*  Retrieves the oldest message. Returns -EAGAIN if there are none. */
+int nn_conflate_pop (struct nn_conflate *self, struct nn_msg *msg);
+
+/*  Stores copies of all the messages held by 'src', in their order. */
+void nn_conflate_cp (struct nn_conflate *self, struct nn_conflate *src);
+
+#endif
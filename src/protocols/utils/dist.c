@@ -33,23 +33,26 @@ void nn_dist_init (struct nn_dist *self)
 {
     self->count = 0;
     nn_list_init (&self->pipes);
+    self->total = 0;
 }
 
 void nn_dist_term (struct nn_dist *self)
 {
-    nn_assert (self->count == 0);
+    nn_assert (self->count == 0 && self->total == 0);
     nn_list_term (&self->pipes);
 }
 
-void nn_dist_add (NN_UNUSED struct nn_dist *self,
+void nn_dist_add (struct nn_dist *self,
     struct nn_dist_data *data, struct nn_pipe *pipe)
 {
+    ++self->total;
     data->pipe = pipe;
     nn_list_item_init (&data->item);
 }
 
 void nn_dist_rm (struct nn_dist *self, struct nn_dist_data *data)
 {
+    --self->total;
     if (nn_list_item_isinlist (&data->item)) {
         --self->count;
         nn_list_erase (&self->pipes, &data->item);
@@ -35,8 +35,13 @@ struct nn_dist_data {
 };
 
 struct nn_dist {
+
+    /*  Number of writable pipes, i.e. those in the list. */
     uint32_t count;
     struct nn_list pipes;
+
+    /*  Number of all the attached pipes. */
+    uint32_t total;
 };
 
 void nn_dist_init (struct nn_dist *self);
@@ -35,6 +35,9 @@ extern "C" {
 #define NN_SUB_SUBSCRIBE 1
 #define NN_SUB_UNSUBSCRIBE 2
 
+#define NN_PUB_CONFLATE 1
+#define NN_PUB_CACHE 2
+
 #ifdef __cplusplus
 }
 #endif
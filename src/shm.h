@@ -1,5 +1,5 @@
 /*
-    Copyright (c) 2012-2013 250bpm s.r.o.  All rights reserved.
+    Copyright (c) 2012 250bpm s.r.o.  All rights reserved.
 
     Permission is hereby granted, free of charge, to any person obtaining a copy
     of this software and associated documentation files (the "Software"),
@@ -20,16 +20,20 @@
     IN THE SOFTWARE.
 */
 
-#if defined NN_HAVE_WINDOWS
-#include "../../utils/win.h"
-#else
-#include <sys/socket.h>
+#ifndef SHM_H_INCLUDED
+#define SHM_H_INCLUDED
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NN_SHM -5
+
+#define NN_SHM_BUFSIZE 1
+
+#ifdef __cplusplus
+}
 #endif
 
-struct nn_dns {
-    struct nn_fsm fsm;
-    int state;
-    struct nn_dns_result *result;
-    struct nn_fsm_event done;
-};
+#endif
 
@@ -30,6 +30,17 @@ extern "C" {
 #define NN_TCP -3
 
 #define NN_TCP_NODELAY 1
+#define NN_TCP_SNDBUF 2
+#define NN_TCP_RCVBUF 3
+#define NN_TCP_KEEPALIVE_IDLE 4
+#define NN_TCP_KEEPALIVE_INTVL 5
+#define NN_TCP_KEEPALIVE_CNT 6
+#define NN_TCP_BUSY_POLL 7
+#define NN_TCP_QUICKACK 8
+#define NN_TCP_NOTSENT_LOWAT 9
+#define NN_TCP_USER_TIMEOUT 10
+#define NN_TCP_ACCEPT_IVL 11
+#define NN_TCP_CONNECTIONS 12
 
 #ifdef __cplusplus
 }
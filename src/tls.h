@@ -0,0 +1,53 @@
+/*
+    Copyright (c) 2014 250bpm s.r.o.  All rights reserved.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom
+    the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included
+    in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+#ifndef TLS_H_INCLUDED
+#define TLS_H_INCLUDED
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NN_TLS -6
+
+/*  String options. The value is a path to a PEM file. */
+#define NN_TLS_CA_FILE 1
+#define NN_TLS_CERT_FILE 2
+#define NN_TLS_KEY_FILE 3
+
+/*  Integer option. One of the NN_TLS_AUTH_* values below. */
+#define NN_TLS_AUTH_MODE 4
+
+/*  Peer authentication modes. The default is to require a valid certificate
+    from the server on connecting endpoints and not to ask clients for one
+    on bound endpoints. */
+#define NN_TLS_AUTH_DEFAULT -1
+#define NN_TLS_AUTH_NONE 0
+#define NN_TLS_AUTH_OPTIONAL 1
+#define NN_TLS_AUTH_REQUIRED 2
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
@@ -181,6 +181,7 @@ struct nn_pipebase {
     uint8_t state;
     uint8_t instate;
     uint8_t outstate;
+    uint8_t throttled;
     struct nn_sock *sock;
     void *data;
     struct nn_fsm_event in;
@@ -207,6 +208,11 @@ void nn_pipebase_received (struct nn_pipebase *self);
 /*  Call this function when current outgoing message was fully sent. */
 void nn_pipebase_sent (struct nn_pipebase *self);
 
+/*  Call this function when the pipe is not writable to tell whether it's
+    because the peer haven't granted enough flow control credit yet.
+    The flag is cleared by nn_pipebase_sent. */
+void nn_pipebase_throttle (struct nn_pipebase *self, int throttled);
+
 /*  Retrieve value of a socket option. */
 void nn_pipebase_getopt (struct nn_pipebase *self, int level, int option,
     void *optval, size_t *optvallen);
@@ -215,6 +221,18 @@ void nn_pipebase_getopt (struct nn_pipebase *self, int level, int option,
     or 0 otherwise. */
 int nn_pipebase_ispeer (struct nn_pipebase *self, int socktype);
 
+/*  Returns 1 if the message has outlived its deadline and should be dropped
+    rather than transferred. The drop is accounted for in socket statistics. */
+int nn_pipebase_expired (struct nn_pipebase *self, struct nn_msg *msg);
+
+/*  Returns number of milliseconds left till the deadline of the message,
+    0 if it have already passed or -1 if the message never expires. */
+int nn_pipebase_ttl (struct nn_pipebase *self, struct nn_msg *msg);
+
+/*  Sets the deadline of the message to 'ttl' milliseconds from now. */
+void nn_pipebase_setttl (struct nn_pipebase *self, struct nn_msg *msg,
+    int ttl);
+
 /******************************************************************************/
 /*  The transport class.                                                      */
 /******************************************************************************/
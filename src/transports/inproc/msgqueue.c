@@ -32,8 +32,8 @@ void nn_msgqueue_init (struct nn_msgqueue *self, size_t maxmem)
 {
     struct nn_msgqueue_chunk *chunk;
 
-    self->count = 0;
-    self->mem = 0;
+    nn_atomic_init (&self->count, 0);
+    nn_atomic_init (&self->mem, 0);
     self->maxmem = maxmem;
 
     chunk = nn_alloc (sizeof (struct nn_msgqueue_chunk), "msgqueue chunk");
@@ -44,21 +44,15 @@ void nn_msgqueue_init (struct nn_msgqueue *self, size_t maxmem)
     self->out.pos = 0;
     self->in.chunk = chunk;
     self->in.pos = 0;
-
-    self->cache = NULL;
 }
 
 void nn_msgqueue_term (struct nn_msgqueue *self)
 {
-    int rc;
     struct nn_msg msg;
 
     /*  Deallocate messages in the pipe. */
-    while (1) {
-        rc = nn_msgqueue_recv (self, &msg);
-        if (rc == -EAGAIN)
-            break;
-        errnum_assert (rc >= 0, -rc);
+    while (self->count.n) {
+        nn_msgqueue_recv (self, &msg);
         nn_msg_term (&msg);
     }
 
@@ -67,61 +61,61 @@ void nn_msgqueue_term (struct nn_msgqueue *self)
     nn_assert (self->in.chunk == self->out.chunk);
     nn_free (self->in.chunk);
 
-    /*  Deallocate the cached chunk, if any. */
-    if (self->cache)
-        nn_free (self->cache);
-}
-
-int nn_msgqueue_empty (struct nn_msgqueue *self)
-{
-    return self->count == 0 ? 1 : 0;
+    nn_atomic_term (&self->mem);
+    nn_atomic_term (&self->count);
 }
 
 int nn_msgqueue_send (struct nn_msgqueue *self, struct nn_msg *msg)
 {
+    int rc;
     size_t msgsz;
+    uint32_t oldmem;
+    struct nn_msgqueue_chunk *chunk;
 
-    /*  By allowing one message of arbitrary size to be written to the queue,
-        we allow even messages that exceed max buffer size to pass through.
-        Beyond that we'll apply the buffer limit as specified by the user. */
-    msgsz = nn_chunkref_size (&msg->sphdr) + nn_chunkref_size (&msg->body);
-    if (nn_slow (self->count > 0 && self->mem + msgsz >= self->maxmem))
-        return -EAGAIN;
-
-    /*  Adjust the statistics. */
-    ++self->count;
-    self->mem += msgsz;
+    /*  Account for the memory before the message is published so that reader
+        never subtracts the size before it was added. */
+    msgsz = nn_chunkref_size (&msg->sphdr) + nn_msg_bodysize (msg);
+    oldmem = nn_atomic_inc (&self->mem, (uint32_t) msgsz);
 
     /*  Move the content of the message to the pipe. */
     nn_msg_mv (&self->out.chunk->msgs [self->out.pos], msg);
     ++self->out.pos;
 
-    /*  If there's no space for a new message in the pipe, either re-use
-        the cache chunk or allocate a new chunk if it does not exist. */
+    /*  If there's no space for a new message in the chunk, allocate a new
+        one. It has to be linked before the message is published, otherwise
+        reader could get past the end of the chunk before the link exists. */
     if (nn_slow (self->out.pos == NN_MSGQUEUE_GRANULARITY)) {
-        if (nn_slow (!self->cache)) {
-            self->cache = nn_alloc (sizeof (struct nn_msgqueue_chunk),
-                "msgqueue chunk");
-            alloc_assert (self->cache);
-            self->cache->next = NULL;
-        }
-        self->out.chunk->next = self->cache;
-        self->out.chunk = self->cache;
-        self->cache = NULL;
+        chunk = nn_alloc (sizeof (struct nn_msgqueue_chunk),
+            "msgqueue chunk");
+        alloc_assert (chunk);
+        chunk->next = NULL;
+        self->out.chunk->next = chunk;
+        self->out.chunk = chunk;
         self->out.pos = 0;
     }
 
-    return 0;
+    /*  Publish the message to the reader. Atomic operation acts as a full
+        memory barrier. */
+    rc = 0;
+    if (nn_atomic_inc (&self->count, 1) == 0)
+        rc |= NN_MSGQUEUE_WASEMPTY;
+
+    /*  By allowing one message of arbitrary size to be written to the queue,
+        we allow even messages that exceed max buffer size to pass through.
+        Beyond that we'll apply the buffer limit as specified by the user. */
+    if (nn_slow (oldmem + msgsz >= self->maxmem))
+        rc |= NN_MSGQUEUE_FULL;
+
+    return rc;
 }
 
 int nn_msgqueue_recv (struct nn_msgqueue *self, struct nn_msg *msg)
 {
+    int rc;
+    size_t msgsz;
+    uint32_t oldmem;
     struct nn_msgqueue_chunk *o;
 
-    /*  If there is no message in the queue. */
-    if (nn_slow (!self->count))
-        return -EAGAIN;
-
     /*  Move the message from the pipe to the user. */
     nn_msg_mv (msg, &self->in.chunk->msgs [self->in.pos]);
 
@@ -131,17 +125,17 @@ int nn_msgqueue_recv (struct nn_msgqueue *self, struct nn_msg *msg)
         o = self->in.chunk;
         self->in.chunk = self->in.chunk->next;
         self->in.pos = 0;
-        if (nn_fast (!self->cache))
-            self->cache = o;
-        else
-            nn_free (o);
+        nn_free (o);
     }
 
-    /*  Adjust the statistics. */
-    --self->count;
-    self->mem -= (nn_chunkref_size (&msg->sphdr) +
-        nn_chunkref_size (&msg->body));
+    /*  Adjust the statistics. Only the transitions matter to the caller. */
+    rc = 0;
+    msgsz = nn_chunkref_size (&msg->sphdr) + nn_msg_bodysize (msg);
+    oldmem = nn_atomic_dec (&self->mem, (uint32_t) msgsz);
+    if (nn_slow (oldmem >= self->maxmem && oldmem - msgsz < self->maxmem))
+        rc |= NN_MSGQUEUE_NOTFULL;
+    if (nn_atomic_dec (&self->count, 1) == 1)
+        rc |= NN_MSGQUEUE_EMPTY;
 
-    return 0;
+    return rc;
 }
-
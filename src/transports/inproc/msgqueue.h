@@ -24,14 +24,38 @@
 #define NN_MSGQUEUE_INCLUDED
 
 #include "../../utils/msg.h"
+#include "../../utils/atomic.h"
 
 #include <stddef.h>
 
-/*  This class is a simple uni-directional message queue. */
+/*  This class is a uni-directional message queue with exactly one writer
+    and exactly one reader, each of them possibly running in a different
+    context. Writer and reader never touch the same fields, except for the
+    two atomic counters, so no lock is needed to pass messages through. */
 
 /*  It's not 128 so that chunk including its footer fits into a memory page. */
 #define NN_MSGQUEUE_GRANULARITY 126
 
+/*  Flags returned by nn_msgqueue_send. */
+
+/*  The queue was empty before the message was written. The reader has to be
+    notified that there are messages available. */
+#define NN_MSGQUEUE_WASEMPTY 1
+
+/*  The buffer limit was reached by this message. Writer should not write
+    more messages until the reader reports NN_MSGQUEUE_NOTFULL. */
+#define NN_MSGQUEUE_FULL 2
+
+/*  Flags returned by nn_msgqueue_recv. */
+
+/*  There are no messages left in the queue. Reader has to wait for
+    the writer to report NN_MSGQUEUE_WASEMPTY. */
+#define NN_MSGQUEUE_EMPTY 1
+
+/*  Queue has dropped below the buffer limit. The writer, blocked since
+    it got NN_MSGQUEUE_FULL, has to be notified that it can write again. */
+#define NN_MSGQUEUE_NOTFULL 2
+
 struct nn_msgqueue_chunk {
     struct nn_msg msgs [NN_MSGQUEUE_GRANULARITY];
     struct nn_msgqueue_chunk *next;
@@ -40,47 +64,47 @@ struct nn_msgqueue_chunk {
 struct nn_msgqueue {
 
     /*  Pointer to the position where next message should be written into
-        the message queue. */
+        the message queue. Accessed by the writer only. */
     struct {
         struct nn_msgqueue_chunk *chunk;
         int pos;
     } out;
 
-    /*  Pointer to the first unread message in the message queue. */
+    /*  Pointer to the first unread message in the message queue. Accessed
+        by the reader only. */
     struct {
         struct nn_msgqueue_chunk *chunk;
         int pos;
     } in;
 
-    /*  Number of messages in the queue. */
-    size_t count;
+    /*  Number of messages in the queue. Writer increments it once the message
+        is fully written, thus publishing it to the reader. */
+    struct nn_atomic count;
 
     /*  Amount of memory used by messages in the queue. */
-    size_t mem;
+    struct nn_atomic mem;
 
     /*   Maximal queue size (in bytes). */
     size_t maxmem;
-
-    /*  One empty chunk is always cached so that in case of steady stream
-        of messages through the pipe there are no memory allocations. */
-    struct nn_msgqueue_chunk *cache;
 };
 
 /*  Initialise the message pipe. maxmem is the maximal queue size in bytes. */
 void nn_msgqueue_init (struct nn_msgqueue *self, size_t maxmem);
 
-/*  Terminate the message pipe. */
+/*  Terminate the message pipe. Both writer and reader must be done with
+    the queue at this point. */
 void nn_msgqueue_term (struct nn_msgqueue *self);
 
-/*  Returns 1 if there are no messages in the queue, 0 otherwise. */
-int nn_msgqueue_empty (struct nn_msgqueue *self);
-
-/*  Writes a message to the pipe. -EAGAIN is returned if the message cannot
-    be sent because the queue is full. */
+/*  Writes a message to the pipe. The writer must not call this function
+    after getting NN_MSGQUEUE_FULL until the reader reports that there's
+    space available. Returns a combination of NN_MSGQUEUE_WASEMPTY and
+    NN_MSGQUEUE_FULL. */
 int nn_msgqueue_send (struct nn_msgqueue *self, struct nn_msg *msg);
 
-/*  Reads a message from the pipe. -EAGAIN is returned if there's no message
-    to receive. */
+/*  Reads a message from the pipe. The reader must know that there's
+    a message available, i.e. it was notified about NN_MSGQUEUE_WASEMPTY
+    and haven't got NN_MSGQUEUE_EMPTY since. Returns a combination of
+    NN_MSGQUEUE_EMPTY and NN_MSGQUEUE_NOTFULL. */
 int nn_msgqueue_recv (struct nn_msgqueue *self, struct nn_msg *msg);
 
 #endif
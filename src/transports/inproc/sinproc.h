@@ -60,14 +60,10 @@ struct nn_sinproc {
     struct nn_pipebase pipebase;
 
     /*  Inbound message queue. The messages contained are meant to be received
-        by the user later on. */
+        by the user later on. The peer session writes into it directly from
+        its own context. */
     struct nn_msgqueue msgqueue;
 
-    /*  This message is the one being sent from this session to the peer
-        session. It holds the data only temporarily, until the peer moves
-        it to its msgqueue. */
-    struct nn_msg msg;
-
     /*  Outbound events. I.e. event sent by this sinproc to the peer sinproc. */
     struct nn_fsm_event event_connect;
 
@@ -22,6 +22,7 @@
 
 #include "bipc.h"
 #include "aipc.h"
+#include "ipc.h"
 
 #include "../../aio/fsm.h"
 #include "../../aio/usock.h"
@@ -80,6 +81,9 @@ struct nn_bipc {
 
     /*  Used to wait before retrying to connect. */
     struct nn_backoff retry;
+
+    /*  If set, accepted connections use shared memory. */
+    int shm;
 };
 
 /*  nn_epbase virtual interface implementation. */
@@ -98,12 +102,16 @@ static void nn_bipc_shutdown (struct nn_fsm *self, int src, int type,
 static void nn_bipc_start_listening (struct nn_bipc *self);
 static void nn_bipc_start_accepting (struct nn_bipc *self);
 
-int nn_bipc_create (void *hint, struct nn_epbase **epbase)
+int nn_bipc_create (void *hint, struct nn_epbase **epbase, int shm)
 {
+    int rc;
     struct nn_bipc *self;
     int reconnect_ivl;
     int reconnect_ivl_max;
+    int reconnect_policy;
     size_t sz;
+    struct sockaddr_un un;
+    size_t unlen;
 
     /*  Allocate the new endpoint object. */
     self = nn_alloc (sizeof (struct nn_bipc), "bipc");
@@ -111,6 +119,15 @@ int nn_bipc_create (void *hint, struct nn_epbase **epbase)
 
     /*  Initialise the structure. */
     nn_epbase_init (&self->epbase, &nn_bipc_epbase_vfptr, hint);
+
+    /*  Check whether the address is valid. */
+    rc = nn_ipc_resolve (nn_epbase_getaddr (&self->epbase), &un, &unlen);
+    if (nn_slow (rc < 0)) {
+        nn_epbase_term (&self->epbase);
+        nn_free (self);
+        return rc;
+    }
+
     nn_fsm_init_root (&self->fsm, nn_bipc_handler, nn_bipc_shutdown,
         nn_epbase_getctx (&self->epbase));
     self->state = NN_BIPC_STATE_IDLE;
@@ -124,11 +141,16 @@ int nn_bipc_create (void *hint, struct nn_epbase **epbase)
     nn_assert (sz == sizeof (reconnect_ivl_max));
     if (reconnect_ivl_max == 0)
         reconnect_ivl_max = reconnect_ivl;
+    sz = sizeof (reconnect_policy);
+    nn_epbase_getopt (&self->epbase, NN_SOL_SOCKET, NN_RECONNECT_POLICY,
+        &reconnect_policy, &sz);
+    nn_assert (sz == sizeof (reconnect_policy));
     nn_backoff_init (&self->retry, NN_BIPC_SRC_RECONNECT_TIMER,
-        reconnect_ivl, reconnect_ivl_max, &self->fsm);
+        reconnect_policy, reconnect_ivl, reconnect_ivl_max, &self->fsm);
     nn_usock_init (&self->usock, NN_BIPC_SRC_USOCK, &self->fsm);
     self->aipc = NULL;
     nn_list_init (&self->aipcs);
+    self->shm = shm;
 
     /*  Start the state machine. */
     nn_fsm_start (&self->fsm);
@@ -379,8 +401,8 @@ static void nn_bipc_handler (struct nn_fsm *self, int src, int type,
 static void nn_bipc_start_listening (struct nn_bipc *self)
 {
     int rc;
-    struct sockaddr_storage ss;
-    struct sockaddr_un *un;
+    struct sockaddr_un un;
+    size_t unlen;
     const char *addr;
 #if !defined NN_HAVE_WINDOWS
     int fd;
@@ -389,23 +411,20 @@ static void nn_bipc_start_listening (struct nn_bipc *self)
 
     /*  First, create the AF_UNIX address. */
     addr = nn_epbase_getaddr (&self->epbase);
-    memset (&ss, 0, sizeof (ss));
-    un = (struct sockaddr_un*) &ss;
-    nn_assert (strlen (addr) < sizeof (un->sun_path));
-    ss.ss_family = AF_UNIX;
-    strncpy (un->sun_path, addr, sizeof (un->sun_path));
+    rc = nn_ipc_resolve (addr, &un, &unlen);
+    errnum_assert (rc == 0, -rc);
 
     /*  Delete the IPC file left over by eventual previous runs of
         the application. We'll check whether the file is still in use by
         connecting to the endpoint. On Windows plaform, NamedPipe is used
-        which does not have an underlying file. */
+        which does not have an underlying file. Neither do the addresses
+        in the abstract namespace. */
 #if !defined NN_HAVE_WINDOWS
-    fd = socket (AF_UNIX, SOCK_STREAM, 0);
+    fd = un.sun_path [0] ? socket (AF_UNIX, SOCK_STREAM, 0) : -1;
     if (fd >= 0) {
         rc = fcntl (fd, F_SETFL, O_NONBLOCK);
         errno_assert (rc != -1 || errno == EINVAL);
-        rc = connect (fd, (struct sockaddr*) &ss,
-            sizeof (struct sockaddr_un));
+        rc = connect (fd, (struct sockaddr*) &un, unlen);
         if (rc == -1 && errno == ECONNREFUSED) {
             rc = unlink (addr);
             errno_assert (rc == 0 || errno == ENOENT);
@@ -423,8 +442,7 @@ static void nn_bipc_start_listening (struct nn_bipc *self)
         return;
     }
 
-    rc = nn_usock_bind (&self->usock,
-        (struct sockaddr*) &ss, sizeof (struct sockaddr_un));
+    rc = nn_usock_bind (&self->usock, (struct sockaddr*) &un, unlen);
     if (nn_slow (rc < 0)) {
         nn_usock_stop (&self->usock);
         self->state = NN_BIPC_STATE_CLOSING;
@@ -448,7 +466,8 @@ static void nn_bipc_start_accepting (struct nn_bipc *self)
     /*  Allocate new aipc state machine. */
     self->aipc = nn_alloc (sizeof (struct nn_aipc), "aipc");
     alloc_assert (self->aipc);
-    nn_aipc_init (self->aipc, NN_BIPC_SRC_AIPC, &self->epbase, &self->fsm);
+    nn_aipc_init (self->aipc, NN_BIPC_SRC_AIPC, &self->epbase, self->shm,
+        &self->fsm);
 
     /*  Start waiting for a new incoming connection. */
     nn_aipc_start (self->aipc, &self->usock);
@@ -27,6 +27,7 @@
 
 /*  State machine managing bound IPC socket. */
 
-int nn_bipc_create (void *hint, struct nn_epbase **epbase);
+/*  If 'shm' is set, accepted connections pass messages via shared memory. */
+int nn_bipc_create (void *hint, struct nn_epbase **epbase, int shm);
 
 #endif
@@ -22,6 +22,7 @@
 
 #include "cipc.h"
 #include "sipc.h"
+#include "ipc.h"
 
 #include "../../aio/fsm.h"
 #include "../../aio/usock.h"
@@ -92,12 +93,16 @@ static void nn_cipc_shutdown (struct nn_fsm *self, int src, int type,
     void *srcptr);
 static void nn_cipc_start_connecting (struct nn_cipc *self);
 
-int nn_cipc_create (void *hint, struct nn_epbase **epbase)
+int nn_cipc_create (void *hint, struct nn_epbase **epbase, int shm)
 {
+    int rc;
     struct nn_cipc *self;
     int reconnect_ivl;
     int reconnect_ivl_max;
+    int reconnect_policy;
     size_t sz;
+    struct sockaddr_un un;
+    size_t unlen;
 
     /*  Allocate the new endpoint object. */
     self = nn_alloc (sizeof (struct nn_cipc), "cipc");
@@ -105,6 +110,15 @@ int nn_cipc_create (void *hint, struct nn_epbase **epbase)
 
     /*  Initialise the structure. */
     nn_epbase_init (&self->epbase, &nn_cipc_epbase_vfptr, hint);
+
+    /*  Check whether the address is valid. */
+    rc = nn_ipc_resolve (nn_epbase_getaddr (&self->epbase), &un, &unlen);
+    if (nn_slow (rc < 0)) {
+        nn_epbase_term (&self->epbase);
+        nn_free (self);
+        return rc;
+    }
+
     nn_fsm_init_root (&self->fsm, nn_cipc_handler, nn_cipc_shutdown,
         nn_epbase_getctx (&self->epbase));
     self->state = NN_CIPC_STATE_IDLE;
@@ -119,9 +133,14 @@ int nn_cipc_create (void *hint, struct nn_epbase **epbase)
     nn_assert (sz == sizeof (reconnect_ivl_max));
     if (reconnect_ivl_max == 0)
         reconnect_ivl_max = reconnect_ivl;
+    sz = sizeof (reconnect_policy);
+    nn_epbase_getopt (&self->epbase, NN_SOL_SOCKET, NN_RECONNECT_POLICY,
+        &reconnect_policy, &sz);
+    nn_assert (sz == sizeof (reconnect_policy));
     nn_backoff_init (&self->retry, NN_CIPC_SRC_RECONNECT_TIMER,
-        reconnect_ivl, reconnect_ivl_max, &self->fsm);
-    nn_sipc_init (&self->sipc, NN_CIPC_SRC_SIPC, &self->epbase, &self->fsm);
+        reconnect_policy, reconnect_ivl, reconnect_ivl_max, &self->fsm);
+    nn_sipc_init (&self->sipc, NN_CIPC_SRC_SIPC, &self->epbase,
+        shm ? NN_SIPC_SHM_CONNECT : NN_SIPC_SHM_NONE, &self->fsm);
 
     /*  Start the state machine. */
     nn_fsm_start (&self->fsm);
@@ -237,6 +256,7 @@ static void nn_cipc_handler (struct nn_fsm *self, int src, int type,
                 nn_epbase_stat_increment (&cipc->epbase,
                     NN_STAT_ESTABLISHED_CONNECTIONS, 1);
                 nn_epbase_clear_error (&cipc->epbase);
+                nn_backoff_reset (&cipc->retry);
                 return;
             case NN_USOCK_ERROR:
                 nn_epbase_set_error (&cipc->epbase,
@@ -382,9 +402,8 @@ static void nn_cipc_handler (struct nn_fsm *self, int src, int type,
 static void nn_cipc_start_connecting (struct nn_cipc *self)
 {
     int rc;
-    struct sockaddr_storage ss;
-    struct sockaddr_un *un;
-    const char *addr;
+    struct sockaddr_un un;
+    size_t unlen;
     int val;
     size_t sz;
 
@@ -409,16 +428,11 @@ static void nn_cipc_start_connecting (struct nn_cipc *self)
         &val, sizeof (val));
 
     /*  Create the IPC address from the address string. */
-    addr = nn_epbase_getaddr (&self->epbase);
-    memset (&ss, 0, sizeof (ss));
-    un = (struct sockaddr_un*) &ss;
-    nn_assert (strlen (addr) < sizeof (un->sun_path));
-    ss.ss_family = AF_UNIX;
-    strncpy (un->sun_path, addr, sizeof (un->sun_path));
+    rc = nn_ipc_resolve (nn_epbase_getaddr (&self->epbase), &un, &unlen);
+    errnum_assert (rc == 0, -rc);
 
     /*  Start connecting. */
-    nn_usock_connect (&self->usock, (struct sockaddr*) &ss,
-        sizeof (struct sockaddr_un));
+    nn_usock_connect (&self->usock, (struct sockaddr*) &un, unlen);
     self->state  = NN_CIPC_STATE_CONNECTING;
 
     nn_epbase_stat_increment (&self->epbase,
@@ -27,6 +27,7 @@
 
 /*  State machine managing connected IPC socket. */
 
-int nn_cipc_create (void *hint, struct nn_epbase **epbase);
+/*  If 'shm' is set, the connection passes messages via shared memory. */
+int nn_cipc_create (void *hint, struct nn_epbase **epbase, int shm);
 
 #endif
@@ -31,8 +31,10 @@
 #include "../../utils/alloc.h"
 #include "../../utils/fast.h"
 #include "../../utils/list.h"
+#include "../../utils/cont.h"
 
 #include <string.h>
+#include <stddef.h>
 #if defined NN_HAVE_WINDOWS
 #include "../../utils/win.h"
 #else
@@ -41,9 +43,28 @@
 #include <unistd.h>
 #endif
 
+/*  IPC-specific socket options. */
+
+struct nn_ipc_optset {
+    struct nn_optset base;
+    int peercred;
+};
+
+static void nn_ipc_optset_destroy (struct nn_optset *self);
+static int nn_ipc_optset_setopt (struct nn_optset *self, int option,
+    const void *optval, size_t optvallen);
+static int nn_ipc_optset_getopt (struct nn_optset *self, int option,
+    void *optval, size_t *optvallen);
+static const struct nn_optset_vfptr nn_ipc_optset_vfptr = {
+    nn_ipc_optset_destroy,
+    nn_ipc_optset_setopt,
+    nn_ipc_optset_getopt
+};
+
 /*  nn_transport interface. */
 static int nn_ipc_bind (void *hint, struct nn_epbase **epbase);
 static int nn_ipc_connect (void *hint, struct nn_epbase **epbase);
+static struct nn_optset *nn_ipc_optset (void);
 
 static struct nn_transport nn_ipc_vfptr = {
     "ipc",
@@ -52,7 +73,7 @@ static struct nn_transport nn_ipc_vfptr = {
     NULL,
     nn_ipc_bind,
     nn_ipc_connect,
-    NULL,
+    nn_ipc_optset,
     NN_LIST_ITEM_INITIALIZER
 };
 
@@ -60,11 +81,105 @@ struct nn_transport *nn_ipc = &nn_ipc_vfptr;
 
 static int nn_ipc_bind (void *hint, struct nn_epbase **epbase)
 {
-    return nn_bipc_create (hint, epbase);
+    return nn_bipc_create (hint, epbase, 0);
 }
 
 static int nn_ipc_connect (void *hint, struct nn_epbase **epbase)
 {
-    return nn_cipc_create (hint, epbase);
+    return nn_cipc_create (hint, epbase, 0);
+}
+
+static struct nn_optset *nn_ipc_optset ()
+{
+    struct nn_ipc_optset *optset;
+
+    optset = nn_alloc (sizeof (struct nn_ipc_optset), "optset (ipc)");
+    alloc_assert (optset);
+    optset->base.vfptr = &nn_ipc_optset_vfptr;
+
+    /*  Default values for IPC socket options. */
+    optset->peercred = 0;
+
+    return &optset->base;
 }
 
+static void nn_ipc_optset_destroy (struct nn_optset *self)
+{
+    struct nn_ipc_optset *optset;
+
+    optset = nn_cont (self, struct nn_ipc_optset, base);
+    nn_free (optset);
+}
+
+static int nn_ipc_optset_setopt (struct nn_optset *self, int option,
+    const void *optval, size_t optvallen)
+{
+    struct nn_ipc_optset *optset;
+    int val;
+
+    optset = nn_cont (self, struct nn_ipc_optset, base);
+
+    /*  At this point we assume that all options are of type int. */
+    if (optvallen != sizeof (int))
+        return -EINVAL;
+    val = *(int*) optval;
+
+    switch (option) {
+    case NN_IPC_PEERCRED:
+#if defined SO_PEERCRED
+        optset->peercred = val ? 1 : 0;
+        return 0;
+#else
+        return -ENOPROTOOPT;
+#endif
+    default:
+        return -ENOPROTOOPT;
+    }
+}
+
+static int nn_ipc_optset_getopt (struct nn_optset *self, int option,
+    void *optval, size_t *optvallen)
+{
+    struct nn_ipc_optset *optset;
+    int intval;
+
+    optset = nn_cont (self, struct nn_ipc_optset, base);
+
+    switch (option) {
+    case NN_IPC_PEERCRED:
+        intval = optset->peercred;
+        break;
+    default:
+        return -ENOPROTOOPT;
+    }
+    memcpy (optval, &intval,
+        *optvallen < sizeof (int) ? *optvallen : sizeof (int));
+    *optvallen = sizeof (int);
+    return 0;
+}
+
+int nn_ipc_resolve (const char *addr, struct sockaddr_un *un, size_t *unlen)
+{
+    size_t len;
+
+    len = strlen (addr);
+    if (nn_slow (len >= sizeof (un->sun_path)))
+        return -ENAMETOOLONG;
+    memset (un, 0, sizeof (struct sockaddr_un));
+    un->sun_family = AF_UNIX;
+
+#if defined NN_HAVE_LINUX
+    /*  Abstract namespace address. The leading zero byte replaces the '@'
+        character and the length of the address is significant as the name
+        is not zero-terminated. */
+    if (addr [0] == '@') {
+        memcpy (un->sun_path + 1, addr + 1, len - 1);
+        *unlen = offsetof (struct sockaddr_un, sun_path) + len;
+        return 0;
+    }
+#endif
+
+    memcpy (un->sun_path, addr, len);
+    *unlen = sizeof (struct sockaddr_un);
+    return 0;
+}
@@ -25,6 +25,18 @@
 
 #include "../../transport.h"
 
+#if defined NN_HAVE_WINDOWS
+#include "../../utils/win.h"
+#else
+#include <sys/un.h>
+#endif
+
 extern struct nn_transport *nn_ipc;
 
+/*  Converts the IPC address string into AF_UNIX address. On Linux, addresses
+    starting with '@' live in the abstract namespace and have no file
+    associated with them. Returns -ENAMETOOLONG if the address doesn't fit
+    into the structure. */
+int nn_ipc_resolve (const char *addr, struct sockaddr_un *un, size_t *unlen);
+
 #endif
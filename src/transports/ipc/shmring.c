@@ -0,0 +1,461 @@
+/*
+    Copyright (c) 2013 250bpm s.r.o.  All rights reserved.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom
+    the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included
+    in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+#include "shmring.h"
+
+#include "../../utils/err.h"
+#include "../../utils/fast.h"
+#include "../../utils/wire.h"
+#include "../../utils/random.h"
+#include "../../utils/attr.h"
+
+#include <string.h>
+
+#if defined NN_SHMRING_SUPPORTED
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+/*  Magic number at the beginning of the segment. Used to check that
+    the peer is using compatible segment layout. */
+#define NN_SHMSEG_MAGIC 0x53505348
+
+/*  Length field of the marker record. */
+#define NN_SHMRING_MARKERLEN 0xffffffffffffffffULL
+
+/*  Every record in the ring starts with 64-bit length field and is padded
+    to the multiple of 8 bytes. That way the length field never wraps around
+    the end of the ring. */
+#define NN_SHMRING_ALIGN(sz) (((sz) + 7) & ~((size_t) 7))
+#define NN_SHMRING_HDRSZ 8
+
+struct nn_shmseg_hdr {
+    uint32_t magic;
+    uint32_t reserved;
+    uint64_t ringsz;
+    uint8_t pad [48];
+};
+
+#if defined NN_SHMRING_SUPPORTED
+
+/*  Private functions. */
+static int nn_shmseg_checkname (const char *name, size_t namelen, int pid);
+static void nn_shmseg_setrings (struct nn_shmseg *self, int owner);
+static uint8_t *nn_shmring_data (struct nn_shmring *ring);
+static void nn_shmring_put (struct nn_shmseg *self, uint64_t pos,
+    const void *data, size_t len);
+static void nn_shmring_get (struct nn_shmseg *self, uint64_t pos,
+    void *data, size_t len);
+
+int nn_shmseg_create (struct nn_shmseg *self, size_t ringsz)
+{
+    int rc;
+    int fd;
+    uint8_t rnd [8];
+    struct nn_shmseg_hdr *hdr;
+
+    /*  Ring size has to be a multiple of the record alignment. */
+    ringsz = NN_SHMRING_ALIGN (ringsz);
+    if (nn_slow (ringsz == 0 || ringsz > NN_SHMRING_MAXSZ))
+        return -EINVAL;
+
+    /*  Generate a name that's unlikely to clash with any other segment. */
+    nn_random_generate (rnd, sizeof (rnd));
+    rc = snprintf (self->name, sizeof (self->name), "/nn-%d-%08x%08x",
+        (int) getpid (), (unsigned) nn_getl (rnd), (unsigned) nn_getl (rnd + 4));
+    nn_assert (rc > 0 && rc < (int) sizeof (self->name));
+
+    /*  Create the segment. */
+    fd = shm_open (self->name, O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+    if (nn_slow (fd < 0))
+        return -errno;
+    self->ringsz = ringsz;
+    self->len = sizeof (struct nn_shmseg_hdr) +
+        2 * (sizeof (struct nn_shmring) + ringsz);
+    rc = ftruncate (fd, self->len);
+    if (nn_slow (rc < 0)) {
+        rc = -errno;
+        close (fd);
+        shm_unlink (self->name);
+        return rc;
+    }
+    self->addr = mmap (NULL, self->len, PROT_READ | PROT_WRITE, MAP_SHARED,
+        fd, 0);
+    close (fd);
+    if (nn_slow (self->addr == MAP_FAILED)) {
+        rc = -errno;
+        shm_unlink (self->name);
+        return rc;
+    }
+
+    /*  Newly created segment is zero-filled so the rings are empty. */
+    hdr = (struct nn_shmseg_hdr*) self->addr;
+    hdr->magic = NN_SHMSEG_MAGIC;
+    hdr->ringsz = ringsz;
+    nn_shmseg_setrings (self, 1);
+
+    return 0;
+}
+
+int nn_shmseg_open (struct nn_shmseg *self, const char *name, size_t namelen,
+    int pid)
+{
+    int rc;
+    int fd;
+    struct stat st;
+    struct nn_shmseg_hdr *hdr;
+
+    /*  Don't touch any shared memory object other than the one the peer
+        have created for this connection. */
+    rc = nn_shmseg_checkname (name, namelen, pid);
+    if (nn_slow (rc < 0))
+        return rc;
+    memcpy (self->name, name, namelen);
+    self->name [namelen] = 0;
+
+    fd = shm_open (self->name, O_RDWR, 0);
+    if (nn_slow (fd < 0))
+        return -errno;
+    rc = fstat (fd, &st);
+    if (nn_slow (rc < 0 || (size_t) st.st_size <
+          sizeof (struct nn_shmseg_hdr) + 2 * sizeof (struct nn_shmring) ||
+          (size_t) st.st_size > sizeof (struct nn_shmseg_hdr) +
+          2 * (sizeof (struct nn_shmring) + NN_SHMRING_MAXSZ))) {
+        close (fd);
+        return -EINVAL;
+    }
+    self->len = (size_t) st.st_size;
+    self->addr = mmap (NULL, self->len, PROT_READ | PROT_WRITE, MAP_SHARED,
+        fd, 0);
+    close (fd);
+    if (nn_slow (self->addr == MAP_FAILED))
+        return -errno;
+
+    /*  Check the segment layout before anything is written to it. */
+    hdr = (struct nn_shmseg_hdr*) self->addr;
+    self->ringsz = (size_t) hdr->ringsz;
+    if (nn_slow (hdr->magic != NN_SHMSEG_MAGIC || self->ringsz == 0 ||
+          self->ringsz != NN_SHMRING_ALIGN (self->ringsz) ||
+          self->len != sizeof (struct nn_shmseg_hdr) +
+          2 * (sizeof (struct nn_shmring) + self->ringsz))) {
+        munmap (self->addr, self->len);
+        return -EINVAL;
+    }
+    nn_shmseg_setrings (self, 0);
+
+    return 0;
+}
+
+void nn_shmseg_unlink (struct nn_shmseg *self)
+{
+    if (!self->owner)
+        return;
+    shm_unlink (self->name);
+    self->owner = 0;
+}
+
+void nn_shmseg_close (struct nn_shmseg *self)
+{
+    int rc;
+
+    rc = munmap (self->addr, self->len);
+    errno_assert (rc == 0);
+
+    /*  If the peer haven't got to the segment, remove it. */
+    nn_shmseg_unlink (self);
+}
+
+static int nn_shmseg_checkname (const char *name, size_t namelen, int pid)
+{
+    size_t pos;
+    size_t i;
+    int val;
+
+    /*  The name has the form of "/nn-<pid>-<16 hex digits>". */
+    if (nn_slow (namelen >= NN_SHMRING_NAMELEN || namelen < 4 ||
+          memcmp (name, "/nn-", 4) != 0))
+        return -EINVAL;
+    pos = 4;
+    val = 0;
+    while (pos < namelen && name [pos] >= '0' && name [pos] <= '9' &&
+          pos < 4 + 9) {
+        val = val * 10 + (name [pos] - '0');
+        ++pos;
+    }
+    if (nn_slow (pos == 4 || (pid >= 0 && val != pid)))
+        return -EINVAL;
+    if (nn_slow (namelen != pos + 1 + 16 || name [pos] != '-'))
+        return -EINVAL;
+    for (i = pos + 1; i != namelen; ++i)
+        if (nn_slow (!((name [i] >= '0' && name [i] <= '9') ||
+              (name [i] >= 'a' && name [i] <= 'f'))))
+            return -EINVAL;
+
+    return 0;
+}
+
+static void nn_shmseg_setrings (struct nn_shmseg *self, int owner)
+{
+    struct nn_shmring *first;
+    struct nn_shmring *second;
+
+    first = (struct nn_shmring*) (((uint8_t*) self->addr) +
+        sizeof (struct nn_shmseg_hdr));
+    second = (struct nn_shmring*) (((uint8_t*) (first + 1)) + self->ringsz);
+
+    /*  First ring is used to pass messages from the connecting side
+        to the accepting side, second one in the opposite direction. */
+    self->owner = owner;
+    self->out = owner ? first : second;
+    self->in = owner ? second : first;
+}
+
+int nn_shmring_write (struct nn_shmseg *self, struct nn_msg *msg)
+{
+    uint8_t lenbuf [NN_SHMRING_HDRSZ];
+    size_t hdrsz;
+    size_t bodysz;
+    size_t recsz;
+    size_t pos;
+    uint64_t tail;
+    int i;
+    int iovcnt;
+    struct nn_iovec iov [NN_MSG_MAXPARTS];
+
+    hdrsz = nn_chunkref_size (&msg->sphdr);
+    bodysz = nn_msg_bodysize (msg);
+    recsz = NN_SHMRING_HDRSZ + NN_SHMRING_ALIGN (hdrsz + bodysz);
+    if (nn_slow (recsz > self->ringsz))
+        return -EMSGSIZE;
+
+    /*  Check whether there's enough free space in the ring. */
+    tail = self->out->tail;
+    if (nn_slow (tail + recsz - self->out->head > self->ringsz))
+        return -EAGAIN;
+
+    /*  Write the record. */
+    nn_putll (lenbuf, hdrsz + bodysz);
+    nn_shmring_put (self, tail, lenbuf, sizeof (lenbuf));
+    nn_shmring_put (self, tail + NN_SHMRING_HDRSZ,
+        nn_chunkref_data (&msg->sphdr), hdrsz);
+    pos = tail + NN_SHMRING_HDRSZ + hdrsz;
+    iovcnt = nn_msg_bodyiov (msg, iov);
+    for (i = 0; i != iovcnt; ++i) {
+        nn_shmring_put (self, pos, iov [i].iov_base, iov [i].iov_len);
+        pos += iov [i].iov_len;
+    }
+
+    /*  Publish it to the consumer. */
+    __sync_synchronize ();
+    self->out->tail = tail + recsz;
+
+    return 0;
+}
+
+int nn_shmring_writemarker (struct nn_shmseg *self)
+{
+    uint8_t lenbuf [NN_SHMRING_HDRSZ];
+    uint64_t tail;
+
+    tail = self->out->tail;
+    if (nn_slow (tail + NN_SHMRING_HDRSZ - self->out->head > self->ringsz))
+        return -EAGAIN;
+    nn_putll (lenbuf, NN_SHMRING_MARKERLEN);
+    nn_shmring_put (self, tail, lenbuf, sizeof (lenbuf));
+    __sync_synchronize ();
+    self->out->tail = tail + NN_SHMRING_HDRSZ;
+
+    return 0;
+}
+
+int nn_shmring_peek (struct nn_shmseg *self)
+{
+    uint8_t lenbuf [NN_SHMRING_HDRSZ];
+    uint64_t head;
+    uint64_t avail;
+    uint64_t sz;
+
+    head = self->in->head;
+    avail = self->in->tail - head;
+    if (avail == 0)
+        return NN_SHMRING_EMPTY;
+    __sync_synchronize ();
+
+    /*  The ring is written by the peer. Check that the record is sane
+        before the process relies on it. */
+    if (nn_slow (avail > self->ringsz || avail < NN_SHMRING_HDRSZ))
+        return -EPROTO;
+    nn_shmring_get (self, head, lenbuf, sizeof (lenbuf));
+    sz = nn_getll (lenbuf);
+    if (sz == NN_SHMRING_MARKERLEN)
+        return NN_SHMRING_MARKER;
+    if (nn_slow (sz > self->ringsz - NN_SHMRING_HDRSZ ||
+          NN_SHMRING_HDRSZ + NN_SHMRING_ALIGN ((size_t) sz) > avail))
+        return -EPROTO;
+
+    /*  Remember the size so that the peer can't change it before
+        the message is read. */
+    self->insz = (size_t) sz;
+    return NN_SHMRING_MSG;
+}
+
+void nn_shmring_read (struct nn_shmseg *self, struct nn_msg *msg)
+{
+    uint64_t head;
+
+    /*  Copy the message out of the ring. */
+    head = self->in->head;
+    nn_msg_init (msg, self->insz);
+    nn_shmring_get (self, head + NN_SHMRING_HDRSZ,
+        nn_chunkref_data (&msg->body), self->insz);
+
+    /*  Make sure the data is copied before the space is handed back
+        to the producer. */
+    __sync_synchronize ();
+    self->in->head = head + NN_SHMRING_HDRSZ + NN_SHMRING_ALIGN (self->insz);
+}
+
+void nn_shmring_skip (struct nn_shmseg *self)
+{
+    __sync_synchronize ();
+    self->in->head += NN_SHMRING_HDRSZ;
+}
+
+void nn_shmring_wait (struct nn_shmseg *self, int flag)
+{
+    struct nn_shmring *ring;
+
+    ring = flag == NN_SHMRING_WAITING_DATA ? self->in : self->out;
+    __sync_fetch_and_or (&ring->waiting, (uint32_t) flag);
+}
+
+int nn_shmring_wake (struct nn_shmseg *self, int flag)
+{
+    struct nn_shmring *ring;
+
+    ring = flag == NN_SHMRING_WAITING_DATA ? self->out : self->in;
+    return __sync_fetch_and_and (&ring->waiting, ~((uint32_t) flag)) &
+        flag ? 1 : 0;
+}
+
+static uint8_t *nn_shmring_data (struct nn_shmring *ring)
+{
+    return (uint8_t*) (ring + 1);
+}
+
+static void nn_shmring_put (struct nn_shmseg *self, uint64_t pos,
+    const void *data, size_t len)
+{
+    size_t off;
+    size_t first;
+
+    off = (size_t) (pos % self->ringsz);
+    first = self->ringsz - off < len ? self->ringsz - off : len;
+    memcpy (nn_shmring_data (self->out) + off, data, first);
+    if (nn_slow (first < len))
+        memcpy (nn_shmring_data (self->out),
+            ((const uint8_t*) data) + first, len - first);
+}
+
+static void nn_shmring_get (struct nn_shmseg *self, uint64_t pos,
+    void *data, size_t len)
+{
+    size_t off;
+    size_t first;
+
+    off = (size_t) (pos % self->ringsz);
+    first = self->ringsz - off < len ? self->ringsz - off : len;
+    memcpy (data, nn_shmring_data (self->in) + off, first);
+    if (nn_slow (first < len))
+        memcpy (((uint8_t*) data) + first, nn_shmring_data (self->in),
+            len - first);
+}
+
+#else
+
+int nn_shmseg_create (NN_UNUSED struct nn_shmseg *self,
+    NN_UNUSED size_t ringsz)
+{
+    return -EPROTONOSUPPORT;
+}
+
+int nn_shmseg_open (NN_UNUSED struct nn_shmseg *self,
+    NN_UNUSED const char *name, NN_UNUSED size_t namelen, NN_UNUSED int pid)
+{
+    return -EPROTONOSUPPORT;
+}
+
+void nn_shmseg_unlink (NN_UNUSED struct nn_shmseg *self)
+{
+    nn_assert (0);
+}
+
+void nn_shmseg_close (NN_UNUSED struct nn_shmseg *self)
+{
+    nn_assert (0);
+}
+
+int nn_shmring_write (NN_UNUSED struct nn_shmseg *self,
+    NN_UNUSED struct nn_msg *msg)
+{
+    nn_assert (0);
+    return -EPROTONOSUPPORT;
+}
+
+int nn_shmring_writemarker (NN_UNUSED struct nn_shmseg *self)
+{
+    nn_assert (0);
+    return -EPROTONOSUPPORT;
+}
+
+int nn_shmring_peek (NN_UNUSED struct nn_shmseg *self)
+{
+    nn_assert (0);
+    return -EPROTONOSUPPORT;
+}
+
+void nn_shmring_read (NN_UNUSED struct nn_shmseg *self,
+    NN_UNUSED struct nn_msg *msg)
+{
+    nn_assert (0);
+}
+
+void nn_shmring_skip (NN_UNUSED struct nn_shmseg *self)
+{
+    nn_assert (0);
+}
+
+void nn_shmring_wait (NN_UNUSED struct nn_shmseg *self, NN_UNUSED int flag)
+{
+    nn_assert (0);
+}
+
+int nn_shmring_wake (NN_UNUSED struct nn_shmseg *self, NN_UNUSED int flag)
+{
+    nn_assert (0);
+    return -EPROTONOSUPPORT;
+}
+
+#endif
@@ -0,0 +1,158 @@
+/*
+    Copyright (c) 2013 250bpm s.r.o.  All rights reserved.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom
+    the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included
+    in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+#ifndef NN_SHMRING_INCLUDED
+#define NN_SHMRING_INCLUDED
+
+#include "../../utils/msg.h"
+#include "../../utils/int.h"
+
+#include <stddef.h>
+
+/*  Shared memory segment consisting of two single-producer/single-consumer
+    byte rings, one for each direction of the IPC connection. The segment is
+    created by the connecting side and mapped by the accepting side. Both
+    sides use the rings without any locking, only notifications about state
+    changes (see NN_SHMRING_WAITING_* flags) are passed via the IPC socket.
+
+    Messages are copied into the ring by the producer and out of it by the
+    consumer. Handing out chunks that point into the ring would save the
+    second copy, but the space would then stay in use for as long as the user
+    holds the message, letting a slow consumer stall the producer, and
+    records that wrap around the end of the ring are not contiguous anyway.
+    Both copies are done in user space without any system calls. */
+
+/*  Shared memory can be used only if the atomic operations work across
+    processes, i.e. they are not emulated by a process-local mutex. */
+#if defined NN_HAVE_SHM_OPEN && defined NN_HAVE_GCC_ATOMIC_BUILTINS
+#define NN_SHMRING_SUPPORTED
+#endif
+
+/*  Maximal length of the segment name, including the terminating zero. */
+#define NN_SHMRING_NAMELEN 32
+
+/*  Consumer waits for data to arrive. */
+#define NN_SHMRING_WAITING_DATA 1
+
+/*  Producer waits for space to become available. */
+#define NN_SHMRING_WAITING_SPACE 2
+
+/*  Possible results of nn_shmring_peek. */
+#define NN_SHMRING_EMPTY 0
+#define NN_SHMRING_MSG 1
+#define NN_SHMRING_MARKER 2
+
+/*  Maximal size of a single ring. */
+#define NN_SHMRING_MAXSZ 0x7ffffff8
+
+/*  Header of a single ring. Producer and consumer positions are placed in
+    separate cache lines so that the two sides don't contend for them. */
+struct nn_shmring {
+
+    /*  Number of bytes read from the ring so far. Written by the consumer
+        only. */
+    volatile uint64_t head;
+    uint8_t pad1 [56];
+
+    /*  Number of bytes written to the ring so far. Written by the producer
+        only. */
+    volatile uint64_t tail;
+    uint8_t pad2 [56];
+
+    /*  Combination of NN_SHMRING_WAITING_* flags. */
+    volatile uint32_t waiting;
+    uint8_t pad3 [60];
+
+    /*  The header is followed by the ring buffer itself. */
+};
+
+struct nn_shmseg {
+
+    /*  Name of the segment as passed to the peer. */
+    char name [NN_SHMRING_NAMELEN];
+
+    /*  The whole memory mapped segment. */
+    void *addr;
+    size_t len;
+
+    /*  Size of the data part of a single ring. */
+    size_t ringsz;
+
+    /*  Rings used to receive and send messages respectively. */
+    struct nn_shmring *in;
+    struct nn_shmring *out;
+
+    /*  Size of the inbound message found by the last nn_shmring_peek. */
+    size_t insz;
+
+    /*  1 if the segment was created by this object and its name wasn't
+        removed yet. */
+    int owner;
+};
+
+/*  Creates a new segment with rings of 'ringsz' bytes each. To be used by
+    the connecting side of the connection. */
+int nn_shmseg_create (struct nn_shmseg *self, size_t ringsz);
+
+/*  Maps an existing segment created by the peer. As the name comes from
+    the peer, only names generated by nn_shmseg_create in process 'pid'
+    (any process if -1) are accepted and the segment layout is checked
+    before the segment is used. The name is left for the creator to remove. */
+int nn_shmseg_open (struct nn_shmseg *self, const char *name, size_t namelen,
+    int pid);
+
+/*  Removes the name of the segment created by this object once the peer have
+    mapped it, or refused to. Afterwards the segment is deallocated as soon
+    as both sides unmap it. */
+void nn_shmseg_unlink (struct nn_shmseg *self);
+
+/*  Unmaps the segment. Removes its name if it's still there. */
+void nn_shmseg_close (struct nn_shmseg *self);
+
+/*  Producer side of the outbound ring. Write returns -EAGAIN if there's
+    not enough space in the ring at the moment and -EMSGSIZE if the message
+    would never fit into the ring. Marker tells the consumer that the next
+    message is passed via the IPC socket rather than via the ring. */
+int nn_shmring_write (struct nn_shmseg *self, struct nn_msg *msg);
+int nn_shmring_writemarker (struct nn_shmseg *self);
+
+/*  Consumer side of the inbound ring. Peek returns one of NN_SHMRING_EMPTY,
+    NN_SHMRING_MSG and NN_SHMRING_MARKER constants, or -EPROTO if the peer
+    have corrupted the ring. Read can be used to get the message once peek
+    have returned NN_SHMRING_MSG. Skip removes the marker from the ring. */
+int nn_shmring_peek (struct nn_shmseg *self);
+void nn_shmring_read (struct nn_shmseg *self, struct nn_msg *msg);
+void nn_shmring_skip (struct nn_shmseg *self);
+
+/*  Announce that this side is going to wait for the specified condition,
+    one of the NN_SHMRING_WAITING_* flags. Consumer waits on the inbound
+    ring, producer on the outbound ring. The condition has to be re-checked
+    after this call to avoid the race with the peer. */
+void nn_shmring_wait (struct nn_shmseg *self, int flag);
+
+/*  Clears the flag the peer may be waiting on. Returns 1 if the peer was
+    waiting, i.e. it has to be notified, 0 otherwise. Producer clears
+    NN_SHMRING_WAITING_DATA on the outbound ring, consumer clears
+    NN_SHMRING_WAITING_SPACE on the inbound ring. */
+int nn_shmring_wake (struct nn_shmseg *self, int flag);
+
+#endif
@@ -22,6 +22,9 @@
 
 #include "sipc.h"
 
+#include "../../shm.h"
+#include "../../ipc.h"
+
 #include "../../utils/err.h"
 #include "../../utils/cont.h"
 #include "../../utils/fast.h"
@@ -29,9 +32,20 @@
 #include "../../utils/int.h"
 #include "../../utils/attr.h"
 
-/*  Types of messages passed via IPC transport. */
+#include <string.h>
+#if !defined NN_HAVE_WINDOWS
+#include <sys/socket.h>
+#endif
+
+/*  Types of messages passed via IPC transport. SHMEM carries the name of
+    the shared memory segment, or nothing if the segment couldn't be created.
+    SHMACK is the reply to it, 1 if the segment was mapped and is to be used,
+    0 otherwise. DOORBELL carries NN_SHMRING_WAITING_* flags the peer was
+    waiting for. */
 #define NN_SIPC_MSG_NORMAL 1
 #define NN_SIPC_MSG_SHMEM 2
+#define NN_SIPC_MSG_DOORBELL 3
+#define NN_SIPC_MSG_SHMACK 4
 
 /*  States of the object as a whole. */
 #define NN_SIPC_STATE_IDLE 1
@@ -41,6 +55,7 @@
 #define NN_SIPC_STATE_SHUTTING_DOWN 5
 #define NN_SIPC_STATE_DONE 6
 #define NN_SIPC_STATE_STOPPING 7
+#define NN_SIPC_STATE_SHMSETUP 8
 
 /*  Subordinated srcptr objects. */
 #define NN_SIPC_SRC_USOCK 1
@@ -50,11 +65,38 @@
 #define NN_SIPC_INSTATE_HDR 1
 #define NN_SIPC_INSTATE_BODY 2
 #define NN_SIPC_INSTATE_HASMSG 3
+#define NN_SIPC_INSTATE_SHMNAME 4
 
 /*  Possible states of the outbound part of the object. */
 #define NN_SIPC_OUTSTATE_IDLE 1
 #define NN_SIPC_OUTSTATE_SENDING 2
 
+/*  Shared memory segment is used to pass the messages. */
+#define NN_SIPC_SHMFLAG_ACTIVE 1
+
+/*  Control message is being sent via the socket. */
+#define NN_SIPC_SHMFLAG_CTLSENDING 2
+
+/*  Outbound message too large for the ring is being sent via the socket. */
+#define NN_SIPC_SHMFLAG_MSGSENDING 4
+
+/*  Outbound message too large for the ring waits for the socket to become
+    available. The marker was already written to the ring. */
+#define NN_SIPC_SHMFLAG_MSGPENDING 8
+
+/*  Outbound message waits for the peer to free some space in the ring. */
+#define NN_SIPC_SHMFLAG_SPACEPENDING 16
+
+/*  Marker was read from the ring. Next inbound message arrives via the
+    socket. */
+#define NN_SIPC_SHMFLAG_MARKER 32
+
+/*  The pipe was notified that there's a message to receive. */
+#define NN_SIPC_SHMFLAG_READABLE 64
+
+/*  Shared memory segment is mapped, though it may not be in use yet. */
+#define NN_SIPC_SHMFLAG_MAPPED 128
+
 /*  Stream is a special type of pipe. Implementation of the virtual pipe API. */
 static int nn_sipc_send (struct nn_pipebase *self, struct nn_msg *msg);
 static int nn_sipc_recv (struct nn_pipebase *self, struct nn_msg *msg);
@@ -68,10 +110,29 @@ static void nn_sipc_handler (struct nn_fsm *self, int src, int type,
     void *srcptr);
 static void nn_sipc_shutdown (struct nn_fsm *self, int src, int type,
     void *srcptr);
+static int nn_sipc_start_pipe (struct nn_sipc *self);
+static void nn_sipc_start_receiving (struct nn_sipc *self);
+static int nn_sipc_process_hdr (struct nn_sipc *self);
+static void nn_sipc_received (struct nn_sipc *self);
+static void nn_sipc_start_outmsg (struct nn_sipc *self);
+static void nn_sipc_send_next (struct nn_sipc *self);
+static void nn_sipc_send_outmsg (struct nn_sipc *self);
+static int nn_sipc_shm_create (struct nn_sipc *self);
+static int nn_sipc_shm_open (struct nn_sipc *self);
+static void nn_sipc_shm_send_ack (struct nn_sipc *self, int ok);
+static void nn_sipc_shm_push (struct nn_sipc *self);
+static void nn_sipc_shm_pull (struct nn_sipc *self);
+static void nn_sipc_shm_notify (struct nn_sipc *self, int doorbell);
+static void nn_sipc_shm_send_ctl (struct nn_sipc *self);
+static void nn_sipc_get_peercred (struct nn_sipc *self);
+static void nn_sipc_attach_peercred (struct nn_sipc *self, struct nn_msg *msg);
 
 void nn_sipc_init (struct nn_sipc *self, int src,
-    struct nn_epbase *epbase, struct nn_fsm *owner)
+    struct nn_epbase *epbase, int shmmode, struct nn_fsm *owner)
 {
+    int sndbuf;
+    size_t sz;
+
     nn_fsm_init (&self->fsm, nn_sipc_handler, nn_sipc_shutdown,
         src, self, owner);
     self->state = NN_SIPC_STATE_IDLE;
@@ -84,6 +145,16 @@ void nn_sipc_init (struct nn_sipc *self, int src,
     nn_msg_init (&self->inmsg, 0);
     self->outstate = -1;
     nn_msg_init (&self->outmsg, 0);
+    sz = sizeof (sndbuf);
+    nn_pipebase_getopt (&self->pipebase, NN_SOL_SOCKET, NN_SNDBUF,
+        &sndbuf, &sz);
+    nn_assert (sz == sizeof (sndbuf));
+    nn_sndq_init (&self->sndq, (size_t) sndbuf);
+    self->outblocked = 0;
+    self->shmmode = shmmode;
+    self->shmflags = 0;
+    self->doorbells = 0;
+    nn_chunkref_init (&self->peercred, 0);
     nn_fsm_event_init (&self->done);
 }
 
@@ -92,6 +163,8 @@ void nn_sipc_term (struct nn_sipc *self)
     nn_assert_state (self, NN_SIPC_STATE_IDLE);
 
     nn_fsm_event_term (&self->done);
+    nn_chunkref_term (&self->peercred);
+    nn_sndq_term (&self->sndq);
     nn_msg_term (&self->outmsg);
     nn_msg_term (&self->inmsg);
     nn_pipebase_term (&self->pipebase);
@@ -112,6 +185,9 @@ void nn_sipc_start (struct nn_sipc *self, struct nn_usock *usock)
     self->usock_owner.fsm = &self->fsm;
     nn_usock_swap_owner (usock, &self->usock_owner);
     self->usock = usock;
+    self->shmflags = 0;
+    self->doorbells = 0;
+    nn_sipc_get_peercred (self);
 
     /*  Launch the state machine. */
     nn_fsm_start (&self->fsm);
@@ -125,52 +201,83 @@ void nn_sipc_stop (struct nn_sipc *self)
 static int nn_sipc_send (struct nn_pipebase *self, struct nn_msg *msg)
 {
     struct nn_sipc *sipc;
-    struct nn_iovec iov [3];
 
     sipc = nn_cont (self, struct nn_sipc, pipebase);
 
     nn_assert_state (sipc, NN_SIPC_STATE_ACTIVE);
-    nn_assert (sipc->outstate == NN_SIPC_OUTSTATE_IDLE);
-
-    /*  Move the message to the local storage. */
-    nn_msg_term (&sipc->outmsg);
-    nn_msg_mv (&sipc->outmsg, msg);
-
-    /*  Serialise the message header. */
-    sipc->outhdr [0] = NN_SIPC_MSG_NORMAL;
-    nn_putll (sipc->outhdr + 1, nn_chunkref_size (&sipc->outmsg.sphdr) +
-        nn_chunkref_size (&sipc->outmsg.body));
-
-    /*  Start async sending. */
-    iov [0].iov_base = sipc->outhdr;
-    iov [0].iov_len = sizeof (sipc->outhdr);
-    iov [1].iov_base = nn_chunkref_data (&sipc->outmsg.sphdr);
-    iov [1].iov_len = nn_chunkref_size (&sipc->outmsg.sphdr);
-    iov [2].iov_base = nn_chunkref_data (&sipc->outmsg.body);
-    iov [2].iov_len = nn_chunkref_size (&sipc->outmsg.body);
-    nn_usock_send (sipc->usock, iov, 3);
+    nn_assert (!sipc->outblocked);
+
+    /*  If there's a message being sent already, queue the new one. */
+    if (sipc->outstate == NN_SIPC_OUTSTATE_SENDING)
+        nn_sndq_push (&sipc->sndq, msg);
+    else {
+        nn_msg_term (&sipc->outmsg);
+        nn_msg_mv (&sipc->outmsg, msg);
+        nn_sipc_start_outmsg (sipc);
+    }
 
-    sipc->outstate = NN_SIPC_OUTSTATE_SENDING;
+    /*  The pipe remains writable until the queue is full. */
+    if (nn_slow (nn_sndq_full (&sipc->sndq)))
+        sipc->outblocked = 1;
+    else
+        nn_pipebase_sent (&sipc->pipebase);
 
     return 0;
 }
 
 static int nn_sipc_recv (struct nn_pipebase *self, struct nn_msg *msg)
 {
+    int rc;
     struct nn_sipc *sipc;
 
     sipc = nn_cont (self, struct nn_sipc, pipebase);
 
     nn_assert_state (sipc, NN_SIPC_STATE_ACTIVE);
+
+    if (sipc->shmflags & NN_SIPC_SHMFLAG_ACTIVE) {
+        nn_assert (sipc->shmflags & NN_SIPC_SHMFLAG_READABLE);
+        sipc->shmflags &= ~NN_SIPC_SHMFLAG_READABLE;
+
+        /*  Take the message from the ring unless it was passed via
+            the socket. */
+        if (!(sipc->shmflags & NN_SIPC_SHMFLAG_MARKER)) {
+            nn_shmring_read (&sipc->shmseg, msg);
+            nn_sipc_attach_peercred (sipc, msg);
+            nn_sipc_shm_notify (sipc, NN_SHMRING_WAITING_SPACE);
+            nn_sipc_shm_pull (sipc);
+            return 0;
+        }
+        sipc->shmflags &= ~NN_SIPC_SHMFLAG_MARKER;
+    }
+
     nn_assert (sipc->instate == NN_SIPC_INSTATE_HASMSG);
 
     /*  Move received message to the user. */
     nn_msg_mv (msg, &sipc->inmsg);
     nn_msg_init (&sipc->inmsg, 0);
+    nn_sipc_attach_peercred (sipc, msg);
 
-    /*  Start receiving new message. */
+    /*  There may be more messages waiting in the ring. */
     sipc->instate = NN_SIPC_INSTATE_HDR;
-    nn_usock_recv (sipc->usock, sipc->inhdr, sizeof (sipc->inhdr));
+    if (sipc->shmflags & NN_SIPC_SHMFLAG_ACTIVE) {
+        nn_usock_recv (sipc->usock, sipc->inhdr, sizeof (sipc->inhdr));
+        nn_sipc_shm_pull (sipc);
+        return 0;
+    }
+
+    /*  Start receiving new message. If the whole message was already read
+        from the socket, it is made available straight away, without
+        a round-trip through the state machine. */
+    if (!nn_usock_recv_buffered (sipc->usock, sipc->inhdr,
+          sizeof (sipc->inhdr))) {
+        nn_usock_recv (sipc->usock, sipc->inhdr, sizeof (sipc->inhdr));
+        return 0;
+    }
+    rc = nn_sipc_process_hdr (sipc);
+    if (nn_slow (rc < 0)) {
+        sipc->state = NN_SIPC_STATE_DONE;
+        nn_fsm_raise (&sipc->fsm, &sipc->done, NN_SIPC_ERROR);
+    }
 
     return 0;
 }
@@ -185,10 +292,18 @@ static void nn_sipc_shutdown (struct nn_fsm *self, int src, int type,
     if (nn_slow (src == NN_FSM_ACTION && type == NN_FSM_STOP)) {
         nn_pipebase_stop (&sipc->pipebase);
         nn_streamhdr_stop (&sipc->streamhdr);
+
+        /*  The object may be reused for a new connection. Messages queued
+            for this one must not be sent there. */
+        nn_sndq_clear (&sipc->sndq);
         sipc->state = NN_SIPC_STATE_STOPPING;
     }
     if (nn_slow (sipc->state == NN_SIPC_STATE_STOPPING)) {
         if (nn_streamhdr_isidle (&sipc->streamhdr)) {
+            if (sipc->shmflags & NN_SIPC_SHMFLAG_MAPPED) {
+                nn_shmseg_close (&sipc->shmseg);
+                sipc->shmflags = 0;
+            }
             nn_usock_swap_owner (sipc->usock, &sipc->usock_owner);
             sipc->usock = NULL;
             sipc->usock_owner.src = -1;
@@ -209,6 +324,7 @@ static void nn_sipc_handler (struct nn_fsm *self, int src, int type,
     int rc;
     struct nn_sipc *sipc;
     uint64_t size;
+    uint64_t doorbells;
 
     sipc = nn_cont (self, struct nn_sipc, fsm);
 
@@ -225,7 +341,8 @@ static void nn_sipc_handler (struct nn_fsm *self, int src, int type,
             switch (type) {
             case NN_FSM_START:
                 nn_streamhdr_start (&sipc->streamhdr, sipc->usock,
-                    &sipc->pipebase);
+                    &sipc->pipebase, sipc->shmmode == NN_SIPC_SHM_NONE ?
+                    0 : NN_STREAMHDR_SHM);
                 sipc->state = NN_SIPC_STATE_PROTOHDR;
                 return;
             default:
@@ -278,24 +395,153 @@ static void nn_sipc_handler (struct nn_fsm *self, int src, int type,
             switch (type) {
             case NN_STREAMHDR_STOPPED:
 
-                 /*  Start the pipe. */
-                 rc = nn_pipebase_start (&sipc->pipebase);
-                 if (nn_slow (rc < 0)) {
+                /*  If both peers use shared memory, accepting side has to
+                    wait for the peer to pass it the shared memory segment
+                    before the pipe can be used. Connecting side creates
+                    the segment, passes its name to the peer and waits for
+                    the peer to confirm it has mapped it. Otherwise,
+                    messages are passed via the socket. */
+                if ((sipc->streamhdr.features & NN_STREAMHDR_SHM) &&
+                      (sipc->shmmode == NN_SIPC_SHM_ACCEPT ||
+                      nn_sipc_shm_create (sipc) == 0)) {
+                    sipc->instate = NN_SIPC_INSTATE_HDR;
+                    nn_usock_recv (sipc->usock, &sipc->inhdr,
+                        sizeof (sipc->inhdr));
+                    sipc->state = NN_SIPC_STATE_SHMSETUP;
+                    return;
+                }
+
+                rc = nn_sipc_start_pipe (sipc);
+                if (nn_slow (rc < 0)) {
                     sipc->state = NN_SIPC_STATE_DONE;
                     nn_fsm_raise (&sipc->fsm, &sipc->done, NN_SIPC_ERROR);
                     return;
-                 }
+                }
+                nn_sipc_start_receiving (sipc);
+                return;
 
-                 /*  Start receiving a message in asynchronous manner. */
-                 sipc->instate = NN_SIPC_INSTATE_HDR;
-                 nn_usock_recv (sipc->usock, &sipc->inhdr,
-                     sizeof (sipc->inhdr));
+            default:
+                nn_fsm_bad_action (sipc->state, src, type);
+            }
 
-                 /*  Mark the pipe as available for sending. */
-                 sipc->outstate = NN_SIPC_OUTSTATE_IDLE;
+        default:
+            nn_fsm_bad_source (sipc->state, src, type);
+        }
 
-                 sipc->state = NN_SIPC_STATE_ACTIVE;
-                 return;
+/******************************************************************************/
+/*  SHMSETUP state.                                                           */
+/*  Accepting side is waiting for the name of the shared memory segment,      */
+/*  connecting side is waiting for the peer to confirm it has mapped it.      */
+/******************************************************************************/
+    case NN_SIPC_STATE_SHMSETUP:
+        switch (src) {
+
+        case NN_SIPC_SRC_USOCK:
+            switch (type) {
+            case NN_USOCK_SENT:
+
+                /*  The name of the segment was passed to the peer. */
+                nn_assert (sipc->shmflags & NN_SIPC_SHMFLAG_CTLSENDING);
+                sipc->shmflags &= ~NN_SIPC_SHMFLAG_CTLSENDING;
+                return;
+
+            case NN_USOCK_RECEIVED:
+
+                /*  Whatever the peer's answer is, the name of the segment
+                    is not needed anymore. If the peer couldn't map the
+                    segment, e.g. because it runs under a different user,
+                    the messages are passed via the socket. */
+                if (sipc->shmmode == NN_SIPC_SHM_CONNECT) {
+                    if (nn_slow (sipc->inhdr [0] != NN_SIPC_MSG_SHMACK)) {
+                        sipc->state = NN_SIPC_STATE_DONE;
+                        nn_fsm_raise (&sipc->fsm, &sipc->done,
+                            NN_SIPC_ERROR);
+                        return;
+                    }
+                    nn_shmseg_unlink (&sipc->shmseg);
+                    if (nn_getll (sipc->inhdr + 1))
+                        sipc->shmflags |= NN_SIPC_SHMFLAG_ACTIVE;
+                    else {
+                        nn_shmseg_close (&sipc->shmseg);
+                        sipc->shmflags &= ~NN_SIPC_SHMFLAG_MAPPED;
+                    }
+                    rc = nn_sipc_start_pipe (sipc);
+                    if (nn_slow (rc < 0)) {
+                        sipc->state = NN_SIPC_STATE_DONE;
+                        nn_fsm_raise (&sipc->fsm, &sipc->done,
+                            NN_SIPC_ERROR);
+                        return;
+                    }
+                    nn_sipc_start_receiving (sipc);
+                    return;
+                }
+
+                switch (sipc->instate) {
+                case NN_SIPC_INSTATE_HDR:
+                    size = nn_getll (sipc->inhdr + 1);
+                    if (nn_slow (sipc->inhdr [0] != NN_SIPC_MSG_SHMEM ||
+                          size >= NN_SHMRING_NAMELEN)) {
+                        sipc->state = NN_SIPC_STATE_DONE;
+                        nn_fsm_raise (&sipc->fsm, &sipc->done,
+                            NN_SIPC_ERROR);
+                        return;
+                    }
+
+                    /*  The peer couldn't create the segment. */
+                    if (size == 0) {
+                        rc = nn_sipc_start_pipe (sipc);
+                        if (nn_slow (rc < 0)) {
+                            sipc->state = NN_SIPC_STATE_DONE;
+                            nn_fsm_raise (&sipc->fsm, &sipc->done,
+                                NN_SIPC_ERROR);
+                            return;
+                        }
+                        nn_sipc_start_receiving (sipc);
+                        return;
+                    }
+
+                    /*  Receive the name of the segment. */
+                    nn_msg_term (&sipc->inmsg);
+                    nn_msg_init (&sipc->inmsg, (size_t) size);
+                    sipc->instate = NN_SIPC_INSTATE_SHMNAME;
+                    nn_usock_recv (sipc->usock,
+                        nn_chunkref_data (&sipc->inmsg.body), (size_t) size);
+                    return;
+
+                case NN_SIPC_INSTATE_SHMNAME:
+
+                    /*  Map the segment and tell the peer whether it's going
+                        to be used. If it can't be mapped, messages are
+                        passed via the socket. */
+                    rc = nn_sipc_shm_open (sipc);
+                    nn_msg_term (&sipc->inmsg);
+                    nn_msg_init (&sipc->inmsg, 0);
+                    if (nn_fast (rc == 0))
+                        sipc->shmflags |= NN_SIPC_SHMFLAG_ACTIVE |
+                            NN_SIPC_SHMFLAG_MAPPED;
+                    nn_sipc_shm_send_ack (sipc, rc == 0);
+                    rc = nn_sipc_start_pipe (sipc);
+                    if (nn_slow (rc < 0)) {
+                        sipc->state = NN_SIPC_STATE_DONE;
+                        nn_fsm_raise (&sipc->fsm, &sipc->done,
+                            NN_SIPC_ERROR);
+                        return;
+                    }
+                    nn_sipc_start_receiving (sipc);
+                    return;
+
+                default:
+                    nn_assert (0);
+                }
+
+            case NN_USOCK_SHUTDOWN:
+                sipc->state = NN_SIPC_STATE_SHUTTING_DOWN;
+                return;
+
+            case NN_USOCK_ERROR:
+                sipc->state = NN_SIPC_STATE_DONE;
+                nn_fsm_raise (&sipc->fsm, &sipc->done, NN_SIPC_ERROR);
+                return;
 
             default:
                 nn_fsm_bad_action (sipc->state, src, type);
@@ -315,12 +561,27 @@ static void nn_sipc_handler (struct nn_fsm *self, int src, int type,
             switch (type) {
             case NN_USOCK_SENT:
 
+                /*  Control message was sent. Continue with whatever
+                    waits for the socket. */
+                if (sipc->shmflags & NN_SIPC_SHMFLAG_CTLSENDING) {
+                    sipc->shmflags &= ~NN_SIPC_SHMFLAG_CTLSENDING;
+                    if (sipc->shmflags & NN_SIPC_SHMFLAG_MSGPENDING) {
+                        sipc->shmflags &= ~NN_SIPC_SHMFLAG_MSGPENDING;
+                        nn_sipc_send_outmsg (sipc);
+                        return;
+                    }
+                    nn_sipc_shm_send_ctl (sipc);
+                    return;
+                }
+
                 /*  The message is now fully sent. */
                 nn_assert (sipc->outstate == NN_SIPC_OUTSTATE_SENDING);
                 sipc->outstate = NN_SIPC_OUTSTATE_IDLE;
+                sipc->shmflags &= ~NN_SIPC_SHMFLAG_MSGSENDING;
                 nn_msg_term (&sipc->outmsg);
                 nn_msg_init (&sipc->outmsg, 0);
-                nn_pipebase_sent (&sipc->pipebase);
+                nn_sipc_shm_send_ctl (sipc);
+                nn_sipc_send_next (sipc);
                 return;
 
             case NN_USOCK_RECEIVED:
@@ -328,25 +589,30 @@ static void nn_sipc_handler (struct nn_fsm *self, int src, int type,
                 switch (sipc->instate) {
                 case NN_SIPC_INSTATE_HDR:
 
-                    /*  Message header was received. Allocate memory for the
-                        message. */
-                    nn_assert (sipc->inhdr [0] == NN_SIPC_MSG_NORMAL);
-                    size = nn_getll (sipc->inhdr + 1);
-                    nn_msg_term (&sipc->inmsg);
-                    nn_msg_init (&sipc->inmsg, (size_t) size);
-
-                    /*  Special case when size of the message body is 0. */
-                    if (!size) {
-                        sipc->instate = NN_SIPC_INSTATE_HASMSG;
-                        nn_pipebase_received (&sipc->pipebase);
+                    /*  Notification from the peer using shared memory. */
+                    if (sipc->inhdr [0] == NN_SIPC_MSG_DOORBELL &&
+                          (sipc->shmflags & NN_SIPC_SHMFLAG_ACTIVE)) {
+                        doorbells = nn_getll (sipc->inhdr + 1);
+                        nn_usock_recv (sipc->usock, sipc->inhdr,
+                            sizeof (sipc->inhdr));
+                        if (doorbells & NN_SHMRING_WAITING_DATA)
+                            nn_sipc_shm_pull (sipc);
+                        if (nn_slow (sipc->state != NN_SIPC_STATE_ACTIVE))
+                            return;
+                        if ((doorbells & NN_SHMRING_WAITING_SPACE) &&
+                              (sipc->shmflags & NN_SIPC_SHMFLAG_SPACEPENDING)) {
+                            nn_sipc_shm_push (sipc);
+                            nn_sipc_send_next (sipc);
+                        }
                         return;
                     }
 
-                    /*  Start receiving the message body. */
-                    sipc->instate = NN_SIPC_INSTATE_BODY;
-                    nn_usock_recv (sipc->usock,
-                        nn_chunkref_data (&sipc->inmsg.body), (size_t) size);
-
+                    rc = nn_sipc_process_hdr (sipc);
+                    if (nn_slow (rc < 0)) {
+                        nn_pipebase_stop (&sipc->pipebase);
+                        sipc->state = NN_SIPC_STATE_DONE;
+                        nn_fsm_raise (&sipc->fsm, &sipc->done, NN_SIPC_ERROR);
+                    }
                     return;
 
                 case NN_SIPC_INSTATE_BODY:
@@ -354,7 +620,7 @@ static void nn_sipc_handler (struct nn_fsm *self, int src, int type,
                     /*  Message body was received. Notify the owner that it
                         can receive it. */
                     sipc->instate = NN_SIPC_INSTATE_HASMSG;
-                    nn_pipebase_received (&sipc->pipebase);
+                    nn_sipc_received (sipc);
 
                     return;
 
@@ -420,3 +686,412 @@ static void nn_sipc_handler (struct nn_fsm *self, int src, int type,
         nn_fsm_bad_state (sipc->state, src, type);
     }
 }
+
+static int nn_sipc_start_pipe (struct nn_sipc *self)
+{
+    int rc;
+
+    /*  Start the pipe. */
+    rc = nn_pipebase_start (&self->pipebase);
+    if (nn_slow (rc < 0))
+        return rc;
+
+    /*  Mark the pipe as available for sending. Nothing may be left over
+        from the previous connection. */
+    nn_assert (self->sndq.count == 0);
+    self->outstate = NN_SIPC_OUTSTATE_IDLE;
+    self->outblocked = 0;
+
+    self->state = NN_SIPC_STATE_ACTIVE;
+
+    return 0;
+}
+
+static void nn_sipc_start_receiving (struct nn_sipc *self)
+{
+    /*  Start receiving a message in asynchronous manner. */
+    self->instate = NN_SIPC_INSTATE_HDR;
+    nn_usock_recv (self->usock, &self->inhdr, sizeof (self->inhdr));
+
+    /*  Check whether the peer have already put some messages to the ring. */
+    if (self->shmflags & NN_SIPC_SHMFLAG_ACTIVE)
+        nn_sipc_shm_pull (self);
+}
+
+static int nn_sipc_process_hdr (struct nn_sipc *self)
+{
+    uint64_t size;
+
+    if (nn_slow (self->inhdr [0] != NN_SIPC_MSG_NORMAL))
+        return -EPROTO;
+
+    /*  Message header was received. Allocate memory for the message. */
+    size = nn_getll (self->inhdr + 1);
+    nn_msg_term (&self->inmsg);
+    nn_msg_init (&self->inmsg, (size_t) size);
+
+    /*  If the body was already read from the socket, along with the header,
+        the message is complete. This is also the case when size of the
+        message body is 0. */
+    if (!size || nn_usock_recv_buffered (self->usock,
+          nn_chunkref_data (&self->inmsg.body), (size_t) size)) {
+        self->instate = NN_SIPC_INSTATE_HASMSG;
+        nn_sipc_received (self);
+        return 0;
+    }
+
+    /*  Start receiving the message body. The part of it that was already
+        read is picked up from the read-ahead buffer, the rest is read
+        by a single operation. */
+    self->instate = NN_SIPC_INSTATE_BODY;
+    nn_usock_recv (self->usock, nn_chunkref_data (&self->inmsg.body),
+        (size_t) size);
+
+    return 0;
+}
+
+static void nn_sipc_received (struct nn_sipc *self)
+{
+    /*  With shared memory the message received via the socket has to wait
+        till the preceding messages are taken from the ring. */
+    if (self->shmflags & NN_SIPC_SHMFLAG_ACTIVE) {
+        nn_sipc_shm_pull (self);
+        return;
+    }
+
+    nn_pipebase_received (&self->pipebase);
+}
+
+static void nn_sipc_start_outmsg (struct nn_sipc *self)
+{
+    self->outstate = NN_SIPC_OUTSTATE_SENDING;
+
+    /*  Pass the message via shared memory, if possible. */
+    if (self->shmflags & NN_SIPC_SHMFLAG_ACTIVE) {
+        nn_sipc_shm_push (self);
+        return;
+    }
+
+    /*  Control message sent while setting up the connection may still be
+        in progress. The message waits for it to finish. */
+    if (nn_slow (self->shmflags & NN_SIPC_SHMFLAG_CTLSENDING)) {
+        self->shmflags |= NN_SIPC_SHMFLAG_MSGPENDING;
+        return;
+    }
+
+    nn_sipc_send_outmsg (self);
+}
+
+static void nn_sipc_send_next (struct nn_sipc *self)
+{
+    /*  Send the queued messages. Messages passed via shared memory are
+        done with straight away so continue till one of them has to wait. */
+    while (self->outstate == NN_SIPC_OUTSTATE_IDLE) {
+        nn_msg_term (&self->outmsg);
+        if (nn_sndq_pop (&self->sndq, &self->outmsg) < 0) {
+            nn_msg_init (&self->outmsg, 0);
+            break;
+        }
+
+        /*  Messages that have expired while waiting in the queue
+            are dropped. */
+        if (nn_slow (nn_pipebase_expired (&self->pipebase, &self->outmsg)))
+            continue;
+        nn_sipc_start_outmsg (self);
+    }
+
+    /*  If the queue have drained enough, the pipe becomes writable again. */
+    if (self->outblocked && !nn_sndq_full (&self->sndq)) {
+        self->outblocked = 0;
+        nn_pipebase_sent (&self->pipebase);
+    }
+}
+
+static void nn_sipc_send_outmsg (struct nn_sipc *self)
+{
+    struct nn_iovec iov [NN_USOCK_MAX_IOVCNT];
+    int iovcnt;
+
+    /*  Serialise the message header. */
+    self->outhdr [0] = NN_SIPC_MSG_NORMAL;
+    nn_putll (self->outhdr + 1, nn_chunkref_size (&self->outmsg.sphdr) +
+        nn_msg_bodysize (&self->outmsg));
+
+    /*  Start async sending. If possible, the headers are prepended to
+        the body in place so that the message is a single buffer. */
+    if (nn_fast (nn_msg_prepend (&self->outmsg, self->outhdr,
+          sizeof (self->outhdr)) == 0)) {
+        iovcnt = nn_msg_bodyiov (&self->outmsg, iov);
+    }
+    else {
+        iov [0].iov_base = self->outhdr;
+        iov [0].iov_len = sizeof (self->outhdr);
+        iov [1].iov_base = nn_chunkref_data (&self->outmsg.sphdr);
+        iov [1].iov_len = nn_chunkref_size (&self->outmsg.sphdr);
+        iovcnt = 2 + nn_msg_bodyiov (&self->outmsg, iov + 2);
+    }
+    nn_usock_send (self->usock, iov, iovcnt);
+
+    self->shmflags |= NN_SIPC_SHMFLAG_MSGSENDING;
+}
+
+static int nn_sipc_shm_create (struct nn_sipc *self)
+{
+    int rc;
+    int bufsize;
+    size_t sz;
+    struct nn_iovec iov [2];
+
+    sz = sizeof (bufsize);
+    nn_pipebase_getopt (&self->pipebase, NN_SHM, NN_SHM_BUFSIZE,
+        &bufsize, &sz);
+    nn_assert (sz == sizeof (bufsize));
+
+    /*  If the segment cannot be created, messages are passed via the socket.
+        Empty name lets the peer know. */
+    rc = nn_shmseg_create (&self->shmseg, (size_t) bufsize);
+    self->ctlhdr [0] = NN_SIPC_MSG_SHMEM;
+    if (nn_slow (rc < 0)) {
+        nn_putll (self->ctlhdr + 1, 0);
+        iov [0].iov_base = self->ctlhdr;
+        iov [0].iov_len = sizeof (self->ctlhdr);
+        nn_usock_send (self->usock, iov, 1);
+        self->shmflags |= NN_SIPC_SHMFLAG_CTLSENDING;
+        return rc;
+    }
+    self->shmflags |= NN_SIPC_SHMFLAG_MAPPED;
+
+    /*  Pass the name of the segment to the peer. */
+    nn_putll (self->ctlhdr + 1, strlen (self->shmseg.name));
+    iov [0].iov_base = self->ctlhdr;
+    iov [0].iov_len = sizeof (self->ctlhdr);
+    iov [1].iov_base = self->shmseg.name;
+    iov [1].iov_len = strlen (self->shmseg.name);
+    nn_usock_send (self->usock, iov, 2);
+    self->shmflags |= NN_SIPC_SHMFLAG_CTLSENDING;
+
+    return 0;
+}
+
+static int nn_sipc_shm_open (struct nn_sipc *self)
+{
+    int pid;
+#if defined SO_PEERCRED
+    int rc;
+    size_t sz;
+    struct ucred ucred;
+#endif
+
+    /*  The segment must have been created by the peer process itself. Where
+        the peer's identity can't be established, only the form of the name
+        is checked. */
+    pid = -1;
+#if defined SO_PEERCRED
+    sz = sizeof (ucred);
+    rc = nn_usock_getsockopt (self->usock, SOL_SOCKET, SO_PEERCRED,
+        &ucred, &sz);
+    if (nn_slow (rc < 0 || sz != sizeof (ucred)))
+        return -EINVAL;
+    pid = (int) ucred.pid;
+#endif
+
+    return nn_shmseg_open (&self->shmseg,
+        nn_chunkref_data (&self->inmsg.body),
+        nn_chunkref_size (&self->inmsg.body), pid);
+}
+
+static void nn_sipc_shm_send_ack (struct nn_sipc *self, int ok)
+{
+    struct nn_iovec iov;
+
+    self->ctlhdr [0] = NN_SIPC_MSG_SHMACK;
+    nn_putll (self->ctlhdr + 1, ok ? 1 : 0);
+    iov.iov_base = self->ctlhdr;
+    iov.iov_len = sizeof (self->ctlhdr);
+    nn_usock_send (self->usock, &iov, 1);
+    self->shmflags |= NN_SIPC_SHMFLAG_CTLSENDING;
+}
+
+static void nn_sipc_shm_push (struct nn_sipc *self)
+{
+    int rc;
+    int big;
+    int waiting;
+
+    nn_assert (self->outstate == NN_SIPC_OUTSTATE_SENDING);
+
+    waiting = 0;
+    while (1) {
+
+        /*  Messages that don't fit into the ring are sent via the socket.
+            Marker in the ring keeps them in order with the other messages. */
+        rc = nn_shmring_write (&self->shmseg, &self->outmsg);
+        big = rc == -EMSGSIZE ? 1 : 0;
+        if (nn_slow (big))
+            rc = nn_shmring_writemarker (&self->shmseg);
+        if (nn_fast (rc != -EAGAIN))
+            break;
+
+        /*  The ring is full. Ask the peer to notify us once it frees some
+            space and check once again to avoid the race with the peer.
+            The request has to be renewed each time, the notification that
+            woke us up may have been for the space we've already used. */
+        if (waiting)
+            return;
+        self->shmflags |= NN_SIPC_SHMFLAG_SPACEPENDING;
+        nn_shmring_wait (&self->shmseg, NN_SHMRING_WAITING_SPACE);
+        waiting = 1;
+    }
+    errnum_assert (rc == 0, -rc);
+    self->shmflags &= ~NN_SIPC_SHMFLAG_SPACEPENDING;
+
+    /*  There's no need to ring the doorbell for large messages. The message
+        itself will wake the peer up. */
+    if (nn_slow (big)) {
+        nn_shmring_wake (&self->shmseg, NN_SHMRING_WAITING_DATA);
+        if (self->shmflags & NN_SIPC_SHMFLAG_CTLSENDING)
+            self->shmflags |= NN_SIPC_SHMFLAG_MSGPENDING;
+        else
+            nn_sipc_send_outmsg (self);
+        return;
+    }
+
+    /*  The message is in the ring now. The caller takes care of the queued
+        messages. */
+    nn_msg_term (&self->outmsg);
+    nn_msg_init (&self->outmsg, 0);
+    self->outstate = NN_SIPC_OUTSTATE_IDLE;
+    nn_sipc_shm_notify (self, NN_SHMRING_WAITING_DATA);
+}
+
+static void nn_sipc_shm_pull (struct nn_sipc *self)
+{
+    int rc;
+    int waiting;
+
+    if (self->shmflags & NN_SIPC_SHMFLAG_READABLE)
+        return;
+
+    waiting = 0;
+    while (1) {
+
+        /*  Message passed via the socket goes next. */
+        if (self->shmflags & NN_SIPC_SHMFLAG_MARKER) {
+            if (self->instate != NN_SIPC_INSTATE_HASMSG)
+                return;
+            break;
+        }
+
+        rc = nn_shmring_peek (&self->shmseg);
+        if (nn_slow (rc < 0)) {
+
+            /*  The peer have corrupted the ring. Drop the connection. */
+            self->state = NN_SIPC_STATE_DONE;
+            nn_fsm_raise (&self->fsm, &self->done, NN_SIPC_ERROR);
+            return;
+        }
+        if (rc == NN_SHMRING_MSG)
+            break;
+        if (rc == NN_SHMRING_MARKER) {
+            nn_shmring_skip (&self->shmseg);
+            self->shmflags |= NN_SIPC_SHMFLAG_MARKER;
+            nn_sipc_shm_notify (self, NN_SHMRING_WAITING_SPACE);
+            continue;
+        }
+
+        /*  The ring is empty. Ask the peer to notify us once it writes
+            a message and check once again to avoid the race with the peer. */
+        if (waiting)
+            return;
+        nn_shmring_wait (&self->shmseg, NN_SHMRING_WAITING_DATA);
+        waiting = 1;
+    }
+
+    self->shmflags |= NN_SIPC_SHMFLAG_READABLE;
+    nn_pipebase_received (&self->pipebase);
+}
+
+static void nn_sipc_shm_notify (struct nn_sipc *self, int doorbell)
+{
+    if (nn_fast (!nn_shmring_wake (&self->shmseg, doorbell)))
+        return;
+    self->doorbells |= doorbell;
+    nn_sipc_shm_send_ctl (self);
+}
+
+static void nn_sipc_shm_send_ctl (struct nn_sipc *self)
+{
+    struct nn_iovec iov;
+
+    /*  Only one send can be in progress at a time. If the socket is busy,
+        the notifications will be sent once it's available. */
+    if (!self->doorbells || (self->shmflags & (NN_SIPC_SHMFLAG_CTLSENDING |
+          NN_SIPC_SHMFLAG_MSGSENDING | NN_SIPC_SHMFLAG_MSGPENDING)))
+        return;
+
+    self->ctlhdr [0] = NN_SIPC_MSG_DOORBELL;
+    nn_putll (self->ctlhdr + 1, self->doorbells);
+    self->doorbells = 0;
+    iov.iov_base = self->ctlhdr;
+    iov.iov_len = sizeof (self->ctlhdr);
+    nn_usock_send (self->usock, &iov, 1);
+    self->shmflags |= NN_SIPC_SHMFLAG_CTLSENDING;
+}
+
+static void nn_sipc_get_peercred (struct nn_sipc *self)
+{
+#if defined SO_PEERCRED
+    int rc;
+    int val;
+    size_t sz;
+    struct ucred ucred;
+    struct nn_cmsghdr *hdr;
+    struct nn_ipc_peercred *cred;
+
+    nn_chunkref_term (&self->peercred);
+    nn_chunkref_init (&self->peercred, 0);
+
+    /*  The option belongs to the IPC transport. SHM endpoints don't
+        report credentials. */
+    if (self->shmmode != NN_SIPC_SHM_NONE)
+        return;
+
+    sz = sizeof (val);
+    nn_pipebase_getopt (&self->pipebase, NN_IPC, NN_IPC_PEERCRED, &val, &sz);
+    nn_assert (sz == sizeof (val));
+    if (!val)
+        return;
+
+    /*  The credentials are retrieved once per connection. If the peer is
+        already gone, the connection will fail shortly anyway. */
+    sz = sizeof (ucred);
+    rc = nn_usock_getsockopt (self->usock, SOL_SOCKET, SO_PEERCRED,
+        &ucred, &sz);
+    if (nn_slow (rc < 0 || sz != sizeof (ucred)))
+        return;
+
+    /*  Build the ancillary property. It is shared by all the inbound
+        messages rather than copied to each of them. */
+    nn_chunkref_term (&self->peercred);
+    nn_chunkref_init (&self->peercred,
+        NN_CMSG_SPACE (sizeof (struct nn_ipc_peercred)));
+    memset (nn_chunkref_data (&self->peercred), 0,
+        nn_chunkref_size (&self->peercred));
+    hdr = (struct nn_cmsghdr*) nn_chunkref_data (&self->peercred);
+    hdr->cmsg_len = sizeof (struct nn_ipc_peercred);
+    hdr->cmsg_level = NN_IPC;
+    hdr->cmsg_type = NN_IPC_PEERCRED;
+    cred = (struct nn_ipc_peercred*) NN_CMSG_DATA (hdr);
+    cred->pid = (int) ucred.pid;
+    cred->uid = (unsigned int) ucred.uid;
+    cred->gid = (unsigned int) ucred.gid;
+#endif
+}
+
+static void nn_sipc_attach_peercred (struct nn_sipc *self, struct nn_msg *msg)
+{
+    if (nn_fast (nn_chunkref_size (&self->peercred) == 0))
+        return;
+    nn_chunkref_term (&msg->hdrs);
+    nn_chunkref_cp (&msg->hdrs, &self->peercred);
+}
@@ -29,6 +29,9 @@
 #include "../../aio/usock.h"
 
 #include "../utils/streamhdr.h"
+#include "../utils/sndq.h"
+
+#include "shmring.h"
 
 #include "../../utils/msg.h"
 
@@ -38,6 +41,12 @@
 #define NN_SIPC_ERROR 1
 #define NN_SIPC_STOPPED 2
 
+/*  Specifies whether messages are passed via shared memory and, if so,
+    which side of the connection creates the shared memory segment. */
+#define NN_SIPC_SHM_NONE 0
+#define NN_SIPC_SHM_CONNECT 1
+#define NN_SIPC_SHM_ACCEPT 2
+
 struct nn_sipc {
 
     /*  The state machine. */
@@ -74,12 +83,39 @@ struct nn_sipc {
     /*  Message being sent at the moment. */
     struct nn_msg outmsg;
 
+    /*  Messages waiting for the one above to be sent. */
+    struct nn_sndq sndq;
+
+    /*  1 if the send queue is full and the pipe waits for it to drain. */
+    int outblocked;
+
+    /*  One of the NN_SIPC_SHM_* values. */
+    int shmmode;
+
+    /*  Shared memory segment used to pass the messages. Valid only if
+        NN_SIPC_SHMFLAG_ACTIVE flag is set. */
+    struct nn_shmseg shmseg;
+
+    /*  Any combination of NN_SIPC_SHMFLAG_* flags defined in the .c file. */
+    int shmflags;
+
+    /*  Notifications (NN_SHMRING_WAITING_* flags) to be sent to the peer
+        once the socket is available. */
+    int doorbells;
+
+    /*  Buffer used to store the header of outgoing control message. */
+    uint8_t ctlhdr [9];
+
+    /*  NN_IPC_PEERCRED ancillary property attached to each inbound message.
+        Empty if the property is not requested. */
+    struct nn_chunkref peercred;
+
     /*  Event raised when the state machine ends. */
     struct nn_fsm_event done;
 };
 
 void nn_sipc_init (struct nn_sipc *self, int src,
-    struct nn_epbase *epbase, struct nn_fsm *owner);
+    struct nn_epbase *epbase, int shmmode, struct nn_fsm *owner);
 void nn_sipc_term (struct nn_sipc *self);
 
 int nn_sipc_isidle (struct nn_sipc *self);
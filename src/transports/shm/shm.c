@@ -0,0 +1,164 @@
+/*
+    Copyright (c) 2013 250bpm s.r.o.  All rights reserved.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom
+    the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included
+    in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+#include "shm.h"
+
+#include "../ipc/bipc.h"
+#include "../ipc/cipc.h"
+#include "../ipc/shmring.h"
+
+#include "../../shm.h"
+
+#include "../../utils/err.h"
+#include "../../utils/alloc.h"
+#include "../../utils/fast.h"
+#include "../../utils/list.h"
+#include "../../utils/cont.h"
+
+#include <string.h>
+
+/*  Shared memory transport. Connections are established in the same way
+    as with IPC transport, however, once the connection is set up, messages
+    are passed via ring buffers in a shared memory segment. IPC connection
+    is used only to notify the peer about the state changes of the rings
+    and to transfer messages too large to fit into the ring. */
+
+/*  SHM-specific socket options. */
+
+struct nn_shm_optset {
+    struct nn_optset base;
+    int bufsize;
+};
+
+static void nn_shm_optset_destroy (struct nn_optset *self);
+static int nn_shm_optset_setopt (struct nn_optset *self, int option,
+    const void *optval, size_t optvallen);
+static int nn_shm_optset_getopt (struct nn_optset *self, int option,
+    void *optval, size_t *optvallen);
+static const struct nn_optset_vfptr nn_shm_optset_vfptr = {
+    nn_shm_optset_destroy,
+    nn_shm_optset_setopt,
+    nn_shm_optset_getopt
+};
+
+/*  nn_transport interface. */
+static int nn_shm_bind (void *hint, struct nn_epbase **epbase);
+static int nn_shm_connect (void *hint, struct nn_epbase **epbase);
+static struct nn_optset *nn_shm_optset (void);
+
+static struct nn_transport nn_shm_vfptr = {
+    "shm",
+    NN_SHM,
+    NULL,
+    NULL,
+    nn_shm_bind,
+    nn_shm_connect,
+    nn_shm_optset,
+    NN_LIST_ITEM_INITIALIZER
+};
+
+struct nn_transport *nn_shm = &nn_shm_vfptr;
+
+static int nn_shm_bind (void *hint, struct nn_epbase **epbase)
+{
+#if defined NN_SHMRING_SUPPORTED
+    return nn_bipc_create (hint, epbase, 1);
+#else
+    return -EPROTONOSUPPORT;
+#endif
+}
+
+static int nn_shm_connect (void *hint, struct nn_epbase **epbase)
+{
+#if defined NN_SHMRING_SUPPORTED
+    return nn_cipc_create (hint, epbase, 1);
+#else
+    return -EPROTONOSUPPORT;
+#endif
+}
+
+static struct nn_optset *nn_shm_optset ()
+{
+    struct nn_shm_optset *optset;
+
+    optset = nn_alloc (sizeof (struct nn_shm_optset), "optset (shm)");
+    alloc_assert (optset);
+    optset->base.vfptr = &nn_shm_optset_vfptr;
+
+    /*  Default values for SHM socket options. */
+    optset->bufsize = 1024 * 1024;
+
+    return &optset->base;
+}
+
+static void nn_shm_optset_destroy (struct nn_optset *self)
+{
+    struct nn_shm_optset *optset;
+
+    optset = nn_cont (self, struct nn_shm_optset, base);
+    nn_free (optset);
+}
+
+static int nn_shm_optset_setopt (struct nn_optset *self, int option,
+    const void *optval, size_t optvallen)
+{
+    struct nn_shm_optset *optset;
+    int val;
+
+    optset = nn_cont (self, struct nn_shm_optset, base);
+
+    /*  At this point we assume that all options are of type int. */
+    if (optvallen != sizeof (int))
+        return -EINVAL;
+    val = *(int*) optval;
+
+    switch (option) {
+    case NN_SHM_BUFSIZE:
+        if (nn_slow (val <= 0))
+            return -EINVAL;
+        optset->bufsize = val;
+        return 0;
+    default:
+        return -ENOPROTOOPT;
+    }
+}
+
+static int nn_shm_optset_getopt (struct nn_optset *self, int option,
+    void *optval, size_t *optvallen)
+{
+    struct nn_shm_optset *optset;
+    int intval;
+
+    optset = nn_cont (self, struct nn_shm_optset, base);
+
+    switch (option) {
+    case NN_SHM_BUFSIZE:
+        intval = optset->bufsize;
+        break;
+    default:
+        return -ENOPROTOOPT;
+    }
+    memcpy (optval, &intval,
+        *optvallen < sizeof (int) ? *optvallen : sizeof (int));
+    *optvallen = sizeof (int);
+    return 0;
+}
@@ -21,6 +21,7 @@
 */
 
 #include "atcp.h"
+#include "tcp.h"
 
 #include "../../utils/err.h"
 #include "../../utils/cont.h"
@@ -46,12 +47,13 @@ static void nn_atcp_shutdown (struct nn_fsm *self, int src, int type,
     void *srcptr);
 
 void nn_atcp_init (struct nn_atcp *self, int src,
-    struct nn_epbase *epbase, struct nn_fsm *owner)
+    struct nn_epbase *epbase, struct nn_tlsctx *tlsctx, struct nn_fsm *owner)
 {
     nn_fsm_init (&self->fsm, nn_atcp_handler, nn_atcp_shutdown,
         src, self, owner);
     self->state = NN_ATCP_STATE_IDLE;
     self->epbase = epbase;
+    self->tlsctx = tlsctx;
     nn_usock_init (&self->usock, NN_ATCP_SRC_USOCK, &self->fsm);
     self->listener = NULL;
     self->listener_owner.src = -1;
@@ -141,8 +143,6 @@ static void nn_atcp_handler (struct nn_fsm *self, int src, int type,
     NN_UNUSED void *srcptr)
 {
     struct nn_atcp *atcp;
-    int val;
-    size_t sz;
 
     atcp = nn_cont (self, struct nn_atcp, fsm);
 
@@ -182,18 +182,7 @@ static void nn_atcp_handler (struct nn_fsm *self, int src, int type,
                 nn_epbase_clear_error (atcp->epbase);
 
                 /*  Set the relevant socket options. */
-                sz = sizeof (val);
-                nn_epbase_getopt (atcp->epbase, NN_SOL_SOCKET, NN_SNDBUF,
-                    &val, &sz);
-                nn_assert (sz == sizeof (val));
-                nn_usock_setsockopt (&atcp->usock, SOL_SOCKET, SO_SNDBUF,
-                    &val, sizeof (val));
-                sz = sizeof (val);
-                nn_epbase_getopt (atcp->epbase, NN_SOL_SOCKET, NN_RCVBUF,
-                    &val, &sz);
-                nn_assert (sz == sizeof (val));
-                nn_usock_setsockopt (&atcp->usock, SOL_SOCKET, SO_RCVBUF,
-                    &val, sizeof (val));
+                nn_tcp_setsockopts (atcp->epbase, &atcp->usock, 0);
 
                 /*  Return ownership of the listening socket to the parent. */
                 nn_usock_swap_owner (atcp->listener, &atcp->listener_owner);
@@ -204,7 +193,8 @@ static void nn_atcp_handler (struct nn_fsm *self, int src, int type,
 
                 /*  Start the stcp state machine. */
                 nn_usock_activate (&atcp->usock);
-                nn_stcp_start (&atcp->stcp, &atcp->usock);
+                nn_stcp_start (&atcp->stcp, &atcp->usock, atcp->tlsctx ?
+                    nn_tlsctx_new (atcp->tlsctx, NULL, 0) : NULL);
                 atcp->state = NN_ATCP_STATE_ACTIVE;
 
                 nn_epbase_stat_increment (atcp->epbase,
@@ -30,6 +30,8 @@
 #include "../../aio/fsm.h"
 #include "../../aio/usock.h"
 
+#include "../utils/tlsctx.h"
+
 #include "../../utils/list.h"
 
 /*  State machine handling accepted TCP sockets. */
@@ -50,6 +52,9 @@ struct nn_atcp {
     /*  Pointer to the associated endpoint. */
     struct nn_epbase *epbase;
 
+    /*  TLS configuration of the endpoint, NULL for plain TCP. */
+    struct nn_tlsctx *tlsctx;
+
     /*  Underlying socket. */
     struct nn_usock usock;
 
@@ -69,7 +74,7 @@ struct nn_atcp {
 };
 
 void nn_atcp_init (struct nn_atcp *self, int src,
-    struct nn_epbase *epbase, struct nn_fsm *owner);
+    struct nn_epbase *epbase, struct nn_tlsctx *tlsctx, struct nn_fsm *owner);
 void nn_atcp_term (struct nn_atcp *self);
 
 int nn_atcp_isidle (struct nn_atcp *self);
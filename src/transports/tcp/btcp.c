@@ -22,14 +22,17 @@
 
 #include "btcp.h"
 #include "atcp.h"
+#include "tcp.h"
 
 #include "../utils/port.h"
 #include "../utils/iface.h"
 
 #include "../../aio/fsm.h"
 #include "../../aio/usock.h"
+#include "../../aio/timer.h"
 
 #include "../utils/backoff.h"
+#include "../utils/tlsctx.h"
 
 #include "../../utils/err.h"
 #include "../../utils/cont.h"
@@ -38,6 +41,8 @@
 #include "../../utils/fast.h"
 #include "../../utils/int.h"
 
+#include "../../tcp.h"
+
 #include <string.h>
 
 #if defined NN_HAVE_WINDOWS
@@ -64,6 +69,7 @@
 #define NN_BTCP_SRC_USOCK 1
 #define NN_BTCP_SRC_ATCP 2
 #define NN_BTCP_SRC_RECONNECT_TIMER 3
+#define NN_BTCP_SRC_ACCEPT_TIMER 4
 
 struct nn_btcp {
 
@@ -86,6 +92,13 @@ struct nn_btcp {
 
     /*  Used to wait before retrying to connect. */
     struct nn_backoff retry;
+
+    /*  Used to pace accepting of new connections (NN_TCP_ACCEPT_IVL). */
+    struct nn_timer accept_timer;
+
+    /*  TLS configuration, used only if 'tls' is set. */
+    int tls;
+    struct nn_tlsctx tlsctx;
 };
 
 /*  nn_epbase virtual interface implementation. */
@@ -103,8 +116,9 @@ static void nn_btcp_shutdown (struct nn_fsm *self, int src, int type,
     void *srcptr);
 static void nn_btcp_start_listening (struct nn_btcp *self);
 static void nn_btcp_start_accepting (struct nn_btcp *self);
+static int nn_btcp_accept_ivl (struct nn_btcp *self);
 
-int nn_btcp_create (void *hint, struct nn_epbase **epbase)
+int nn_btcp_create (void *hint, struct nn_epbase **epbase, int tls)
 {
     int rc;
     struct nn_btcp *self;
@@ -117,6 +131,7 @@ int nn_btcp_create (void *hint, struct nn_epbase **epbase)
     size_t ipv4onlylen;
     int reconnect_ivl;
     int reconnect_ivl_max;
+    int reconnect_policy;
     size_t sz;
 
     /*  Allocate the new endpoint object. */
@@ -132,12 +147,14 @@ int nn_btcp_create (void *hint, struct nn_epbase **epbase)
     pos = strrchr (addr, ':');
     if (nn_slow (!pos)) {
         nn_epbase_term (&self->epbase);
+        nn_free (self);
         return -EINVAL;
     }
     ++pos;
     rc = nn_port_resolve (pos, end - pos);
     if (nn_slow (rc < 0)) {
         nn_epbase_term (&self->epbase);
+        nn_free (self);
         return -EINVAL;
     }
 
@@ -151,9 +168,21 @@ int nn_btcp_create (void *hint, struct nn_epbase **epbase)
     rc = nn_iface_resolve (addr, pos - addr - 1, ipv4only, &ss, &sslen);
     if (nn_slow (rc < 0)) {
         nn_epbase_term (&self->epbase);
+        nn_free (self);
         return -ENODEV;
     }
 
+    /*  Load the certificates. */
+    self->tls = tls;
+    if (tls) {
+        rc = nn_tlsctx_init (&self->tlsctx, &self->epbase, 1);
+        if (nn_slow (rc < 0)) {
+            nn_epbase_term (&self->epbase);
+            nn_free (self);
+            return rc;
+        }
+    }
+
     /*  Initialise the structure. */
     nn_fsm_init_root (&self->fsm, nn_btcp_handler, nn_btcp_shutdown,
         nn_epbase_getctx (&self->epbase));
@@ -168,9 +197,14 @@ int nn_btcp_create (void *hint, struct nn_epbase **epbase)
     nn_assert (sz == sizeof (reconnect_ivl_max));
     if (reconnect_ivl_max == 0)
         reconnect_ivl_max = reconnect_ivl;
+    sz = sizeof (reconnect_policy);
+    nn_epbase_getopt (&self->epbase, NN_SOL_SOCKET, NN_RECONNECT_POLICY,
+        &reconnect_policy, &sz);
+    nn_assert (sz == sizeof (reconnect_policy));
     nn_backoff_init (&self->retry, NN_BTCP_SRC_RECONNECT_TIMER,
-        reconnect_ivl, reconnect_ivl_max, &self->fsm);
+        reconnect_policy, reconnect_ivl, reconnect_ivl_max, &self->fsm);
     nn_usock_init (&self->usock, NN_BTCP_SRC_USOCK, &self->fsm);
+    nn_timer_init (&self->accept_timer, NN_BTCP_SRC_ACCEPT_TIMER, &self->fsm);
     self->atcp = NULL;
     nn_list_init (&self->atcps);
 
@@ -201,8 +235,11 @@ static void nn_btcp_destroy (struct nn_epbase *self)
     nn_assert_state (btcp, NN_BTCP_STATE_IDLE);
     nn_list_term (&btcp->atcps);
     nn_assert (btcp->atcp == NULL);
+    nn_timer_term (&btcp->accept_timer);
     nn_usock_term (&btcp->usock);
     nn_backoff_term (&btcp->retry);
+    if (btcp->tls)
+        nn_tlsctx_term (&btcp->tlsctx);
     nn_epbase_term (&btcp->epbase);
     nn_fsm_term (&btcp->fsm);
 
@@ -220,11 +257,16 @@ static void nn_btcp_shutdown (struct nn_fsm *self, int src, int type,
 
     if (nn_slow (src == NN_FSM_ACTION && type == NN_FSM_STOP)) {
         nn_backoff_stop (&btcp->retry);
+        nn_timer_stop (&btcp->accept_timer);
         if (btcp->atcp) {
             nn_atcp_stop (btcp->atcp);
             btcp->state = NN_BTCP_STATE_STOPPING_ATCP;
         }
         else {
+
+            /*  The listening socket may be active even though there is no
+                connection being accepted if the accepting is being paced. */
+            nn_usock_stop (&btcp->usock);
             btcp->state = NN_BTCP_STATE_STOPPING_USOCK;
         }
     }
@@ -238,7 +280,8 @@ static void nn_btcp_shutdown (struct nn_fsm *self, int src, int type,
         btcp->state = NN_BTCP_STATE_STOPPING_USOCK;
     }
     if (nn_slow (btcp->state == NN_BTCP_STATE_STOPPING_USOCK)) {
-       if (!nn_usock_isidle (&btcp->usock))
+       if (!nn_usock_isidle (&btcp->usock) ||
+             !nn_timer_isidle (&btcp->accept_timer))
             return;
         for (it = nn_list_begin (&btcp->atcps);
               it != nn_list_end (&btcp->atcps);
@@ -277,6 +320,7 @@ static void nn_btcp_handler (struct nn_fsm *self, int src, int type,
 {
     struct nn_btcp *btcp;
     struct nn_atcp *atcp;
+    int ivl;
 
     btcp = nn_cont (self, struct nn_btcp, fsm);
 
@@ -316,7 +360,15 @@ static void nn_btcp_handler (struct nn_fsm *self, int src, int type,
                     nn_list_end (&btcp->atcps));
                 btcp->atcp = NULL;
 
-                /*  Start waiting for a new incoming connection. */
+                /*  Start waiting for a new incoming connection. If required,
+                    wait a bit before accepting it so that a reconnection
+                    storm is spread over time. The pending connections are
+                    held in the listen backlog in the meantime. */
+                ivl = nn_btcp_accept_ivl (btcp);
+                if (ivl > 0) {
+                    nn_timer_start (&btcp->accept_timer, ivl);
+                    return;
+                }
                 nn_btcp_start_accepting (btcp);
 
                 return;
@@ -326,6 +378,19 @@ static void nn_btcp_handler (struct nn_fsm *self, int src, int type,
             }
         }
 
+        if (src == NN_BTCP_SRC_ACCEPT_TIMER) {
+            switch (type) {
+            case NN_TIMER_TIMEOUT:
+                nn_timer_stop (&btcp->accept_timer);
+                return;
+            case NN_TIMER_STOPPED:
+                nn_btcp_start_accepting (btcp);
+                return;
+            default:
+                nn_fsm_bad_action (btcp->state, src, type);
+            }
+        }
+
         /*  For all remaining events we'll assume they are coming from one
             of remaining child atcp objects. */
         nn_assert (src == NN_BTCP_SRC_ATCP);
@@ -473,6 +538,9 @@ static void nn_btcp_start_listening (struct nn_btcp *self)
         return;
     }
 
+    /*  Set the relevant socket options. */
+    nn_tcp_setsockopts (&self->epbase, &self->usock, 1);
+
     rc = nn_usock_bind (&self->usock, (struct sockaddr*) &ss, (size_t) sslen);
     if (nn_slow (rc < 0)) {
         nn_usock_stop (&self->usock);
@@ -497,9 +565,21 @@ static void nn_btcp_start_accepting (struct nn_btcp *self)
     /*  Allocate new atcp state machine. */
     self->atcp = nn_alloc (sizeof (struct nn_atcp), "atcp");
     alloc_assert (self->atcp);
-    nn_atcp_init (self->atcp, NN_BTCP_SRC_ATCP, &self->epbase, &self->fsm);
+    nn_atcp_init (self->atcp, NN_BTCP_SRC_ATCP, &self->epbase,
+        self->tls ? &self->tlsctx : NULL, &self->fsm);
 
     /*  Start waiting for a new incoming connection. */
     nn_atcp_start (self->atcp, &self->usock);
 }
 
+static int nn_btcp_accept_ivl (struct nn_btcp *self)
+{
+    int ivl;
+    size_t sz;
+
+    sz = sizeof (ivl);
+    nn_epbase_getopt (&self->epbase, NN_TCP, NN_TCP_ACCEPT_IVL, &ivl, &sz);
+    nn_assert (sz == sizeof (ivl));
+    return ivl;
+}
+
@@ -27,7 +27,9 @@
 
 /*  State machine managing bound TCP socket. */
 
-int nn_btcp_create (void *hint, struct nn_epbase **epbase);
+/*  If 'tls' is non-zero, connections are secured by TLS configured by NN_TLS
+    socket options. */
+int nn_btcp_create (void *hint, struct nn_epbase **epbase, int tls);
 
 #endif
 
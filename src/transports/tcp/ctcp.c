@@ -22,14 +22,17 @@
 
 #include "ctcp.h"
 #include "stcp.h"
+#include "tcp.h"
 
 #include "../../tcp.h"
 
 #include "../utils/dns.h"
+#include "../utils/connector.h"
 #include "../utils/port.h"
 #include "../utils/iface.h"
 #include "../utils/backoff.h"
 #include "../utils/literal.h"
+#include "../utils/tlsctx.h"
 
 #include "../../aio/fsm.h"
 #include "../../aio/usock.h"
@@ -52,34 +55,58 @@
 #endif
 
 #define NN_CTCP_STATE_IDLE 1
-#define NN_CTCP_STATE_RESOLVING 2
-#define NN_CTCP_STATE_STOPPING_DNS 3
-#define NN_CTCP_STATE_CONNECTING 4
-#define NN_CTCP_STATE_ACTIVE 5
-#define NN_CTCP_STATE_STOPPING_STCP 6
-#define NN_CTCP_STATE_STOPPING_USOCK 7
-#define NN_CTCP_STATE_WAITING 8
-#define NN_CTCP_STATE_STOPPING_BACKOFF 9
-#define NN_CTCP_STATE_STOPPING_STCP_FINAL 10
-#define NN_CTCP_STATE_STOPPING 11
-
-#define NN_CTCP_SRC_USOCK 1
-#define NN_CTCP_SRC_RECONNECT_TIMER 2
-#define NN_CTCP_SRC_DNS 3
-#define NN_CTCP_SRC_STCP 4
-
-struct nn_ctcp {
+#define NN_CTCP_STATE_ACTIVE 2
+#define NN_CTCP_STATE_STOPPING 3
+
+#define NN_CTCP_SRC_CONN 1
+
+#define NN_CTCP_CONN_STATE_IDLE 1
+#define NN_CTCP_CONN_STATE_RESOLVING 2
+#define NN_CTCP_CONN_STATE_STOPPING_DNS 3
+#define NN_CTCP_CONN_STATE_CONNECTING 4
+#define NN_CTCP_CONN_STATE_ACTIVE 5
+#define NN_CTCP_CONN_STATE_STOPPING_STCP 6
+#define NN_CTCP_CONN_STATE_STOPPING_CONNECTOR 7
+#define NN_CTCP_CONN_STATE_WAITING 8
+#define NN_CTCP_CONN_STATE_STOPPING_BACKOFF 9
+#define NN_CTCP_CONN_STATE_STOPPING_STCP_FINAL 10
+#define NN_CTCP_CONN_STATE_STOPPING 11
+
+#define NN_CTCP_CONN_SRC_CONNECTOR 1
+#define NN_CTCP_CONN_SRC_RECONNECT_TIMER 2
+#define NN_CTCP_CONN_SRC_DNS 3
+#define NN_CTCP_CONN_SRC_STCP 4
+
+#define NN_CTCP_CONN_STOPPED 1
+
+/*  A single connection of the endpoint. It keeps connecting and reconnecting
+    to the remote peer for the whole lifetime of the endpoint. */
+struct nn_ctcp_conn {
 
     /*  The state machine. */
     struct nn_fsm fsm;
     int state;
 
-    /*  This object is a specific type of endpoint.
-        Thus it is derived from epbase. */
-    struct nn_epbase epbase;
+    /*  The endpoint the connection belongs to. */
+    struct nn_epbase *epbase;
+
+    /*  TLS configuration of the endpoint, NULL for plain TCP. */
+    struct nn_tlsctx *tlsctx;
 
-    /*  The underlying TCP socket. */
-    struct nn_usock usock;
+    /*  Connects the underlying TCP socket to one of the remote addresses. */
+    struct nn_connector connector;
+
+    /*  For each address passed to the connector, the host it was resolved
+        from. Needed to verify the server's certificate. */
+    const char *hosts [NN_CONNECTOR_MAX_ADDRS];
+
+    /*  Local address to bind the socket to. */
+    struct sockaddr_storage local;
+    size_t locallen;
+
+    /*  The host from the address string that is being resolved at the
+        moment. */
+    const char *host;
 
     /*  Used to wait before retrying to connect. */
     struct nn_backoff retry;
@@ -94,6 +121,26 @@ struct nn_ctcp {
     struct nn_dns_result dns_result;
 };
 
+struct nn_ctcp {
+
+    /*  The state machine. */
+    struct nn_fsm fsm;
+    int state;
+
+    /*  This object is a specific type of endpoint.
+        Thus it is derived from epbase. */
+    struct nn_epbase epbase;
+
+    /*  Parallel connections to the remote peer (NN_TCP_CONNECTIONS). Each
+        of them is presented to the protocol as a separate pipe. */
+    struct nn_ctcp_conn *conns;
+    int nconns;
+
+    /*  TLS configuration, used only if 'tls' is set. */
+    int tls;
+    struct nn_tlsctx tlsctx;
+};
+
 /*  nn_epbase virtual interface implementation. */
 static void nn_ctcp_stop (struct nn_epbase *self);
 static void nn_ctcp_destroy (struct nn_epbase *self);
@@ -107,15 +154,32 @@ static void nn_ctcp_handler (struct nn_fsm *self, int src, int type,
     void *srcptr);
 static void nn_ctcp_shutdown (struct nn_fsm *self, int src, int type,
     void *srcptr);
-static void nn_ctcp_start_resolving (struct nn_ctcp *self);
-static void nn_ctcp_start_connecting (struct nn_ctcp *self,
-    struct sockaddr_storage *ss, size_t sslen);
+static int nn_ctcp_parse_host (const char *host, const char **colon,
+    const char **end);
+static void nn_ctcp_setsockopts (struct nn_epbase *epbase,
+    struct nn_usock *usock);
+
+static void nn_ctcp_conn_init (struct nn_ctcp_conn *self,
+    struct nn_epbase *epbase, struct nn_tlsctx *tlsctx, struct nn_fsm *owner);
+static void nn_ctcp_conn_term (struct nn_ctcp_conn *self);
+static int nn_ctcp_conn_isidle (struct nn_ctcp_conn *self);
+static void nn_ctcp_conn_start (struct nn_ctcp_conn *self);
+static void nn_ctcp_conn_stop (struct nn_ctcp_conn *self);
+static void nn_ctcp_conn_handler (struct nn_fsm *self, int src, int type,
+    void *srcptr);
+static void nn_ctcp_conn_shutdown (struct nn_fsm *self, int src, int type,
+    void *srcptr);
+static void nn_ctcp_conn_start_resolving (struct nn_ctcp_conn *self);
+static void nn_ctcp_conn_resolve_host (struct nn_ctcp_conn *self);
+static void nn_ctcp_conn_add_addrs (struct nn_ctcp_conn *self);
+static void nn_ctcp_conn_start_connecting (struct nn_ctcp_conn *self);
+static void *nn_ctcp_conn_new_tls (struct nn_ctcp_conn *self);
 
-int nn_ctcp_create (void *hint, struct nn_epbase **epbase)
+int nn_ctcp_create (void *hint, struct nn_epbase **epbase, int tls)
 {
     int rc;
+    int i;
     const char *addr;
-    size_t addrlen;
     const char *semicolon;
     const char *hostname;
     const char *colon;
@@ -125,8 +189,6 @@ int nn_ctcp_create (void *hint, struct nn_epbase **epbase)
     int ipv4only;
     size_t ipv4onlylen;
     struct nn_ctcp *self;
-    int reconnect_ivl;
-    int reconnect_ivl_max;
     size_t sz;
 
     /*  Allocate the new endpoint object. */
@@ -142,32 +204,34 @@ int nn_ctcp_create (void *hint, struct nn_epbase **epbase)
         &ipv4only, &ipv4onlylen);
     nn_assert (ipv4onlylen == sizeof (ipv4only));
 
-    /*  Start parsing the address. */
+    /*  Start parsing the address. The remote part of the address is
+        a comma-separated list of hosts to connect to. */
     addr = nn_epbase_getaddr (&self->epbase);
-    addrlen = strlen (addr);
     semicolon = strchr (addr, ';');
     hostname = semicolon ? semicolon + 1 : addr;
-    colon = strrchr (addr, ':');
-    end = addr + addrlen;
+    while (1) {
 
-    /*  Parse the port. */
-    if (nn_slow (!colon)) {
-        nn_epbase_term (&self->epbase);
-        return -EINVAL;
-    }
-    rc = nn_port_resolve (colon + 1, end - colon - 1);
-    if (nn_slow (rc < 0)) {
-        nn_epbase_term (&self->epbase);
-        return -EINVAL;
-    }
+        /*  Parse the port. */
+        rc = nn_ctcp_parse_host (hostname, &colon, &end);
+        if (nn_slow (rc < 0)) {
+            nn_epbase_term (&self->epbase);
+            nn_free (self);
+            return -EINVAL;
+        }
 
-    /*  Check whether the host portion of the address is either a literal
-        or a valid hostname. */
-    if (nn_dns_check_hostname (hostname, colon - hostname) < 0 &&
-          nn_literal_resolve (hostname, colon - hostname, ipv4only,
-          &ss, &sslen) < 0) {
-        nn_epbase_term (&self->epbase);
-        return -EINVAL;
+        /*  Check whether the host portion of the address is either a literal
+            or a valid hostname. */
+        if (nn_dns_check_hostname (hostname, colon - hostname) < 0 &&
+              nn_literal_resolve (hostname, colon - hostname, ipv4only,
+              &ss, &sslen) < 0) {
+            nn_epbase_term (&self->epbase);
+            nn_free (self);
+            return -EINVAL;
+        }
+
+        if (*end != ',')
+            break;
+        hostname = end + 1;
     }
 
     /*  If local address is specified, check whether it is valid. */
@@ -175,29 +239,37 @@ int nn_ctcp_create (void *hint, struct nn_epbase **epbase)
         rc = nn_iface_resolve (addr, semicolon - addr, ipv4only, &ss, &sslen);
         if (rc < 0) {
             nn_epbase_term (&self->epbase);
+            nn_free (self);
             return -ENODEV;
         }
     }
 
+    /*  Load the certificates. */
+    self->tls = tls;
+    if (tls) {
+        rc = nn_tlsctx_init (&self->tlsctx, &self->epbase, 0);
+        if (nn_slow (rc < 0)) {
+            nn_epbase_term (&self->epbase);
+            nn_free (self);
+            return rc;
+        }
+    }
+
     /*  Initialise the structure. */
     nn_fsm_init_root (&self->fsm, nn_ctcp_handler, nn_ctcp_shutdown,
         nn_epbase_getctx (&self->epbase));
     self->state = NN_CTCP_STATE_IDLE;
-    nn_usock_init (&self->usock, NN_CTCP_SRC_USOCK, &self->fsm);
-    sz = sizeof (reconnect_ivl);
-    nn_epbase_getopt (&self->epbase, NN_SOL_SOCKET, NN_RECONNECT_IVL,
-        &reconnect_ivl, &sz);
-    nn_assert (sz == sizeof (reconnect_ivl));
-    sz = sizeof (reconnect_ivl_max);
-    nn_epbase_getopt (&self->epbase, NN_SOL_SOCKET, NN_RECONNECT_IVL_MAX,
-        &reconnect_ivl_max, &sz);
-    nn_assert (sz == sizeof (reconnect_ivl_max));
-    if (reconnect_ivl_max == 0)
-        reconnect_ivl_max = reconnect_ivl;
-    nn_backoff_init (&self->retry, NN_CTCP_SRC_RECONNECT_TIMER,
-        reconnect_ivl, reconnect_ivl_max, &self->fsm);
-    nn_stcp_init (&self->stcp, NN_CTCP_SRC_STCP, &self->epbase, &self->fsm);
-    nn_dns_init (&self->dns, NN_CTCP_SRC_DNS, &self->fsm);
+    sz = sizeof (self->nconns);
+    nn_epbase_getopt (&self->epbase, NN_TCP, NN_TCP_CONNECTIONS,
+        &self->nconns, &sz);
+    nn_assert (sz == sizeof (self->nconns));
+    nn_assert (self->nconns >= 1);
+    self->conns = nn_alloc (self->nconns * sizeof (struct nn_ctcp_conn),
+        "ctcp connections");
+    alloc_assert (self->conns);
+    for (i = 0; i != self->nconns; ++i)
+        nn_ctcp_conn_init (&self->conns [i], &self->epbase,
+            tls ? &self->tlsctx : NULL, &self->fsm);
 
     /*  Start the state machine. */
     nn_fsm_start (&self->fsm);
@@ -219,15 +291,17 @@ static void nn_ctcp_stop (struct nn_epbase *self)
 
 static void nn_ctcp_destroy (struct nn_epbase *self)
 {
+    int i;
     struct nn_ctcp *ctcp;
 
     ctcp = nn_cont (self, struct nn_ctcp, epbase);
 
-    nn_dns_term (&ctcp->dns);
-    nn_stcp_term (&ctcp->stcp);
-    nn_backoff_term (&ctcp->retry);
-    nn_usock_term (&ctcp->usock);
+    for (i = 0; i != ctcp->nconns; ++i)
+        nn_ctcp_conn_term (&ctcp->conns [i]);
+    nn_free (ctcp->conns);
     nn_fsm_term (&ctcp->fsm);
+    if (ctcp->tls)
+        nn_tlsctx_term (&ctcp->tlsctx);
     nn_epbase_term (&ctcp->epbase);
 
     nn_free (ctcp);
@@ -236,31 +310,20 @@ static void nn_ctcp_destroy (struct nn_epbase *self)
 static void nn_ctcp_shutdown (struct nn_fsm *self, int src, int type,
     NN_UNUSED void *srcptr)
 {
+    int i;
     struct nn_ctcp *ctcp;
 
     ctcp = nn_cont (self, struct nn_ctcp, fsm);
 
     if (nn_slow (src == NN_FSM_ACTION && type == NN_FSM_STOP)) {
-        if (!nn_stcp_isidle (&ctcp->stcp)) {
-            nn_epbase_stat_increment (&ctcp->epbase,
-                NN_STAT_DROPPED_CONNECTIONS, 1);
-            nn_stcp_stop (&ctcp->stcp);
-        }
-        ctcp->state = NN_CTCP_STATE_STOPPING_STCP_FINAL;
-    }
-    if (nn_slow (ctcp->state == NN_CTCP_STATE_STOPPING_STCP_FINAL)) {
-        if (!nn_stcp_isidle (&ctcp->stcp))
-            return;
-        nn_backoff_stop (&ctcp->retry);
-        nn_usock_stop (&ctcp->usock);
-        nn_dns_stop (&ctcp->dns);
+        for (i = 0; i != ctcp->nconns; ++i)
+            nn_ctcp_conn_stop (&ctcp->conns [i]);
         ctcp->state = NN_CTCP_STATE_STOPPING;
     }
     if (nn_slow (ctcp->state == NN_CTCP_STATE_STOPPING)) {
-        if (!nn_backoff_isidle (&ctcp->retry) ||
-              !nn_usock_isidle (&ctcp->usock) ||
-              !nn_dns_isidle (&ctcp->dns))
-            return;
+        for (i = 0; i != ctcp->nconns; ++i)
+            if (!nn_ctcp_conn_isidle (&ctcp->conns [i]))
+                return;
         ctcp->state = NN_CTCP_STATE_IDLE;
         nn_fsm_stopped_noevent (&ctcp->fsm);
         nn_epbase_stopped (&ctcp->epbase);
@@ -273,6 +336,7 @@ static void nn_ctcp_shutdown (struct nn_fsm *self, int src, int type,
 static void nn_ctcp_handler (struct nn_fsm *self, int src, int type,
     NN_UNUSED void *srcptr)
 {
+    int i;
     struct nn_ctcp *ctcp;
 
     ctcp = nn_cont (self, struct nn_ctcp, fsm);
@@ -289,7 +353,9 @@ static void nn_ctcp_handler (struct nn_fsm *self, int src, int type,
         case NN_FSM_ACTION:
             switch (type) {
             case NN_FSM_START:
-                nn_ctcp_start_resolving (ctcp);
+                for (i = 0; i != ctcp->nconns; ++i)
+                    nn_ctcp_conn_start (&ctcp->conns [i]);
+                ctcp->state = NN_CTCP_STATE_ACTIVE;
                 return;
             default:
                 nn_fsm_bad_action (ctcp->state, src, type);
@@ -299,156 +365,314 @@ static void nn_ctcp_handler (struct nn_fsm *self, int src, int type,
             nn_fsm_bad_source (ctcp->state, src, type);
         }
 
+/******************************************************************************/
+/*  ACTIVE state.                                                             */
+/*  The connections take care of themselves in this state.                    */
+/******************************************************************************/
+    case NN_CTCP_STATE_ACTIVE:
+        nn_fsm_bad_source (ctcp->state, src, type);
+
+/******************************************************************************/
+/*  Invalid state.                                                            */
+/******************************************************************************/
+    default:
+        nn_fsm_bad_state (ctcp->state, src, type);
+    }
+}
+
+/******************************************************************************/
+/*  Parallel connections.                                                     */
+/******************************************************************************/
+
+static void nn_ctcp_conn_init (struct nn_ctcp_conn *self,
+    struct nn_epbase *epbase, struct nn_tlsctx *tlsctx, struct nn_fsm *owner)
+{
+    int reconnect_ivl;
+    int reconnect_ivl_max;
+    int reconnect_policy;
+    size_t sz;
+
+    nn_fsm_init (&self->fsm, nn_ctcp_conn_handler, nn_ctcp_conn_shutdown,
+        NN_CTCP_SRC_CONN, self, owner);
+    self->state = NN_CTCP_CONN_STATE_IDLE;
+    self->epbase = epbase;
+    self->tlsctx = tlsctx;
+    nn_connector_init (&self->connector, NN_CTCP_CONN_SRC_CONNECTOR, epbase,
+        nn_ctcp_setsockopts, &self->fsm);
+    self->locallen = 0;
+    self->host = NULL;
+    sz = sizeof (reconnect_ivl);
+    nn_epbase_getopt (epbase, NN_SOL_SOCKET, NN_RECONNECT_IVL,
+        &reconnect_ivl, &sz);
+    nn_assert (sz == sizeof (reconnect_ivl));
+    sz = sizeof (reconnect_ivl_max);
+    nn_epbase_getopt (epbase, NN_SOL_SOCKET, NN_RECONNECT_IVL_MAX,
+        &reconnect_ivl_max, &sz);
+    nn_assert (sz == sizeof (reconnect_ivl_max));
+    if (reconnect_ivl_max == 0)
+        reconnect_ivl_max = reconnect_ivl;
+    sz = sizeof (reconnect_policy);
+    nn_epbase_getopt (epbase, NN_SOL_SOCKET, NN_RECONNECT_POLICY,
+        &reconnect_policy, &sz);
+    nn_assert (sz == sizeof (reconnect_policy));
+    nn_backoff_init (&self->retry, NN_CTCP_CONN_SRC_RECONNECT_TIMER,
+        reconnect_policy, reconnect_ivl, reconnect_ivl_max, &self->fsm);
+    nn_stcp_init (&self->stcp, NN_CTCP_CONN_SRC_STCP, epbase, &self->fsm);
+    nn_dns_init (&self->dns, NN_CTCP_CONN_SRC_DNS, &self->fsm);
+}
+
+static void nn_ctcp_conn_term (struct nn_ctcp_conn *self)
+{
+    nn_assert_state (self, NN_CTCP_CONN_STATE_IDLE);
+
+    nn_dns_term (&self->dns);
+    nn_stcp_term (&self->stcp);
+    nn_backoff_term (&self->retry);
+    nn_connector_term (&self->connector);
+    nn_fsm_term (&self->fsm);
+}
+
+static int nn_ctcp_conn_isidle (struct nn_ctcp_conn *self)
+{
+    return nn_fsm_isidle (&self->fsm);
+}
+
+static void nn_ctcp_conn_start (struct nn_ctcp_conn *self)
+{
+    nn_fsm_start (&self->fsm);
+}
+
+static void nn_ctcp_conn_stop (struct nn_ctcp_conn *self)
+{
+    nn_fsm_stop (&self->fsm);
+}
+
+static void nn_ctcp_conn_shutdown (struct nn_fsm *self, int src, int type,
+    NN_UNUSED void *srcptr)
+{
+    struct nn_ctcp_conn *conn;
+
+    conn = nn_cont (self, struct nn_ctcp_conn, fsm);
+
+    if (nn_slow (src == NN_FSM_ACTION && type == NN_FSM_STOP)) {
+        if (!nn_stcp_isidle (&conn->stcp)) {
+            nn_epbase_stat_increment (conn->epbase,
+                NN_STAT_DROPPED_CONNECTIONS, 1);
+            nn_stcp_stop (&conn->stcp);
+        }
+        conn->state = NN_CTCP_CONN_STATE_STOPPING_STCP_FINAL;
+    }
+    if (nn_slow (conn->state == NN_CTCP_CONN_STATE_STOPPING_STCP_FINAL)) {
+        if (!nn_stcp_isidle (&conn->stcp))
+            return;
+        nn_backoff_stop (&conn->retry);
+        nn_connector_stop (&conn->connector);
+        nn_dns_stop (&conn->dns);
+        conn->state = NN_CTCP_CONN_STATE_STOPPING;
+    }
+    if (nn_slow (conn->state == NN_CTCP_CONN_STATE_STOPPING)) {
+        if (!nn_backoff_isidle (&conn->retry) ||
+              !nn_connector_isidle (&conn->connector) ||
+              !nn_dns_isidle (&conn->dns))
+            return;
+        conn->state = NN_CTCP_CONN_STATE_IDLE;
+        nn_fsm_stopped (&conn->fsm, NN_CTCP_CONN_STOPPED);
+        return;
+    }
+
+    nn_fsm_bad_state (conn->state, src, type);
+}
+
+static void nn_ctcp_conn_handler (struct nn_fsm *self, int src, int type,
+    NN_UNUSED void *srcptr)
+{
+    struct nn_ctcp_conn *conn;
+
+    conn = nn_cont (self, struct nn_ctcp_conn, fsm);
+
+    switch (conn->state) {
+
+/******************************************************************************/
+/*  IDLE state.                                                               */
+/*  The state machine wasn't yet started.                                     */
+/******************************************************************************/
+    case NN_CTCP_CONN_STATE_IDLE:
+        switch (src) {
+
+        case NN_FSM_ACTION:
+            switch (type) {
+            case NN_FSM_START:
+                nn_ctcp_conn_start_resolving (conn);
+                return;
+            default:
+                nn_fsm_bad_action (conn->state, src, type);
+            }
+
+        default:
+            nn_fsm_bad_source (conn->state, src, type);
+        }
+
 /******************************************************************************/
 /*  RESOLVING state.                                                          */
 /*  Name of the host to connect to is being resolved to get an IP address.    */
 /******************************************************************************/
-    case NN_CTCP_STATE_RESOLVING:
+    case NN_CTCP_CONN_STATE_RESOLVING:
         switch (src) {
 
-        case NN_CTCP_SRC_DNS:
+        case NN_CTCP_CONN_SRC_DNS:
             switch (type) {
             case NN_DNS_DONE:
-                nn_dns_stop (&ctcp->dns);
-                ctcp->state = NN_CTCP_STATE_STOPPING_DNS;
+                nn_dns_stop (&conn->dns);
+                conn->state = NN_CTCP_CONN_STATE_STOPPING_DNS;
                 return;
             default:
-                nn_fsm_bad_action (ctcp->state, src, type);
+                nn_fsm_bad_action (conn->state, src, type);
             }
 
         default:
-            nn_fsm_bad_source (ctcp->state, src, type);
+            nn_fsm_bad_source (conn->state, src, type);
         }
 
 /******************************************************************************/
 /*  STOPPING_DNS state.                                                       */
 /*  dns object was asked to stop but it haven't stopped yet.                  */
 /******************************************************************************/
-    case NN_CTCP_STATE_STOPPING_DNS:
+    case NN_CTCP_CONN_STATE_STOPPING_DNS:
         switch (src) {
 
-        case NN_CTCP_SRC_DNS:
+        case NN_CTCP_CONN_SRC_DNS:
             switch (type) {
             case NN_DNS_STOPPED:
-                if (ctcp->dns_result.error == 0) {
-                    nn_ctcp_start_connecting (ctcp, &ctcp->dns_result.addr,
-                        ctcp->dns_result.addrlen);
+                if (conn->dns_result.error == 0)
+                    nn_ctcp_conn_add_addrs (conn);
+
+                /*  Resolve the next host from the list, if any. */
+                conn->host = strchr (conn->host, ',');
+                if (conn->host) {
+                    ++conn->host;
+                    nn_ctcp_conn_resolve_host (conn);
+                    return;
+                }
+
+                if (nn_connector_count (&conn->connector) > 0) {
+                    nn_ctcp_conn_start_connecting (conn);
                     return;
                 }
-                nn_backoff_start (&ctcp->retry);
-                ctcp->state = NN_CTCP_STATE_WAITING;
+                nn_backoff_start (&conn->retry);
+                conn->state = NN_CTCP_CONN_STATE_WAITING;
                 return;
             default:
-                nn_fsm_bad_action (ctcp->state, src, type);
+                nn_fsm_bad_action (conn->state, src, type);
             }
 
         default:
-            nn_fsm_bad_source (ctcp->state, src, type);
+            nn_fsm_bad_source (conn->state, src, type);
         }
 
 /******************************************************************************/
 /*  CONNECTING state.                                                         */
-/*  Non-blocking connect is under way.                                        */
+/*  Non-blocking connects to the remote addresses are under way.              */
 /******************************************************************************/
-    case NN_CTCP_STATE_CONNECTING:
+    case NN_CTCP_CONN_STATE_CONNECTING:
         switch (src) {
 
-        case NN_CTCP_SRC_USOCK:
+        case NN_CTCP_CONN_SRC_CONNECTOR:
             switch (type) {
-            case NN_USOCK_CONNECTED:
-                nn_stcp_start (&ctcp->stcp, &ctcp->usock);
-                ctcp->state = NN_CTCP_STATE_ACTIVE;
-                nn_epbase_stat_increment (&ctcp->epbase,
+            case NN_CONNECTOR_CONNECTED:
+                nn_stcp_start (&conn->stcp,
+                    nn_connector_usock (&conn->connector),
+                    conn->tlsctx ? nn_ctcp_conn_new_tls (conn) : NULL);
+                conn->state = NN_CTCP_CONN_STATE_ACTIVE;
+                nn_epbase_stat_increment (conn->epbase,
                     NN_STAT_INPROGRESS_CONNECTIONS, -1);
-                nn_epbase_stat_increment (&ctcp->epbase,
+                nn_epbase_stat_increment (conn->epbase,
                     NN_STAT_ESTABLISHED_CONNECTIONS, 1);
-                nn_epbase_clear_error (&ctcp->epbase);
+                nn_epbase_clear_error (conn->epbase);
+                nn_backoff_reset (&conn->retry);
                 return;
-            case NN_USOCK_ERROR:
-                nn_epbase_set_error (&ctcp->epbase,
-                    nn_usock_geterrno (&ctcp->usock));
-                nn_usock_stop (&ctcp->usock);
-                ctcp->state = NN_CTCP_STATE_STOPPING_USOCK;
-                nn_epbase_stat_increment (&ctcp->epbase,
+            case NN_CONNECTOR_ERROR:
+                nn_epbase_set_error (conn->epbase,
+                    nn_connector_geterrno (&conn->connector));
+                nn_connector_stop (&conn->connector);
+                conn->state = NN_CTCP_CONN_STATE_STOPPING_CONNECTOR;
+                nn_epbase_stat_increment (conn->epbase,
                     NN_STAT_INPROGRESS_CONNECTIONS, -1);
-                nn_epbase_stat_increment (&ctcp->epbase,
+                nn_epbase_stat_increment (conn->epbase,
                     NN_STAT_CONNECT_ERRORS, 1);
                 return;
             default:
-                nn_fsm_bad_action (ctcp->state, src, type);
+                nn_fsm_bad_action (conn->state, src, type);
             }
 
         default:
-            nn_fsm_bad_source (ctcp->state, src, type);
+            nn_fsm_bad_source (conn->state, src, type);
         }
 
 /******************************************************************************/
 /*  ACTIVE state.                                                             */
 /*  Connection is established and handled by the stcp state machine.          */
 /******************************************************************************/
-    case NN_CTCP_STATE_ACTIVE:
+    case NN_CTCP_CONN_STATE_ACTIVE:
         switch (src) {
 
-        case NN_CTCP_SRC_STCP:
+        case NN_CTCP_CONN_SRC_STCP:
             switch (type) {
             case NN_STCP_ERROR:
-                nn_stcp_stop (&ctcp->stcp);
-                ctcp->state = NN_CTCP_STATE_STOPPING_STCP;
-                nn_epbase_stat_increment (&ctcp->epbase,
+                nn_stcp_stop (&conn->stcp);
+                conn->state = NN_CTCP_CONN_STATE_STOPPING_STCP;
+                nn_epbase_stat_increment (conn->epbase,
                     NN_STAT_BROKEN_CONNECTIONS, 1);
                 return;
             default:
-                nn_fsm_bad_action (ctcp->state, src, type);
+                nn_fsm_bad_action (conn->state, src, type);
             }
 
         default:
-            nn_fsm_bad_source (ctcp->state, src, type);
+            nn_fsm_bad_source (conn->state, src, type);
         }
 
 /******************************************************************************/
 /*  STOPPING_STCP state.                                                      */
 /*  stcp object was asked to stop but it haven't stopped yet.                 */
 /******************************************************************************/
-    case NN_CTCP_STATE_STOPPING_STCP:
+    case NN_CTCP_CONN_STATE_STOPPING_STCP:
         switch (src) {
 
-        case NN_CTCP_SRC_STCP:
+        case NN_CTCP_CONN_SRC_STCP:
             switch (type) {
             case NN_USOCK_SHUTDOWN:
                 return;
             case NN_STCP_STOPPED:
-                nn_usock_stop (&ctcp->usock);
-                ctcp->state = NN_CTCP_STATE_STOPPING_USOCK;
+                nn_connector_stop (&conn->connector);
+                conn->state = NN_CTCP_CONN_STATE_STOPPING_CONNECTOR;
                 return;
             default:
-                nn_fsm_bad_action (ctcp->state, src, type);
+                nn_fsm_bad_action (conn->state, src, type);
             }
 
         default:
-            nn_fsm_bad_source (ctcp->state, src, type);
+            nn_fsm_bad_source (conn->state, src, type);
         }
 
 /******************************************************************************/
-/*  STOPPING_USOCK state.                                                     */
-/*  usock object was asked to stop but it haven't stopped yet.                */
+/*  STOPPING_CONNECTOR state.                                                 */
+/*  connector object was asked to stop but it haven't stopped yet.            */
 /******************************************************************************/
-    case NN_CTCP_STATE_STOPPING_USOCK:
+    case NN_CTCP_CONN_STATE_STOPPING_CONNECTOR:
         switch (src) {
 
-        case NN_CTCP_SRC_USOCK:
+        case NN_CTCP_CONN_SRC_CONNECTOR:
             switch (type) {
-            case NN_USOCK_SHUTDOWN:
-                return;
-            case NN_USOCK_STOPPED:
-                nn_backoff_start (&ctcp->retry);
-                ctcp->state = NN_CTCP_STATE_WAITING;
+            case NN_CONNECTOR_STOPPED:
+                nn_backoff_start (&conn->retry);
+                conn->state = NN_CTCP_CONN_STATE_WAITING;
                 return;
             default:
-                nn_fsm_bad_action (ctcp->state, src, type);
+                nn_fsm_bad_action (conn->state, src, type);
             }
 
         default:
-            nn_fsm_bad_source (ctcp->state, src, type);
+            nn_fsm_bad_source (conn->state, src, type);
         }
 
 /******************************************************************************/
@@ -456,48 +680,48 @@ static void nn_ctcp_handler (struct nn_fsm *self, int src, int type,
 /*  Waiting before re-connection is attempted. This way we won't overload     */
 /*  the system by continuous re-connection attemps.                           */
 /******************************************************************************/
-    case NN_CTCP_STATE_WAITING:
+    case NN_CTCP_CONN_STATE_WAITING:
         switch (src) {
 
-        case NN_CTCP_SRC_RECONNECT_TIMER:
+        case NN_CTCP_CONN_SRC_RECONNECT_TIMER:
             switch (type) {
             case NN_BACKOFF_TIMEOUT:
-                nn_backoff_stop (&ctcp->retry);
-                ctcp->state = NN_CTCP_STATE_STOPPING_BACKOFF;
+                nn_backoff_stop (&conn->retry);
+                conn->state = NN_CTCP_CONN_STATE_STOPPING_BACKOFF;
                 return;
             default:
-                nn_fsm_bad_action (ctcp->state, src, type);
+                nn_fsm_bad_action (conn->state, src, type);
             }
 
         default:
-            nn_fsm_bad_source (ctcp->state, src, type);
+            nn_fsm_bad_source (conn->state, src, type);
         }
 
 /******************************************************************************/
 /*  STOPPING_BACKOFF state.                                                   */
 /*  backoff object was asked to stop, but it haven't stopped yet.             */
 /******************************************************************************/
-    case NN_CTCP_STATE_STOPPING_BACKOFF:
+    case NN_CTCP_CONN_STATE_STOPPING_BACKOFF:
         switch (src) {
 
-        case NN_CTCP_SRC_RECONNECT_TIMER:
+        case NN_CTCP_CONN_SRC_RECONNECT_TIMER:
             switch (type) {
             case NN_BACKOFF_STOPPED:
-                nn_ctcp_start_resolving (ctcp);
+                nn_ctcp_conn_start_resolving (conn);
                 return;
             default:
-                nn_fsm_bad_action (ctcp->state, src, type);
+                nn_fsm_bad_action (conn->state, src, type);
             }
 
         default:
-            nn_fsm_bad_source (ctcp->state, src, type);
+            nn_fsm_bad_source (conn->state, src, type);
         }
 
 /******************************************************************************/
 /*  Invalid state.                                                            */
 /******************************************************************************/
     default:
-        nn_fsm_bad_state (ctcp->state, src, type);
+        nn_fsm_bad_state (conn->state, src, type);
     }
 }
 
@@ -505,123 +729,139 @@ static void nn_ctcp_handler (struct nn_fsm *self, int src, int type,
 /*  State machine actions.                                                    */
 /******************************************************************************/
 
-static void nn_ctcp_start_resolving (struct nn_ctcp *self)
+static void nn_ctcp_conn_start_resolving (struct nn_ctcp_conn *self)
 {
+    int rc;
     const char *addr;
-    const char *begin;
-    const char *end;
+    const char *semicolon;
     int ipv4only;
     size_t ipv4onlylen;
 
-    /*  Extract the hostname part from address string. */
-    addr = nn_epbase_getaddr (&self->epbase);
-    begin = strchr (addr, ';');
-    if (!begin)
-        begin = addr;
-    else
-        ++begin;
-    end = strrchr (addr, ':');
-    nn_assert (end);
-
     /*  Check whether IPv6 is to be used. */
     ipv4onlylen = sizeof (ipv4only);
-    nn_epbase_getopt (&self->epbase, NN_SOL_SOCKET, NN_IPV4ONLY,
+    nn_epbase_getopt (self->epbase, NN_SOL_SOCKET, NN_IPV4ONLY,
         &ipv4only, &ipv4onlylen);
     nn_assert (ipv4onlylen == sizeof (ipv4only));
 
-    /*  TODO: Get the actual value of IPV4ONLY option. */
-    nn_dns_start (&self->dns, begin, end - begin, ipv4only, &self->dns_result);
+    /*  Parse the local address, if any. */
+    addr = nn_epbase_getaddr (self->epbase);
+    semicolon = strchr (addr, ';');
+    memset (&self->local, 0, sizeof (self->local));
+    if (semicolon)
+        rc = nn_iface_resolve (addr, semicolon - addr, ipv4only,
+            &self->local, &self->locallen);
+    else
+        rc = nn_iface_resolve ("*", 1, ipv4only, &self->local,
+            &self->locallen);
+    if (nn_slow (rc < 0)) {
+        nn_backoff_start (&self->retry);
+        self->state = NN_CTCP_CONN_STATE_WAITING;
+        return;
+    }
 
-    self->state = NN_CTCP_STATE_RESOLVING;
+    /*  Start with the first remote host. */
+    self->host = semicolon ? semicolon + 1 : addr;
+    nn_ctcp_conn_resolve_host (self);
 }
 
-static void nn_ctcp_start_connecting (struct nn_ctcp *self,
-    struct sockaddr_storage *ss, size_t sslen)
+static void nn_ctcp_conn_resolve_host (struct nn_ctcp_conn *self)
 {
     int rc;
-    struct sockaddr_storage remote;
-    size_t remotelen;
-    struct sockaddr_storage local;
-    size_t locallen;
-    const char *addr;
-    const char *end;
     const char *colon;
-    const char *semicolon;
-    uint16_t port;
+    const char *end;
     int ipv4only;
     size_t ipv4onlylen;
-    int val;
-    size_t sz;
 
-    /*  Create IP address from the address string. */
-    addr = nn_epbase_getaddr (&self->epbase);
-    memset (&remote, 0, sizeof (remote));
-
-    /*  Parse the port. */
-    end = addr + strlen (addr);
-    colon = strrchr (addr, ':');
-    rc = nn_port_resolve (colon + 1, end - colon - 1);
+    /*  Extract the hostname part of the current host. */
+    rc = nn_ctcp_parse_host (self->host, &colon, &end);
     errnum_assert (rc > 0, -rc);
-    port = rc;
 
     /*  Check whether IPv6 is to be used. */
     ipv4onlylen = sizeof (ipv4only);
-    nn_epbase_getopt (&self->epbase, NN_SOL_SOCKET, NN_IPV4ONLY,
+    nn_epbase_getopt (self->epbase, NN_SOL_SOCKET, NN_IPV4ONLY,
         &ipv4only, &ipv4onlylen);
     nn_assert (ipv4onlylen == sizeof (ipv4only));
 
-    /*  Parse the local address, if any. */
-    semicolon = strchr (addr, ';');
-    memset (&local, 0, sizeof (local));
-    if (semicolon)
-        rc = nn_iface_resolve (addr, semicolon - addr, ipv4only,
-            &local, &locallen);
-    else
-        rc = nn_iface_resolve ("*", 1, ipv4only, &local, &locallen);
-    if (nn_slow (rc < 0)) {
-        nn_backoff_start (&self->retry);
-        self->state = NN_CTCP_STATE_WAITING;
-        return;
-    }
+    nn_dns_start (&self->dns, self->host, colon - self->host, ipv4only,
+        &self->dns_result);
 
-    /*  Combine the remote address and the port. */
-    remote = *ss;
-    remotelen = sslen;
-    if (remote.ss_family == AF_INET)
-        ((struct sockaddr_in*) &remote)->sin_port = htons (port);
-    else if (remote.ss_family == AF_INET6)
-        ((struct sockaddr_in6*) &remote)->sin6_port = htons (port);
-    else
-        nn_assert (0);
+    self->state = NN_CTCP_CONN_STATE_RESOLVING;
+}
 
-    /*  Try to start the underlying socket. */
-    rc = nn_usock_start (&self->usock, remote.ss_family, SOCK_STREAM, 0);
-    if (nn_slow (rc < 0)) {
-        nn_backoff_start (&self->retry);
-        self->state = NN_CTCP_STATE_WAITING;
-        return;
+static void nn_ctcp_conn_add_addrs (struct nn_ctcp_conn *self)
+{
+    int rc;
+    int i;
+    const char *colon;
+    const char *end;
+    uint16_t port;
+    struct sockaddr_storage *ss;
+
+    /*  Parse the port of the current host. */
+    rc = nn_ctcp_parse_host (self->host, &colon, &end);
+    errnum_assert (rc > 0, -rc);
+    port = rc;
+
+    /*  Combine the resolved addresses and the port. */
+    for (i = 0; i != self->dns_result.naddrs; ++i) {
+        ss = &self->dns_result.addrs [i];
+        if (ss->ss_family == AF_INET)
+            ((struct sockaddr_in*) ss)->sin_port = htons (port);
+        else if (ss->ss_family == AF_INET6)
+            ((struct sockaddr_in6*) ss)->sin6_port = htons (port);
+        else
+            nn_assert (0);
+        if (nn_connector_count (&self->connector) < NN_CONNECTOR_MAX_ADDRS)
+            self->hosts [nn_connector_count (&self->connector)] = self->host;
+        nn_connector_add (&self->connector, (struct sockaddr*) ss,
+            self->dns_result.addrlens [i]);
     }
+}
 
-    /*  Set the relevant socket options. */
-    sz = sizeof (val);
-    nn_epbase_getopt (&self->epbase, NN_SOL_SOCKET, NN_SNDBUF, &val, &sz);
-    nn_assert (sz == sizeof (val));
-    nn_usock_setsockopt (&self->usock, SOL_SOCKET, SO_SNDBUF,
-        &val, sizeof (val));
-    sz = sizeof (val);
-    nn_epbase_getopt (&self->epbase, NN_SOL_SOCKET, NN_RCVBUF, &val, &sz);
-    nn_assert (sz == sizeof (val));
-    nn_usock_setsockopt (&self->usock, SOL_SOCKET, SO_RCVBUF,
-        &val, sizeof (val));
-
-    /*  Bind the socket to the local network interface. */
-    rc = nn_usock_bind (&self->usock, (struct sockaddr*) &local, locallen);
-    errnum_assert (rc == 0, -rc);
-
-    /*  Start connecting. */
-    nn_usock_connect (&self->usock, (struct sockaddr*) &remote, remotelen);
-    self->state = NN_CTCP_STATE_CONNECTING;
-    nn_epbase_stat_increment (&self->epbase,
+static void nn_ctcp_conn_start_connecting (struct nn_ctcp_conn *self)
+{
+    nn_connector_start (&self->connector, (struct sockaddr*) &self->local,
+        self->locallen);
+    self->state = NN_CTCP_CONN_STATE_CONNECTING;
+    nn_epbase_stat_increment (self->epbase,
         NN_STAT_INPROGRESS_CONNECTIONS, 1);
 }
 
+static void *nn_ctcp_conn_new_tls (struct nn_ctcp_conn *self)
+{
+    int rc;
+    const char *host;
+    const char *colon;
+    const char *end;
+
+    /*  Find out which of the remote hosts the connection was made to. */
+    host = self->hosts [nn_connector_index (&self->connector)];
+    rc = nn_ctcp_parse_host (host, &colon, &end);
+    errnum_assert (rc > 0, -rc);
+
+    return nn_tlsctx_new (self->tlsctx, host, colon - host);
+}
+
+/*  Parses a single 'host:port' element of the remote address. The element is
+    terminated either by a comma or by the end of the string. Returns the port
+    number or a negative error code. */
+static int nn_ctcp_parse_host (const char *host, const char **colon,
+    const char **end)
+{
+    const char *it;
+
+    *colon = NULL;
+    for (it = host; *it && *it != ','; ++it)
+        if (*it == ':')
+            *colon = it;
+    *end = it;
+    if (nn_slow (!*colon))
+        return -EINVAL;
+    return nn_port_resolve (*colon + 1, *end - *colon - 1);
+}
+
+static void nn_ctcp_setsockopts (struct nn_epbase *epbase,
+    struct nn_usock *usock)
+{
+    nn_tcp_setsockopts (epbase, usock, 0);
+}
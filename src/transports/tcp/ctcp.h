@@ -27,7 +27,9 @@
 
 /*  State machine managing connected TCP socket. */
 
-int nn_ctcp_create (void *hint, struct nn_epbase **epbase);
+/*  If 'tls' is non-zero, connections are secured by TLS configured by NN_TLS
+    socket options. */
+int nn_ctcp_create (void *hint, struct nn_epbase **epbase, int tls);
 
 #endif
 
@@ -37,6 +37,7 @@
 #define NN_STCP_STATE_SHUTTING_DOWN 5
 #define NN_STCP_STATE_DONE 6
 #define NN_STCP_STATE_STOPPING 7
+#define NN_STCP_STATE_HANDSHAKE 8
 
 /*  Possible states of the inbound part of the object. */
 #define NN_STCP_INSTATE_HDR 1
@@ -47,6 +48,14 @@
 #define NN_STCP_OUTSTATE_IDLE 1
 #define NN_STCP_OUTSTATE_SENDING 2
 
+/*  With flow control, message header with the top bit set is a credit
+    grant. The remaining bits specify the number of bytes granted. */
+#define NN_STCP_CREDIT (((uint64_t) 1) << 63)
+
+/*  Header with the second highest bit set precedes a message that expires.
+    The remaining bits specify its time to live in milliseconds. */
+#define NN_STCP_TTL (((uint64_t) 1) << 62)
+
 /*  Subordinate srcptr objects. */
 #define NN_STCP_SRC_USOCK 1
 #define NN_STCP_SRC_STREAMHDR 2
@@ -64,10 +73,19 @@ static void nn_stcp_handler (struct nn_fsm *self, int src, int type,
     void *srcptr);
 static void nn_stcp_shutdown (struct nn_fsm *self, int src, int type,
     void *srcptr);
+static void nn_stcp_process_hdr (struct nn_stcp *self);
+static void nn_stcp_send_outmsg (struct nn_stcp *self);
+static void nn_stcp_send_next (struct nn_stcp *self);
+static int nn_stcp_writable (struct nn_stcp *self);
+static void nn_stcp_unblock (struct nn_stcp *self);
 
 void nn_stcp_init (struct nn_stcp *self, int src,
     struct nn_epbase *epbase, struct nn_fsm *owner)
 {
+    int sndbuf;
+    int rcvbuf;
+    size_t sz;
+
     nn_fsm_init (&self->fsm, nn_stcp_handler, nn_stcp_shutdown,
         src, self, owner);
     self->state = NN_STCP_STATE_IDLE;
@@ -75,11 +93,30 @@ void nn_stcp_init (struct nn_stcp *self, int src,
     self->usock = NULL;
     self->usock_owner.src = -1;
     self->usock_owner.fsm = NULL;
+    self->ssl = NULL;
     nn_pipebase_init (&self->pipebase, &nn_stcp_pipebase_vfptr, epbase);
     self->instate = -1;
     nn_msg_init (&self->inmsg, 0);
     self->outstate = -1;
     nn_msg_init (&self->outmsg, 0);
+    sz = sizeof (sndbuf);
+    nn_pipebase_getopt (&self->pipebase, NN_SOL_SOCKET, NN_SNDBUF,
+        &sndbuf, &sz);
+    nn_assert (sz == sizeof (sndbuf));
+    nn_sndq_init (&self->sndq, (size_t) sndbuf);
+    self->outblocked = 0;
+    sz = sizeof (rcvbuf);
+    nn_pipebase_getopt (&self->pipebase, NN_SOL_SOCKET, NN_RCVBUF,
+        &rcvbuf, &sz);
+    nn_assert (sz == sizeof (rcvbuf));
+    self->rcvbuf = (size_t) rcvbuf;
+    self->flowctl = 0;
+    self->credit = 0;
+    self->consumed = 0;
+    self->grant = 0;
+    self->ctlsending = 0;
+    self->deadlines = 0;
+    self->inttl = -1;
     nn_fsm_event_init (&self->done);
 }
 
@@ -88,6 +125,7 @@ void nn_stcp_term (struct nn_stcp *self)
     nn_assert_state (self, NN_STCP_STATE_IDLE);
 
     nn_fsm_event_term (&self->done);
+    nn_sndq_term (&self->sndq);
     nn_msg_term (&self->outmsg);
     nn_msg_term (&self->inmsg);
     nn_pipebase_term (&self->pipebase);
@@ -100,7 +138,7 @@ int nn_stcp_isidle (struct nn_stcp *self)
     return nn_fsm_isidle (&self->fsm);
 }
 
-void nn_stcp_start (struct nn_stcp *self, struct nn_usock *usock)
+void nn_stcp_start (struct nn_stcp *self, struct nn_usock *usock, void *ssl)
 {
     /*  Take ownership of the underlying socket. */
     nn_assert (self->usock == NULL && self->usock_owner.fsm == NULL);
@@ -108,6 +146,7 @@ void nn_stcp_start (struct nn_stcp *self, struct nn_usock *usock)
     self->usock_owner.fsm = &self->fsm;
     nn_usock_swap_owner (usock, &self->usock_owner);
     self->usock = usock;
+    self->ssl = ssl;
 
     /*  Launch the state machine. */
     nn_fsm_start (&self->fsm);
@@ -121,31 +160,35 @@ void nn_stcp_stop (struct nn_stcp *self)
 static int nn_stcp_send (struct nn_pipebase *self, struct nn_msg *msg)
 {
     struct nn_stcp *stcp;
-    struct nn_iovec iov [3];
 
     stcp = nn_cont (self, struct nn_stcp, pipebase);
 
     nn_assert_state (stcp, NN_STCP_STATE_ACTIVE);
-    nn_assert (stcp->outstate == NN_STCP_OUTSTATE_IDLE);
-
-    /*  Move the message to the local storage. */
-    nn_msg_term (&stcp->outmsg);
-    nn_msg_mv (&stcp->outmsg, msg);
-
-    /*  Serialise the message header. */
-    nn_putll (stcp->outhdr, nn_chunkref_size (&stcp->outmsg.sphdr) +
-        nn_chunkref_size (&stcp->outmsg.body));
-
-    /*  Start async sending. */
-    iov [0].iov_base = stcp->outhdr;
-    iov [0].iov_len = sizeof (stcp->outhdr);
-    iov [1].iov_base = nn_chunkref_data (&stcp->outmsg.sphdr);
-    iov [1].iov_len = nn_chunkref_size (&stcp->outmsg.sphdr);
-    iov [2].iov_base = nn_chunkref_data (&stcp->outmsg.body);
-    iov [2].iov_len = nn_chunkref_size (&stcp->outmsg.body);
-    nn_usock_send (stcp->usock, iov, 3);
+    nn_assert (!stcp->outblocked);
+
+    /*  Use up the credit. */
+    if (stcp->flowctl)
+        stcp->credit -= nn_chunkref_size (&msg->sphdr) +
+            nn_msg_bodysize (msg);
+
+    /*  If the socket is busy, queue the message. */
+    if (stcp->outstate == NN_STCP_OUTSTATE_SENDING || stcp->ctlsending)
+        nn_sndq_push (&stcp->sndq, msg);
+    else {
+        nn_msg_term (&stcp->outmsg);
+        nn_msg_mv (&stcp->outmsg, msg);
+        nn_stcp_send_outmsg (stcp);
+    }
 
-    stcp->outstate = NN_STCP_OUTSTATE_SENDING;
+    /*  The pipe remains writable until the queue is full or, with flow
+        control, until the credit is exhausted. */
+    if (nn_slow (!nn_stcp_writable (stcp))) {
+        stcp->outblocked = 1;
+        nn_pipebase_throttle (&stcp->pipebase,
+            stcp->flowctl && stcp->credit <= 0);
+    }
+    else
+        nn_pipebase_sent (&stcp->pipebase);
 
     return 0;
 }
@@ -159,13 +202,34 @@ static int nn_stcp_recv (struct nn_pipebase *self, struct nn_msg *msg)
     nn_assert_state (stcp, NN_STCP_STATE_ACTIVE);
     nn_assert (stcp->instate == NN_STCP_INSTATE_HASMSG);
 
+    /*  Once the user have received half of the receive buffer, let the peer
+        send more. */
+    if (stcp->flowctl) {
+        stcp->consumed += nn_chunkref_size (&stcp->inmsg.body);
+        if (stcp->consumed >= stcp->rcvbuf / 2) {
+            stcp->grant += stcp->consumed;
+            stcp->consumed = 0;
+
+            /*  If a message is being sent, the grant goes out as soon as
+                it's done, in front of the next message from the queue. */
+            if (stcp->outstate == NN_STCP_OUTSTATE_IDLE && !stcp->ctlsending)
+                nn_stcp_send_next (stcp);
+        }
+    }
+
     /*  Move received message to the user. */
     nn_msg_mv (msg, &stcp->inmsg);
     nn_msg_init (&stcp->inmsg, 0);
 
-    /*  Start receiving new message. */
+    /*  Start receiving new message. If the whole message was already read
+        from the socket, it is made available straight away, without
+        a round-trip through the state machine. */
     stcp->instate = NN_STCP_INSTATE_HDR;
-    nn_usock_recv (stcp->usock, stcp->inhdr, sizeof (stcp->inhdr));
+    if (nn_usock_recv_buffered (stcp->usock, stcp->inhdr,
+          sizeof (stcp->inhdr)))
+        nn_stcp_process_hdr (stcp);
+    else
+        nn_usock_recv (stcp->usock, stcp->inhdr, sizeof (stcp->inhdr));
 
     return 0;
 }
@@ -180,6 +244,10 @@ static void nn_stcp_shutdown (struct nn_fsm *self, int src, int type,
     if (nn_slow (src == NN_FSM_ACTION && type == NN_FSM_STOP)) {
         nn_pipebase_stop (&stcp->pipebase);
         nn_streamhdr_stop (&stcp->streamhdr);
+
+        /*  The object may be reused for a new connection. Messages queued
+            for this one must not be sent there. */
+        nn_sndq_clear (&stcp->sndq);
         stcp->state = NN_STCP_STATE_STOPPING;
     }
     if (nn_slow (stcp->state == NN_STCP_STATE_STOPPING)) {
@@ -203,7 +271,6 @@ static void nn_stcp_handler (struct nn_fsm *self, int src, int type,
 {
     int rc;
     struct nn_stcp *stcp;
-    uint64_t size;
 
     stcp = nn_cont (self, struct nn_stcp, fsm);
 
@@ -218,10 +285,53 @@ static void nn_stcp_handler (struct nn_fsm *self, int src, int type,
         case NN_FSM_ACTION:
             switch (type) {
             case NN_FSM_START:
+
+                /*  With TLS, the connection has to be secured before
+                    the protocol header is exchanged. */
+                if (stcp->ssl) {
+                    nn_usock_tls (stcp->usock, stcp->ssl);
+                    stcp->ssl = NULL;
+                    stcp->state = NN_STCP_STATE_HANDSHAKE;
+                    return;
+                }
+                nn_streamhdr_start (&stcp->streamhdr, stcp->usock,
+                    &stcp->pipebase,
+                    NN_STREAMHDR_FLOWCTL | NN_STREAMHDR_DEADLINE);
+                stcp->state = NN_STCP_STATE_PROTOHDR;
+                return;
+            default:
+                nn_fsm_bad_action (stcp->state, src, type);
+            }
+
+        default:
+            nn_fsm_bad_source (stcp->state, src, type);
+        }
+
+/******************************************************************************/
+/*  HANDSHAKE state.                                                          */
+/*  TLS handshake is being performed.                                         */
+/******************************************************************************/
+    case NN_STCP_STATE_HANDSHAKE:
+        switch (src) {
+
+        case NN_STCP_SRC_USOCK:
+            switch (type) {
+            case NN_USOCK_SECURED:
                 nn_streamhdr_start (&stcp->streamhdr, stcp->usock,
-                    &stcp->pipebase);
+                    &stcp->pipebase,
+                    NN_STREAMHDR_FLOWCTL | NN_STREAMHDR_DEADLINE);
                 stcp->state = NN_STCP_STATE_PROTOHDR;
                 return;
+
+            case NN_USOCK_SHUTDOWN:
+                stcp->state = NN_STCP_STATE_SHUTTING_DOWN;
+                return;
+
+            case NN_USOCK_ERROR:
+                stcp->state = NN_STCP_STATE_DONE;
+                nn_fsm_raise (&stcp->fsm, &stcp->done, NN_STCP_ERROR);
+                return;
+
             default:
                 nn_fsm_bad_action (stcp->state, src, type);
             }
@@ -285,8 +395,27 @@ static void nn_stcp_handler (struct nn_fsm *self, int src, int type,
                  nn_usock_recv (stcp->usock, &stcp->inhdr,
                      sizeof (stcp->inhdr));
 
-                 /*  Mark the pipe as available for sending. */
+                 /*  Mark the pipe as available for sending. Nothing may
+                     be left over from the previous connection. */
+                 nn_assert (stcp->sndq.count == 0);
                  stcp->outstate = NN_STCP_OUTSTATE_IDLE;
+                 stcp->outblocked = 0;
+
+                 /*  With flow control, the peer can't send anything until
+                     it's granted the credit. */
+                 stcp->flowctl = stcp->streamhdr.features &
+                     NN_STREAMHDR_FLOWCTL ? 1 : 0;
+                 stcp->credit = 0;
+                 stcp->consumed = 0;
+                 stcp->ctlsending = 0;
+                 stcp->grant = 0;
+                 stcp->deadlines = stcp->streamhdr.features &
+                     NN_STREAMHDR_DEADLINE ? 1 : 0;
+                 stcp->inttl = -1;
+                 if (stcp->flowctl) {
+                     stcp->grant = stcp->rcvbuf;
+                     nn_stcp_send_next (stcp);
+                 }
 
                  stcp->state = NN_STCP_STATE_ACTIVE;
                  return;
@@ -309,37 +438,28 @@ static void nn_stcp_handler (struct nn_fsm *self, int src, int type,
             switch (type) {
             case NN_USOCK_SENT:
 
-                /*  The message is now fully sent. */
-                nn_assert (stcp->outstate == NN_STCP_OUTSTATE_SENDING);
-                stcp->outstate = NN_STCP_OUTSTATE_IDLE;
-                nn_msg_term (&stcp->outmsg);
-                nn_msg_init (&stcp->outmsg, 0);
-                nn_pipebase_sent (&stcp->pipebase);
+                /*  The credit grant or the message is now fully sent. Start
+                    sending the next one from the queue, if any. */
+                if (stcp->ctlsending)
+                    stcp->ctlsending = 0;
+                else {
+                    nn_assert (stcp->outstate == NN_STCP_OUTSTATE_SENDING);
+                    nn_msg_term (&stcp->outmsg);
+                    nn_msg_init (&stcp->outmsg, 0);
+                    stcp->outstate = NN_STCP_OUTSTATE_IDLE;
+                }
+                nn_stcp_send_next (stcp);
+
+                /*  If the queue have drained enough, the pipe becomes
+                    writable again. */
+                nn_stcp_unblock (stcp);
                 return;
 
             case NN_USOCK_RECEIVED:
 
                 switch (stcp->instate) {
                 case NN_STCP_INSTATE_HDR:
-
-                    /*  Message header was received. Allocate memory for the
-                        message. */
-                    size = nn_getll (stcp->inhdr);
-                    nn_msg_term (&stcp->inmsg);
-                    nn_msg_init (&stcp->inmsg, (size_t) size);
-
-                    /*  Special case when size of the message body is 0. */
-                    if (!size) {
-                        stcp->instate = NN_STCP_INSTATE_HASMSG;
-                        nn_pipebase_received (&stcp->pipebase);
-                        return;
-                    }
-
-                    /*  Start receiving the message body. */
-                    stcp->instate = NN_STCP_INSTATE_BODY;
-                    nn_usock_recv (stcp->usock,
-                        nn_chunkref_data (&stcp->inmsg.body), (size_t) size);
-
+                    nn_stcp_process_hdr (stcp);
                     return;
 
                 case NN_STCP_INSTATE_BODY:
@@ -414,3 +534,162 @@ static void nn_stcp_handler (struct nn_fsm *self, int src, int type,
     }
 }
 
+static void nn_stcp_process_hdr (struct nn_stcp *self)
+{
+    uint64_t size;
+
+    /*  Message header was received. */
+    size = nn_getll (self->inhdr);
+
+    /*  Credit grants and time-to-live headers are processed straight away
+        and the next header is read. Loop is used so that long series of
+        grants in the read-ahead buffer don't exhaust the stack. */
+    while (nn_slow ((self->flowctl && (size & NN_STCP_CREDIT)) ||
+          (self->deadlines && (size & NN_STCP_TTL)))) {
+        if (size & NN_STCP_CREDIT) {
+            self->credit += size & ~NN_STCP_CREDIT;
+            nn_stcp_unblock (self);
+        }
+        else
+            self->inttl = (int) (size & ~NN_STCP_TTL);
+        if (!nn_usock_recv_buffered (self->usock, self->inhdr,
+              sizeof (self->inhdr))) {
+            nn_usock_recv (self->usock, self->inhdr, sizeof (self->inhdr));
+            return;
+        }
+        size = nn_getll (self->inhdr);
+    }
+
+    /*  Allocate memory for the message. */
+    nn_msg_term (&self->inmsg);
+    nn_msg_init (&self->inmsg, (size_t) size);
+    if (nn_slow (self->inttl >= 0)) {
+        nn_pipebase_setttl (&self->pipebase, &self->inmsg, self->inttl);
+        self->inttl = -1;
+    }
+
+    /*  If the body was already read from the socket, along with the header,
+        the message is complete. This is also the case when size of the
+        message body is 0. */
+    if (!size || nn_usock_recv_buffered (self->usock,
+          nn_chunkref_data (&self->inmsg.body), (size_t) size)) {
+        self->instate = NN_STCP_INSTATE_HASMSG;
+        nn_pipebase_received (&self->pipebase);
+        return;
+    }
+
+    /*  Start receiving the message body. The part of it that was already
+        read is picked up from the read-ahead buffer, the rest is read
+        by a single operation. */
+    self->instate = NN_STCP_INSTATE_BODY;
+    nn_usock_recv (self->usock, nn_chunkref_data (&self->inmsg.body),
+        (size_t) size);
+}
+
+static void nn_stcp_send_outmsg (struct nn_stcp *self)
+{
+    struct nn_iovec iov [NN_USOCK_MAX_IOVCNT];
+    int iovcnt;
+    size_t hdrlen;
+    int ttl;
+
+    /*  Pending credit grant is sent along with the message so that it
+        doesn't have to wait for the message to be written out. */
+    hdrlen = 0;
+    if (nn_slow (self->grant)) {
+        nn_putll (self->outhdr, NN_STCP_CREDIT | self->grant);
+        self->grant = 0;
+        hdrlen += 8;
+    }
+
+    /*  If the peer understands deadlines, message that expires is preceded
+        by its remaining time to live. */
+    if (nn_slow (self->deadlines && self->outmsg.deadline)) {
+        ttl = nn_pipebase_ttl (&self->pipebase, &self->outmsg);
+        nn_putll (self->outhdr + hdrlen,
+            NN_STCP_TTL | (uint64_t) (ttl ? ttl : 1));
+        hdrlen += 8;
+    }
+
+    /*  Serialise the message header. */
+    nn_putll (self->outhdr + hdrlen,
+        nn_chunkref_size (&self->outmsg.sphdr) +
+        nn_msg_bodysize (&self->outmsg));
+    hdrlen += 8;
+
+    /*  Start async sending. If possible, the headers are prepended to
+        the body in place so that the message is a single buffer. */
+    if (nn_fast (nn_msg_prepend (&self->outmsg, self->outhdr,
+          hdrlen) == 0)) {
+        iovcnt = nn_msg_bodyiov (&self->outmsg, iov);
+    }
+    else {
+        iov [0].iov_base = self->outhdr;
+        iov [0].iov_len = hdrlen;
+        iov [1].iov_base = nn_chunkref_data (&self->outmsg.sphdr);
+        iov [1].iov_len = nn_chunkref_size (&self->outmsg.sphdr);
+        iovcnt = 2 + nn_msg_bodyiov (&self->outmsg, iov + 2);
+    }
+    nn_usock_send (self->usock, iov, iovcnt);
+
+    self->outstate = NN_STCP_OUTSTATE_SENDING;
+}
+
+static void nn_stcp_send_next (struct nn_stcp *self)
+{
+    struct nn_iovec iov;
+
+    nn_assert (self->outstate == NN_STCP_OUTSTATE_IDLE && !self->ctlsending);
+
+    /*  Messages that have expired while waiting in the queue are dropped.
+        The credit they've used up is returned. Pending credit grant is
+        sent in front of the next message, ahead of the rest of the queue. */
+    nn_msg_term (&self->outmsg);
+    while (nn_sndq_pop (&self->sndq, &self->outmsg) == 0) {
+        if (nn_fast (!nn_pipebase_expired (&self->pipebase, &self->outmsg))) {
+            nn_stcp_send_outmsg (self);
+            return;
+        }
+        if (self->flowctl)
+            self->credit += nn_chunkref_size (&self->outmsg.sphdr) +
+                nn_msg_bodysize (&self->outmsg);
+        nn_msg_term (&self->outmsg);
+    }
+    nn_msg_init (&self->outmsg, 0);
+
+    /*  There's no message to send the credit grant with. Send it on its
+        own so that the peer doesn't stall. */
+    if (self->grant) {
+        nn_putll (self->ctlhdr, NN_STCP_CREDIT | self->grant);
+        self->grant = 0;
+        iov.iov_base = self->ctlhdr;
+        iov.iov_len = sizeof (self->ctlhdr);
+        nn_usock_send (self->usock, &iov, 1);
+        self->ctlsending = 1;
+    }
+}
+
+static int nn_stcp_writable (struct nn_stcp *self)
+{
+    if (nn_sndq_full (&self->sndq))
+        return 0;
+    if (self->flowctl && self->credit <= 0)
+        return 0;
+    return 1;
+}
+
+static void nn_stcp_unblock (struct nn_stcp *self)
+{
+    if (!self->outblocked)
+        return;
+
+    /*  If the pipe can accept messages again, let the user know. Otherwise
+        update the reason why it can't. */
+    if (nn_stcp_writable (self)) {
+        self->outblocked = 0;
+        nn_pipebase_sent (&self->pipebase);
+        return;
+    }
+    nn_pipebase_throttle (&self->pipebase,
+        self->flowctl && self->credit <= 0);
+}
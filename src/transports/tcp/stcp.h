@@ -29,6 +29,7 @@
 #include "../../aio/usock.h"
 
 #include "../utils/streamhdr.h"
+#include "../utils/sndq.h"
 
 #include "../../utils/msg.h"
 
@@ -53,6 +54,10 @@ struct nn_stcp {
     /*  The original owner of the underlying socket. */
     struct nn_fsm_owner usock_owner;
 
+    /*  TLS session to run over the socket, if any. It's handed over to
+        the socket when the state machine is started. */
+    void *ssl;
+
     /*  Pipe connecting this TCP connection to the nanomsg core. */
     struct nn_pipebase pipebase;
 
@@ -62,18 +67,50 @@ struct nn_stcp {
     /*  Buffer used to store the header of incoming message. */
     uint8_t inhdr [8];
 
+    /*  Time to live of the message being received or -1 if it never
+        expires. */
+    int inttl;
+
     /*  Message being received at the moment. */
     struct nn_msg inmsg;
 
     /*  State of the outbound state machine. */
     int outstate;
 
-    /*  Buffer used to store the header of outgoing message. */
-    uint8_t outhdr [8];
+    /*  Buffer used to store the header of outgoing message, preceded by
+        its time to live and by a pending credit grant, if any. */
+    uint8_t outhdr [24];
 
     /*  Message being sent at the moment. */
     struct nn_msg outmsg;
 
+    /*  Messages waiting for the one above to be sent. */
+    struct nn_sndq sndq;
+
+    /*  1 if the send queue is full and the pipe waits for it to drain. */
+    int outblocked;
+
+    /*  1 if credit-based flow control was negotiated with the peer. */
+    int flowctl;
+
+    /*  Number of bytes the peer is willing to accept. As one message is
+        allowed to exceed the credit it may drop below zero. */
+    int64_t credit;
+
+    /*  Size of the receive buffer, number of bytes received by the user
+        since the last grant and number of bytes to be granted to the peer. */
+    size_t rcvbuf;
+    size_t consumed;
+    size_t grant;
+
+    /*  Header used to grant the credit when there's no message to send it
+        with and whether it's being sent. */
+    uint8_t ctlhdr [8];
+    int ctlsending;
+
+    /*  1 if the peer accepts message deadlines. */
+    int deadlines;
+
     /*  Event raised when the state machine ends. */
     struct nn_fsm_event done;
 };
@@ -83,7 +120,7 @@ void nn_stcp_init (struct nn_stcp *self, int src,
 void nn_stcp_term (struct nn_stcp *self);
 
 int nn_stcp_isidle (struct nn_stcp *self);
-void nn_stcp_start (struct nn_stcp *self, struct nn_usock *usock);
+void nn_stcp_start (struct nn_stcp *self, struct nn_usock *usock, void *ssl);
 void nn_stcp_stop (struct nn_stcp *self);
 
 #endif
@@ -42,13 +42,35 @@
 #include "../../utils/win.h"
 #else
 #include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #endif
 
+/*  Platforms name the TCP keepalive idle time differently. */
+#if !defined TCP_KEEPIDLE && defined TCP_KEEPALIVE
+#define TCP_KEEPIDLE TCP_KEEPALIVE
+#endif
+
+/*  Maximum number of parallel connections per connecting endpoint. */
+#define NN_TCP_MAX_CONNECTIONS 256
+
 /*  TCP-specific socket options. */
 
 struct nn_tcp_optset {
     struct nn_optset base;
     int nodelay;
+    int sndbuf;
+    int rcvbuf;
+    int keepidle;
+    int keepintvl;
+    int keepcnt;
+    int busypoll;
+    int quickack;
+    int notsentlowat;
+    int usertimeout;
+    int acceptivl;
+    int connections;
 };
 
 static void nn_tcp_optset_destroy (struct nn_optset *self);
@@ -82,12 +104,12 @@ struct nn_transport *nn_tcp = &nn_tcp_vfptr;
 
 static int nn_tcp_bind (void *hint, struct nn_epbase **epbase)
 {
-    return nn_btcp_create (hint, epbase);
+    return nn_btcp_create (hint, epbase, 0);
 }
 
 static int nn_tcp_connect (void *hint, struct nn_epbase **epbase)
 {
-    return nn_ctcp_create (hint, epbase);
+    return nn_ctcp_create (hint, epbase, 0);
 }
 
 static struct nn_optset *nn_tcp_optset ()
@@ -98,8 +120,21 @@ static struct nn_optset *nn_tcp_optset ()
     alloc_assert (optset);
     optset->base.vfptr = &nn_tcp_optset_vfptr;
 
-    /*  Default values for TCP socket options. */
+    /*  Default values for TCP socket options. Zero means that the OS default
+        is used, except for the buffer sizes which default to NN_SNDBUF and
+        NN_RCVBUF. */
     optset->nodelay = 0;
+    optset->sndbuf = 0;
+    optset->rcvbuf = 0;
+    optset->keepidle = 0;
+    optset->keepintvl = 0;
+    optset->keepcnt = 0;
+    optset->busypoll = 0;
+    optset->quickack = 0;
+    optset->notsentlowat = 0;
+    optset->usertimeout = 0;
+    optset->acceptivl = 0;
+    optset->connections = 1;
 
     return &optset->base;   
 }
@@ -131,6 +166,71 @@ static int nn_tcp_optset_setopt (struct nn_optset *self, int option,
             return -EINVAL;
         optset->nodelay = val;
         return 0;
+    case NN_TCP_SNDBUF:
+        if (nn_slow (val < 0))
+            return -EINVAL;
+        optset->sndbuf = val;
+        return 0;
+    case NN_TCP_RCVBUF:
+        if (nn_slow (val < 0))
+            return -EINVAL;
+        optset->rcvbuf = val;
+        return 0;
+#if defined TCP_KEEPIDLE && defined TCP_KEEPINTVL && defined TCP_KEEPCNT
+    case NN_TCP_KEEPALIVE_IDLE:
+        if (nn_slow (val < 0))
+            return -EINVAL;
+        optset->keepidle = val;
+        return 0;
+    case NN_TCP_KEEPALIVE_INTVL:
+        if (nn_slow (val < 0))
+            return -EINVAL;
+        optset->keepintvl = val;
+        return 0;
+    case NN_TCP_KEEPALIVE_CNT:
+        if (nn_slow (val < 0))
+            return -EINVAL;
+        optset->keepcnt = val;
+        return 0;
+#endif
+#if defined SO_BUSY_POLL
+    case NN_TCP_BUSY_POLL:
+        if (nn_slow (val < 0))
+            return -EINVAL;
+        optset->busypoll = val;
+        return 0;
+#endif
+#if defined TCP_QUICKACK
+    case NN_TCP_QUICKACK:
+        if (nn_slow (val != 0 && val != 1))
+            return -EINVAL;
+        optset->quickack = val;
+        return 0;
+#endif
+#if defined TCP_NOTSENT_LOWAT
+    case NN_TCP_NOTSENT_LOWAT:
+        if (nn_slow (val < 0))
+            return -EINVAL;
+        optset->notsentlowat = val;
+        return 0;
+#endif
+#if defined TCP_USER_TIMEOUT
+    case NN_TCP_USER_TIMEOUT:
+        if (nn_slow (val < 0))
+            return -EINVAL;
+        optset->usertimeout = val;
+        return 0;
+#endif
+    case NN_TCP_ACCEPT_IVL:
+        if (nn_slow (val < 0))
+            return -EINVAL;
+        optset->acceptivl = val;
+        return 0;
+    case NN_TCP_CONNECTIONS:
+        if (nn_slow (val < 1 || val > NN_TCP_MAX_CONNECTIONS))
+            return -EINVAL;
+        optset->connections = val;
+        return 0;
     default:
         return -ENOPROTOOPT;
     }
@@ -148,6 +248,39 @@ static int nn_tcp_optset_getopt (struct nn_optset *self, int option,
     case NN_TCP_NODELAY:
         intval = optset->nodelay;
         break;
+    case NN_TCP_SNDBUF:
+        intval = optset->sndbuf;
+        break;
+    case NN_TCP_RCVBUF:
+        intval = optset->rcvbuf;
+        break;
+    case NN_TCP_KEEPALIVE_IDLE:
+        intval = optset->keepidle;
+        break;
+    case NN_TCP_KEEPALIVE_INTVL:
+        intval = optset->keepintvl;
+        break;
+    case NN_TCP_KEEPALIVE_CNT:
+        intval = optset->keepcnt;
+        break;
+    case NN_TCP_BUSY_POLL:
+        intval = optset->busypoll;
+        break;
+    case NN_TCP_QUICKACK:
+        intval = optset->quickack;
+        break;
+    case NN_TCP_NOTSENT_LOWAT:
+        intval = optset->notsentlowat;
+        break;
+    case NN_TCP_USER_TIMEOUT:
+        intval = optset->usertimeout;
+        break;
+    case NN_TCP_ACCEPT_IVL:
+        intval = optset->acceptivl;
+        break;
+    case NN_TCP_CONNECTIONS:
+        intval = optset->connections;
+        break;
     default:
         return -ENOPROTOOPT;
     }
@@ -157,3 +290,104 @@ static int nn_tcp_optset_getopt (struct nn_optset *self, int option,
     return 0;
 }
 
+static int nn_tcp_getintopt (struct nn_epbase *epbase, int level, int option)
+{
+    int val;
+    size_t sz;
+
+    sz = sizeof (val);
+    nn_epbase_getopt (epbase, level, option, &val, &sz);
+    nn_assert (sz == sizeof (val));
+    return val;
+}
+
+void nn_tcp_setsockopts (struct nn_epbase *epbase, struct nn_usock *usock,
+    int listener)
+{
+    int val;
+    int sndbuf;
+    int rcvbuf;
+
+    /*  Failures to apply the options are ignored. The connection works
+        either way, just not as well tuned. */
+
+    /*  Receive window scaling is negotiated before the connection is
+        accepted. Thus, explicitly set buffer sizes have to be applied to
+        the listening socket. */
+    sndbuf = nn_tcp_getintopt (epbase, NN_TCP, NN_TCP_SNDBUF);
+    rcvbuf = nn_tcp_getintopt (epbase, NN_TCP, NN_TCP_RCVBUF);
+    if (listener) {
+        if (sndbuf)
+            nn_usock_setsockopt (usock, SOL_SOCKET, SO_SNDBUF,
+                &sndbuf, sizeof (sndbuf));
+        if (rcvbuf)
+            nn_usock_setsockopt (usock, SOL_SOCKET, SO_RCVBUF,
+                &rcvbuf, sizeof (rcvbuf));
+        return;
+    }
+    if (!sndbuf)
+        sndbuf = nn_tcp_getintopt (epbase, NN_SOL_SOCKET, NN_SNDBUF);
+    nn_usock_setsockopt (usock, SOL_SOCKET, SO_SNDBUF,
+        &sndbuf, sizeof (sndbuf));
+    if (!rcvbuf)
+        rcvbuf = nn_tcp_getintopt (epbase, NN_SOL_SOCKET, NN_RCVBUF);
+    nn_usock_setsockopt (usock, SOL_SOCKET, SO_RCVBUF,
+        &rcvbuf, sizeof (rcvbuf));
+
+    val = nn_tcp_getintopt (epbase, NN_TCP, NN_TCP_NODELAY);
+    if (val)
+        nn_usock_setsockopt (usock, IPPROTO_TCP, TCP_NODELAY,
+            &val, sizeof (val));
+
+#if defined TCP_KEEPIDLE && defined TCP_KEEPINTVL && defined TCP_KEEPCNT
+    /*  Keepalives are enabled by setting the idle time. The times are
+        specified in milliseconds but the OS accepts whole seconds only. */
+    val = nn_tcp_getintopt (epbase, NN_TCP, NN_TCP_KEEPALIVE_IDLE);
+    if (val) {
+        val = (val + 999) / 1000;
+        nn_usock_setsockopt (usock, IPPROTO_TCP, TCP_KEEPIDLE,
+            &val, sizeof (val));
+        val = nn_tcp_getintopt (epbase, NN_TCP, NN_TCP_KEEPALIVE_INTVL);
+        if (val) {
+            val = (val + 999) / 1000;
+            nn_usock_setsockopt (usock, IPPROTO_TCP, TCP_KEEPINTVL,
+                &val, sizeof (val));
+        }
+        val = nn_tcp_getintopt (epbase, NN_TCP, NN_TCP_KEEPALIVE_CNT);
+        if (val)
+            nn_usock_setsockopt (usock, IPPROTO_TCP, TCP_KEEPCNT,
+                &val, sizeof (val));
+        val = 1;
+        nn_usock_setsockopt (usock, SOL_SOCKET, SO_KEEPALIVE,
+            &val, sizeof (val));
+    }
+#endif
+
+#if defined SO_BUSY_POLL
+    val = nn_tcp_getintopt (epbase, NN_TCP, NN_TCP_BUSY_POLL);
+    if (val)
+        nn_usock_setsockopt (usock, SOL_SOCKET, SO_BUSY_POLL,
+            &val, sizeof (val));
+#endif
+
+#if defined TCP_QUICKACK
+    val = nn_tcp_getintopt (epbase, NN_TCP, NN_TCP_QUICKACK);
+    if (val)
+        nn_usock_setsockopt (usock, IPPROTO_TCP, TCP_QUICKACK,
+            &val, sizeof (val));
+#endif
+
+#if defined TCP_NOTSENT_LOWAT
+    val = nn_tcp_getintopt (epbase, NN_TCP, NN_TCP_NOTSENT_LOWAT);
+    if (val)
+        nn_usock_setsockopt (usock, IPPROTO_TCP, TCP_NOTSENT_LOWAT,
+            &val, sizeof (val));
+#endif
+
+#if defined TCP_USER_TIMEOUT
+    val = nn_tcp_getintopt (epbase, NN_TCP, NN_TCP_USER_TIMEOUT);
+    if (val)
+        nn_usock_setsockopt (usock, IPPROTO_TCP, TCP_USER_TIMEOUT,
+            &val, sizeof (val));
+#endif
+}
@@ -24,7 +24,14 @@
 #define NN_TCP_INCLUDED
 
 #include "../../transport.h"
+#include "../../aio/usock.h"
 
 extern struct nn_transport *nn_tcp;
 
+/*  Applies TCP-specific options of the endpoint to the underlying socket.
+    For listening sockets only the options that have to be in place before
+    the connection is established are set. */
+void nn_tcp_setsockopts (struct nn_epbase *epbase, struct nn_usock *usock,
+    int listener);
+
 #endif
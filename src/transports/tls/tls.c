@@ -0,0 +1,218 @@
+/*
+    Copyright (c) 2014 250bpm s.r.o.  All rights reserved.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom
+    the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included
+    in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+#include "tls.h"
+
+#include "../tcp/btcp.h"
+#include "../tcp/ctcp.h"
+
+#include "../../tls.h"
+
+#include "../../utils/err.h"
+#include "../../utils/alloc.h"
+#include "../../utils/fast.h"
+#include "../../utils/list.h"
+#include "../../utils/cont.h"
+
+#include <string.h>
+
+/*  TLS transport. Connections are established and configured in the same
+    way as with TCP transport (including NN_TCP options), however, TLS
+    handshake is done before the SP protocol header is exchanged and all
+    the data are encrypted afterwards. */
+
+/*  TLS-specific socket options. */
+
+struct nn_tls_optset {
+    struct nn_optset base;
+    char *cafile;
+    char *certfile;
+    char *keyfile;
+    int authmode;
+};
+
+static void nn_tls_optset_destroy (struct nn_optset *self);
+static int nn_tls_optset_setopt (struct nn_optset *self, int option,
+    const void *optval, size_t optvallen);
+static int nn_tls_optset_getopt (struct nn_optset *self, int option,
+    void *optval, size_t *optvallen);
+static const struct nn_optset_vfptr nn_tls_optset_vfptr = {
+    nn_tls_optset_destroy,
+    nn_tls_optset_setopt,
+    nn_tls_optset_getopt
+};
+
+/*  nn_transport interface. */
+static int nn_tls_bind (void *hint, struct nn_epbase **epbase);
+static int nn_tls_connect (void *hint, struct nn_epbase **epbase);
+static struct nn_optset *nn_tls_optset (void);
+
+static struct nn_transport nn_tls_vfptr = {
+    "tls+tcp",
+    NN_TLS,
+    NULL,
+    NULL,
+    nn_tls_bind,
+    nn_tls_connect,
+    nn_tls_optset,
+    NN_LIST_ITEM_INITIALIZER
+};
+
+struct nn_transport *nn_tls = &nn_tls_vfptr;
+
+static int nn_tls_bind (void *hint, struct nn_epbase **epbase)
+{
+#if defined NN_HAVE_OPENSSL && !defined NN_HAVE_WINDOWS
+    return nn_btcp_create (hint, epbase, 1);
+#else
+    return -EPROTONOSUPPORT;
+#endif
+}
+
+static int nn_tls_connect (void *hint, struct nn_epbase **epbase)
+{
+#if defined NN_HAVE_OPENSSL && !defined NN_HAVE_WINDOWS
+    return nn_ctcp_create (hint, epbase, 1);
+#else
+    return -EPROTONOSUPPORT;
+#endif
+}
+
+static struct nn_optset *nn_tls_optset ()
+{
+    struct nn_tls_optset *optset;
+
+    optset = nn_alloc (sizeof (struct nn_tls_optset), "optset (tls)");
+    alloc_assert (optset);
+    optset->base.vfptr = &nn_tls_optset_vfptr;
+
+    /*  Default values for TLS socket options. */
+    optset->cafile = NULL;
+    optset->certfile = NULL;
+    optset->keyfile = NULL;
+    optset->authmode = NN_TLS_AUTH_DEFAULT;
+
+    return &optset->base;
+}
+
+static void nn_tls_optset_destroy (struct nn_optset *self)
+{
+    struct nn_tls_optset *optset;
+
+    optset = nn_cont (self, struct nn_tls_optset, base);
+    if (optset->cafile)
+        nn_free (optset->cafile);
+    if (optset->certfile)
+        nn_free (optset->certfile);
+    if (optset->keyfile)
+        nn_free (optset->keyfile);
+    nn_free (optset);
+}
+
+static int nn_tls_optset_setopt (struct nn_optset *self, int option,
+    const void *optval, size_t optvallen)
+{
+    struct nn_tls_optset *optset;
+    char **str;
+    int val;
+
+    optset = nn_cont (self, struct nn_tls_optset, base);
+
+    switch (option) {
+    case NN_TLS_CA_FILE:
+        str = &optset->cafile;
+        break;
+    case NN_TLS_CERT_FILE:
+        str = &optset->certfile;
+        break;
+    case NN_TLS_KEY_FILE:
+        str = &optset->keyfile;
+        break;
+    case NN_TLS_AUTH_MODE:
+        if (optvallen != sizeof (int))
+            return -EINVAL;
+        val = *(int*) optval;
+        if (nn_slow (val != NN_TLS_AUTH_DEFAULT && val != NN_TLS_AUTH_NONE &&
+              val != NN_TLS_AUTH_OPTIONAL && val != NN_TLS_AUTH_REQUIRED))
+            return -EINVAL;
+        optset->authmode = val;
+        return 0;
+    default:
+        return -ENOPROTOOPT;
+    }
+
+    /*  File names. Zero-length value resets the option. */
+    if (*str) {
+        nn_free (*str);
+        *str = NULL;
+    }
+    if (!optvallen)
+        return 0;
+    if (nn_slow (memchr (optval, 0, optvallen) != NULL))
+        return -EINVAL;
+    *str = nn_alloc (optvallen + 1, "tls option");
+    alloc_assert (*str);
+    memcpy (*str, optval, optvallen);
+    (*str) [optvallen] = 0;
+    return 0;
+}
+
+static int nn_tls_optset_getopt (struct nn_optset *self, int option,
+    void *optval, size_t *optvallen)
+{
+    struct nn_tls_optset *optset;
+    const char *str;
+    size_t sz;
+
+    optset = nn_cont (self, struct nn_tls_optset, base);
+
+    switch (option) {
+    case NN_TLS_CA_FILE:
+        str = optset->cafile;
+        break;
+    case NN_TLS_CERT_FILE:
+        str = optset->certfile;
+        break;
+    case NN_TLS_KEY_FILE:
+        str = optset->keyfile;
+        break;
+    case NN_TLS_AUTH_MODE:
+        memcpy (optval, &optset->authmode,
+            *optvallen < sizeof (int) ? *optvallen : sizeof (int));
+        *optvallen = sizeof (int);
+        return 0;
+    default:
+        return -ENOPROTOOPT;
+    }
+
+    /*  File names are returned without the terminating zero. The returned
+        length is the full length of the name even if the buffer was too
+        short. */
+    sz = 0;
+    if (str) {
+        sz = strlen (str);
+        memcpy (optval, str, *optvallen < sz ? *optvallen : sz);
+    }
+    *optvallen = sz;
+    return 0;
+}
+
@@ -1,5 +1,5 @@
 /*
-    Copyright (c) 2012-2013 250bpm s.r.o.  All rights reserved.
+    Copyright (c) 2014 250bpm s.r.o.  All rights reserved.
 
     Permission is hereby granted, free of charge, to any person obtaining a copy
     of this software and associated documentation files (the "Software"),
@@ -20,24 +20,12 @@
     IN THE SOFTWARE.
 */
 
-#include <netdb.h>
+#ifndef NN_TLS_INCLUDED
+#define NN_TLS_INCLUDED
 
-#include "../../nn.h"
+#include "../../transport.h"
 
-#if defined NN_HAVE_WINDOWS
-#include "../../utils/win.h"
-#else
-#include <sys/socket.h>
-#endif
+extern struct nn_transport *nn_tls;
 
-struct nn_dns {
-    struct nn_fsm fsm;
-    int state;
-    int error;
-    char hostname [NN_SOCKADDR_MAX];
-    struct addrinfo request;
-    struct gaicb gcb;
-    struct nn_dns_result *result;
-    struct nn_fsm_event done;
-};
+#endif
 
@@ -22,13 +22,28 @@
 
 #include "backoff.h"
 
-void nn_backoff_init (struct nn_backoff *self, int src, int minivl, int maxivl,
-    struct nn_fsm *owner)
+#include "../../nn.h"
+
+#include "../../utils/random.h"
+
+/*  Private functions. */
+static int nn_backoff_ceiling (struct nn_backoff *self);
+static int nn_backoff_random (struct nn_backoff *self, int min, int max);
+
+void nn_backoff_init (struct nn_backoff *self, int src, int policy,
+    int minivl, int maxivl, struct nn_fsm *owner)
 {
     nn_timer_init (&self->timer, src, owner);
+    self->policy = policy;
     self->minivl = minivl;
     self->maxivl = maxivl;
     self->n = 1;
+    self->prev = minivl;
+
+    /*  Seed the timer's own generator. Timers of different sockets, and thus
+        different processes, end up with different sequences. */
+    nn_random_generate (&self->seed, sizeof (self->seed));
+    self->seed |= 1;
 }
 
 void nn_backoff_term (struct nn_backoff *self)
@@ -44,14 +59,36 @@ int nn_backoff_isidle (struct nn_backoff *self)
 void nn_backoff_start (struct nn_backoff *self)
 {
      int timeout;
+     int max;
+
+     switch (self->policy) {
+     case NN_RECONNECT_FULL_JITTER:
+         timeout = nn_backoff_random (self, 0, nn_backoff_ceiling (self));
+         break;
+     case NN_RECONNECT_EQUAL_JITTER:
+         max = nn_backoff_ceiling (self);
+         timeout = max / 2 + nn_backoff_random (self, 0, max - max / 2);
+         break;
+     case NN_RECONNECT_DECORRELATED_JITTER:
+         max = self->prev > self->maxivl / 3 ? self->maxivl : self->prev * 3;
+         if (max < self->minivl)
+             max = self->minivl;
+         timeout = nn_backoff_random (self, self->minivl, max);
+         if (timeout > self->maxivl)
+             timeout = self->maxivl;
+         self->prev = timeout;
+         break;
+     default:
 
-     /*  Start the timer for the actual n value. If the interval haven't yet
-         exceeded the maximum, double the next timeout value. */
-     timeout = (self->n - 1) * self->minivl;
-     if (timeout > self->maxivl)
-         timeout = self->maxivl;
-     else
-         self->n *= 2;
+         /*  Start the timer for the actual n value. If the interval haven't
+             yet exceeded the maximum, double the next timeout value. */
+         timeout = (self->n - 1) * self->minivl;
+         if (timeout > self->maxivl)
+             timeout = self->maxivl;
+         else
+             self->n *= 2;
+         break;
+     }
      nn_timer_start (&self->timer, timeout);
 }
 
@@ -63,5 +100,31 @@ void nn_backoff_stop (struct nn_backoff *self)
 void nn_backoff_reset (struct nn_backoff *self)
 {
     self->n = 1;
+    self->prev = self->minivl;
+}
+
+/*  Returns (2^n)*minivl capped by maxivl and doubles the next value. */
+static int nn_backoff_ceiling (struct nn_backoff *self)
+{
+    if (self->minivl == 0)
+        return 0;
+    if (self->minivl > self->maxivl / self->n)
+        return self->maxivl;
+    self->n *= 2;
+    return self->n / 2 * self->minivl;
+}
+
+/*  Returns a pseudo-random number in the range of [min, max]. */
+static int nn_backoff_random (struct nn_backoff *self, int min, int max)
+{
+    if (max <= min)
+        return min;
+
+    /*  xorshift64* generator. */
+    self->seed ^= self->seed >> 12;
+    self->seed ^= self->seed << 25;
+    self->seed ^= self->seed >> 27;
+    return min + (int) (((self->seed * 2685821657736338717ULL) >> 33) %
+        ((uint64_t) max - min + 1));
 }
 
@@ -25,21 +25,41 @@
 
 #include "../../aio/timer.h"
 
-/*  Timer with exponential backoff. Actual wating time is (2^n-1)*minivl,
-    meaning that first wait is 0 ms long, second one is minivl ms long etc. */
+#include "../../utils/int.h"
+
+/*  Timer with exponential backoff. The waiting time depends on the policy
+    (see NN_RECONNECT_POLICY socket option):
+
+    NN_RECONNECT_EXPONENTIAL: Actual wating time is (2^n-1)*minivl, meaning
+    that first wait is 0 ms long, second one is minivl ms long etc.
+    NN_RECONNECT_FULL_JITTER: Random time between 0 and (2^n)*minivl.
+    NN_RECONNECT_EQUAL_JITTER: Random time between (2^n)*minivl/2 and
+    (2^n)*minivl.
+    NN_RECONNECT_DECORRELATED_JITTER: Random time between minivl and three
+    times the previous waiting time.
+
+    In all cases the waiting time never exceeds maxivl. */
 
 #define NN_BACKOFF_TIMEOUT NN_TIMER_TIMEOUT
 #define NN_BACKOFF_STOPPED NN_TIMER_STOPPED
 
 struct nn_backoff {
     struct nn_timer timer;
+    int policy;
     int minivl;
     int maxivl;
     int n;
+
+    /*  Previous waiting time. Used by the decorrelated jitter policy. */
+    int prev;
+
+    /*  State of the pseudo-random number generator. Each timer has its own
+        so that it can be used without synchronisation. */
+    uint64_t seed;
 };
 
-void nn_backoff_init (struct nn_backoff *self, int src, int minivl, int maxivl,
-    struct nn_fsm *owner);
+void nn_backoff_init (struct nn_backoff *self, int src, int policy,
+    int minivl, int maxivl, struct nn_fsm *owner);
 void nn_backoff_term (struct nn_backoff *self);
 
 int nn_backoff_isidle (struct nn_backoff *self);
@@ -0,0 +1,342 @@
+/*
+    Copyright (c) 2014 250bpm s.r.o.  All rights reserved.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom
+    the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included
+    in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+#include "connector.h"
+
+#include "../../utils/err.h"
+#include "../../utils/cont.h"
+#include "../../utils/fast.h"
+#include "../../utils/attr.h"
+
+#include <string.h>
+
+/*  Head start, in milliseconds, given to each connection attempt before
+    the next one is started. RFC 8305 recommends 250 ms. */
+#define NN_CONNECTOR_DELAY 250
+
+#define NN_CONNECTOR_STATE_IDLE 1
+#define NN_CONNECTOR_STATE_CONNECTING 2
+#define NN_CONNECTOR_STATE_ACTIVE 3
+#define NN_CONNECTOR_STATE_DONE 4
+#define NN_CONNECTOR_STATE_STOPPING 5
+
+#define NN_CONNECTOR_SRC_USOCK 1
+#define NN_CONNECTOR_SRC_TIMER 2
+
+/*  Private functions. */
+static void nn_connector_handler (struct nn_fsm *self, int src, int type,
+    void *srcptr);
+static void nn_connector_shutdown (struct nn_fsm *self, int src, int type,
+    void *srcptr);
+static void nn_connector_attempt (struct nn_connector *self);
+
+void nn_connector_init (struct nn_connector *self, int src,
+    struct nn_epbase *epbase, nn_connector_setopts_fn setopts,
+    struct nn_fsm *owner)
+{
+    int i;
+
+    nn_fsm_init (&self->fsm, nn_connector_handler, nn_connector_shutdown,
+        src, self, owner);
+    self->state = NN_CONNECTOR_STATE_IDLE;
+    self->epbase = epbase;
+    self->setopts = setopts;
+    self->naddrs = 0;
+    self->locallen = 0;
+    for (i = 0; i != NN_CONNECTOR_MAX_ADDRS; ++i)
+        nn_usock_init (&self->usocks [i], NN_CONNECTOR_SRC_USOCK, &self->fsm);
+    self->next = 0;
+    self->pending = 0;
+    nn_timer_init (&self->timer, NN_CONNECTOR_SRC_TIMER, &self->fsm);
+    self->usock = NULL;
+    self->error = 0;
+    nn_fsm_event_init (&self->done);
+}
+
+void nn_connector_term (struct nn_connector *self)
+{
+    int i;
+
+    nn_assert_state (self, NN_CONNECTOR_STATE_IDLE);
+
+    nn_fsm_event_term (&self->done);
+    nn_timer_term (&self->timer);
+    for (i = 0; i != NN_CONNECTOR_MAX_ADDRS; ++i)
+        nn_usock_term (&self->usocks [i]);
+    nn_fsm_term (&self->fsm);
+}
+
+int nn_connector_isidle (struct nn_connector *self)
+{
+    return nn_fsm_isidle (&self->fsm);
+}
+
+void nn_connector_add (struct nn_connector *self,
+    const struct sockaddr *addr, size_t addrlen)
+{
+    nn_assert_state (self, NN_CONNECTOR_STATE_IDLE);
+    nn_assert (addrlen <= sizeof (struct sockaddr_storage));
+
+    if (self->naddrs == NN_CONNECTOR_MAX_ADDRS)
+        return;
+    memcpy (&self->addrs [self->naddrs], addr, addrlen);
+    self->addrlens [self->naddrs] = addrlen;
+    ++self->naddrs;
+}
+
+int nn_connector_count (struct nn_connector *self)
+{
+    return self->naddrs;
+}
+
+void nn_connector_start (struct nn_connector *self,
+    const struct sockaddr *local, size_t locallen)
+{
+    nn_assert (self->naddrs > 0);
+    nn_assert (locallen <= sizeof (struct sockaddr_storage));
+
+    memcpy (&self->local, local, locallen);
+    self->locallen = locallen;
+    nn_fsm_start (&self->fsm);
+}
+
+void nn_connector_stop (struct nn_connector *self)
+{
+    nn_fsm_stop (&self->fsm);
+}
+
+struct nn_usock *nn_connector_usock (struct nn_connector *self)
+{
+    nn_assert_state (self, NN_CONNECTOR_STATE_ACTIVE);
+    return self->usock;
+}
+
+int nn_connector_index (struct nn_connector *self)
+{
+    nn_assert_state (self, NN_CONNECTOR_STATE_ACTIVE);
+    return (int) (self->usock - self->usocks);
+}
+
+int nn_connector_geterrno (struct nn_connector *self)
+{
+    return self->error;
+}
+
+static void nn_connector_shutdown (struct nn_fsm *self, int src, int type,
+    NN_UNUSED void *srcptr)
+{
+    int i;
+    struct nn_connector *connector;
+
+    connector = nn_cont (self, struct nn_connector, fsm);
+
+    if (nn_slow (src == NN_FSM_ACTION && type == NN_FSM_STOP)) {
+        for (i = 0; i != NN_CONNECTOR_MAX_ADDRS; ++i)
+            nn_usock_stop (&connector->usocks [i]);
+        nn_timer_stop (&connector->timer);
+        connector->state = NN_CONNECTOR_STATE_STOPPING;
+    }
+    if (nn_slow (connector->state == NN_CONNECTOR_STATE_STOPPING)) {
+        if (!nn_timer_isidle (&connector->timer))
+            return;
+        for (i = 0; i != NN_CONNECTOR_MAX_ADDRS; ++i)
+            if (!nn_usock_isidle (&connector->usocks [i]))
+                return;
+        connector->naddrs = 0;
+        connector->next = 0;
+        connector->pending = 0;
+        connector->usock = NULL;
+        connector->state = NN_CONNECTOR_STATE_IDLE;
+        nn_fsm_stopped (&connector->fsm, NN_CONNECTOR_STOPPED);
+        return;
+    }
+
+    nn_fsm_bad_state (connector->state, src, type);
+}
+
+static void nn_connector_handler (struct nn_fsm *self, int src, int type,
+    void *srcptr)
+{
+    int i;
+    struct nn_connector *connector;
+    struct nn_usock *usock;
+
+    connector = nn_cont (self, struct nn_connector, fsm);
+
+    switch (connector->state) {
+
+/******************************************************************************/
+/*  IDLE state.                                                               */
+/******************************************************************************/
+    case NN_CONNECTOR_STATE_IDLE:
+        switch (src) {
+
+        case NN_FSM_ACTION:
+            switch (type) {
+            case NN_FSM_START:
+                connector->state = NN_CONNECTOR_STATE_CONNECTING;
+                nn_connector_attempt (connector);
+                return;
+            default:
+                nn_fsm_bad_action (connector->state, src, type);
+            }
+
+        default:
+            nn_fsm_bad_source (connector->state, src, type);
+        }
+
+/******************************************************************************/
+/*  CONNECTING state.                                                         */
+/*  One or more connection attempts are under way.                            */
+/******************************************************************************/
+    case NN_CONNECTOR_STATE_CONNECTING:
+        switch (src) {
+
+        case NN_CONNECTOR_SRC_USOCK:
+            usock = (struct nn_usock*) srcptr;
+            switch (type) {
+            case NN_USOCK_CONNECTED:
+
+                /*  We have a winner. Cancel all the other attempts. */
+                connector->usock = usock;
+                for (i = 0; i != NN_CONNECTOR_MAX_ADDRS; ++i)
+                    if (&connector->usocks [i] != usock)
+                        nn_usock_stop (&connector->usocks [i]);
+                nn_timer_stop (&connector->timer);
+                connector->state = NN_CONNECTOR_STATE_ACTIVE;
+                nn_fsm_raise (&connector->fsm, &connector->done,
+                    NN_CONNECTOR_CONNECTED);
+                return;
+            case NN_USOCK_ERROR:
+
+                /*  Don't wait for the timer, try the next address
+                    straight away. */
+                connector->error = nn_usock_geterrno (usock);
+                nn_usock_stop (usock);
+                --connector->pending;
+                nn_connector_attempt (connector);
+                return;
+            case NN_USOCK_SHUTDOWN:
+            case NN_USOCK_STOPPED:
+                return;
+            default:
+                nn_fsm_bad_action (connector->state, src, type);
+            }
+
+        case NN_CONNECTOR_SRC_TIMER:
+            switch (type) {
+            case NN_TIMER_TIMEOUT:
+                nn_timer_stop (&connector->timer);
+                return;
+            case NN_TIMER_STOPPED:
+                nn_connector_attempt (connector);
+                return;
+            default:
+                nn_fsm_bad_action (connector->state, src, type);
+            }
+
+        default:
+            nn_fsm_bad_source (connector->state, src, type);
+        }
+
+/******************************************************************************/
+/*  ACTIVE state.                                                             */
+/*  Connection was established. The remaining attempts are being cancelled.   */
+/*  The connected socket may be passed back to us when its new owner is done  */
+/*  with it.                                                                  */
+/******************************************************************************/
+    case NN_CONNECTOR_STATE_ACTIVE:
+        switch (src) {
+        case NN_CONNECTOR_SRC_USOCK:
+        case NN_CONNECTOR_SRC_TIMER:
+            return;
+        default:
+            nn_fsm_bad_source (connector->state, src, type);
+        }
+
+/******************************************************************************/
+/*  DONE state.                                                               */
+/*  All the connection attempts have failed.                                  */
+/******************************************************************************/
+    case NN_CONNECTOR_STATE_DONE:
+        switch (src) {
+        case NN_CONNECTOR_SRC_USOCK:
+        case NN_CONNECTOR_SRC_TIMER:
+            return;
+        default:
+            nn_fsm_bad_source (connector->state, src, type);
+        }
+
+/******************************************************************************/
+/*  Invalid state.                                                            */
+/******************************************************************************/
+    default:
+        nn_fsm_bad_state (connector->state, src, type);
+    }
+}
+
+/******************************************************************************/
+/*  State machine actions.                                                    */
+/******************************************************************************/
+
+static void nn_connector_attempt (struct nn_connector *self)
+{
+    int rc;
+    int i;
+    struct nn_usock *usock;
+
+    /*  Start connecting to the next address. The addresses that can't be
+        connected to at all are skipped. */
+    while (self->next < self->naddrs) {
+        i = self->next++;
+        usock = &self->usocks [i];
+        rc = nn_usock_start (usock, self->addrs [i].ss_family,
+            SOCK_STREAM, 0);
+        if (nn_slow (rc < 0)) {
+            self->error = -rc;
+            continue;
+        }
+        if (self->setopts)
+            self->setopts (self->epbase, usock);
+        rc = nn_usock_bind (usock, (struct sockaddr*) &self->local,
+            self->locallen);
+        if (nn_slow (rc < 0)) {
+            self->error = -rc;
+            nn_usock_stop (usock);
+            continue;
+        }
+        nn_usock_connect (usock, (struct sockaddr*) &self->addrs [i],
+            self->addrlens [i]);
+        ++self->pending;
+
+        /*  Give this attempt a head start before trying the next address. */
+        if (self->next < self->naddrs && nn_timer_isidle (&self->timer))
+            nn_timer_start (&self->timer, NN_CONNECTOR_DELAY);
+        return;
+    }
+
+    /*  All the addresses were tried and all the attempts have failed. */
+    if (self->pending == 0) {
+        self->state = NN_CONNECTOR_STATE_DONE;
+        nn_fsm_raise (&self->fsm, &self->done, NN_CONNECTOR_ERROR);
+    }
+}
@@ -0,0 +1,130 @@
+/*
+    Copyright (c) 2014 250bpm s.r.o.  All rights reserved.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom
+    the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included
+    in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+#ifndef NN_CONNECTOR_INCLUDED
+#define NN_CONNECTOR_INCLUDED
+
+#include "dns.h"
+
+#include "../../transport.h"
+
+#include "../../aio/fsm.h"
+#include "../../aio/usock.h"
+#include "../../aio/timer.h"
+
+#include <stddef.h>
+
+/*  State machine that connects to a remote peer which is reachable at several
+    addresses. The connection attempts are started one after another, each
+    getting a head start of NN_CONNECTOR_DELAY milliseconds, and the first one
+    to succeed wins (RFC 8305). If an attempt fails, the next one is started
+    straight away. */
+
+#define NN_CONNECTOR_CONNECTED 1
+#define NN_CONNECTOR_ERROR 2
+#define NN_CONNECTOR_STOPPED 3
+
+/*  Maximum number of addresses to try. */
+#define NN_CONNECTOR_MAX_ADDRS NN_DNS_MAX_ADDRS
+
+/*  Function to set socket options on a newly created socket before it starts
+    connecting. */
+typedef void (*nn_connector_setopts_fn) (struct nn_epbase *epbase,
+    struct nn_usock *usock);
+
+struct nn_connector {
+
+    /*  The state machine. */
+    struct nn_fsm fsm;
+    int state;
+
+    /*  The endpoint the connection is being established for. */
+    struct nn_epbase *epbase;
+    nn_connector_setopts_fn setopts;
+
+    /*  Addresses to connect to, in the order they are to be tried. */
+    struct sockaddr_storage addrs [NN_CONNECTOR_MAX_ADDRS];
+    size_t addrlens [NN_CONNECTOR_MAX_ADDRS];
+    int naddrs;
+
+    /*  Local address to bind the sockets to. */
+    struct sockaddr_storage local;
+    size_t locallen;
+
+    /*  One underlying socket per address. */
+    struct nn_usock usocks [NN_CONNECTOR_MAX_ADDRS];
+
+    /*  Index of the next address to try and the number of connection attempts
+        currently in progress. */
+    int next;
+    int pending;
+
+    /*  Used to delay the next connection attempt. */
+    struct nn_timer timer;
+
+    /*  The socket that got connected. */
+    struct nn_usock *usock;
+
+    /*  Error reported by the last failed connection attempt. */
+    int error;
+
+    /*  Event raised when connection is established or all the attempts
+        have failed. */
+    struct nn_fsm_event done;
+};
+
+void nn_connector_init (struct nn_connector *self, int src,
+    struct nn_epbase *epbase, nn_connector_setopts_fn setopts,
+    struct nn_fsm *owner);
+void nn_connector_term (struct nn_connector *self);
+
+int nn_connector_isidle (struct nn_connector *self);
+
+/*  Add an address to try. Addresses beyond NN_CONNECTOR_MAX_ADDRS are
+    ignored. Can be called only while the connector is idle. */
+void nn_connector_add (struct nn_connector *self,
+    const struct sockaddr *addr, size_t addrlen);
+
+/*  Returns the number of addresses added so far. */
+int nn_connector_count (struct nn_connector *self);
+
+/*  Start connecting. All the sockets are bound to the supplied local address
+    before connecting. When done, either NN_CONNECTOR_CONNECTED or
+    NN_CONNECTOR_ERROR is raised. Afterwards, the connector has to be stopped.
+    The list of addresses is cleared when the connector stops. */
+void nn_connector_start (struct nn_connector *self,
+    const struct sockaddr *local, size_t locallen);
+void nn_connector_stop (struct nn_connector *self);
+
+/*  Returns the connected socket. Valid after NN_CONNECTOR_CONNECTED was
+    raised, until the connector is stopped. */
+struct nn_usock *nn_connector_usock (struct nn_connector *self);
+
+/*  Returns the position of the connected socket's address in the order in
+    which the addresses were added. Valid during the same time as
+    nn_connector_usock. */
+int nn_connector_index (struct nn_connector *self);
+
+/*  Returns the error that caused the last connection attempt to fail. */
+int nn_connector_geterrno (struct nn_connector *self);
+
+#endif
@@ -21,10 +21,96 @@
 */
 
 #include "dns.h"
+#include "literal.h"
+
+#include "../../aio/ctx.h"
 
 #include "../../utils/err.h"
+#include "../../utils/cont.h"
+#include "../../utils/alloc.h"
+#include "../../utils/attr.h"
+#include "../../utils/fast.h"
+#include "../../utils/mutex.h"
+#include "../../utils/sem.h"
+#include "../../utils/thread.h"
+#include "../../utils/clock.h"
 
 #include <string.h>
+#include <stdlib.h>
+
+#ifndef NN_HAVE_WINDOWS
+#include <sys/types.h>
+#include <netinet/in.h>
+#include <netdb.h>
+#endif
+
+#define NN_DNS_STATE_IDLE 1
+#define NN_DNS_STATE_RESOLVING 2
+#define NN_DNS_STATE_DONE 3
+#define NN_DNS_STATE_STOPPING 4
+
+#define NN_DNS_ACTION_DONE 1
+
+/*  Default time, in milliseconds, to keep the results of DNS lookups.
+    Failed lookups are remembered for a shorter time. The values can be
+    overridden by NN_DNS_TTL and NN_DNS_NEGATIVE_TTL environment variables. */
+#define NN_DNS_TTL_DEFAULT 60000
+#define NN_DNS_NEGATIVE_TTL_DEFAULT 1000
+
+/*  Result of resolving a single hostname. */
+struct nn_dns_entry {
+
+    /*  Member of the list of all cached entries. */
+    struct nn_list_item item;
+
+    /*  Member of the queue of entries waiting to be resolved. */
+    struct nn_list_item queued;
+
+    char hostname [NN_SOCKADDR_MAX];
+    int ipv4only;
+
+    /*  If set, the lookup is in progress and the result is not valid yet. */
+    int resolving;
+
+    /*  Time when the result becomes stale. */
+    uint64_t expiry;
+
+    struct nn_dns_result result;
+
+    /*  nn_dns objects waiting for the lookup to finish. */
+    struct nn_list waiters;
+};
+
+/*  The cache and the resolver thread shared by all nn_dns objects. */
+struct nn_dns_cache {
+    struct nn_mutex sync;
+    struct nn_clock clock;
+    struct nn_list entries;
+    struct nn_list queue;
+    struct nn_sem wakeup;
+    struct nn_thread thread;
+    int started;
+    int stopping;
+    int ttl;
+    int negative_ttl;
+};
+
+static struct nn_dns_cache nn_dns_cache;
+
+/*  Private functions. */
+static void nn_dns_handler (struct nn_fsm *self, int src, int type,
+    void *srcptr);
+static void nn_dns_shutdown (struct nn_fsm *self, int src, int type,
+    void *srcptr);
+static int nn_dns_cache_lookup (struct nn_dns *self, const char *addr,
+    size_t addrlen, int ipv4only);
+static void nn_dns_resolver (void *arg);
+static void nn_dns_resolve (const char *hostname, int ipv4only,
+    struct nn_dns_result *result);
+static void nn_dns_addaddr (struct nn_dns_result *result,
+    struct addrinfo *addr);
+static int nn_dns_isipv6 (const struct sockaddr *addr);
+static int nn_dns_getenv (const char *name, int dflt);
 
 int nn_dns_check_hostname (const char *name, size_t namelen)
 {
@@ -88,8 +174,479 @@ int nn_dns_check_hostname (const char *name, size_t namelen)
     }
 }
 
-#if defined NN_HAVE_GETADDRINFO_A
-#include "dns_getaddrinfo_a.inc"
-#else
-#include "dns_getaddrinfo.inc"
+void nn_dns_init (struct nn_dns *self, int src, struct nn_fsm *owner)
+{
+    nn_fsm_init (&self->fsm, nn_dns_handler, nn_dns_shutdown, src, self, owner);
+    self->state = NN_DNS_STATE_IDLE;
+    self->result = NULL;
+    self->entry = NULL;
+    nn_list_item_init (&self->item);
+    nn_fsm_event_init (&self->done);
+}
+
+void nn_dns_term (struct nn_dns *self)
+{
+    nn_assert_state (self, NN_DNS_STATE_IDLE);
+
+    nn_fsm_event_term (&self->done);
+    nn_list_item_term (&self->item);
+    nn_fsm_term (&self->fsm);
+}
+
+int nn_dns_isidle (struct nn_dns *self)
+{
+    return nn_fsm_isidle (&self->fsm);
+}
+
+void nn_dns_start (struct nn_dns *self, const char *addr, size_t addrlen,
+    int ipv4only, struct nn_dns_result *result)
+{
+    int rc;
+
+    nn_assert_state (self, NN_DNS_STATE_IDLE);
+
+    self->result = result;
+
+    /*  Try to resolve the supplied string as a literal address. In this case,
+        there's no DNS lookup involved. */
+    rc = nn_literal_resolve (addr, addrlen, ipv4only, &self->result->addrs [0],
+        &self->result->addrlens [0]);
+    if (rc == 0) {
+        self->result->error = 0;
+        self->result->naddrs = 1;
+        nn_fsm_start (&self->fsm);
+        return;
+    }
+    errnum_assert (rc == -EINVAL, -rc);
+
+    /*  The name is not a literal. Use the cached result, if any. Otherwise
+        wait for the resolver thread to do the lookup. */
+    if (!nn_dns_cache_lookup (self, addr, addrlen, ipv4only))
+        self->result->error = EINPROGRESS;
+    nn_fsm_start (&self->fsm);
+}
+
+void nn_dns_stop (struct nn_dns *self)
+{
+    nn_fsm_stop (&self->fsm);
+}
+
+static void nn_dns_shutdown (struct nn_fsm *self, int src, int type,
+    NN_UNUSED void *srcptr)
+{
+    struct nn_dns *dns;
+
+    dns = nn_cont (self, struct nn_dns, fsm);
+
+    if (nn_slow (src == NN_FSM_ACTION && type == NN_FSM_STOP)) {
+        if (dns->state == NN_DNS_STATE_RESOLVING) {
+
+            /*  If the lookup is still in progress, stop waiting for it.
+                Otherwise, the result is being delivered to this object and
+                we have to wait for it. */
+            nn_mutex_lock (&nn_dns_cache.sync);
+            if (!dns->entry) {
+                nn_mutex_unlock (&nn_dns_cache.sync);
+                dns->state = NN_DNS_STATE_STOPPING;
+                return;
+            }
+            nn_list_erase (&dns->entry->waiters, &dns->item);
+            dns->entry = NULL;
+            nn_mutex_unlock (&nn_dns_cache.sync);
+        }
+        nn_fsm_stopped (&dns->fsm, NN_DNS_STOPPED);
+        dns->state = NN_DNS_STATE_IDLE;
+        return;
+    }
+    if (nn_slow (dns->state == NN_DNS_STATE_STOPPING)) {
+        if (src == NN_FSM_ACTION && type == NN_DNS_ACTION_DONE) {
+            nn_fsm_stopped (&dns->fsm, NN_DNS_STOPPED);
+            dns->state = NN_DNS_STATE_IDLE;
+            return;
+        }
+        return;
+    }
+
+    nn_fsm_bad_state (dns->state, src, type);
+}
+
+static void nn_dns_handler (struct nn_fsm *self, int src, int type,
+    NN_UNUSED void *srcptr)
+{
+    struct nn_dns *dns;
+
+    dns = nn_cont (self, struct nn_dns, fsm);
+
+    switch (dns->state) {
+/******************************************************************************/
+/*  IDLE state.                                                               */
+/******************************************************************************/
+    case NN_DNS_STATE_IDLE:
+        switch (src) {
+        case NN_FSM_ACTION:
+            switch (type) {
+            case NN_FSM_START:
+                if (dns->result->error == EINPROGRESS) {
+                    dns->state = NN_DNS_STATE_RESOLVING;
+                    return;
+                }
+                nn_fsm_raise (&dns->fsm, &dns->done, NN_DNS_DONE);
+                dns->state = NN_DNS_STATE_DONE;
+                return;
+            default:
+                nn_fsm_bad_action (dns->state, src, type);
+            }
+        default:
+            nn_fsm_bad_source (dns->state, src, type);
+        }
+
+/******************************************************************************/
+/*  RESOLVING state.                                                          */
+/*  Waiting for the resolver thread.                                          */
+/******************************************************************************/
+    case NN_DNS_STATE_RESOLVING:
+        switch (src) {
+        case NN_FSM_ACTION:
+            switch (type) {
+            case NN_DNS_ACTION_DONE:
+                nn_fsm_raise (&dns->fsm, &dns->done, NN_DNS_DONE);
+                dns->state = NN_DNS_STATE_DONE;
+                return;
+            default:
+                nn_fsm_bad_action (dns->state, src, type);
+            }
+        default:
+            nn_fsm_bad_source (dns->state, src, type);
+        }
+
+/******************************************************************************/
+/*  DONE state.                                                               */
+/******************************************************************************/
+    case NN_DNS_STATE_DONE:
+        nn_fsm_bad_source (dns->state, src, type);
+
+/******************************************************************************/
+/*  Invalid state.                                                            */
+/******************************************************************************/
+    default:
+        nn_fsm_bad_state (dns->state, src, type);
+    }
+}
+
+void nn_dns_cache_init (void)
+{
+    nn_mutex_init (&nn_dns_cache.sync);
+    nn_clock_init (&nn_dns_cache.clock);
+    nn_list_init (&nn_dns_cache.entries);
+    nn_list_init (&nn_dns_cache.queue);
+    nn_sem_init (&nn_dns_cache.wakeup);
+    nn_dns_cache.started = 0;
+    nn_dns_cache.stopping = 0;
+    nn_dns_cache.ttl = nn_dns_getenv ("NN_DNS_TTL", NN_DNS_TTL_DEFAULT);
+    nn_dns_cache.negative_ttl = nn_dns_getenv ("NN_DNS_NEGATIVE_TTL",
+        NN_DNS_NEGATIVE_TTL_DEFAULT);
+}
+
+void nn_dns_cache_term (void)
+{
+    struct nn_dns_entry *entry;
+
+    /*  Ask the resolver thread to exit. If it is in the middle of a DNS
+        lookup, we have to wait till the lookup is done. */
+    if (nn_dns_cache.started) {
+        nn_mutex_lock (&nn_dns_cache.sync);
+        nn_dns_cache.stopping = 1;
+        nn_mutex_unlock (&nn_dns_cache.sync);
+        nn_sem_post (&nn_dns_cache.wakeup);
+        nn_thread_term (&nn_dns_cache.thread);
+    }
+
+    /*  All the endpoints are closed at this point, so nobody is waiting for
+        the results any more. */
+    while (!nn_list_empty (&nn_dns_cache.entries)) {
+        entry = nn_cont (nn_list_begin (&nn_dns_cache.entries),
+            struct nn_dns_entry, item);
+        nn_list_erase (&nn_dns_cache.entries, &entry->item);
+        if (nn_list_item_isinlist (&entry->queued))
+            nn_list_erase (&nn_dns_cache.queue, &entry->queued);
+        nn_list_term (&entry->waiters);
+        nn_list_item_term (&entry->queued);
+        nn_list_item_term (&entry->item);
+        nn_free (entry);
+    }
+
+    nn_sem_term (&nn_dns_cache.wakeup);
+    nn_list_term (&nn_dns_cache.queue);
+    nn_list_term (&nn_dns_cache.entries);
+    nn_clock_term (&nn_dns_cache.clock);
+    nn_mutex_term (&nn_dns_cache.sync);
+}
+
+/*  Returns 1 if the result was found in the cache and stored in the object.
+    Otherwise, the object is registered to be notified once the lookup
+    is done and 0 is returned. */
+static int nn_dns_cache_lookup (struct nn_dns *self, const char *addr,
+    size_t addrlen, int ipv4only)
+{
+    uint64_t now;
+    struct nn_list_item *it;
+    struct nn_dns_entry *entry;
+    struct nn_dns_entry *found;
+
+    nn_assert (addrlen < NN_SOCKADDR_MAX);
+
+    nn_mutex_lock (&nn_dns_cache.sync);
+    now = nn_clock_now (&nn_dns_cache.clock);
+
+    /*  Find the entry for the hostname. Drop the stale entries on the way. */
+    found = NULL;
+    it = nn_list_begin (&nn_dns_cache.entries);
+    while (it != nn_list_end (&nn_dns_cache.entries)) {
+        entry = nn_cont (it, struct nn_dns_entry, item);
+        if (entry->ipv4only == ipv4only &&
+              strlen (entry->hostname) == addrlen &&
+              memcmp (entry->hostname, addr, addrlen) == 0) {
+            found = entry;
+            it = nn_list_next (&nn_dns_cache.entries, it);
+            continue;
+        }
+        if (!entry->resolving && entry->expiry <= now) {
+            it = nn_list_erase (&nn_dns_cache.entries, it);
+            nn_list_term (&entry->waiters);
+            nn_list_item_term (&entry->queued);
+            nn_list_item_term (&entry->item);
+            nn_free (entry);
+            continue;
+        }
+        it = nn_list_next (&nn_dns_cache.entries, it);
+    }
+
+    /*  Fresh result is available. */
+    if (found && !found->resolving && found->expiry > now) {
+        *self->result = found->result;
+        nn_mutex_unlock (&nn_dns_cache.sync);
+        return 1;
+    }
+
+    if (!found) {
+        found = nn_alloc (sizeof (struct nn_dns_entry), "dns cache entry");
+        alloc_assert (found);
+        nn_list_item_init (&found->item);
+        nn_list_item_init (&found->queued);
+        memcpy (found->hostname, addr, addrlen);
+        found->hostname [addrlen] = 0;
+        found->ipv4only = ipv4only;
+        found->resolving = 0;
+        found->expiry = 0;
+        nn_list_init (&found->waiters);
+        nn_list_insert (&nn_dns_cache.entries, &found->item,
+            nn_list_end (&nn_dns_cache.entries));
+    }
+
+    /*  Ask the resolver thread to do the lookup unless it's already in
+        progress. */
+    if (!found->resolving) {
+        found->resolving = 1;
+        nn_list_insert (&nn_dns_cache.queue, &found->queued,
+            nn_list_end (&nn_dns_cache.queue));
+        if (nn_slow (!nn_dns_cache.started)) {
+            nn_thread_init (&nn_dns_cache.thread, nn_dns_resolver, NULL);
+            nn_dns_cache.started = 1;
+        }
+        nn_sem_post (&nn_dns_cache.wakeup);
+    }
+
+    self->entry = found;
+    nn_list_insert (&found->waiters, &self->item,
+        nn_list_end (&found->waiters));
+
+    nn_mutex_unlock (&nn_dns_cache.sync);
+    return 0;
+}
+
+static void nn_dns_resolver (NN_UNUSED void *arg)
+{
+    int rc;
+    struct nn_dns_entry *entry;
+    struct nn_dns_result result;
+    char hostname [NN_SOCKADDR_MAX];
+    int ipv4only;
+    struct nn_list ready;
+    struct nn_dns *dns;
+
+    nn_list_init (&ready);
+
+    nn_mutex_lock (&nn_dns_cache.sync);
+    while (!nn_dns_cache.stopping) {
+
+        /*  Wait for a hostname to resolve. */
+        if (nn_list_empty (&nn_dns_cache.queue)) {
+            nn_mutex_unlock (&nn_dns_cache.sync);
+            rc = nn_sem_wait (&nn_dns_cache.wakeup);
+            errnum_assert (rc == 0 || rc == -EINTR, -rc);
+            nn_mutex_lock (&nn_dns_cache.sync);
+            continue;
+        }
+        entry = nn_cont (nn_list_begin (&nn_dns_cache.queue),
+            struct nn_dns_entry, queued);
+        nn_list_erase (&nn_dns_cache.queue, &entry->queued);
+        memcpy (hostname, entry->hostname, sizeof (hostname));
+        ipv4only = entry->ipv4only;
+
+        /*  Do the lookup itself without holding the lock. The entry can't be
+            deallocated in the meantime as it is marked as being resolved. */
+        nn_mutex_unlock (&nn_dns_cache.sync);
+        nn_dns_resolve (hostname, ipv4only, &result);
+        nn_mutex_lock (&nn_dns_cache.sync);
+
+        entry->result = result;
+        entry->resolving = 0;
+        entry->expiry = nn_clock_now (&nn_dns_cache.clock) +
+            (result.error ? nn_dns_cache.negative_ttl : nn_dns_cache.ttl);
+
+        /*  Take the waiting objects from the entry. From now on they can't
+            cancel the wait and have to accept the result. */
+        while (!nn_list_empty (&entry->waiters)) {
+            dns = nn_cont (nn_list_begin (&entry->waiters), struct nn_dns,
+                item);
+            nn_list_erase (&entry->waiters, &dns->item);
+            dns->entry = NULL;
+            nn_list_insert (&ready, &dns->item, nn_list_end (&ready));
+        }
+
+        /*  Deliver the result. The cache lock must not be held while entering
+            the context of the objects, as they access the cache from within
+            their context. */
+        nn_mutex_unlock (&nn_dns_cache.sync);
+        while (!nn_list_empty (&ready)) {
+            dns = nn_cont (nn_list_begin (&ready), struct nn_dns, item);
+            nn_list_erase (&ready, &dns->item);
+            nn_ctx_enter (dns->fsm.ctx);
+            *dns->result = result;
+            nn_fsm_action (&dns->fsm, NN_DNS_ACTION_DONE);
+            nn_ctx_leave (dns->fsm.ctx);
+        }
+        nn_mutex_lock (&nn_dns_cache.sync);
+    }
+    nn_mutex_unlock (&nn_dns_cache.sync);
+
+    nn_list_term (&ready);
+}
+
+static void nn_dns_resolve (const char *hostname, int ipv4only,
+    struct nn_dns_result *result)
+{
+    int rc;
+    int i;
+    int n6;
+    int n4;
+    int first6;
+    struct addrinfo query;
+    struct addrinfo *reply;
+    struct addrinfo *it;
+    struct addrinfo *addrs6 [NN_DNS_MAX_ADDRS];
+    struct addrinfo *addrs4 [NN_DNS_MAX_ADDRS];
+
+    /*  Unless IPv4 is enforced, ask for all IPv6 addresses as well as all
+        the IPv4 addresses mapped into IPv6 space. */
+    memset (&query, 0, sizeof (query));
+    if (ipv4only)
+        query.ai_family = AF_INET;
+    else {
+        query.ai_family = AF_INET6;
+#if defined AI_V4MAPPED && defined AI_ALL
+        query.ai_flags = AI_V4MAPPED | AI_ALL;
+#elif defined AI_V4MAPPED
+        query.ai_flags = AI_V4MAPPED;
 #endif
+    }
+    query.ai_socktype = SOCK_STREAM;
+
+    rc = getaddrinfo (hostname, NULL, &query, &reply);
+    if (rc != 0) {
+        result->error = EINVAL;
+        return;
+    }
+    nn_assert (reply);
+
+    /*  Split the addresses into native IPv6 and IPv4 ones, dropping the
+        duplicates. */
+    n6 = 0;
+    n4 = 0;
+    first6 = nn_dns_isipv6 (reply->ai_addr);
+    for (it = reply; it; it = it->ai_next) {
+        nn_assert (it->ai_addrlen <= sizeof (struct sockaddr_storage));
+        for (i = 0; i != n6; ++i)
+            if (addrs6 [i]->ai_addrlen == it->ai_addrlen &&
+                  memcmp (addrs6 [i]->ai_addr, it->ai_addr,
+                  it->ai_addrlen) == 0)
+                break;
+        if (i != n6)
+            continue;
+        for (i = 0; i != n4; ++i)
+            if (addrs4 [i]->ai_addrlen == it->ai_addrlen &&
+                  memcmp (addrs4 [i]->ai_addr, it->ai_addr,
+                  it->ai_addrlen) == 0)
+                break;
+        if (i != n4)
+            continue;
+        if (nn_dns_isipv6 (it->ai_addr)) {
+            if (n6 < NN_DNS_MAX_ADDRS)
+                addrs6 [n6++] = it;
+        }
+        else {
+            if (n4 < NN_DNS_MAX_ADDRS)
+                addrs4 [n4++] = it;
+        }
+    }
+
+    /*  Interleave the two families, starting with the one preferred by
+        the system (RFC 8305, section 4). */
+    result->error = 0;
+    result->naddrs = 0;
+    i = 0;
+    while (result->naddrs < NN_DNS_MAX_ADDRS && (i < n6 || i < n4)) {
+        if (first6 && i < n6)
+            nn_dns_addaddr (result, addrs6 [i]);
+        if (i < n4 && result->naddrs < NN_DNS_MAX_ADDRS)
+            nn_dns_addaddr (result, addrs4 [i]);
+        if (!first6 && i < n6 && result->naddrs < NN_DNS_MAX_ADDRS)
+            nn_dns_addaddr (result, addrs6 [i]);
+        ++i;
+    }
+    nn_assert (result->naddrs > 0);
+
+    freeaddrinfo (reply);
+}
+
+static void nn_dns_addaddr (struct nn_dns_result *result,
+    struct addrinfo *addr)
+{
+    memcpy (&result->addrs [result->naddrs], addr->ai_addr, addr->ai_addrlen);
+    result->addrlens [result->naddrs] = (size_t) addr->ai_addrlen;
+    ++result->naddrs;
+}
+
+/*  Returns 1 if the address is a native IPv6 address, 0 if it is an IPv4
+    address, even if mapped into IPv6 space. */
+static int nn_dns_isipv6 (const struct sockaddr *addr)
+{
+    const struct sockaddr_in6 *in6;
+
+    if (addr->sa_family != AF_INET6)
+        return 0;
+    in6 = (const struct sockaddr_in6*) addr;
+    return IN6_IS_ADDR_V4MAPPED (&in6->sin6_addr) ? 0 : 1;
+}
+
+static int nn_dns_getenv (const char *name, int dflt)
+{
+    char *envvar;
+    int val;
+
+    envvar = getenv (name);
+    if (!envvar || !*envvar)
+        return dflt;
+    val = atoi (envvar);
+    return val < 0 ? dflt : val;
+}
@@ -25,8 +25,16 @@
 
 #include "../../aio/fsm.h"
 
+#include "../../utils/list.h"
+
 #include <stddef.h>
 
+#if defined NN_HAVE_WINDOWS
+#include "../../utils/win.h"
+#else
+#include <sys/socket.h>
+#endif
+
 /*  Checks the hostname according to RFC 952 and RFC 1123.
     Returns 0 in case the it is valid. */
 int nn_dns_check_hostname (const char *name, size_t namelen);
@@ -35,16 +43,38 @@ int nn_dns_check_hostname (const char *name, size_t namelen);
 #define NN_DNS_DONE 1
 #define NN_DNS_STOPPED 2
 
-#if defined NN_HAVE_GETADDRINFO_A
-#include "dns_getaddrinfo_a.h"
-#else
-#include "dns_getaddrinfo.h"
-#endif
+/*  Maximum number of addresses kept from a single DNS lookup. */
+#define NN_DNS_MAX_ADDRS 8
 
+/*  If the lookup succeeds, 'addrs' holds 'naddrs' addresses in the order
+    they should be tried in. IPv6 and IPv4 addresses are interleaved so that
+    a broken address family doesn't delay connecting to the other one. */
 struct nn_dns_result {
     int error;
-    struct sockaddr_storage addr;
-    size_t addrlen;
+    int naddrs;
+    struct sockaddr_storage addrs [NN_DNS_MAX_ADDRS];
+    size_t addrlens [NN_DNS_MAX_ADDRS];
+};
+
+/*  Hostnames are resolved in a dedicated thread, so that slow DNS doesn't
+    block the worker threads. The results, including the failures, are cached
+    for a while and shared among all the endpoints in the process.
+    Concurrent requests to resolve the same hostname are served by a single
+    DNS lookup. */
+
+struct nn_dns_entry;
+
+struct nn_dns {
+    struct nn_fsm fsm;
+    int state;
+    struct nn_dns_result *result;
+
+    /*  Cache entry this object is waiting for. NULL if the result is being
+        delivered to the object at the moment. */
+    struct nn_dns_entry *entry;
+    struct nn_list_item item;
+
+    struct nn_fsm_event done;
 };
 
 void nn_dns_init (struct nn_dns *self, int src, struct nn_fsm *owner);
@@ -55,4 +85,9 @@ void nn_dns_start (struct nn_dns *self, const char *addr, size_t addrlen,
     int ipv4only, struct nn_dns_result *result);
 void nn_dns_stop (struct nn_dns *self);
 
+/*  Initialise and terminate the process-wide DNS cache. */
+void nn_dns_cache_init (void);
+void nn_dns_cache_term (void);
+
 #endif
+
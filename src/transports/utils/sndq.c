@@ -0,0 +1,101 @@
+/*
+    Copyright (c) 2012 250bpm s.r.o.  All rights reserved.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom
+    the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included
+    in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+#include "sndq.h"
+
+#include "../../utils/alloc.h"
+#include "../../utils/err.h"
+#include "../../utils/fast.h"
+
+#include <string.h>
+
+/*  Initial capacity of the queue, in messages. */
+#define NN_SNDQ_INITIAL 16
+
+void nn_sndq_init (struct nn_sndq *self, size_t maxmem)
+{
+    self->msgs = NULL;
+    self->capacity = 0;
+    self->head = 0;
+    self->count = 0;
+    self->mem = 0;
+    self->maxmem = maxmem;
+}
+
+void nn_sndq_term (struct nn_sndq *self)
+{
+    nn_sndq_clear (self);
+    nn_free (self->msgs);
+}
+
+void nn_sndq_clear (struct nn_sndq *self)
+{
+    struct nn_msg msg;
+
+    while (nn_sndq_pop (self, &msg) == 0)
+        nn_msg_term (&msg);
+}
+
+int nn_sndq_full (struct nn_sndq *self)
+{
+    return self->mem >= self->maxmem ? 1 : 0;
+}
+
+void nn_sndq_push (struct nn_sndq *self, struct nn_msg *msg)
+{
+    int capacity;
+    struct nn_msg *msgs;
+
+    /*  Grow the buffer if needed. Messages are unwrapped so that the new
+        buffer starts with the head of the queue. */
+    if (nn_slow (self->count == self->capacity)) {
+        capacity = self->capacity ? self->capacity * 2 : NN_SNDQ_INITIAL;
+        msgs = nn_alloc (capacity * sizeof (struct nn_msg), "send queue");
+        alloc_assert (msgs);
+        memcpy (msgs, self->msgs + self->head,
+            (self->capacity - self->head) * sizeof (struct nn_msg));
+        memcpy (msgs + self->capacity - self->head, self->msgs,
+            self->head * sizeof (struct nn_msg));
+        nn_free (self->msgs);
+        self->msgs = msgs;
+        self->capacity = capacity;
+        self->head = 0;
+    }
+
+    self->mem += nn_chunkref_size (&msg->sphdr) + nn_msg_bodysize (msg);
+    nn_msg_mv (&self->msgs [(self->head + self->count) % self->capacity],
+        msg);
+    ++self->count;
+}
+
+int nn_sndq_pop (struct nn_sndq *self, struct nn_msg *msg)
+{
+    if (!self->count)
+        return -EAGAIN;
+
+    nn_msg_mv (msg, &self->msgs [self->head]);
+    self->head = (self->head + 1) % self->capacity;
+    --self->count;
+    self->mem -= nn_chunkref_size (&msg->sphdr) + nn_msg_bodysize (msg);
+
+    return 0;
+}
@@ -0,0 +1,70 @@
+/*
+    Copyright (c) 2012 250bpm s.r.o.  All rights reserved.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom
+    the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included
+    in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+#ifndef NN_SNDQ_INCLUDED
+#define NN_SNDQ_INCLUDED
+
+#include "../../utils/msg.h"
+
+#include <stddef.h>
+
+/*  Queue of outbound messages waiting for the underlying connection to
+    become writable. Stream transports use it so that the pipe remains
+    writable while a message is being written to the socket, up to the
+    point where NN_SNDBUF bytes are queued. It's accessed only from within
+    the state machine of the connection and thus needs no synchronisation. */
+
+struct nn_sndq {
+
+    /*  Circular buffer of messages. It grows as needed. */
+    struct nn_msg *msgs;
+    int capacity;
+    int head;
+    int count;
+
+    /*  Total size of the queued messages and the limit on it (in bytes). */
+    size_t mem;
+    size_t maxmem;
+};
+
+/*  Initialise the queue. maxmem is the maximal queue size in bytes. */
+void nn_sndq_init (struct nn_sndq *self, size_t maxmem);
+
+/*  Deallocates the queue along with any messages in it. */
+void nn_sndq_term (struct nn_sndq *self);
+
+/*  Drops all the messages in the queue. */
+void nn_sndq_clear (struct nn_sndq *self);
+
+/*  Returns 1 if the size limit was reached, 0 otherwise. New messages can be
+    added to the queue irrespective of the limit, the caller should just stop
+    accepting them from the user. */
+int nn_sndq_full (struct nn_sndq *self);
+
+/*  Moves the message to the end of the queue. */
+void nn_sndq_push (struct nn_sndq *self, struct nn_msg *msg);
+
+/*  Moves the first message from the queue to 'msg', which must be
+    uninitialised. Returns -EAGAIN if the queue is empty. */
+int nn_sndq_pop (struct nn_sndq *self, struct nn_msg *msg);
+
+#endif
@@ -63,6 +63,7 @@ void nn_streamhdr_init (struct nn_streamhdr *self, int src,
     self->usock_owner.src = -1;
     self->usock_owner.fsm = NULL;
     self->pipebase = NULL;
+    self->features = 0;
 }
 
 void nn_streamhdr_term (struct nn_streamhdr *self)
@@ -80,10 +81,12 @@ int nn_streamhdr_isidle (struct nn_streamhdr *self)
 }
 
 void nn_streamhdr_start (struct nn_streamhdr *self, struct nn_usock *usock,
-    struct nn_pipebase *pipebase)
+    struct nn_pipebase *pipebase, int features)
 {
     size_t sz;
     int protocol;
+    int flowctl;
+    int msgttl;
 
     /*  Take ownership of the underlying socket. */
     nn_assert (self->usock == NULL && self->usock_owner.fsm == NULL);
@@ -98,9 +101,29 @@ void nn_streamhdr_start (struct nn_streamhdr *self, struct nn_usock *usock,
     nn_pipebase_getopt (pipebase, NN_SOL_SOCKET, NN_PROTOCOL, &protocol, &sz);
     nn_assert (sz == sizeof (protocol));
 
+    /*  Check which of the features are switched on. */
+    if (features & NN_STREAMHDR_FLOWCTL) {
+        sz = sizeof (flowctl);
+        nn_pipebase_getopt (pipebase, NN_SOL_SOCKET, NN_FLOWCTL,
+            &flowctl, &sz);
+        nn_assert (sz == sizeof (flowctl));
+        if (!flowctl)
+            features &= ~NN_STREAMHDR_FLOWCTL;
+    }
+    if (features & NN_STREAMHDR_DEADLINE) {
+        sz = sizeof (msgttl);
+        nn_pipebase_getopt (pipebase, NN_SOL_SOCKET, NN_MSGTTL,
+            &msgttl, &sz);
+        nn_assert (sz == sizeof (msgttl));
+        if (msgttl < 0)
+            features &= ~NN_STREAMHDR_DEADLINE;
+    }
+    self->features = features;
+
     /*  Compose the protocol header. */
     memcpy (self->protohdr, "\0SP\0\0\0\0\0", 8);
     nn_puts (self->protohdr + 4, (uint16_t) protocol);
+    self->protohdr [6] = (uint8_t) features;
 
     /*  Launch the state machine. */
     nn_fsm_start (&self->fsm);
@@ -223,6 +246,7 @@ static void nn_streamhdr_handler (struct nn_fsm *self, int src, int type,
                 protocol = nn_gets (streamhdr->protohdr + 4);
                 if (!nn_pipebase_ispeer (streamhdr->pipebase, protocol))
                     goto invalidhdr;
+                streamhdr->features &= streamhdr->protohdr [6];
                 nn_timer_stop (&streamhdr->timer);
                 streamhdr->state = NN_STREAMHDR_STATE_STOPPING_TIMER_DONE;
                 return;
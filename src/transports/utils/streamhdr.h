@@ -38,6 +38,21 @@
 #define NN_STREAMHDR_ERROR 2
 #define NN_STREAMHDR_STOPPED 3
 
+/*  Optional features of the connection. They are advertised in the reserved
+    part of the protocol header and enabled only if both peers support them.
+    The field must be zero unless the user has switched a feature on, other
+    SP implementations reject headers where it isn't. */
+
+/*  Credit-based flow control (see NN_FLOWCTL socket option). */
+#define NN_STREAMHDR_FLOWCTL 1
+
+/*  Message deadlines are passed to the peer. Offered only if NN_MSGTTL
+    socket option is set. */
+#define NN_STREAMHDR_DEADLINE 2
+
+/*  Messages are passed via shared memory. Offered only by shm:// endpoints. */
+#define NN_STREAMHDR_SHM 4
+
 struct nn_streamhdr {
 
     /*  The state machine. */
@@ -59,6 +74,10 @@ struct nn_streamhdr {
     /*  Protocol header. */
     uint8_t protohdr [8];
 
+    /*  Features supported by both peers. Valid once NN_STREAMHDR_OK
+        is raised. */
+    int features;
+
     /*  Event fired when the state machine ends. */
     struct nn_fsm_event done;
 };
@@ -68,8 +87,10 @@ void nn_streamhdr_init (struct nn_streamhdr *self, int src,
 void nn_streamhdr_term (struct nn_streamhdr *self);
 
 int nn_streamhdr_isidle (struct nn_streamhdr *self);
+/*  'features' is the set of features the transport implements. Those of them
+    that are enabled by the socket options are offered to the peer. */
 void nn_streamhdr_start (struct nn_streamhdr *self, struct nn_usock *usock,
-    struct nn_pipebase *pipebase);
+    struct nn_pipebase *pipebase, int features);
 void nn_streamhdr_stop (struct nn_streamhdr *self);
 
 #endif
@@ -0,0 +1,255 @@
+/*
+    Copyright (c) 2014 250bpm s.r.o.  All rights reserved.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom
+    the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included
+    in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+#include "tlsctx.h"
+
+#include "../../tls.h"
+
+#include "../../utils/err.h"
+#include "../../utils/alloc.h"
+#include "../../utils/fast.h"
+#include "../../utils/attr.h"
+
+#include <string.h>
+
+#if defined NN_HAVE_OPENSSL
+
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#include <openssl/x509v3.h>
+
+/*  Private functions. */
+static char *nn_tlsctx_getstr (struct nn_epbase *epbase, int option);
+static int nn_tlsctx_new_session (SSL *ssl, SSL_SESSION *session);
+
+int nn_tlsctx_init (struct nn_tlsctx *self, struct nn_epbase *epbase,
+    int server)
+{
+    int rc;
+    SSL_CTX *ctx;
+    char *cafile;
+    char *certfile;
+    char *keyfile;
+    int authmode;
+    size_t sz;
+    int mode;
+
+    ctx = SSL_CTX_new (server ? TLS_server_method () : TLS_client_method ());
+    alloc_assert (ctx);
+    rc = SSL_CTX_set_min_proto_version (ctx, TLS1_2_VERSION);
+    nn_assert (rc == 1);
+    SSL_CTX_set_options (ctx, SSL_OP_NO_RENEGOTIATION);
+
+    /*  Load the certificates. If the private key is not specified, it is
+        expected to be in the same file as the certificate. */
+    cafile = nn_tlsctx_getstr (epbase, NN_TLS_CA_FILE);
+    certfile = nn_tlsctx_getstr (epbase, NN_TLS_CERT_FILE);
+    keyfile = nn_tlsctx_getstr (epbase, NN_TLS_KEY_FILE);
+    rc = 0;
+    if (cafile) {
+        if (SSL_CTX_load_verify_locations (ctx, cafile, NULL) != 1)
+            rc = -EINVAL;
+    }
+    else
+        SSL_CTX_set_default_verify_paths (ctx);
+    if (rc == 0 && certfile) {
+        if (SSL_CTX_use_certificate_chain_file (ctx, certfile) != 1 ||
+              SSL_CTX_use_PrivateKey_file (ctx, keyfile ? keyfile : certfile,
+              SSL_FILETYPE_PEM) != 1 ||
+              SSL_CTX_check_private_key (ctx) != 1)
+            rc = -EINVAL;
+    }
+
+    /*  Server can't do without a certificate. */
+    if (rc == 0 && server && !certfile)
+        rc = -EINVAL;
+    if (cafile)
+        nn_free (cafile);
+    if (certfile)
+        nn_free (certfile);
+    if (keyfile)
+        nn_free (keyfile);
+    if (nn_slow (rc < 0)) {
+        ERR_clear_error ();
+        SSL_CTX_free (ctx);
+        return rc;
+    }
+
+    /*  Choose how the peer is authenticated. */
+    sz = sizeof (authmode);
+    nn_epbase_getopt (epbase, NN_TLS, NN_TLS_AUTH_MODE, &authmode, &sz);
+    nn_assert (sz == sizeof (authmode));
+    if (authmode == NN_TLS_AUTH_DEFAULT)
+        authmode = server ? NN_TLS_AUTH_NONE : NN_TLS_AUTH_REQUIRED;
+    switch (authmode) {
+    case NN_TLS_AUTH_NONE:
+        mode = SSL_VERIFY_NONE;
+        break;
+    case NN_TLS_AUTH_OPTIONAL:
+        mode = SSL_VERIFY_PEER;
+        break;
+    case NN_TLS_AUTH_REQUIRED:
+        mode = SSL_VERIFY_PEER | SSL_VERIFY_FAIL_IF_NO_PEER_CERT;
+        break;
+    default:
+        nn_assert (0);
+    }
+    SSL_CTX_set_verify (ctx, mode, NULL);
+
+    /*  Server issues session tickets by default. Connecting side caches
+        the last session itself, in this object, and tries to resume it
+        when reconnecting. */
+    if (server) {
+        rc = SSL_CTX_set_session_id_context (ctx,
+            (const unsigned char*) "nanomsg", 7);
+        nn_assert (rc == 1);
+    }
+    else {
+        SSL_CTX_set_session_cache_mode (ctx,
+            SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+        SSL_CTX_sess_set_new_cb (ctx, nn_tlsctx_new_session);
+    }
+    SSL_CTX_set_app_data (ctx, self);
+
+    self->ctx = ctx;
+    self->server = server;
+    self->session = NULL;
+
+    return 0;
+}
+
+void nn_tlsctx_term (struct nn_tlsctx *self)
+{
+    if (self->session)
+        SSL_SESSION_free ((SSL_SESSION*) self->session);
+    SSL_CTX_free ((SSL_CTX*) self->ctx);
+}
+
+void *nn_tlsctx_new (struct nn_tlsctx *self, const char *host,
+    size_t hostlen)
+{
+    int rc;
+    SSL *ssl;
+    char *name;
+
+    ssl = SSL_new ((SSL_CTX*) self->ctx);
+    alloc_assert (ssl);
+
+    if (self->server) {
+        SSL_set_accept_state (ssl);
+        return ssl;
+    }
+    SSL_set_connect_state (ssl);
+
+    /*  Literal addresses are matched against IP addresses in the server's
+        certificate. Anything else is a hostname, which is also sent to
+        the server using SNI. */
+    if (host && hostlen) {
+        if (hostlen >= 2 && host [0] == '[' && host [hostlen - 1] == ']') {
+            ++host;
+            hostlen -= 2;
+        }
+        name = nn_alloc (hostlen + 1, "tls hostname");
+        alloc_assert (name);
+        memcpy (name, host, hostlen);
+        name [hostlen] = 0;
+        if (X509_VERIFY_PARAM_set1_ip_asc (SSL_get0_param (ssl), name) != 1) {
+            rc = SSL_set_tlsext_host_name (ssl, name);
+            nn_assert (rc == 1);
+            rc = SSL_set1_host (ssl, name);
+            nn_assert (rc == 1);
+        }
+        nn_free (name);
+    }
+
+    /*  Try to resume the previous session with the server. */
+    if (self->session) {
+        rc = SSL_set_session (ssl, (SSL_SESSION*) self->session);
+        nn_assert (rc == 1);
+    }
+
+    return ssl;
+}
+
+static char *nn_tlsctx_getstr (struct nn_epbase *epbase, int option)
+{
+    char dummy;
+    char *str;
+    size_t sz;
+
+    /*  Find out the length of the string first. */
+    sz = 0;
+    nn_epbase_getopt (epbase, NN_TLS, option, &dummy, &sz);
+    if (!sz)
+        return NULL;
+
+    str = nn_alloc (sz + 1, "tls option");
+    alloc_assert (str);
+    nn_epbase_getopt (epbase, NN_TLS, option, str, &sz);
+    str [sz] = 0;
+    return str;
+}
+
+static int nn_tlsctx_new_session (SSL *ssl, SSL_SESSION *session)
+{
+    struct nn_tlsctx *self;
+    SSL_SESSION *copy;
+
+    /*  OpenSSL marks the session as not resumable once its connection is
+        closed without TLS shutdown. Reconnecting after such a failure is
+        exactly the case where resumption is needed, so keep a copy. */
+    copy = SSL_SESSION_dup (session);
+    if (nn_slow (!copy))
+        return 0;
+
+    /*  The callback is invoked from within the endpoint's context, same as
+        nn_tlsctx_new, so no locking is needed. */
+    self = SSL_CTX_get_app_data (SSL_get_SSL_CTX (ssl));
+    if (self->session)
+        SSL_SESSION_free ((SSL_SESSION*) self->session);
+    self->session = copy;
+
+    return 0;
+}
+
+#else
+
+int nn_tlsctx_init (NN_UNUSED struct nn_tlsctx *self,
+    NN_UNUSED struct nn_epbase *epbase, NN_UNUSED int server)
+{
+    return -EPROTONOSUPPORT;
+}
+
+void nn_tlsctx_term (NN_UNUSED struct nn_tlsctx *self)
+{
+    nn_assert (0);
+}
+
+void *nn_tlsctx_new (NN_UNUSED struct nn_tlsctx *self,
+    NN_UNUSED const char *host, NN_UNUSED size_t hostlen)
+{
+    nn_assert (0);
+    return NULL;
+}
+
+#endif
+
@@ -0,0 +1,62 @@
+/*
+    Copyright (c) 2014 250bpm s.r.o.  All rights reserved.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom
+    the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included
+    in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+#ifndef NN_TLSCTX_INCLUDED
+#define NN_TLSCTX_INCLUDED
+
+#include "../../transport.h"
+
+#include <stddef.h>
+
+/*  TLS configuration shared by all the connections of an endpoint. It is
+    built from NN_TLS socket options when the endpoint is created. On the
+    connecting side it also remembers the last session issued by the server
+    so that subsequent connections can resume it rather than doing a full
+    handshake. */
+
+struct nn_tlsctx {
+
+    /*  OpenSSL's SSL_CTX object. */
+    void *ctx;
+
+    /*  Non-zero on the accepting side of the connections. */
+    int server;
+
+    /*  Session to resume by the next connection (SSL_SESSION), if any. */
+    void *session;
+};
+
+/*  Returns -EINVAL if the options are inconsistent or the files they refer
+    to can't be loaded, -EPROTONOSUPPORT if the library was built without
+    TLS support. */
+int nn_tlsctx_init (struct nn_tlsctx *self, struct nn_epbase *epbase,
+    int server);
+void nn_tlsctx_term (struct nn_tlsctx *self);
+
+/*  Creates the TLS session (SSL object) for a new connection, to be passed
+    to nn_usock_tls. On the connecting side 'host' is the name or literal
+    address of the server used to verify its certificate. */
+void *nn_tlsctx_new (struct nn_tlsctx *self, const char *host,
+    size_t hostlen);
+
+#endif
+
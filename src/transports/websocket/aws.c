@@ -47,12 +47,13 @@ static void nn_aws_shutdown (struct nn_fsm *self, int src, int type,
     void *srcptr);
 
 void nn_aws_init (struct nn_aws *self, int src,
-    struct nn_epbase *epbase, struct nn_fsm *owner)
+    struct nn_epbase *epbase, struct nn_tlsctx *tlsctx, struct nn_fsm *owner)
 {
     nn_fsm_init (&self->fsm, nn_aws_handler, nn_aws_shutdown,
         src, self, owner);
     self->state = NN_AWS_STATE_IDLE;
     self->epbase = epbase;
+    self->tlsctx = tlsctx;
     nn_usock_init (&self->usock, NN_AWS_SRC_USOCK, &self->fsm);
     self->listener = NULL;
     self->listener_owner.src = -1;
@@ -214,7 +215,8 @@ static void nn_aws_handler (struct nn_fsm *self, int src, int type,
                 /*  Start the sws state machine. */
                 nn_usock_activate (&aws->usock);
                 nn_sws_start (&aws->sws, &aws->usock, NN_WS_SERVER,
-                    NULL, NULL);
+                    NULL, NULL, aws->tlsctx ?
+                    nn_tlsctx_new (aws->tlsctx, NULL, 0) : NULL);
                 aws->state = NN_AWS_STATE_ACTIVE;
 
                 nn_epbase_stat_increment (aws->epbase,
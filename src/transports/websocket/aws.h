@@ -31,6 +31,8 @@
 #include "../../aio/fsm.h"
 #include "../../aio/usock.h"
 
+#include "../utils/tlsctx.h"
+
 #include "../../utils/list.h"
 
 /*  State machine handling accepted WS sockets. */
@@ -51,6 +53,9 @@ struct nn_aws {
     /*  Pointer to the associated endpoint. */
     struct nn_epbase *epbase;
 
+    /*  TLS configuration of the endpoint, NULL for plain WebSocket. */
+    struct nn_tlsctx *tlsctx;
+
     /*  Underlying socket. */
     struct nn_usock usock;
 
@@ -70,7 +75,7 @@ struct nn_aws {
 };
 
 void nn_aws_init (struct nn_aws *self, int src,
-    struct nn_epbase *epbase, struct nn_fsm *owner);
+    struct nn_epbase *epbase, struct nn_tlsctx *tlsctx, struct nn_fsm *owner);
 void nn_aws_term (struct nn_aws *self);
 
 int nn_aws_isidle (struct nn_aws *self);
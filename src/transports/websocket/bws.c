@@ -26,6 +26,7 @@
 
 #include "../utils/port.h"
 #include "../utils/iface.h"
+#include "../utils/tlsctx.h"
 
 #include "../../aio/fsm.h"
 #include "../../aio/usock.h"
@@ -77,6 +78,10 @@ struct nn_bws {
 
     /*  List of accepted connections. */
     struct nn_list awss;
+
+    /*  TLS configuration, used only if 'tls' is set. */
+    int tls;
+    struct nn_tlsctx tlsctx;
 };
 
 /*  nn_epbase virtual interface implementation. */
@@ -95,7 +100,7 @@ static void nn_bws_shutdown (struct nn_fsm *self, int src, int type,
 static void nn_bws_start_listening (struct nn_bws *self);
 static void nn_bws_start_accepting (struct nn_bws *self);
 
-int nn_bws_create (void *hint, struct nn_epbase **epbase)
+int nn_bws_create (void *hint, struct nn_epbase **epbase, int tls)
 {
     int rc;
     struct nn_bws *self;
@@ -120,12 +125,14 @@ int nn_bws_create (void *hint, struct nn_epbase **epbase)
     pos = strrchr (addr, ':');
     if (nn_slow (!pos)) {
         nn_epbase_term (&self->epbase);
+        nn_free (self);
         return -EINVAL;
     }
     ++pos;
     rc = nn_port_resolve (pos, end - pos);
     if (nn_slow (rc < 0)) {
         nn_epbase_term (&self->epbase);
+        nn_free (self);
         return -EINVAL;
     }
 
@@ -139,9 +146,21 @@ int nn_bws_create (void *hint, struct nn_epbase **epbase)
     rc = nn_iface_resolve (addr, pos - addr - 1, ipv4only, &ss, &sslen);
     if (nn_slow (rc < 0)) {
         nn_epbase_term (&self->epbase);
+        nn_free (self);
         return -ENODEV;
     }
 
+    /*  Load the certificates. */
+    self->tls = tls;
+    if (tls) {
+        rc = nn_tlsctx_init (&self->tlsctx, &self->epbase, 1);
+        if (nn_slow (rc < 0)) {
+            nn_epbase_term (&self->epbase);
+            nn_free (self);
+            return rc;
+        }
+    }
+
     /*  Initialise the structure. */
     nn_fsm_init_root (&self->fsm, nn_bws_handler, nn_bws_shutdown,
         nn_epbase_getctx (&self->epbase));
@@ -178,6 +197,8 @@ static void nn_bws_destroy (struct nn_epbase *self)
     nn_list_term (&bws->awss);
     nn_assert (bws->aws == NULL);
     nn_usock_term (&bws->usock);
+    if (bws->tls)
+        nn_tlsctx_term (&bws->tlsctx);
     nn_epbase_term (&bws->epbase);
     nn_fsm_term (&bws->fsm);
 
@@ -388,7 +409,8 @@ static void nn_bws_start_accepting (struct nn_bws *self)
     /*  Allocate new aws state machine. */
     self->aws = nn_alloc (sizeof (struct nn_aws), "aws");
     alloc_assert (self->aws);
-    nn_aws_init (self->aws, NN_BWS_SRC_AWS, &self->epbase, &self->fsm);
+    nn_aws_init (self->aws, NN_BWS_SRC_AWS, &self->epbase,
+        self->tls ? &self->tlsctx : NULL, &self->fsm);
 
     /*  Start waiting for a new incoming connection. */
     nn_aws_start (self->aws, &self->usock);
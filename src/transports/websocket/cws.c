@@ -27,10 +27,12 @@
 #include "../../websocket.h"
 
 #include "../utils/dns.h"
+#include "../utils/connector.h"
 #include "../utils/port.h"
 #include "../utils/iface.h"
 #include "../utils/backoff.h"
 #include "../utils/literal.h"
+#include "../utils/tlsctx.h"
 
 #include "../../aio/fsm.h"
 #include "../../aio/usock.h"
@@ -58,13 +60,13 @@
 #define NN_CWS_STATE_CONNECTING 4
 #define NN_CWS_STATE_ACTIVE 5
 #define NN_CWS_STATE_STOPPING_SWS 6
-#define NN_CWS_STATE_STOPPING_USOCK 7
+#define NN_CWS_STATE_STOPPING_CONNECTOR 7
 #define NN_CWS_STATE_WAITING 8
 #define NN_CWS_STATE_STOPPING_BACKOFF 9
 #define NN_CWS_STATE_STOPPING_SWS_FINAL 10
 #define NN_CWS_STATE_STOPPING 11
 
-#define NN_CWS_SRC_USOCK 1
+#define NN_CWS_SRC_CONNECTOR 1
 #define NN_CWS_SRC_RECONNECT_TIMER 2
 #define NN_CWS_SRC_DNS 3
 #define NN_CWS_SRC_SWS 4
@@ -79,8 +81,9 @@ struct nn_cws {
         Thus it is derived from epbase. */
     struct nn_epbase epbase;
 
-    /*  The underlying WS socket. */
-    struct nn_usock usock;
+    /*  Connects the underlying WS socket to one of the addresses
+        the remote host resolves to. */
+    struct nn_connector connector;
 
     /*  Used to wait before retrying to connect. */
     struct nn_backoff retry;
@@ -104,6 +107,10 @@ struct nn_cws {
         along with the variable to hold the result. */
     struct nn_dns dns;
     struct nn_dns_result dns_result;
+
+    /*  TLS configuration, used only if 'tls' is set. */
+    int tls;
+    struct nn_tlsctx tlsctx;
 };
 
 /*  nn_epbase virtual interface implementation. */
@@ -120,10 +127,11 @@ static void nn_cws_handler (struct nn_fsm *self, int src, int type,
 static void nn_cws_shutdown (struct nn_fsm *self, int src, int type,
     void *srcptr);
 static void nn_cws_start_resolving (struct nn_cws *self);
-static void nn_cws_start_connecting (struct nn_cws *self,
-    struct sockaddr_storage *ss, size_t sslen);
+static void nn_cws_start_connecting (struct nn_cws *self);
+static void nn_cws_setsockopts (struct nn_epbase *epbase,
+    struct nn_usock *usock);
 
-int nn_cws_create (void *hint, struct nn_epbase **epbase)
+int nn_cws_create (void *hint, struct nn_epbase **epbase, int tls)
 {
     int rc;
     const char *addr;
@@ -142,6 +150,7 @@ int nn_cws_create (void *hint, struct nn_epbase **epbase)
     struct nn_cws *self;
     int reconnect_ivl;
     int reconnect_ivl_max;
+    int reconnect_policy;
     size_t sz;
 
     /*  Allocate the new endpoint object. */
@@ -170,17 +179,19 @@ int nn_cws_create (void *hint, struct nn_epbase **epbase)
     /*  Host contains both hostname and port. */
     hostlen = resource - hostname;
 
-    /*  Parse the port; assume port 80 if not explicitly declared. */
+    /*  Parse the port; assume port 80 (443 for TLS) if not explicitly
+        declared. */
     if (nn_slow (colon)) {
         rc = nn_port_resolve (colon + 1, resource - colon - 1);
         if (nn_slow (rc < 0)) {
             nn_epbase_term (&self->epbase);
+            nn_free (self);
             return -EINVAL;
         }
         self->remote_port = rc;
     }
     else {
-        self->remote_port = 80;
+        self->remote_port = tls ? 443 : 80;
     }
 
     /*  Check whether the host portion of the address is either a literal
@@ -189,6 +200,7 @@ int nn_cws_create (void *hint, struct nn_epbase **epbase)
           nn_literal_resolve (hostname, self->remote_hostname_len, ipv4only,
           &ss, &sslen) < 0) {
         nn_epbase_term (&self->epbase);
+        nn_free (self);
         return -EINVAL;
     }
 
@@ -197,10 +209,22 @@ int nn_cws_create (void *hint, struct nn_epbase **epbase)
         rc = nn_iface_resolve (addr, semicolon - addr, ipv4only, &ss, &sslen);
         if (rc < 0) {
             nn_epbase_term (&self->epbase);
+            nn_free (self);
             return -ENODEV;
         }
     }
 
+    /*  Load the certificates. */
+    self->tls = tls;
+    if (tls) {
+        rc = nn_tlsctx_init (&self->tlsctx, &self->epbase, 0);
+        if (nn_slow (rc < 0)) {
+            nn_epbase_term (&self->epbase);
+            nn_free (self);
+            return rc;
+        }
+    }
+
     /*  At this point, the address is valid, so begin allocating resources. */
     nn_chunkref_init (&self->remote_host, hostlen + 1);
     memcpy (nn_chunkref_data (&self->remote_host), hostname, hostlen);
@@ -233,7 +257,8 @@ int nn_cws_create (void *hint, struct nn_epbase **epbase)
     nn_fsm_init_root (&self->fsm, nn_cws_handler, nn_cws_shutdown,
         nn_epbase_getctx (&self->epbase));
     self->state = NN_CWS_STATE_IDLE;
-    nn_usock_init (&self->usock, NN_CWS_SRC_USOCK, &self->fsm);
+    nn_connector_init (&self->connector, NN_CWS_SRC_CONNECTOR, &self->epbase,
+        nn_cws_setsockopts, &self->fsm);
     sz = sizeof (reconnect_ivl);
     nn_epbase_getopt (&self->epbase, NN_SOL_SOCKET, NN_RECONNECT_IVL,
         &reconnect_ivl, &sz);
@@ -244,8 +269,12 @@ int nn_cws_create (void *hint, struct nn_epbase **epbase)
     nn_assert (sz == sizeof (reconnect_ivl_max));
     if (reconnect_ivl_max == 0)
         reconnect_ivl_max = reconnect_ivl;
+    sz = sizeof (reconnect_policy);
+    nn_epbase_getopt (&self->epbase, NN_SOL_SOCKET, NN_RECONNECT_POLICY,
+        &reconnect_policy, &sz);
+    nn_assert (sz == sizeof (reconnect_policy));
     nn_backoff_init (&self->retry, NN_CWS_SRC_RECONNECT_TIMER,
-        reconnect_ivl, reconnect_ivl_max, &self->fsm);
+        reconnect_policy, reconnect_ivl, reconnect_ivl_max, &self->fsm);
     nn_sws_init (&self->sws, NN_CWS_SRC_SWS, &self->epbase, &self->fsm);
     nn_dns_init (&self->dns, NN_CWS_SRC_DNS, &self->fsm);
 
@@ -279,8 +308,10 @@ static void nn_cws_destroy (struct nn_epbase *self)
     nn_dns_term (&cws->dns);
     nn_sws_term (&cws->sws);
     nn_backoff_term (&cws->retry);
-    nn_usock_term (&cws->usock);
+    nn_connector_term (&cws->connector);
     nn_fsm_term (&cws->fsm);
+    if (cws->tls)
+        nn_tlsctx_term (&cws->tlsctx);
     nn_epbase_term (&cws->epbase);
 
     nn_free (cws);
@@ -305,13 +336,13 @@ static void nn_cws_shutdown (struct nn_fsm *self, int src, int type,
         if (!nn_sws_isidle (&cws->sws))
             return;
         nn_backoff_stop (&cws->retry);
-        nn_usock_stop (&cws->usock);
+        nn_connector_stop (&cws->connector);
         nn_dns_stop (&cws->dns);
         cws->state = NN_CWS_STATE_STOPPING;
     }
     if (nn_slow (cws->state == NN_CWS_STATE_STOPPING)) {
         if (!nn_backoff_isidle (&cws->retry) ||
-              !nn_usock_isidle (&cws->usock) ||
+              !nn_connector_isidle (&cws->connector) ||
               !nn_dns_isidle (&cws->dns))
             return;
         cws->state = NN_CWS_STATE_IDLE;
@@ -384,8 +415,7 @@ static void nn_cws_handler (struct nn_fsm *self, int src, int type,
             switch (type) {
             case NN_DNS_STOPPED:
                 if (cws->dns_result.error == 0) {
-                    nn_cws_start_connecting (cws, &cws->dns_result.addr,
-                        cws->dns_result.addrlen);
+                    nn_cws_start_connecting (cws);
                     return;
                 }
                 nn_backoff_start (&cws->retry);
@@ -401,17 +431,21 @@ static void nn_cws_handler (struct nn_fsm *self, int src, int type,
 
 /******************************************************************************/
 /*  CONNECTING state.                                                         */
-/*  Non-blocking connect is under way.                                        */
+/*  Non-blocking connects to the remote addresses are under way.              */
 /******************************************************************************/
     case NN_CWS_STATE_CONNECTING:
         switch (src) {
 
-        case NN_CWS_SRC_USOCK:
+        case NN_CWS_SRC_CONNECTOR:
             switch (type) {
-            case NN_USOCK_CONNECTED:
-                nn_sws_start (&cws->sws, &cws->usock, NN_WS_CLIENT,
+            case NN_CONNECTOR_CONNECTED:
+                nn_sws_start (&cws->sws, nn_connector_usock (&cws->connector),
+                    NN_WS_CLIENT,
                     nn_chunkref_data (&cws->resource),
-                    nn_chunkref_data (&cws->remote_host));
+                    nn_chunkref_data (&cws->remote_host), cws->tls ?
+                    nn_tlsctx_new (&cws->tlsctx,
+                    nn_chunkref_data (&cws->remote_host),
+                    cws->remote_hostname_len) : NULL);
                 cws->state = NN_CWS_STATE_ACTIVE;
                 cws->peer_gone = 0;
                 nn_epbase_stat_increment (&cws->epbase,
@@ -419,12 +453,13 @@ static void nn_cws_handler (struct nn_fsm *self, int src, int type,
                 nn_epbase_stat_increment (&cws->epbase,
                     NN_STAT_ESTABLISHED_CONNECTIONS, 1);
                 nn_epbase_clear_error (&cws->epbase);
+                nn_backoff_reset (&cws->retry);
                 return;
-            case NN_USOCK_ERROR:
+            case NN_CONNECTOR_ERROR:
                 nn_epbase_set_error (&cws->epbase,
-                    nn_usock_geterrno (&cws->usock));
-                nn_usock_stop (&cws->usock);
-                cws->state = NN_CWS_STATE_STOPPING_USOCK;
+                    nn_connector_geterrno (&cws->connector));
+                nn_connector_stop (&cws->connector);
+                cws->state = NN_CWS_STATE_STOPPING_CONNECTOR;
                 nn_epbase_stat_increment (&cws->epbase,
                     NN_STAT_INPROGRESS_CONNECTIONS, -1);
                 nn_epbase_stat_increment (&cws->epbase,
@@ -480,8 +515,8 @@ static void nn_cws_handler (struct nn_fsm *self, int src, int type,
             case NN_USOCK_SHUTDOWN:
                 return;
             case NN_SWS_RETURN_STOPPED:
-                nn_usock_stop (&cws->usock);
-                cws->state = NN_CWS_STATE_STOPPING_USOCK;
+                nn_connector_stop (&cws->connector);
+                cws->state = NN_CWS_STATE_STOPPING_CONNECTOR;
                 return;
             default:
                 nn_fsm_bad_action (cws->state, src, type);
@@ -492,17 +527,15 @@ static void nn_cws_handler (struct nn_fsm *self, int src, int type,
         }
 
 /******************************************************************************/
-/*  STOPPING_USOCK state.                                                     */
-/*  usock object was asked to stop but it haven't stopped yet.                */
+/*  STOPPING_CONNECTOR state.                                                 */
+/*  connector object was asked to stop but it haven't stopped yet.            */
 /******************************************************************************/
-    case NN_CWS_STATE_STOPPING_USOCK:
+    case NN_CWS_STATE_STOPPING_CONNECTOR:
         switch (src) {
 
-        case NN_CWS_SRC_USOCK:
+        case NN_CWS_SRC_CONNECTOR:
             switch (type) {
-            case NN_USOCK_SHUTDOWN:
-                return;
-            case NN_USOCK_STOPPED:
+            case NN_CONNECTOR_STOPPED:
                 /*  If the peer has confirmed itself gone with a Closing
                     Handshake, or if the local endpoint failed the remote,
                     don't try to reconnect. */
@@ -598,20 +631,16 @@ static void nn_cws_start_resolving (struct nn_cws *self)
     self->state = NN_CWS_STATE_RESOLVING;
 }
 
-static void nn_cws_start_connecting (struct nn_cws *self,
-    struct sockaddr_storage *ss, size_t sslen)
+static void nn_cws_start_connecting (struct nn_cws *self)
 {
     int rc;
-    struct sockaddr_storage remote;
-    size_t remotelen;
+    int i;
+    struct sockaddr_storage *ss;
     struct sockaddr_storage local;
     size_t locallen;
     int ipv4only;
     size_t ipv4onlylen;
-    int val;
-    size_t sz;
 
-    memset (&remote, 0, sizeof (remote));
     memset (&local, 0, sizeof (local));
 
     /*  Check whether IPv6 is to be used. */
@@ -629,43 +658,40 @@ static void nn_cws_start_connecting (struct nn_cws *self,
         return;
     }
 
-    /*  Combine the remote address and the port. */
-    remote = *ss;
-    remotelen = sslen;
-    if (remote.ss_family == AF_INET)
-        ((struct sockaddr_in*) &remote)->sin_port = htons (self->remote_port);
-    else if (remote.ss_family == AF_INET6)
-        ((struct sockaddr_in6*) &remote)->sin6_port = htons (self->remote_port);
-    else
-        nn_assert (0);
-
-    /*  Try to start the underlying socket. */
-    rc = nn_usock_start (&self->usock, remote.ss_family, SOCK_STREAM, 0);
-    if (nn_slow (rc < 0)) {
-        nn_backoff_start (&self->retry);
-        self->state = NN_CWS_STATE_WAITING;
-        return;
+    /*  Combine the remote addresses and the port. */
+    for (i = 0; i != self->dns_result.naddrs; ++i) {
+        ss = &self->dns_result.addrs [i];
+        if (ss->ss_family == AF_INET)
+            ((struct sockaddr_in*) ss)->sin_port = htons (self->remote_port);
+        else if (ss->ss_family == AF_INET6)
+            ((struct sockaddr_in6*) ss)->sin6_port = htons (self->remote_port);
+        else
+            nn_assert (0);
+        nn_connector_add (&self->connector, (struct sockaddr*) ss,
+            self->dns_result.addrlens [i]);
     }
 
+    /*  Start connecting. */
+    nn_connector_start (&self->connector, (struct sockaddr*) &local,
+        locallen);
+    self->state = NN_CWS_STATE_CONNECTING;
+    nn_epbase_stat_increment (&self->epbase,
+        NN_STAT_INPROGRESS_CONNECTIONS, 1);
+}
+
+static void nn_cws_setsockopts (struct nn_epbase *epbase,
+    struct nn_usock *usock)
+{
+    int val;
+    size_t sz;
+
     /*  Set the relevant socket options. */
     sz = sizeof (val);
-    nn_epbase_getopt (&self->epbase, NN_SOL_SOCKET, NN_SNDBUF, &val, &sz);
+    nn_epbase_getopt (epbase, NN_SOL_SOCKET, NN_SNDBUF, &val, &sz);
     nn_assert (sz == sizeof (val));
-    nn_usock_setsockopt (&self->usock, SOL_SOCKET, SO_SNDBUF,
-        &val, sizeof (val));
+    nn_usock_setsockopt (usock, SOL_SOCKET, SO_SNDBUF, &val, sizeof (val));
     sz = sizeof (val);
-    nn_epbase_getopt (&self->epbase, NN_SOL_SOCKET, NN_RCVBUF, &val, &sz);
+    nn_epbase_getopt (epbase, NN_SOL_SOCKET, NN_RCVBUF, &val, &sz);
     nn_assert (sz == sizeof (val));
-    nn_usock_setsockopt (&self->usock, SOL_SOCKET, SO_RCVBUF,
-        &val, sizeof (val));
-
-    /*  Bind the socket to the local network interface. */
-    rc = nn_usock_bind (&self->usock, (struct sockaddr*) &local, locallen);
-    errnum_assert (rc == 0, -rc);
-
-    /*  Start connecting. */
-    nn_usock_connect (&self->usock, (struct sockaddr*) &remote, remotelen);
-    self->state = NN_CWS_STATE_CONNECTING;
-    nn_epbase_stat_increment (&self->epbase,
-        NN_STAT_INPROGRESS_CONNECTIONS, 1);
+    nn_usock_setsockopt (usock, SOL_SOCKET, SO_RCVBUF, &val, sizeof (val));
 }
@@ -28,7 +28,9 @@
 
 /*  State machine managing connected WS socket. */
 
-int nn_cws_create (void *hint, struct nn_epbase **epbase);
+/*  If 'tls' is non-zero, connections are secured by TLS configured by NN_TLS
+    socket options. */
+int nn_cws_create (void *hint, struct nn_epbase **epbase, int tls);
 
 #endif
 
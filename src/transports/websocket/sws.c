@@ -42,6 +42,7 @@
 #define NN_SWS_STATE_BROKEN_CONNECTION 6
 #define NN_SWS_STATE_DONE 7
 #define NN_SWS_STATE_STOPPING 8
+#define NN_SWS_STATE_SECURING 9
 
 /*  Possible states of the inbound part of the object. */
 #define NN_SWS_INSTATE_RECV_HDR 1
@@ -123,6 +124,11 @@ static int nn_sws_recv_hdr (struct nn_sws *self);
 static void nn_sws_mask_payload (uint8_t *payload, size_t payload_len,
     const uint8_t *mask, size_t mask_len, int *mask_start_pos);
 
+/*  Drops the first 'off' bytes of the chunk and makes sure the rest can be
+    modified in place. The content is copied only if it's shared with anyone
+    else. */
+static void nn_sws_unshare (struct nn_chunkref *self, size_t off);
+
 /*  Validates incoming text chunks for UTF-8 compliance as per RFC 3629. */
 static void nn_sws_validate_utf8_chunk (struct nn_sws *self);
 
@@ -141,6 +147,7 @@ void nn_sws_init (struct nn_sws *self, int src,
     self->usock = NULL;
     self->usock_owner.src = -1;
     self->usock_owner.fsm = NULL;
+    self->ssl = NULL;
     nn_pipebase_init (&self->pipebase, &nn_sws_pipebase_vfptr, epbase);
     self->instate = -1;
     nn_list_init (&self->inmsg_array);
@@ -179,7 +186,7 @@ int nn_sws_isidle (struct nn_sws *self)
 }
 
 void nn_sws_start (struct nn_sws *self, struct nn_usock *usock, int mode,
-    const char *resource, const char *host)
+    const char *resource, const char *host, void *ssl)
 {
     /*  Take ownership of the underlying socket. */
     nn_assert (self->usock == NULL && self->usock_owner.fsm == NULL);
@@ -190,6 +197,7 @@ void nn_sws_start (struct nn_sws *self, struct nn_usock *usock, int mode,
     self->mode = mode;
     self->resource = resource;
     self->remote_host = host;
+    self->ssl = ssl;
 
     /*  Launch the state machine. */
     nn_fsm_start (&self->fsm);
@@ -359,6 +367,25 @@ static int nn_sws_recv_hdr (struct nn_sws *self)
     return 0;
 }
 
+static void nn_sws_unshare (struct nn_chunkref *self, size_t off)
+{
+    struct nn_chunkref copy;
+    size_t size;
+
+    if (!nn_chunkref_isshared (self)) {
+        if (off)
+            nn_chunkref_trim (self, off);
+        return;
+    }
+
+    size = nn_chunkref_size (self) - off;
+    nn_chunkref_init (&copy, size);
+    memcpy (nn_chunkref_data (&copy),
+        ((uint8_t*) nn_chunkref_data (self)) + off, size);
+    nn_chunkref_term (self);
+    nn_chunkref_mv (self, &copy);
+}
+
 static int nn_sws_send (struct nn_pipebase *self, struct nn_msg *msg)
 {
     struct nn_sws *sws;
@@ -366,6 +393,7 @@ static int nn_sws_send (struct nn_pipebase *self, struct nn_msg *msg)
     int mask_pos;
     size_t nn_msg_size;
     size_t hdr_len;
+    size_t body_off;
     uint8_t rand_mask [NN_SWS_FRAME_SIZE_MASK];
 
     sws = nn_cont (self, struct nn_sws, pipebase);
@@ -377,15 +405,22 @@ static int nn_sws_send (struct nn_pipebase *self, struct nn_msg *msg)
     nn_msg_term (&sws->outmsg);
     nn_msg_mv (&sws->outmsg, msg);
 
+    /*  The frame header is taken from the body and the payload may need to
+        be masked, so work on a contiguous body. */
+    nn_msg_linearize (&sws->outmsg);
+
     memset (sws->outhdr, 0, sizeof (sws->outhdr));
 
     hdr_len = NN_SWS_FRAME_SIZE_INITIAL;
 
     /*  If the outgoing message has specified an opcode and control framing in
-        its header, properly frame it as per RFC 6455 5.2. */
+        its header, properly frame it as per RFC 6455 5.2. The message may
+        share its chunks with other pipes (e.g. with PUB socket) so it is
+        skipped rather than trimmed. */
+    body_off = 0;
     if (nn_chunkref_size (&sws->outmsg.body) >= 1) {
         memcpy (sws->outhdr, nn_chunkref_data (&sws->outmsg.body), 1);
-        nn_chunkref_trim (&sws->outmsg.body, 1);
+        body_off = 1;
     }
     else {
         /*  If the header does not specify an opcode, assume this default. */
@@ -393,7 +428,7 @@ static int nn_sws_send (struct nn_pipebase *self, struct nn_msg *msg)
     }
 
     nn_msg_size = nn_chunkref_size (&sws->outmsg.sphdr) +
-        nn_chunkref_size (&sws->outmsg.body);
+        nn_chunkref_size (&sws->outmsg.body) - body_off;
 
     /*  Framing WebSocket payload size in network byte order (big endian). */
     if (nn_msg_size <= NN_SWS_PAYLOAD_MAX_LENGTH) {
@@ -424,6 +459,12 @@ static int nn_sws_send (struct nn_pipebase *self, struct nn_msg *msg)
         memcpy (&sws->outhdr [hdr_len], rand_mask, NN_SWS_FRAME_SIZE_MASK);
         hdr_len += NN_SWS_FRAME_SIZE_MASK;
 
+        /*  Masking modifies the payload. If it's shared with other pipes,
+            do it on a private copy. */
+        nn_sws_unshare (&sws->outmsg.sphdr, 0);
+        nn_sws_unshare (&sws->outmsg.body, body_off);
+        body_off = 0;
+
         /*  Mask payload, beginning with header and moving to body. */
         mask_pos = 0;
 
@@ -449,8 +490,9 @@ static int nn_sws_send (struct nn_pipebase *self, struct nn_msg *msg)
     iov [0].iov_len = hdr_len;
     iov [1].iov_base = nn_chunkref_data (&sws->outmsg.sphdr);
     iov [1].iov_len = nn_chunkref_size (&sws->outmsg.sphdr);
-    iov [2].iov_base = nn_chunkref_data (&sws->outmsg.body);
-    iov [2].iov_len = nn_chunkref_size (&sws->outmsg.body);
+    iov [2].iov_base = ((uint8_t*) nn_chunkref_data (&sws->outmsg.body)) +
+        body_off;
+    iov [2].iov_len = nn_chunkref_size (&sws->outmsg.body) - body_off;
     nn_usock_send (sws->usock, iov, 3);
 
     sws->outstate = NN_SWS_OUTSTATE_SENDING;
@@ -882,6 +924,15 @@ static void nn_sws_handler (struct nn_fsm *self, int src, int type,
         case NN_FSM_ACTION:
             switch (type) {
             case NN_FSM_START:
+
+                /*  With TLS, the connection has to be secured before
+                    the opening handshake is exchanged. */
+                if (sws->ssl) {
+                    nn_usock_tls (sws->usock, sws->ssl);
+                    sws->ssl = NULL;
+                    sws->state = NN_SWS_STATE_SECURING;
+                    return;
+                }
                 nn_ws_handshake_start (&sws->handshaker, sws->usock,
                     &sws->pipebase, sws->mode, sws->resource, sws->remote_host);
                 sws->state = NN_SWS_STATE_HANDSHAKE;
@@ -894,6 +945,38 @@ static void nn_sws_handler (struct nn_fsm *self, int src, int type,
             nn_fsm_bad_source (sws->state, src, type);
         }
 
+/******************************************************************************/
+/*  SECURING state.                                                           */
+/*  TLS handshake is being performed.                                         */
+/******************************************************************************/
+    case NN_SWS_STATE_SECURING:
+        switch (src) {
+
+        case NN_SWS_SRC_USOCK:
+            switch (type) {
+            case NN_USOCK_SECURED:
+                nn_ws_handshake_start (&sws->handshaker, sws->usock,
+                    &sws->pipebase, sws->mode, sws->resource, sws->remote_host);
+                sws->state = NN_SWS_STATE_HANDSHAKE;
+                return;
+
+            case NN_USOCK_SHUTDOWN:
+                sws->state = NN_SWS_STATE_BROKEN_CONNECTION;
+                return;
+
+            case NN_USOCK_ERROR:
+                sws->state = NN_SWS_STATE_DONE;
+                nn_fsm_raise (&sws->fsm, &sws->done, NN_SWS_RETURN_ERROR);
+                return;
+
+            default:
+                nn_fsm_bad_action (sws->state, src, type);
+            }
+
+        default:
+            nn_fsm_bad_source (sws->state, src, type);
+        }
+
 /******************************************************************************/
 /*  HANDSHAKE state.                                                          */
 /******************************************************************************/
@@ -104,6 +104,10 @@ struct nn_sws {
     /*  Remote Host in header request when acting as client. */
     const char* remote_host;
 
+    /*  TLS session to establish before the opening handshake, if any.
+        Ownership passes to the underlying socket once started. */
+    void *ssl;
+
     /*  State of inbound state machine. */
     int instate;
 
@@ -197,7 +201,7 @@ void nn_sws_term (struct nn_sws *self);
 
 int nn_sws_isidle (struct nn_sws *self);
 void nn_sws_start (struct nn_sws *self, struct nn_usock *usock, int mode,
-    const char *resource, const char *host);
+    const char *resource, const char *host, void *ssl);
 void nn_sws_stop (struct nn_sws *self);
 
 #endif
@@ -67,6 +67,8 @@ static const struct nn_optset_vfptr nn_ws_optset_vfptr = {
 static int nn_ws_bind (void *hint, struct nn_epbase **epbase);
 static int nn_ws_connect (void *hint, struct nn_epbase **epbase);
 static struct nn_optset *nn_ws_optset (void);
+static int nn_wss_bind (void *hint, struct nn_epbase **epbase);
+static int nn_wss_connect (void *hint, struct nn_epbase **epbase);
 
 static struct nn_transport nn_ws_vfptr = {
     "ws",
@@ -81,14 +83,45 @@ static struct nn_transport nn_ws_vfptr = {
 
 struct nn_transport *nn_ws = &nn_ws_vfptr;
 
+static struct nn_transport nn_wss_vfptr = {
+    "wss",
+    NN_WSS,
+    NULL,
+    NULL,
+    nn_wss_bind,
+    nn_wss_connect,
+    NULL,
+    NN_LIST_ITEM_INITIALIZER
+};
+
+struct nn_transport *nn_wss = &nn_wss_vfptr;
+
 static int nn_ws_bind (void *hint, struct nn_epbase **epbase)
 {
-    return nn_bws_create (hint, epbase);
+    return nn_bws_create (hint, epbase, 0);
 }
 
 static int nn_ws_connect (void *hint, struct nn_epbase **epbase)
 {
-    return nn_cws_create (hint, epbase); 
+    return nn_cws_create (hint, epbase, 0); 
+}
+
+static int nn_wss_bind (void *hint, struct nn_epbase **epbase)
+{
+#if defined NN_HAVE_OPENSSL && !defined NN_HAVE_WINDOWS
+    return nn_bws_create (hint, epbase, 1);
+#else
+    return -EPROTONOSUPPORT;
+#endif
+}
+
+static int nn_wss_connect (void *hint, struct nn_epbase **epbase)
+{
+#if defined NN_HAVE_OPENSSL && !defined NN_HAVE_WINDOWS
+    return nn_cws_create (hint, epbase, 1);
+#else
+    return -EPROTONOSUPPORT;
+#endif
 }
 
 static struct nn_optset *nn_ws_optset ()
@@ -28,4 +28,7 @@
 
 extern struct nn_transport *nn_ws;
 
+/*  WebSocket over TLS. TLS is configured by NN_TLS socket options. */
+extern struct nn_transport *nn_wss;
+
 #endif
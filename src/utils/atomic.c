@@ -42,6 +42,8 @@ uint32_t nn_atomic_inc (struct nn_atomic *self, uint32_t n)
 {
 #if defined NN_ATOMIC_WINAPI
     return (uint32_t) InterlockedExchangeAdd ((LONG*) &self->n, n);
+#elif defined NN_ATOMIC_GCC_MEMMODEL
+    return __atomic_fetch_add (&self->n, n, __ATOMIC_ACQ_REL);
 #elif defined NN_ATOMIC_SOLARIS
     return atomic_add_32_nv (&self->n, n) - n;
 #elif defined NN_ATOMIC_GCC_BUILTINS
@@ -58,10 +60,23 @@ uint32_t nn_atomic_inc (struct nn_atomic *self, uint32_t n)
 #endif
 }
 
+uint32_t nn_atomic_addref (struct nn_atomic *self, uint32_t n)
+{
+#if defined NN_ATOMIC_GCC_MEMMODEL
+    /*  New reference can only be created from an existing one, thus there's
+        nothing to synchronise with. */
+    return __atomic_fetch_add (&self->n, n, __ATOMIC_RELAXED);
+#else
+    return nn_atomic_inc (self, n);
+#endif
+}
+
 uint32_t nn_atomic_dec (struct nn_atomic *self, uint32_t n)
 {
 #if defined NN_ATOMIC_WINAPI
     return (uint32_t) InterlockedExchangeAdd ((LONG*) &self->n, -((LONG) n));
+#elif defined NN_ATOMIC_GCC_MEMMODEL
+    return __atomic_fetch_sub (&self->n, n, __ATOMIC_ACQ_REL);
 #elif defined NN_ATOMIC_SOLARIS
     return atomic_add_32_nv (&self->n, -((int32_t) n)) + n;
 #elif defined NN_ATOMIC_GCC_BUILTINS
@@ -78,3 +93,30 @@ uint32_t nn_atomic_dec (struct nn_atomic *self, uint32_t n)
 #endif
 }
 
+uint32_t nn_atomic_load (struct nn_atomic *self)
+{
+#if defined NN_ATOMIC_WINAPI
+    return (uint32_t) InterlockedCompareExchange ((LONG*) &self->n, 0, 0);
+#elif defined NN_ATOMIC_GCC_MEMMODEL
+    return __atomic_load_n (&self->n, __ATOMIC_ACQUIRE);
+#elif defined NN_ATOMIC_SOLARIS
+    uint32_t res;
+    res = self->n;
+    membar_consumer ();
+    return res;
+#elif defined NN_ATOMIC_GCC_BUILTINS
+    uint32_t res;
+    res = self->n;
+    __sync_synchronize ();
+    return res;
+#elif defined NN_ATOMIC_MUTEX
+    uint32_t res;
+    nn_mutex_lock (&self->sync);
+    res = self->n;
+    nn_mutex_unlock (&self->sync);
+    return res;
+#else
+#error
+#endif
+}
+
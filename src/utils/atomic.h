@@ -26,6 +26,8 @@
 #if defined NN_HAVE_WINDOWS
 #include "win.h"
 #define NN_ATOMIC_WINAPI
+#elif defined __ATOMIC_ACQ_REL
+#define NN_ATOMIC_GCC_MEMMODEL
 #elif NN_HAVE_ATOMIC_SOLARIS
 #include <atomic.h>
 #define NN_ATOMIC_SOLARIS
@@ -54,8 +56,17 @@ void nn_atomic_term (struct nn_atomic *self);
 /*  Atomically add n to the object, return old value of the object. */
 uint32_t nn_atomic_inc (struct nn_atomic *self, uint32_t n);
 
+/*  Same as nn_atomic_inc but doesn't order surrounding memory accesses.
+    Only usable for reference counts, where a new reference is always
+    created from an existing one. */
+uint32_t nn_atomic_addref (struct nn_atomic *self, uint32_t n);
+
 /*  Atomically subtract n from the object, return old value of the object. */
 uint32_t nn_atomic_dec (struct nn_atomic *self, uint32_t n);
 
+/*  Returns current value of the object. Memory writes done by other threads
+    before they've decremented the object are visible after the call. */
+uint32_t nn_atomic_load (struct nn_atomic *self);
+
 #endif
 
@@ -30,9 +30,32 @@
 
 #include <string.h>
 
+#if !defined NN_HAVE_WINDOWS
+#include <sched.h>
+#endif
+
 #define NN_CHUNK_TAG 0xdeadcafe
 #define NN_CHUNK_TAG_DEALLOCATED 0xbeadfeed
 
+/*  Memory blocks of small chunks are not returned to the heap straight away.
+    Instead, up to NN_CHUNK_CACHE_SIZE blocks of each size class are kept on a
+    free list and reused by subsequent allocations, so that a steady flow of
+    small messages doesn't hit malloc at all. Chunks are often allocated in
+    one thread and deallocated in another, thus the lists are shared and
+    guarded by a spinlock. Set NN_CHUNK_CACHE_SIZE to zero to disable. */
+#ifndef NN_CHUNK_CACHE_SIZE
+#define NN_CHUNK_CACHE_SIZE 256
+#endif
+#if NN_CHUNK_CACHE_SIZE > 0 && !defined NN_ATOMIC_MUTEX
+#define NN_CHUNK_CACHE
+#define NN_CHUNK_CACHE_CLASSES 3
+static const size_t nn_chunk_cache_blocks [NN_CHUNK_CACHE_CLASSES] =
+    {128, 256, 512};
+
+/*  Number of iterations to spin on a busy lock before giving up the CPU. */
+#define NN_CHUNK_CACHE_SPINS 64
+#endif
+
 typedef void (*nn_chunk_free_fn) (void *p);
 
 struct nn_chunk {
@@ -46,6 +69,9 @@ struct nn_chunk {
     /*  Deallocation function. */
     nn_chunk_free_fn ffn;
 
+    /*  Size class of the memory block, -1 if it doesn't belong to any. */
+    int cls;
+
     /*  The structure if followed by optional empty space, a 32 bit unsigned
         integer specifying the size of said empty space, a 32 bit tag and
         the message data itself. */
@@ -53,9 +79,94 @@ struct nn_chunk {
 
 /*  Private functions. */
 static struct nn_chunk *nn_chunk_getptr (void *p);
-static void *nn_chunk_getdata (struct nn_chunk *c);
+static void *nn_chunk_getdata (struct nn_chunk *c, size_t off);
 static void nn_chunk_default_free (void *p);
 static size_t nn_chunk_hdrsize ();
+#if defined NN_CHUNK_CACHE
+static struct nn_chunk *nn_chunk_cache_alloc (size_t sz);
+static void nn_chunk_cache_free (void *p);
+#endif
+
+#if defined NN_CHUNK_CACHE
+
+/*  Free list of memory blocks of a single size class. Blocks are linked
+    through their first word. */
+struct nn_chunk_cache {
+    volatile uint32_t lock;
+    void *blocks;
+    int count;
+};
+
+static struct nn_chunk_cache nn_chunk_caches [NN_CHUNK_CACHE_CLASSES];
+
+/*  Tells the CPU we are in a spin-wait loop. */
+static void nn_chunk_cache_pause (void)
+{
+#if defined NN_HAVE_WINDOWS
+    YieldProcessor ();
+#elif defined __GNUC__ && (defined __i386__ || defined __x86_64__)
+    __asm__ __volatile__ ("pause");
+#elif defined __GNUC__ && (defined __aarch64__ || defined __arm__)
+    __asm__ __volatile__ ("yield");
+#endif
+}
+
+static void nn_chunk_cache_lock (struct nn_chunk_cache *self)
+{
+    int spins;
+
+    while (1) {
+#if defined NN_ATOMIC_WINAPI
+        if (!InterlockedExchange ((LONG*) &self->lock, 1))
+            return;
+#elif defined NN_ATOMIC_GCC_MEMMODEL
+        if (!__atomic_exchange_n (&self->lock, 1, __ATOMIC_ACQUIRE))
+            return;
+#elif defined NN_ATOMIC_SOLARIS
+        if (!atomic_swap_32 (&self->lock, 1))
+            return;
+#elif defined NN_ATOMIC_GCC_BUILTINS
+        if (!__sync_lock_test_and_set (&self->lock, 1))
+            return;
+#else
+#error
+#endif
+        /*  The lock is held only for a couple of instructions. Wait for it
+            to be released without hammering the cache line. If it is still
+            held after a short spin, the holder has most likely been
+            preempted, so give up the CPU rather than burn our timeslice. */
+        spins = 0;
+        while (self->lock) {
+            if (spins < NN_CHUNK_CACHE_SPINS) {
+                nn_chunk_cache_pause ();
+                ++spins;
+                continue;
+            }
+#if defined NN_HAVE_WINDOWS
+            SwitchToThread ();
+#else
+            sched_yield ();
+#endif
+        }
+    }
+}
+
+static void nn_chunk_cache_unlock (struct nn_chunk_cache *self)
+{
+#if defined NN_ATOMIC_WINAPI
+    InterlockedExchange ((LONG*) &self->lock, 0);
+#elif defined NN_ATOMIC_GCC_MEMMODEL
+    __atomic_store_n (&self->lock, 0, __ATOMIC_RELEASE);
+#elif defined NN_ATOMIC_SOLARIS
+    atomic_swap_32 (&self->lock, 0);
+#elif defined NN_ATOMIC_GCC_BUILTINS
+    __sync_lock_release (&self->lock);
+#else
+#error
+#endif
+}
+
+#endif
 
 int nn_chunk_alloc (size_t size, int type, void **result)
 {
@@ -64,14 +175,24 @@ int nn_chunk_alloc (size_t size, int type, void **result)
     const size_t hdrsz = nn_chunk_hdrsize ();
 
     /*  Compute total size to be allocated. Check for overflow. */
-    sz = hdrsz + size;
-    if (nn_slow (sz < hdrsz))
+    sz = hdrsz + NN_CHUNK_HEADROOM + size;
+    if (nn_slow (sz < hdrsz + NN_CHUNK_HEADROOM))
         return -ENOMEM;
 
     /*  Allocate the actual memory depending on the type. */
     switch (type) {
     case 0:
+#if defined NN_CHUNK_CACHE
+        if (sz <= nn_chunk_cache_blocks [NN_CHUNK_CACHE_CLASSES - 1]) {
+            self = nn_chunk_cache_alloc (sz);
+            break;
+        }
+#endif
         self = nn_alloc (sz, "message chunk");
+        if (nn_fast (self != NULL)) {
+            self->ffn = nn_chunk_default_free;
+            self->cls = -1;
+        }
         break;
     default:
         return -EINVAL;
@@ -82,16 +203,13 @@ int nn_chunk_alloc (size_t size, int type, void **result)
     /*  Fill in the chunk header. */
     nn_atomic_init (&self->refcount, 1);
     self->size = size;
-    self->ffn = nn_chunk_default_free;
 
     /*  Fill in the size of the empty space between the chunk header
-        and the message. */
-    nn_putl ((uint8_t*) ((uint32_t*) (self + 1)), 0);
+        and the message and the tag. */
+    *result = nn_chunk_getdata (self, NN_CHUNK_HEADROOM);
+    nn_putl ((uint8_t*) (((uint32_t*) *result) - 2), NN_CHUNK_HEADROOM);
+    nn_putl ((uint8_t*) (((uint32_t*) *result) - 1), NN_CHUNK_TAG);
 
-    /*  Fill in the tag. */
-    nn_putl ((uint8_t*) ((((uint32_t*) (self + 1))) + 1), NN_CHUNK_TAG);
-
-    *result = nn_chunk_getdata (self);
     return 0;
 }
 
@@ -102,16 +220,19 @@ int nn_chunk_realloc (size_t size, void **chunk)
     void *new_ptr;
     size_t hdr_size;
     size_t new_size;
+    uint32_t off;
     int rc;
 
     self = nn_chunk_getptr (*chunk);
 
     /*  Check if we only have one reference to this object, in that case we can
         reallocate the memory chunk. */
-    if (self->refcount.n == 1) {
+    if (nn_atomic_load (&self->refcount) == 1) {
 
-        /* Compute new size, check for overflow. */
-        hdr_size = nn_chunk_hdrsize ();
+        /* Compute new size, check for overflow. The empty space in front of
+           the data is preserved. */
+        off = nn_getl ((uint8_t*) *chunk - 2 * sizeof (uint32_t));
+        hdr_size = nn_chunk_hdrsize () + off;
         new_size = hdr_size + size;
         if (nn_slow (new_size < hdr_size))
             return -ENOMEM;
@@ -121,8 +242,11 @@ int nn_chunk_realloc (size_t size, void **chunk)
         if (nn_slow (new_chunk == NULL))
             return -ENOMEM;
 
+        /*  The block doesn't match its size class anymore. */
         new_chunk->size = size;
-        *chunk = nn_chunk_getdata (new_chunk);
+        new_chunk->ffn = nn_chunk_default_free;
+        new_chunk->cls = -1;
+        *chunk = nn_chunk_getdata (new_chunk, off);
     }
 
     /*  There are many references to this memory chunk, we have to create a new
@@ -135,9 +259,11 @@ int nn_chunk_realloc (size_t size, void **chunk)
             return rc;
         }
 
-        memcpy (new_ptr, nn_chunk_getdata (self), self->size);
+        /*  The other references may have been dropped in the meantime,
+            so release this one the usual way. */
+        memcpy (new_ptr, *chunk, self->size < size ? self->size : size);
+        nn_chunk_free (*chunk);
         *chunk = new_ptr;
-        nn_atomic_dec (&self->refcount, 1);
     }
 
     return 0;
@@ -150,8 +276,10 @@ void nn_chunk_free (void *p)
     self = nn_chunk_getptr (p);
 
     /*  Decrement the reference count. Actual deallocation happens only if
-        it drops to zero. */
-    if (nn_atomic_dec (&self->refcount, 1) <= 1) {
+        it drops to zero. If this is the only reference there's no one else
+        to race with and the atomic operation can be skipped. */
+    if (nn_atomic_load (&self->refcount) == 1 ||
+          nn_atomic_dec (&self->refcount, 1) <= 1) {
 
         /*  Mark chunk as deallocated. */
         nn_putl ((uint8_t*) (((uint32_t*) p) - 1), NN_CHUNK_TAG_DEALLOCATED);
@@ -171,7 +299,15 @@ void nn_chunk_addref (void *p, uint32_t n)
 
     self = nn_chunk_getptr (p);
 
-    nn_atomic_inc (&self->refcount, n);
+    /*  Chunk that is referenced from a single place can't be accessed by
+        any other thread. The new references will be handed over to other
+        threads via synchronised queues so plain store is sufficient. */
+    if (nn_atomic_load (&self->refcount) == 1) {
+        self->refcount.n = 1 + n;
+        return;
+    }
+
+    nn_atomic_addref (&self->refcount, n);
 }
 
 
@@ -180,6 +316,11 @@ size_t nn_chunk_size (void *p)
     return nn_chunk_getptr (p)->size;
 }
 
+int nn_chunk_isshared (void *p)
+{
+    return nn_atomic_load (&nn_chunk_getptr (p)->refcount) != 1 ? 1 : 0;
+}
+
 void *nn_chunk_trim (void *p, size_t n)
 {
     struct nn_chunk *self;
@@ -204,6 +345,32 @@ void *nn_chunk_trim (void *p, size_t n)
     return p;
 }
 
+void *nn_chunk_push (void *p, size_t n)
+{
+    struct nn_chunk *self;
+    uint32_t off;
+
+    self = nn_chunk_getptr (p);
+
+    /*  Other references would see the size change. */
+    if (nn_slow (nn_atomic_load (&self->refcount) != 1))
+        return NULL;
+
+    off = nn_getl ((uint8_t*) p - 2 * sizeof (uint32_t));
+    if (nn_slow (n > off))
+        return NULL;
+
+    /*  Adjust the chunk header. */
+    p = ((uint8_t*) p) - n;
+    nn_putl ((uint8_t*) (((uint32_t*) p) - 1), NN_CHUNK_TAG);
+    nn_putl ((uint8_t*) (((uint32_t*) p) - 2), (uint32_t) (off - n));
+
+    /*  Adjust the size of the message. */
+    self->size += n;
+
+    return p;
+}
+
 static struct nn_chunk *nn_chunk_getptr (void *p)
 {
     uint32_t off;
@@ -215,9 +382,9 @@ static struct nn_chunk *nn_chunk_getptr (void *p)
         sizeof (struct nn_chunk));
 }
 
-static void *nn_chunk_getdata (struct nn_chunk *self)
+static void *nn_chunk_getdata (struct nn_chunk *self, size_t off)
 {
-    return ((uint8_t*) (self + 1)) + 2 * sizeof (uint32_t);
+    return ((uint8_t*) (self + 1)) + off + 2 * sizeof (uint32_t);
 }
 
 static void nn_chunk_default_free (void *p)
@@ -225,6 +392,83 @@ static void nn_chunk_default_free (void *p)
     nn_free (p);
 }
 
+#if defined NN_CHUNK_CACHE
+
+static struct nn_chunk *nn_chunk_cache_alloc (size_t sz)
+{
+    int cls;
+    struct nn_chunk_cache *cache;
+    struct nn_chunk *self;
+
+    /*  Find the smallest size class the chunk fits into. */
+    for (cls = 0; sz > nn_chunk_cache_blocks [cls]; ++cls)
+        ;
+    cache = &nn_chunk_caches [cls];
+
+    /*  Reuse a cached block if possible. */
+    nn_chunk_cache_lock (cache);
+    self = cache->blocks;
+    if (self) {
+        cache->blocks = *(void**) self;
+        --cache->count;
+    }
+    nn_chunk_cache_unlock (cache);
+
+    if (!self) {
+        self = nn_alloc (nn_chunk_cache_blocks [cls], "message chunk");
+        if (nn_slow (!self))
+            return NULL;
+    }
+
+    self->ffn = nn_chunk_cache_free;
+    self->cls = cls;
+    return self;
+}
+
+static void nn_chunk_cache_free (void *p)
+{
+    struct nn_chunk_cache *cache;
+
+    cache = &nn_chunk_caches [((struct nn_chunk*) p)->cls];
+
+    nn_chunk_cache_lock (cache);
+    if (cache->count < NN_CHUNK_CACHE_SIZE) {
+        *(void**) p = cache->blocks;
+        cache->blocks = p;
+        ++cache->count;
+        p = NULL;
+    }
+    nn_chunk_cache_unlock (cache);
+
+    /*  The cache is full. */
+    if (p)
+        nn_free (p);
+}
+
+#endif
+
+void nn_chunk_cache_term (void)
+{
+#if defined NN_CHUNK_CACHE
+    int cls;
+    void *blocks;
+    void *next;
+
+    for (cls = 0; cls != NN_CHUNK_CACHE_CLASSES; ++cls) {
+        nn_chunk_cache_lock (&nn_chunk_caches [cls]);
+        blocks = nn_chunk_caches [cls].blocks;
+        nn_chunk_caches [cls].blocks = NULL;
+        nn_chunk_caches [cls].count = 0;
+        nn_chunk_cache_unlock (&nn_chunk_caches [cls]);
+        while (blocks) {
+            next = *(void**) blocks;
+            nn_free (blocks);
+            blocks = next;
+        }
+    }
+#endif
+}
+
 static size_t nn_chunk_hdrsize ()
 {
     return sizeof (struct nn_chunk) + 2 * sizeof (uint32_t);
@@ -26,6 +26,12 @@
 #include <stddef.h>
 #include "int.h"
 
+/*  Number of bytes reserved in front of the data of each chunk so that
+    protocol and transport headers can be prepended in place. */
+#ifndef NN_CHUNK_HEADROOM
+#define NN_CHUNK_HEADROOM 32
+#endif
+
 /*  Allocates the chunk using the allocation mechanism specified by 'type'. */
 int nn_chunk_alloc (size_t size, int type, void **result);
 
@@ -42,9 +48,23 @@ void nn_chunk_addref (void *p, uint32_t n);
 /*  Returns size of the chunk buffer. */
 size_t nn_chunk_size (void *p);
 
+/*  Returns 1 if the chunk is referenced from more than one place, 0 otherwise.
+    Chunk that is not shared can be modified in place. */
+int nn_chunk_isshared (void *p);
+
 /*  Trims n bytes from the beginning of the chunk. Returns pointer to the new
     chunk. */
 void *nn_chunk_trim (void *p, size_t n);
 
+/*  The inverse of nn_chunk_trim. Extends the chunk by n bytes at the
+    beginning, using the empty space in front of the data. Returns pointer to
+    the new chunk or NULL if there's not enough space or if the chunk is
+    referenced from more than one place. */
+void *nn_chunk_push (void *p, size_t n);
+
+/*  Returns the memory blocks kept around for reuse by small chunks to the
+    heap. Chunks freed afterwards are cached anew. */
+void nn_chunk_cache_term (void);
+
 #endif
 
@@ -124,6 +124,13 @@ size_t nn_chunkref_size (struct nn_chunkref *self)
         self->u.ref [0];
 }
 
+int nn_chunkref_isshared (struct nn_chunkref *self)
+{
+    /*  Data stored inside the chunkref itself is copied along with it. */
+    return self->u.ref [0] == 0xff ?
+        nn_chunk_isshared (((struct nn_chunkref_chunk*) self)->chunk) : 0;
+}
+
 void nn_chunkref_trim (struct nn_chunkref *self, size_t n)
 {
     struct nn_chunkref_chunk *ch;
@@ -139,6 +146,27 @@ void nn_chunkref_trim (struct nn_chunkref *self, size_t n)
     self->u.ref [0] -= (uint8_t) n;
 }
 
+int nn_chunkref_push (struct nn_chunkref *self, size_t n)
+{
+    struct nn_chunkref_chunk *ch;
+    void *p;
+
+    if (self->u.ref [0] == 0xff) {
+        ch = (struct nn_chunkref_chunk*) self;
+        p = nn_chunk_push (ch->chunk, n);
+        if (nn_slow (!p))
+            return -ENOBUFS;
+        ch->chunk = p;
+        return 0;
+    }
+
+    if (nn_slow (self->u.ref [0] + n >= NN_CHUNKREF_MAX))
+        return -ENOBUFS;
+    memmove (&self->u.ref [1 + n], &self->u.ref [1], self->u.ref [0]);
+    self->u.ref [0] += (uint8_t) n;
+    return 0;
+}
+
 void nn_chunkref_bulkcopy_start (struct nn_chunkref *self, uint32_t copies)
 {
     struct nn_chunkref_chunk *ch;
@@ -23,7 +23,13 @@
 #ifndef NN_CHUNKREF_INCLUDED
 #define NN_CHUNKREF_INCLUDED
 
+/*  Messages shorter than this are stored inside the chunkref itself. Raising
+    the limit avoids allocating chunks for larger messages at the cost of
+    making each nn_msg (which has several chunkrefs) bigger. Must be less
+    than 255. */
+#ifndef NN_CHUNKREF_MAX
 #define NN_CHUNKREF_MAX 32
+#endif
 
 #include "chunk.h"
 #include "int.h"
@@ -75,9 +81,17 @@ void *nn_chunkref_data (struct nn_chunkref *self);
 /*  Returns the size of the binary data stored in the chunk. */
 size_t nn_chunkref_size (struct nn_chunkref *self);
 
+/*  Returns 1 if the data is shared with other chunkrefs, 0 otherwise. */
+int nn_chunkref_isshared (struct nn_chunkref *self);
+
 /*  Trims n bytes from the beginning of the chunk. */
 void nn_chunkref_trim (struct nn_chunkref *self, size_t n);
 
+/*  The inverse of nn_chunkref_trim. Extends the chunk by n bytes at the
+    beginning without copying the data. Returns -ENOBUFS if there's no room
+    in front of the data or if the chunk is shared. */
+int nn_chunkref_push (struct nn_chunkref *self, size_t n);
+
 /*  Bulk copying is done by first invoking nn_chunkref_bulkcopy_start on the
     source chunk and specifying how many copies of the chunk will be made.
     Then, nn_chunkref_bulkcopy_cp should be used 'copies' of times to make
@@ -21,6 +21,7 @@
 */
 
 #include "msg.h"
+#include "err.h"
 
 #include <string.h>
 
@@ -29,6 +30,8 @@ void nn_msg_init (struct nn_msg *self, size_t size)
     nn_chunkref_init (&self->sphdr, 0);
     nn_chunkref_init (&self->hdrs, 0);
     nn_chunkref_init (&self->body, size);
+    self->nparts = 0;
+    self->deadline = 0;
 }
 
 void nn_msg_init_chunk (struct nn_msg *self, void *chunk)
@@ -36,6 +39,17 @@ void nn_msg_init_chunk (struct nn_msg *self, void *chunk)
     nn_chunkref_init (&self->sphdr, 0);
     nn_chunkref_init (&self->hdrs, 0);
     nn_chunkref_init_chunk (&self->body, chunk);
+    self->nparts = 0;
+    self->deadline = 0;
+}
+
+static void nn_msg_term_parts (struct nn_msg *self)
+{
+    int i;
+
+    for (i = 0; i != self->nparts; ++i)
+        nn_chunk_free (self->parts [i]);
+    self->nparts = 0;
 }
 
 void nn_msg_term (struct nn_msg *self)
@@ -43,6 +57,7 @@ void nn_msg_term (struct nn_msg *self)
     nn_chunkref_term (&self->sphdr);
     nn_chunkref_term (&self->hdrs);
     nn_chunkref_term (&self->body);
+    nn_msg_term_parts (self);
 }
 
 void nn_msg_mv (struct nn_msg *dst, struct nn_msg *src)
@@ -50,20 +65,36 @@ void nn_msg_mv (struct nn_msg *dst, struct nn_msg *src)
     nn_chunkref_mv (&dst->sphdr, &src->sphdr);
     nn_chunkref_mv (&dst->hdrs, &src->hdrs);
     nn_chunkref_mv (&dst->body, &src->body);
+    dst->nparts = src->nparts;
+    dst->deadline = src->deadline;
+    if (nn_slow (src->nparts))
+        memcpy (dst->parts, src->parts, src->nparts * sizeof (void*));
 }
 
 void nn_msg_cp (struct nn_msg *dst, struct nn_msg *src)
 {
+    int i;
+
     nn_chunkref_cp (&dst->sphdr, &src->sphdr);
     nn_chunkref_cp (&dst->hdrs, &src->hdrs);
     nn_chunkref_cp (&dst->body, &src->body);
+    dst->nparts = src->nparts;
+    dst->deadline = src->deadline;
+    for (i = 0; i != src->nparts; ++i) {
+        nn_chunk_addref (src->parts [i], 1);
+        dst->parts [i] = src->parts [i];
+    }
 }
 
 void nn_msg_bulkcopy_start (struct nn_msg *self, uint32_t copies)
 {
+    int i;
+
     nn_chunkref_bulkcopy_start (&self->sphdr, copies);
     nn_chunkref_bulkcopy_start (&self->hdrs, copies);
     nn_chunkref_bulkcopy_start (&self->body, copies);
+    for (i = 0; i != self->nparts; ++i)
+        nn_chunk_addref (self->parts [i], copies);
 }
 
 void nn_msg_bulkcopy_cp (struct nn_msg *dst, struct nn_msg *src)
@@ -71,11 +102,95 @@ void nn_msg_bulkcopy_cp (struct nn_msg *dst, struct nn_msg *src)
     nn_chunkref_bulkcopy_cp (&dst->sphdr, &src->sphdr);
     nn_chunkref_bulkcopy_cp (&dst->hdrs, &src->hdrs);
     nn_chunkref_bulkcopy_cp (&dst->body, &src->body);
+    dst->nparts = src->nparts;
+    dst->deadline = src->deadline;
+    if (nn_slow (src->nparts))
+        memcpy (dst->parts, src->parts, src->nparts * sizeof (void*));
 }
 
 void nn_msg_replace_body (struct nn_msg *self, struct nn_chunkref new_body) 
 {
     nn_chunkref_term (&self->body);
+    nn_msg_term_parts (self);
     self->body = new_body;
 }
 
+void nn_msg_append (struct nn_msg *self, void *chunk)
+{
+    nn_assert (self->nparts < NN_MSG_MAXPARTS - 1);
+    self->parts [self->nparts++] = chunk;
+}
+
+size_t nn_msg_bodysize (struct nn_msg *self)
+{
+    int i;
+    size_t sz;
+
+    sz = nn_chunkref_size (&self->body);
+    for (i = 0; i != self->nparts; ++i)
+        sz += nn_chunk_size (self->parts [i]);
+    return sz;
+}
+
+void nn_msg_pullup (struct nn_msg *self, size_t size)
+{
+    if (nn_fast (self->nparts == 0 || nn_chunkref_size (&self->body) >= size))
+        return;
+    nn_msg_linearize (self);
+}
+
+void nn_msg_linearize (struct nn_msg *self)
+{
+    int i;
+    size_t sz;
+    size_t pos;
+    struct nn_chunkref body;
+
+    if (nn_fast (self->nparts == 0))
+        return;
+
+    sz = nn_msg_bodysize (self);
+    nn_chunkref_init (&body, sz);
+    pos = nn_chunkref_size (&self->body);
+    memcpy (nn_chunkref_data (&body), nn_chunkref_data (&self->body), pos);
+    for (i = 0; i != self->nparts; ++i) {
+        memcpy (((uint8_t*) nn_chunkref_data (&body)) + pos, self->parts [i],
+            nn_chunk_size (self->parts [i]));
+        pos += nn_chunk_size (self->parts [i]);
+    }
+    nn_msg_replace_body (self, body);
+}
+
+int nn_msg_prepend (struct nn_msg *self, const void *hdr, size_t hdrlen)
+{
+    int rc;
+    size_t spsz;
+    uint8_t *data;
+
+    spsz = nn_chunkref_size (&self->sphdr);
+    rc = nn_chunkref_push (&self->body, hdrlen + spsz);
+    if (nn_slow (rc < 0))
+        return rc;
+
+    data = nn_chunkref_data (&self->body);
+    memcpy (data, hdr, hdrlen);
+    memcpy (data + hdrlen, nn_chunkref_data (&self->sphdr), spsz);
+    nn_chunkref_term (&self->sphdr);
+    nn_chunkref_init (&self->sphdr, 0);
+
+    return 0;
+}
+
+int nn_msg_bodyiov (struct nn_msg *self, struct nn_iovec *iov)
+{
+    int i;
+
+    iov [0].iov_base = nn_chunkref_data (&self->body);
+    iov [0].iov_len = nn_chunkref_size (&self->body);
+    for (i = 0; i != self->nparts; ++i) {
+        iov [i + 1].iov_base = self->parts [i];
+        iov [i + 1].iov_len = nn_chunk_size (self->parts [i]);
+    }
+    return self->nparts + 1;
+}
+
@@ -25,8 +25,13 @@
 
 #include "chunkref.h"
 
+#include "../nn.h"
+
 #include <stddef.h>
 
+/*  Maximum number of chunks the message body can be split into. */
+#define NN_MSG_MAXPARTS 4
+
 struct nn_msg {
 
     /*  Contains SP message header. This field directly corresponds
@@ -40,6 +45,18 @@ struct nn_msg {
 
     /*  Contains application level message payload. */
     struct nn_chunkref body;
+
+    /*  The payload may continue in further chunks, e.g. a large shared
+        buffer framed by a small header. Such messages are written out using
+        gather I/O rather than being copied into a single buffer. Code that
+        needs the payload to be contiguous should use nn_msg_pullup or
+        nn_msg_linearize first. */
+    int nparts;
+    void *parts [NN_MSG_MAXPARTS - 1];
+
+    /*  Point in time (as returned by nn_clock_now) after which the message
+        is no longer worth delivering. Zero means the message never expires. */
+    uint64_t deadline;
 };
 
 /*  Initialises a message with body 'size' bytes long and empty header. */
@@ -68,6 +85,30 @@ void nn_msg_cp (struct nn_msg *dst, struct nn_msg *src);
 void nn_msg_bulkcopy_start (struct nn_msg *self, uint32_t copies);
 void nn_msg_bulkcopy_cp (struct nn_msg *dst, struct nn_msg *src);
 
+/*  Appends a chunk to the message body. The message takes ownership of the
+    chunk. There must be fewer than NN_MSG_MAXPARTS parts already. */
+void nn_msg_append (struct nn_msg *self, void *chunk);
+
+/*  Returns the size of the whole message body, i.e. all the parts. */
+size_t nn_msg_bodysize (struct nn_msg *self);
+
+/*  Makes sure that at least first 'size' bytes of the body (or the whole
+    body if it's shorter) are stored in the 'body' chunkref. */
+void nn_msg_pullup (struct nn_msg *self, size_t size);
+
+/*  Merges all the parts of the body into the 'body' chunkref. */
+void nn_msg_linearize (struct nn_msg *self);
+
+/*  Fills in iovecs pointing to the parts of the message body. There must be
+    space for NN_MSG_MAXPARTS iovecs. Returns number of iovecs filled in. */
+int nn_msg_bodyiov (struct nn_msg *self, struct nn_iovec *iov);
+
+/*  Moves the SP header into the body and prepends 'hdr' to it, both in place,
+    so that the message can be written out as a single buffer. Returns
+    -ENOBUFS if there's no room for that in front of the body. In such case
+    the message is left unchanged. */
+int nn_msg_prepend (struct nn_msg *self, const void *hdr, size_t hdrlen);
+
 /** Replaces the message body with entirely new data.  This allows protocols
     that substantially rewrite or preprocess the userland message to be written. */
 void nn_msg_replace_body(struct nn_msg *self, struct nn_chunkref newBody);
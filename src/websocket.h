@@ -32,6 +32,7 @@ extern "C" {
 #endif
 
 #define NN_WS -4
+#define NN_WSS -7
 
 /*  Socket options  */
 #define NN_WS_OPTION_PLACEHOLDER 1
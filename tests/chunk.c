@@ -0,0 +1,112 @@
+/*
+    Copyright (c) 2013 250bpm s.r.o.  All rights reserved.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom
+    the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included
+    in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+#include "../src/utils/err.c"
+#include "../src/utils/alloc.c"
+#include "../src/utils/mutex.c"
+#include "../src/utils/atomic.c"
+#include "../src/utils/wire.c"
+#include "../src/utils/chunk.c"
+#include "../src/utils/chunkref.c"
+#include "../src/utils/msg.c"
+
+int main ()
+{
+    int rc;
+    void *p;
+    void *p2;
+    struct nn_chunkref ref;
+    struct nn_msg msg;
+    uint8_t hdr [8];
+
+    /*  Push the data back after trimming it. */
+    rc = nn_chunk_alloc (100, 0, &p);
+    errnum_assert (rc == 0, -rc);
+    memset (p, 'a', 100);
+    p = nn_chunk_trim (p, 10);
+    nn_assert (nn_chunk_size (p) == 90);
+    p = nn_chunk_push (p, 10);
+    nn_assert (p && nn_chunk_size (p) == 100);
+
+    /*  Use the headroom. */
+    p = nn_chunk_push (p, NN_CHUNK_HEADROOM);
+    nn_assert (p && nn_chunk_size (p) == 100 + NN_CHUNK_HEADROOM);
+    memset (p, 'b', NN_CHUNK_HEADROOM);
+    nn_assert (nn_chunk_push (p, 1) == NULL);
+
+    /*  Reallocation preserves the headroom. */
+    p = nn_chunk_trim (p, NN_CHUNK_HEADROOM);
+    rc = nn_chunk_realloc (1000, &p);
+    errnum_assert (rc == 0, -rc);
+    nn_assert (((uint8_t*) p) [0] == 'a' && ((uint8_t*) p) [99] == 'a');
+    p = nn_chunk_push (p, NN_CHUNK_HEADROOM);
+    nn_assert (p && ((uint8_t*) p) [0] == 'b');
+
+    /*  Shared chunk can't be extended. */
+    nn_chunk_addref (p, 1);
+    nn_assert (nn_chunk_push (p, 1) == NULL);
+    nn_chunk_free (p);
+    nn_chunk_free (p);
+
+    /*  Reallocating a shared chunk makes a private copy and leaves
+        the original intact. */
+    rc = nn_chunk_alloc (100, 0, &p);
+    errnum_assert (rc == 0, -rc);
+    memset (p, 'd', 100);
+    nn_chunk_addref (p, 2);
+    p2 = p;
+    rc = nn_chunk_realloc (10, &p2);
+    errnum_assert (rc == 0, -rc);
+    nn_assert (p2 != p && nn_chunk_size (p2) == 10);
+    nn_assert (((uint8_t*) p2) [9] == 'd');
+    nn_assert (nn_chunk_size (p) == 100);
+    nn_chunk_free (p2);
+    nn_chunk_free (p);
+    nn_chunk_free (p);
+
+    /*  Small chunkrefs are extended within the inline storage. */
+    nn_chunkref_init (&ref, 10);
+    rc = nn_chunkref_push (&ref, 10);
+    nn_assert (rc == 0 && nn_chunkref_size (&ref) == 20);
+    rc = nn_chunkref_push (&ref, NN_CHUNKREF_MAX);
+    nn_assert (rc == -ENOBUFS && nn_chunkref_size (&ref) == 20);
+    nn_chunkref_term (&ref);
+
+    /*  Headers are prepended to the body in place. */
+    nn_msg_init (&msg, 1000);
+    memset (nn_chunkref_data (&msg.body), 'c', 1000);
+    p2 = nn_chunkref_data (&msg.body);
+    nn_chunkref_term (&msg.sphdr);
+    nn_chunkref_init (&msg.sphdr, 4);
+    memcpy (nn_chunkref_data (&msg.sphdr), "ABCD", 4);
+    memcpy (hdr, "HEADER!!", 8);
+    rc = nn_msg_prepend (&msg, hdr, sizeof (hdr));
+    errnum_assert (rc == 0, -rc);
+    nn_assert (nn_chunkref_size (&msg.sphdr) == 0);
+    nn_assert (nn_chunkref_size (&msg.body) == 1012);
+    nn_assert (nn_chunkref_data (&msg.body) == ((uint8_t*) p2) - 12);
+    nn_assert (memcmp (nn_chunkref_data (&msg.body), "HEADER!!ABCDc", 13) == 0);
+    nn_msg_term (&msg);
+
+    return 0;
+}
+
@@ -0,0 +1,116 @@
+/*
+    Copyright (c) 2012 250bpm s.r.o.  All rights reserved.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom
+    the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included
+    in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+#include "../src/nn.h"
+#include "../src/pubsub.h"
+
+#include "testutil.h"
+
+#include <stdio.h>
+#include <string.h>
+
+/*  Tests last-value conflation on PUB socket. */
+
+#define SOCKET_ADDRESS "inproc://a"
+
+#define RCVBUF 64
+#define UPDATES 100
+
+int main ()
+{
+    int rc;
+    int pub;
+    int sub;
+    int val;
+    size_t sz;
+    int i;
+    int count;
+    char buf [8];
+    char last [2] [8];
+
+    /*  Test the option itself. */
+    pub = test_socket (AF_SP, NN_PUB);
+    sz = sizeof (val);
+    rc = nn_getsockopt (pub, NN_PUB, NN_PUB_CONFLATE, &val, &sz);
+    errno_assert (rc == 0);
+    nn_assert (sz == sizeof (val) && val == 0);
+    val = -1;
+    rc = nn_setsockopt (pub, NN_PUB, NN_PUB_CONFLATE, &val, sizeof (val));
+    nn_assert (rc < 0 && nn_errno () == EINVAL);
+    val = 1;
+    rc = nn_setsockopt (pub, NN_PUB, NN_PUB_CONFLATE, &val, sizeof (val));
+    errno_assert (rc == 0);
+    test_bind (pub, SOCKET_ADDRESS);
+
+    /*  Subscriber with small receive buffer can't keep up with the updates
+        of two topics, 'A' and 'B'. */
+    sub = test_socket (AF_SP, NN_SUB);
+    rc = nn_setsockopt (sub, NN_SUB, NN_SUB_SUBSCRIBE, "", 0);
+    errno_assert (rc == 0);
+    val = RCVBUF;
+    rc = nn_setsockopt (sub, NN_SOL_SOCKET, NN_RCVBUF, &val, sizeof (val));
+    errno_assert (rc == 0);
+    val = 100;
+    rc = nn_setsockopt (sub, NN_SOL_SOCKET, NN_RCVTIMEO, &val, sizeof (val));
+    errno_assert (rc == 0);
+    test_connect (sub, SOCKET_ADDRESS);
+    nn_sleep (10);
+
+    for (i = 0; i != UPDATES; ++i) {
+        sprintf (buf, "A%03d", i);
+        test_send (pub, buf);
+        sprintf (buf, "B%03d", i);
+        test_send (pub, buf);
+    }
+
+    /*  Some updates are skipped, but each topic arrives in order and ends
+        with the latest value. */
+    count = 0;
+    memset (last, 0, sizeof (last));
+    while (1) {
+        rc = nn_recv (sub, buf, sizeof (buf) - 1, 0);
+        if (rc < 0) {
+            errno_assert (nn_errno () == EAGAIN);
+            break;
+        }
+        nn_assert (rc == 4);
+        buf [rc] = 0;
+        nn_assert (buf [0] == 'A' || buf [0] == 'B');
+        nn_assert (strcmp (buf, last [buf [0] - 'A']) > 0);
+        strcpy (last [buf [0] - 'A'], buf);
+        ++count;
+    }
+    nn_assert (count < 2 * UPDATES);
+    sprintf (buf, "A%03d", UPDATES - 1);
+    nn_assert (strcmp (last [0], buf) == 0);
+    sprintf (buf, "B%03d", UPDATES - 1);
+    nn_assert (strcmp (last [1], buf) == 0);
+
+    /*  Once the subscriber catches up, messages flow as usual. */
+    test_send (pub, "A999");
+    test_recv (sub, "A999");
+
+    test_close (sub);
+    test_close (pub);
+
+    return 0;
+}
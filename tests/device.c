@@ -25,6 +25,7 @@
 #include "../src/bus.h"
 #include "../src/pair.h"
 #include "../src/pipeline.h"
+#include "../src/reqrep.h"
 #include "../src/inproc.h"
 
 #include "testutil.h"
@@ -36,6 +37,13 @@
 #define SOCKET_ADDRESS_C "inproc://c"
 #define SOCKET_ADDRESS_D "inproc://d"
 #define SOCKET_ADDRESS_E "inproc://e"
+#define SOCKET_ADDRESS_F "inproc://f"
+#define SOCKET_ADDRESS_G "inproc://g"
+#define SOCKET_ADDRESS_H "inproc://h"
+#define SOCKET_ADDRESS_I "inproc://i"
+#define SOCKET_ADDRESS_J "inproc://j"
+#define SOCKET_ADDRESS_K "inproc://k"
+#define SOCKET_ADDRESS_L "inproc://l"
 
 void device1 (NN_UNUSED void *arg)
 {
@@ -96,6 +104,100 @@ void device3 (NN_UNUSED void *arg)
     test_close (deve);
 }
 
+void device4 (NN_UNUSED void *arg)
+{
+    int rc;
+    int devf;
+    int devg;
+
+    /*  Intialise the device sockets. */
+    devf = test_socket (AF_SP_RAW, NN_REP);
+    test_bind (devf, SOCKET_ADDRESS_F);
+    devg = test_socket (AF_SP_RAW, NN_REQ);
+    test_bind (devg, SOCKET_ADDRESS_G);
+
+    /*  Run the device. */
+    rc = nn_device (devf, devg);
+    nn_assert (rc < 0 && nn_errno () == ETERM);
+
+    /*  Clean up. */
+    test_close (devg);
+    test_close (devf);
+}
+
+void device5 (NN_UNUSED void *arg)
+{
+    int rc;
+    int devh;
+    int devi;
+
+    /*  Intialise the device sockets. */
+    devh = test_socket (AF_SP_RAW, NN_PAIR);
+    test_bind (devh, SOCKET_ADDRESS_H);
+    devi = test_socket (AF_SP_RAW, NN_PAIR);
+    test_bind (devi, SOCKET_ADDRESS_I);
+
+    /*  Invalid arguments are rejected. */
+    rc = nn_device_batch (devh, devi, -1, 0);
+    nn_assert (rc < 0 && nn_errno () == EINVAL);
+    rc = nn_device_batch (devh, devi, 0, 0x100);
+    nn_assert (rc < 0 && nn_errno () == EINVAL);
+
+    /*  Run the device with a thread per direction. */
+    rc = nn_device_batch (devh, devi, 16, NN_DEVICE_THREADED);
+    nn_assert (rc < 0 && nn_errno () == ETERM);
+
+    /*  Clean up. */
+    test_close (devi);
+    test_close (devh);
+}
+
+/*  Routes messages starting with 'K' to the second socket, messages starting
+    with 'L' to the third one and drops everything else. */
+int route6 (NN_UNUSED void *arg, int from, const struct nn_device_msg *msg)
+{
+    nn_assert (from == 0);
+    nn_assert (msg->hdrlen == 0);
+    if (msg->bodylen == 0)
+        return NN_DEVICE_DROP;
+    if (((const char*) msg->body) [0] == 'K')
+        return 1;
+    if (((const char*) msg->body) [0] == 'L')
+        return 2;
+    return NN_DEVICE_DROP;
+}
+
+void device6 (NN_UNUSED void *arg)
+{
+    int rc;
+    int devs [3];
+
+    /*  Intialise the device sockets. */
+    devs [0] = test_socket (AF_SP_RAW, NN_PULL);
+    test_bind (devs [0], SOCKET_ADDRESS_J);
+    devs [1] = test_socket (AF_SP_RAW, NN_PUSH);
+    test_bind (devs [1], SOCKET_ADDRESS_K);
+    devs [2] = test_socket (AF_SP_RAW, NN_PUSH);
+    test_bind (devs [2], SOCKET_ADDRESS_L);
+
+    /*  Invalid arguments are rejected. */
+    rc = nn_device_route (devs, 3, NULL, NULL, 0);
+    nn_assert (rc < 0 && nn_errno () == EINVAL);
+    rc = nn_device_route (devs, 0, route6, NULL, 0);
+    nn_assert (rc < 0 && nn_errno () == EINVAL);
+    rc = nn_device_route (devs + 1, 2, route6, NULL, 0);
+    nn_assert (rc < 0 && nn_errno () == EINVAL);
+
+    /*  Run the device. */
+    rc = nn_device_route (devs, 3, route6, NULL, 0);
+    nn_assert (rc < 0 && nn_errno () == ETERM);
+
+    /*  Clean up. */
+    test_close (devs [2]);
+    test_close (devs [1]);
+    test_close (devs [0]);
+}
+
 int main ()
 {
     int rc;
@@ -105,9 +207,21 @@ int main ()
     int endd;
     int ende1;
     int ende2;
+    int endf1;
+    int endf2;
+    int endg;
+    int endh;
+    int endi;
+    int endj;
+    int endk;
+    int endl;
+    int i;
     struct nn_thread thread1;
     struct nn_thread thread2;
     struct nn_thread thread3;
+    struct nn_thread thread4;
+    struct nn_thread thread5;
+    struct nn_thread thread6;
     char buf [3];
     int timeo;
 
@@ -147,6 +261,12 @@ int main ()
     test_send (endc, "XYZ");
     test_recv (endd, "XYZ");
 
+    /*  Pass a batch of messages. */
+    for (i = 0; i != 1000; ++i)
+        test_send (endc, "XYZ");
+    for (i = 0; i != 1000; ++i)
+        test_recv (endd, "XYZ");
+
     /*  Clean up. */
     test_close (endd);
     test_close (endc);
@@ -182,11 +302,106 @@ int main ()
     test_close (ende2);
     test_close (ende1);
 
+    /*  Test the request/reply device. */
+
+    /*  Start the device. */
+    nn_thread_init (&thread4, device4, NULL);
+
+    /*  Create two clients and a server to connect to the device. */
+    endf1 = test_socket (AF_SP, NN_REQ);
+    test_connect (endf1, SOCKET_ADDRESS_F);
+    endf2 = test_socket (AF_SP, NN_REQ);
+    test_connect (endf2, SOCKET_ADDRESS_F);
+    endg = test_socket (AF_SP, NN_REP);
+    test_connect (endg, SOCKET_ADDRESS_G);
+
+    /*  Replies have to be routed back to the right client. */
+    for (i = 0; i != 100; ++i) {
+        test_send (endf1, "ABC");
+        test_recv (endg, "ABC");
+        test_send (endf2, "DEF");
+        test_send (endg, "GHI");
+        test_recv (endg, "DEF");
+        test_send (endg, "JKL");
+        test_recv (endf2, "JKL");
+        test_recv (endf1, "GHI");
+    }
+
+    /*  Clean up. */
+    test_close (endg);
+    test_close (endf2);
+    test_close (endf1);
+
+    /*  Test the threaded device. */
+
+    /*  Start the device. */
+    nn_thread_init (&thread5, device5, NULL);
+
+    /*  Create two sockets to connect to the device. */
+    endh = test_socket (AF_SP, NN_PAIR);
+    test_connect (endh, SOCKET_ADDRESS_H);
+    endi = test_socket (AF_SP, NN_PAIR);
+    test_connect (endi, SOCKET_ADDRESS_I);
+
+    /*  Pass batches of messages in both directions at once. */
+    for (i = 0; i != 1000; ++i) {
+        test_send (endh, "ABC");
+        test_send (endi, "DEF");
+    }
+    for (i = 0; i != 1000; ++i) {
+        test_recv (endi, "ABC");
+        test_recv (endh, "DEF");
+    }
+
+    /*  Clean up. */
+    test_close (endi);
+    test_close (endh);
+
+    /*  Test the routing device. */
+
+    /*  Start the device. */
+    nn_thread_init (&thread6, device6, NULL);
+
+    /*  Create a producer and two consumers to connect to the device. */
+    endj = test_socket (AF_SP, NN_PUSH);
+    test_connect (endj, SOCKET_ADDRESS_J);
+    endk = test_socket (AF_SP, NN_PULL);
+    test_connect (endk, SOCKET_ADDRESS_K);
+    endl = test_socket (AF_SP, NN_PULL);
+    test_connect (endl, SOCKET_ADDRESS_L);
+
+    /*  Messages are steered according to their content. */
+    for (i = 0; i != 100; ++i) {
+        test_send (endj, "KLM");
+        test_send (endj, "XYZ");
+        test_send (endj, "LMN");
+    }
+    for (i = 0; i != 100; ++i) {
+        test_recv (endk, "KLM");
+        test_recv (endl, "LMN");
+    }
+
+    /*  Dropped messages don't arrive anywhere. */
+    timeo = 100;
+    rc = nn_setsockopt (endk, NN_SOL_SOCKET, NN_RCVTIMEO,
+       &timeo, sizeof (timeo));
+    errno_assert (rc == 0);
+    rc = nn_recv (endk, buf, sizeof (buf), 0);
+    errno_assert (rc < 0 && nn_errno () == EAGAIN);
+
+    /*  Clean up. */
+    test_close (endl);
+    test_close (endk);
+    test_close (endj);
+
     /*  Shut down the devices. */
     nn_term ();
     nn_thread_term (&thread1);
     nn_thread_term (&thread2);
     nn_thread_term (&thread3);
+    nn_thread_term (&thread4);
+    nn_thread_term (&thread5);
+    nn_thread_term (&thread6);
 
     return 0;
 }
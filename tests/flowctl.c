@@ -0,0 +1,223 @@
+/*
+    Copyright (c) 2012 250bpm s.r.o.  All rights reserved.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom
+    the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included
+    in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+#include "../src/nn.h"
+#include "../src/pipeline.h"
+#include "../src/pair.h"
+
+#include "testutil.h"
+#include "../src/utils/thread.c"
+
+#include <string.h>
+
+/*  Tests credit-based flow control over TCP. */
+
+#define SOCKET_ADDRESS "tcp://127.0.0.1:5595"
+
+#define MSG_SIZE 1000
+#define RCVBUF 4096
+
+/*  In the bidirectional test the messages are larger than half of the
+    receive buffer, so every message received results in a credit grant. */
+#define BIG_MSG_SIZE 3000
+#define BIG_MSG_COUNT 200
+
+/*  Sends messages without blocking till the pipe stops being writable.
+    Returns the number of messages sent. */
+static int send_all (int s, char *buf, int max)
+{
+    int rc;
+    int i;
+
+    for (i = 0; i != max; ++i) {
+        rc = nn_send (s, buf, MSG_SIZE, NN_DONTWAIT);
+        if (rc < 0) {
+            errno_assert (nn_errno () == EAGAIN);
+
+            /*  Give the credit grants in flight a chance to arrive. */
+            nn_sleep (100);
+            rc = nn_send (s, buf, MSG_SIZE, NN_DONTWAIT);
+            if (rc < 0) {
+                errno_assert (nn_errno () == EAGAIN);
+                break;
+            }
+        }
+        errno_assert (rc == MSG_SIZE);
+    }
+    return i;
+}
+
+static void recv_all (int s, int count)
+{
+    int rc;
+    int i;
+    char buf [MSG_SIZE];
+
+    for (i = 0; i != count; ++i) {
+        rc = nn_recv (s, buf, sizeof (buf), 0);
+        errno_assert (rc == MSG_SIZE);
+    }
+}
+
+static void send_big (void *arg)
+{
+    int rc;
+    int s;
+    int i;
+    char buf [BIG_MSG_SIZE];
+
+    s = *(int*) arg;
+    memset (buf, 'b', sizeof (buf));
+    for (i = 0; i != BIG_MSG_COUNT; ++i) {
+        rc = nn_send (s, buf, sizeof (buf), 0);
+        errno_assert (rc == BIG_MSG_SIZE);
+    }
+}
+
+static int flowctl_pair (void)
+{
+    int rc;
+    int s;
+    int val;
+
+    s = test_socket (AF_SP, NN_PAIR);
+    val = 1;
+    rc = nn_setsockopt (s, NN_SOL_SOCKET, NN_FLOWCTL, &val, sizeof (val));
+    errno_assert (rc == 0);
+    val = RCVBUF;
+    rc = nn_setsockopt (s, NN_SOL_SOCKET, NN_RCVBUF, &val, sizeof (val));
+    errno_assert (rc == 0);
+    val = 5000;
+    rc = nn_setsockopt (s, NN_SOL_SOCKET, NN_SNDTIMEO, &val, sizeof (val));
+    errno_assert (rc == 0);
+    rc = nn_setsockopt (s, NN_SOL_SOCKET, NN_RCVTIMEO, &val, sizeof (val));
+    errno_assert (rc == 0);
+    return s;
+}
+
+/*  Both peers send at the same time. Credit grants have to get through
+    while data are being sent in the other direction. */
+static void test_bidirectional (void)
+{
+    int rc;
+    int a;
+    int b;
+    int i;
+    char buf [BIG_MSG_SIZE];
+    struct nn_thread thread_a;
+    struct nn_thread thread_b;
+
+    a = flowctl_pair ();
+    b = flowctl_pair ();
+    test_bind (a, SOCKET_ADDRESS);
+    test_connect (b, SOCKET_ADDRESS);
+    nn_sleep (100);
+
+    nn_thread_init (&thread_a, send_big, &a);
+    nn_thread_init (&thread_b, send_big, &b);
+    for (i = 0; i != BIG_MSG_COUNT; ++i) {
+        rc = nn_recv (a, buf, sizeof (buf), 0);
+        errno_assert (rc == BIG_MSG_SIZE);
+        rc = nn_recv (b, buf, sizeof (buf), 0);
+        errno_assert (rc == BIG_MSG_SIZE);
+    }
+    nn_thread_term (&thread_a);
+    nn_thread_term (&thread_b);
+
+    test_close (a);
+    test_close (b);
+}
+
+int main ()
+{
+    int rc;
+    int push;
+    int pull;
+    int val;
+    size_t sz;
+    int sent;
+    char buf [MSG_SIZE];
+
+    memset (buf, 'a', sizeof (buf));
+
+    /*  Test the option itself. */
+    push = test_socket (AF_SP, NN_PUSH);
+    sz = sizeof (val);
+    rc = nn_getsockopt (push, NN_SOL_SOCKET, NN_FLOWCTL, &val, &sz);
+    errno_assert (rc == 0);
+    nn_assert (sz == sizeof (val) && val == 0);
+    val = 2;
+    rc = nn_setsockopt (push, NN_SOL_SOCKET, NN_FLOWCTL, &val, sizeof (val));
+    nn_assert (rc < 0 && nn_errno () == EINVAL);
+    val = 1;
+    rc = nn_setsockopt (push, NN_SOL_SOCKET, NN_FLOWCTL, &val, sizeof (val));
+    errno_assert (rc == 0);
+
+    /*  Sender is allowed to get only a single receive buffer ahead of
+        the receiver. */
+    pull = test_socket (AF_SP, NN_PULL);
+    rc = nn_setsockopt (pull, NN_SOL_SOCKET, NN_FLOWCTL, &val, sizeof (val));
+    errno_assert (rc == 0);
+    val = RCVBUF;
+    rc = nn_setsockopt (pull, NN_SOL_SOCKET, NN_RCVBUF, &val, sizeof (val));
+    errno_assert (rc == 0);
+    test_bind (pull, SOCKET_ADDRESS);
+    test_connect (push, SOCKET_ADDRESS);
+    nn_sleep (100);
+
+    sent = send_all (push, buf, 1000);
+    nn_assert (sent > 0 && sent <= RCVBUF / MSG_SIZE + 2);
+
+    /*  Receiving the messages renews the credit. */
+    recv_all (pull, sent);
+    sent = send_all (push, buf, 1000);
+    nn_assert (sent > 0 && sent <= RCVBUF / MSG_SIZE + 2);
+    recv_all (pull, sent);
+
+    test_close (push);
+    test_close (pull);
+
+    /*  If the peer doesn't support flow control the connection works as
+        usual. */
+    push = test_socket (AF_SP, NN_PUSH);
+    val = 1;
+    rc = nn_setsockopt (push, NN_SOL_SOCKET, NN_FLOWCTL, &val, sizeof (val));
+    errno_assert (rc == 0);
+    pull = test_socket (AF_SP, NN_PULL);
+    val = RCVBUF;
+    rc = nn_setsockopt (pull, NN_SOL_SOCKET, NN_RCVBUF, &val, sizeof (val));
+    errno_assert (rc == 0);
+    test_bind (pull, SOCKET_ADDRESS);
+    test_connect (push, SOCKET_ADDRESS);
+    nn_sleep (100);
+
+    sent = send_all (push, buf, 100);
+    nn_assert (sent == 100);
+    recv_all (pull, sent);
+
+    test_close (push);
+    test_close (pull);
+
+    test_bidirectional ();
+
+    return 0;
+}
@@ -27,6 +27,11 @@
 
 #include "testutil.h"
 
+#include <string.h>
+#if !defined NN_HAVE_WINDOWS
+#include <unistd.h>
+#endif
+
 /*  Tests IPC transport. */
 
 #define SOCKET_ADDRESS "ipc://test.ipc"
@@ -37,6 +42,17 @@ int main ()
     int sc;
     int i;
     int s1, s2;
+    int rc;
+    int opt;
+    char addr [128];
+#if defined NN_HAVE_LINUX
+    struct nn_msghdr hdr;
+    struct nn_iovec iovec;
+    unsigned char body [3];
+    unsigned char ctrl [256];
+    struct nn_cmsghdr *cmsg;
+    struct nn_ipc_peercred *cred;
+#endif
 
 	size_t size;
 	char * buf;
@@ -114,6 +130,68 @@ int main ()
     test_close (sc);
     test_close (s1);
 
+    /*  Test an address too long to fit into AF_UNIX address structure. */
+    sc = test_socket (AF_SP, NN_PAIR);
+    memset (addr, 0, sizeof (addr));
+    memcpy (addr, "ipc://", 6);
+    memset (addr + 6, 'a', 115);
+    rc = nn_connect (sc, addr);
+    nn_assert (rc < 0 && nn_errno () == ENAMETOOLONG);
+    opt = -1;
+    rc = nn_setsockopt (sc, NN_IPC, NN_IPC_PEERCRED + 100, &opt, sizeof (opt));
+    nn_assert (rc < 0 && nn_errno () == ENOPROTOOPT);
+    test_close (sc);
+
+#if defined NN_HAVE_LINUX
+
+    /*  Test abstract namespace address along with peer credentials. */
+    sb = test_socket (AF_SP, NN_PAIR);
+    opt = 1;
+    rc = nn_setsockopt (sb, NN_IPC, NN_IPC_PEERCRED, &opt, sizeof (opt));
+    errno_assert (rc == 0);
+    test_bind (sb, "ipc://@nanomsg-test.ipc");
+    sc = test_socket (AF_SP, NN_PAIR);
+    test_connect (sc, "ipc://@nanomsg-test.ipc");
+    test_send (sc, "ABC");
+
+    iovec.iov_base = body;
+    iovec.iov_len = sizeof (body);
+    hdr.msg_iov = &iovec;
+    hdr.msg_iovlen = 1;
+    hdr.msg_control = ctrl;
+    hdr.msg_controllen = sizeof (ctrl);
+    rc = nn_recvmsg (sb, &hdr, 0);
+    errno_assert (rc == 3);
+    cmsg = NN_CMSG_FIRSTHDR (&hdr);
+    while (1) {
+        nn_assert (cmsg);
+        if (cmsg->cmsg_level == NN_IPC && cmsg->cmsg_type == NN_IPC_PEERCRED)
+            break;
+        cmsg = NN_CMSG_NXTHDR (&hdr, cmsg);
+    }
+    nn_assert (cmsg->cmsg_len == sizeof (struct nn_ipc_peercred));
+    cred = (struct nn_ipc_peercred*) NN_CMSG_DATA (cmsg);
+    nn_assert (cred->pid == (int) getpid ());
+    nn_assert (cred->uid == (unsigned int) getuid ());
+    nn_assert (cred->gid == (unsigned int) getgid ());
+
+    /*  No credentials are attached on the other side. */
+    test_send (sb, "DEF");
+    hdr.msg_control = &buf;
+    hdr.msg_controllen = NN_MSG;
+    rc = nn_recvmsg (sc, &hdr, 0);
+    errno_assert (rc == 3);
+    cmsg = NN_CMSG_FIRSTHDR (&hdr);
+    while (cmsg) {
+        nn_assert (cmsg->cmsg_level != NN_IPC);
+        cmsg = NN_CMSG_NXTHDR (&hdr, cmsg);
+    }
+    nn_freemsg (buf);
+
+    test_close (sc);
+    test_close (sb);
+#endif
+
     return 0;
 }
 
@@ -0,0 +1,110 @@
+/*
+    Copyright (c) 2012 250bpm s.r.o.  All rights reserved.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom
+    the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included
+    in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+#include "../src/nn.h"
+#include "../src/pubsub.h"
+
+#include "testutil.h"
+
+/*  Tests last value cache on PUB socket. */
+
+#define SOCKET_ADDRESS_INPROC "inproc://a"
+#define SOCKET_ADDRESS_TCP "tcp://127.0.0.1:5597"
+
+int main ()
+{
+    int rc;
+    int pub;
+    int sub;
+    int val;
+    size_t sz;
+    char buf [8];
+
+    /*  Test the option itself. */
+    pub = test_socket (AF_SP, NN_PUB);
+    sz = sizeof (val);
+    rc = nn_getsockopt (pub, NN_PUB, NN_PUB_CACHE, &val, &sz);
+    errno_assert (rc == 0);
+    nn_assert (sz == sizeof (val) && val == 0);
+    val = -1;
+    rc = nn_setsockopt (pub, NN_PUB, NN_PUB_CACHE, &val, sizeof (val));
+    nn_assert (rc < 0 && nn_errno () == EINVAL);
+    val = 1;
+    rc = nn_setsockopt (pub, NN_PUB, NN_PUB_CACHE, &val, sizeof (val));
+    errno_assert (rc == 0);
+    test_bind (pub, SOCKET_ADDRESS_INPROC);
+    test_bind (pub, SOCKET_ADDRESS_TCP);
+
+    /*  Messages published before anyone is listening are cached. */
+    test_send (pub, "A1");
+    test_send (pub, "B1");
+    test_send (pub, "A2");
+
+    /*  New subscriber gets the latest value of each topic first. */
+    sub = test_socket (AF_SP, NN_SUB);
+    rc = nn_setsockopt (sub, NN_SUB, NN_SUB_SUBSCRIBE, "", 0);
+    errno_assert (rc == 0);
+    val = 1000;
+    rc = nn_setsockopt (sub, NN_SOL_SOCKET, NN_RCVTIMEO, &val, sizeof (val));
+    errno_assert (rc == 0);
+    test_connect (sub, SOCKET_ADDRESS_INPROC);
+    test_recv (sub, "A2");
+    test_recv (sub, "B1");
+    test_send (pub, "B2");
+    test_recv (sub, "B2");
+    test_close (sub);
+
+    /*  Same over TCP. */
+    sub = test_socket (AF_SP, NN_SUB);
+    rc = nn_setsockopt (sub, NN_SUB, NN_SUB_SUBSCRIBE, "B", 1);
+    errno_assert (rc == 0);
+    val = 1000;
+    rc = nn_setsockopt (sub, NN_SOL_SOCKET, NN_RCVTIMEO, &val, sizeof (val));
+    errno_assert (rc == 0);
+    test_connect (sub, SOCKET_ADDRESS_TCP);
+    test_recv (sub, "B2");
+    val = 100;
+    rc = nn_setsockopt (sub, NN_SOL_SOCKET, NN_RCVTIMEO, &val, sizeof (val));
+    errno_assert (rc == 0);
+    rc = nn_recv (sub, buf, sizeof (buf), 0);
+    nn_assert (rc < 0 && nn_errno () == EAGAIN);
+    test_close (sub);
+
+    /*  Switching the cache off drops the cached values. */
+    val = 0;
+    rc = nn_setsockopt (pub, NN_PUB, NN_PUB_CACHE, &val, sizeof (val));
+    errno_assert (rc == 0);
+    sub = test_socket (AF_SP, NN_SUB);
+    rc = nn_setsockopt (sub, NN_SUB, NN_SUB_SUBSCRIBE, "", 0);
+    errno_assert (rc == 0);
+    val = 100;
+    rc = nn_setsockopt (sub, NN_SOL_SOCKET, NN_RCVTIMEO, &val, sizeof (val));
+    errno_assert (rc == 0);
+    test_connect (sub, SOCKET_ADDRESS_INPROC);
+    rc = nn_recv (sub, buf, sizeof (buf), 0);
+    nn_assert (rc < 0 && nn_errno () == EAGAIN);
+    test_close (sub);
+
+    test_close (pub);
+
+    return 0;
+}
@@ -0,0 +1,111 @@
+/*
+    Copyright (c) 2012 250bpm s.r.o.  All rights reserved.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom
+    the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included
+    in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+#include "../src/nn.h"
+#include "../src/pipeline.h"
+
+#include "testutil.h"
+
+#include <string.h>
+
+/*  Checks that messages queued for a broken connection are not delivered
+    over the connection that replaces it, in front of newer messages. */
+
+#define SOCKET_ADDRESS_TCP "tcp://127.0.0.1:5592"
+#define SOCKET_ADDRESS_IPC "ipc://test-reconnect.ipc"
+
+#define MSG_SIZE 8192
+#define SNDBUF 32768
+#define RCVBUF 4096
+
+static void test_reconnect (char *address)
+{
+    int rc;
+    int push;
+    int pull;
+    int val;
+    int i;
+    char buf [MSG_SIZE];
+    char seq [2];
+
+    memset (buf, 'a', sizeof (buf));
+
+    push = test_socket (AF_SP, NN_PUSH);
+    val = SNDBUF;
+    rc = nn_setsockopt (push, NN_SOL_SOCKET, NN_SNDBUF, &val, sizeof (val));
+    errno_assert (rc == 0);
+    pull = test_socket (AF_SP, NN_PULL);
+    val = RCVBUF;
+    rc = nn_setsockopt (pull, NN_SOL_SOCKET, NN_RCVBUF, &val, sizeof (val));
+    errno_assert (rc == 0);
+    test_bind (pull, address);
+    test_connect (push, address);
+    nn_sleep (100);
+
+    /*  Fill in the OS buffers and the queue of the connection. The peer
+        doesn't read anything. */
+    for (i = 0; i != 1000; ++i) {
+        rc = nn_send (push, buf, sizeof (buf), NN_DONTWAIT);
+        if (rc < 0) {
+            errno_assert (nn_errno () == EAGAIN);
+            nn_sleep (100);
+            rc = nn_send (push, buf, sizeof (buf), NN_DONTWAIT);
+            if (rc < 0) {
+                errno_assert (nn_errno () == EAGAIN);
+                break;
+            }
+        }
+        errno_assert (rc == sizeof (buf));
+    }
+    nn_assert (i != 1000);
+
+    /*  Break the connection and let the sender reconnect. */
+    test_close (pull);
+    pull = test_socket (AF_SP, NN_PULL);
+    val = 1000;
+    rc = nn_setsockopt (pull, NN_SOL_SOCKET, NN_RCVTIMEO, &val, sizeof (val));
+    errno_assert (rc == 0);
+    test_bind (pull, address);
+    nn_sleep (500);
+
+    /*  Only the messages sent after the reconnection arrive, in order. */
+    seq [1] = 0;
+    for (i = 0; i != 10; ++i) {
+        seq [0] = '0' + i;
+        test_send (push, seq);
+    }
+    for (i = 0; i != 10; ++i) {
+        seq [0] = '0' + i;
+        test_recv (pull, seq);
+    }
+
+    test_close (push);
+    test_close (pull);
+}
+
+int main ()
+{
+    test_reconnect (SOCKET_ADDRESS_TCP);
+    test_reconnect (SOCKET_ADDRESS_IPC);
+
+    return 0;
+}
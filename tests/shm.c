@@ -0,0 +1,204 @@
+/*
+    Copyright (c) 2013 250bpm s.r.o.  All rights reserved.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom
+    the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included
+    in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+#include "../src/nn.h"
+#include "../src/pair.h"
+#include "../src/pubsub.h"
+#include "../src/shm.h"
+
+#include "testutil.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+
+/*  Tests shared memory transport. */
+
+#define SOCKET_ADDRESS "shm://test.shm"
+#define SOCKET_ADDRESS_IPC "ipc://test.shm"
+
+int main ()
+{
+    int rc;
+    int sb;
+    int sc;
+    int i;
+    int j;
+    int count;
+    int val;
+    size_t sz;
+    size_t size;
+    char *buf;
+    char rbuf [16];
+
+    /*  Check the transport-specific option. */
+    sc = test_socket (AF_SP, NN_PAIR);
+    sz = sizeof (val);
+    rc = nn_getsockopt (sc, NN_SHM, NN_SHM_BUFSIZE, &val, &sz);
+    errno_assert (rc == 0);
+    nn_assert (sz == sizeof (val) && val == 1024 * 1024);
+    val = 0;
+    rc = nn_setsockopt (sc, NN_SHM, NN_SHM_BUFSIZE, &val, sizeof (val));
+    nn_assert (rc < 0 && nn_errno () == EINVAL);
+    test_close (sc);
+
+    /*  Try closing a SHM socket while it not connected. */
+    sc = test_socket (AF_SP, NN_PAIR);
+    test_connect (sc, SOCKET_ADDRESS);
+    test_close (sc);
+
+    /*  Open the socket anew. */
+    sc = test_socket (AF_SP, NN_PAIR);
+    test_connect (sc, SOCKET_ADDRESS);
+
+    /*  Leave enough time for at least one re-connect attempt. */
+    nn_sleep (200);
+
+    sb = test_socket (AF_SP, NN_PAIR);
+    test_bind (sb, SOCKET_ADDRESS);
+
+    /*  Ping-pong test. */
+    for (i = 0; i != 100; ++i) {
+        test_send (sc, "0123456789012345678901234567890123456789");
+        test_recv (sb, "0123456789012345678901234567890123456789");
+        test_send (sb, "0123456789012345678901234567890123456789");
+        test_recv (sc, "0123456789012345678901234567890123456789");
+    }
+
+    /*  Batch transfer test. */
+    for (i = 0; i != 100; ++i) {
+        test_send (sc, "XYZ");
+    }
+    for (i = 0; i != 100; ++i) {
+        test_recv (sb, "XYZ");
+    }
+
+    test_close (sc);
+    test_close (sb);
+
+    /*  Use a small ring so that it wraps around, fills up and has to pass
+        large messages via the socket. */
+    sb = test_socket (AF_SP, NN_PAIR);
+    test_bind (sb, SOCKET_ADDRESS);
+    sc = test_socket (AF_SP, NN_PAIR);
+    val = 4096;
+    rc = nn_setsockopt (sc, NN_SHM, NN_SHM_BUFSIZE, &val, sizeof (val));
+    errno_assert (rc == 0);
+    test_connect (sc, SOCKET_ADDRESS);
+
+    /*  Fill in the ring and drain it several times so that it wraps around.
+        Messages are received in order even if the ring is full. */
+    for (j = 0; j != 10; ++j) {
+        test_send (sc, "0");
+        for (i = 1; ; ++i) {
+            sprintf (rbuf, "%d", i);
+            rc = nn_send (sc, rbuf, strlen (rbuf), NN_DONTWAIT);
+            if (rc < 0) {
+                errno_assert (nn_errno () == EAGAIN);
+                break;
+            }
+        }
+        count = i;
+        for (i = 0; i != count; ++i) {
+            sprintf (rbuf, "%d", i);
+            test_recv (sb, rbuf);
+        }
+    }
+
+    /*  Large messages are interleaved with small ones without reordering. */
+    size = 10000;
+    buf = malloc (size);
+    alloc_assert (buf);
+    for (i = 0; i != size - 1; ++i) {
+        buf [i] = 48 + i % 10;
+    }
+    buf [size - 1] = '\0';
+    for (i = 0; i != 10; ++i) {
+        test_send (sc, "ABC");
+        test_send (sc, buf);
+        test_send (sc, "DEF");
+    }
+    for (i = 0; i != 10; ++i) {
+        test_recv (sb, "ABC");
+        test_recv (sb, buf);
+        test_recv (sb, "DEF");
+    }
+    test_send (sb, buf);
+    test_recv (sc, buf);
+    free (buf);
+
+    test_close (sc);
+    test_close (sb);
+
+    /*  Peers using ipc:// address pass messages via the socket, even if they
+        never send anything themselves. */
+    sb = test_socket (AF_SP, NN_PUB);
+    test_bind (sb, SOCKET_ADDRESS);
+    sc = test_socket (AF_SP, NN_SUB);
+    rc = nn_setsockopt (sc, NN_SUB, NN_SUB_SUBSCRIBE, "", 0);
+    errno_assert (rc == 0);
+    val = 1000;
+    rc = nn_setsockopt (sc, NN_SOL_SOCKET, NN_RCVTIMEO, &val, sizeof (val));
+    errno_assert (rc == 0);
+    test_connect (sc, SOCKET_ADDRESS_IPC);
+    nn_sleep (100);
+    test_send (sb, "ABC");
+    test_recv (sc, "ABC");
+    test_close (sc);
+    test_close (sb);
+
+    sb = test_socket (AF_SP, NN_PUB);
+    test_bind (sb, SOCKET_ADDRESS_IPC);
+    sc = test_socket (AF_SP, NN_SUB);
+    rc = nn_setsockopt (sc, NN_SUB, NN_SUB_SUBSCRIBE, "", 0);
+    errno_assert (rc == 0);
+    val = 1000;
+    rc = nn_setsockopt (sc, NN_SOL_SOCKET, NN_RCVTIMEO, &val, sizeof (val));
+    errno_assert (rc == 0);
+    test_connect (sc, SOCKET_ADDRESS);
+    nn_sleep (100);
+    test_send (sb, "ABC");
+    test_recv (sc, "ABC");
+    test_close (sc);
+    test_close (sb);
+
+    /*  If the segment can't be created, messages are passed via the socket. */
+    sb = test_socket (AF_SP, NN_PAIR);
+    test_bind (sb, SOCKET_ADDRESS);
+    sc = test_socket (AF_SP, NN_PAIR);
+    val = INT_MAX;
+    rc = nn_setsockopt (sc, NN_SHM, NN_SHM_BUFSIZE, &val, sizeof (val));
+    errno_assert (rc == 0);
+    test_connect (sc, SOCKET_ADDRESS);
+    for (i = 0; i != 100; ++i) {
+        test_send (sc, "XYZ");
+        test_send (sb, "ABC");
+    }
+    for (i = 0; i != 100; ++i) {
+        test_recv (sb, "XYZ");
+        test_recv (sc, "ABC");
+    }
+    test_close (sc);
+    test_close (sb);
+
+    return 0;
+}
@@ -23,16 +23,86 @@
 #include "../src/nn.h"
 #include "../src/pair.h"
 #include "../src/pubsub.h"
+#include "../src/pipeline.h"
 #include "../src/tcp.h"
 
 #include "testutil.h"
 
+#if defined NN_HAVE_WINDOWS
+#include "../src/utils/win.h"
+#else
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#endif
+
+#include <string.h>
+
 /*  Tests TCP transport. */
 
 #define SOCKET_ADDRESS "tcp://127.0.0.1:5555"
+#define SOCKET_PORT 5555
 
 int sc;
 
+/*  Connects a plain TCP socket to the port and reads the protocol header
+    sent by the nanomsg socket bound to it. */
+static void test_protohdr (int port, unsigned char *hdr)
+{
+    int rc;
+    int sz;
+#if defined NN_HAVE_WINDOWS
+    SOCKET s;
+#else
+    int s;
+#endif
+    struct sockaddr_in addr;
+
+    s = socket (AF_INET, SOCK_STREAM, 0);
+#if defined NN_HAVE_WINDOWS
+    nn_assert (s != INVALID_SOCKET);
+#else
+    errno_assert (s >= 0);
+#endif
+    memset (&addr, 0, sizeof (addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons ((unsigned short) port);
+    addr.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+    rc = connect (s, (struct sockaddr*) &addr, sizeof (addr));
+    nn_assert (rc == 0);
+    sz = 0;
+    while (sz != 8) {
+        rc = recv (s, (char*) hdr + sz, 8 - sz, 0);
+        nn_assert (rc > 0);
+        sz += rc;
+    }
+#if defined NN_HAVE_WINDOWS
+    closesocket (s);
+#else
+    close (s);
+#endif
+}
+
+/*  Sets a TCP tuning option and checks that it can be read back. The option
+    may not be supported by the platform. */
+static void test_tcp_opt (int s, int option, int val)
+{
+    int rc;
+    int opt;
+    size_t sz;
+
+    rc = nn_setsockopt (s, NN_TCP, option, &val, sizeof (val));
+    if (rc < 0) {
+        errno_assert (nn_errno () == ENOPROTOOPT);
+        return;
+    }
+    sz = sizeof (opt);
+    rc = nn_getsockopt (s, NN_TCP, option, &opt, &sz);
+    errno_assert (rc == 0);
+    nn_assert (sz == sizeof (opt));
+    nn_assert (opt == val);
+}
+
 int main ()
 {
     int rc;
@@ -41,6 +111,8 @@ int main ()
     int opt;
     size_t sz;
     int s1, s2;
+    int cs [3];
+    unsigned char hdr [8];
 
     /*  Try closing bound but unconnected socket. */
     sb = test_socket (AF_SP, NN_PAIR);
@@ -74,6 +146,26 @@ int main ()
     nn_assert (sz == sizeof (opt));
     nn_assert (opt == 1);
 
+    /*  Check the remaining tuning options. They are applied to the connection
+        used by the tests below. */
+    opt = -1;
+    rc = nn_setsockopt (sc, NN_TCP, NN_TCP_SNDBUF, &opt, sizeof (opt));
+    nn_assert (rc < 0 && nn_errno () == EINVAL);
+    test_tcp_opt (sc, NN_TCP_SNDBUF, 65536);
+    test_tcp_opt (sc, NN_TCP_RCVBUF, 65536);
+    test_tcp_opt (sc, NN_TCP_KEEPALIVE_IDLE, 10000);
+    test_tcp_opt (sc, NN_TCP_KEEPALIVE_INTVL, 1000);
+    test_tcp_opt (sc, NN_TCP_KEEPALIVE_CNT, 3);
+    test_tcp_opt (sc, NN_TCP_BUSY_POLL, 50);
+    test_tcp_opt (sc, NN_TCP_QUICKACK, 1);
+    test_tcp_opt (sc, NN_TCP_NOTSENT_LOWAT, 16384);
+    test_tcp_opt (sc, NN_TCP_USER_TIMEOUT, 5000);
+    test_tcp_opt (sc, NN_TCP_ACCEPT_IVL, 50);
+    opt = 0;
+    rc = nn_setsockopt (sc, NN_TCP, NN_TCP_CONNECTIONS, &opt, sizeof (opt));
+    nn_assert (rc < 0 && nn_errno () == EINVAL);
+    test_tcp_opt (sc, NN_TCP_CONNECTIONS, 4);
+
     /*  Try using invalid address strings. */
     rc = nn_connect (sc, "tcp://*:");
     nn_assert (rc < 0);
@@ -119,6 +211,12 @@ int main ()
     rc = nn_connect (sc, "tcp://.123:5555");
     nn_assert (rc < 0);
     errno_assert (nn_errno () == EINVAL);
+    rc = nn_connect (sc, "tcp://127.0.0.1:5555,");
+    nn_assert (rc < 0);
+    errno_assert (nn_errno () == EINVAL);
+    rc = nn_connect (sc, "tcp://127.0.0.1:5555,127.0.0.1");
+    nn_assert (rc < 0);
+    errno_assert (nn_errno () == EINVAL);
 
     /*  Connect correctly. Do so before binding the peer socket. */
     test_connect (sc, SOCKET_ADDRESS);
@@ -127,6 +225,7 @@ int main ()
     nn_sleep (200);
 
     sb = test_socket (AF_SP, NN_PAIR);
+    test_tcp_opt (sb, NN_TCP_RCVBUF, 262144);
     test_bind (sb, SOCKET_ADDRESS);
 
     /*  Ping-pong test. */
@@ -178,6 +277,128 @@ int main ()
     test_close (sc);
     test_close (s1);
 
+    /*  Test connecting to a hostname. The second connection uses the cached
+        result of the DNS lookup. Closing the socket while the lookup may
+        still be in progress should work as well. */
+    sb = test_socket (AF_SP, NN_PAIR);
+    test_bind (sb, SOCKET_ADDRESS);
+    s1 = test_socket (AF_SP, NN_PAIR);
+    test_connect (s1, "tcp://localhost:5555");
+    test_close (s1);
+    sc = test_socket (AF_SP, NN_PAIR);
+    test_connect (sc, "tcp://localhost:5555");
+    nn_sleep (100);
+    test_send (sc, "ABC");
+    test_recv (sb, "ABC");
+    test_close (sc);
+    sc = test_socket (AF_SP, NN_PAIR);
+    test_connect (sc, "tcp://localhost:5555");
+    nn_sleep (100);
+    test_send (sc, "DEF");
+    test_recv (sb, "DEF");
+    test_close (sc);
+    test_close (sb);
+
+    /*  Test connecting to a list of hosts. The hosts that refuse
+        the connection or don't respond are skipped. */
+    sb = test_socket (AF_SP, NN_PAIR);
+    test_bind (sb, SOCKET_ADDRESS);
+    sc = test_socket (AF_SP, NN_PAIR);
+    test_connect (sc, "tcp://127.0.0.1:5556,10.255.255.1:5555,"
+        "localhost:5555");
+    test_send (sc, "ABC");
+    test_recv (sb, "ABC");
+    test_close (sc);
+    test_close (sb);
+
+    /*  Test the reconnection policies and paced accepting. The clients are
+        started before the server so that they have to reconnect. */
+    sb = test_socket (AF_SP, NN_PULL);
+    opt = 50;
+    rc = nn_setsockopt (sb, NN_TCP, NN_TCP_ACCEPT_IVL, &opt, sizeof (opt));
+    errno_assert (rc == 0);
+    opt = NN_RECONNECT_DECORRELATED_JITTER + 1;
+    rc = nn_setsockopt (sb, NN_SOL_SOCKET, NN_RECONNECT_POLICY,
+        &opt, sizeof (opt));
+    nn_assert (rc < 0 && nn_errno () == EINVAL);
+    for (i = 0; i != 3; ++i) {
+        cs [i] = test_socket (AF_SP, NN_PUSH);
+        opt = NN_RECONNECT_FULL_JITTER + i;
+        rc = nn_setsockopt (cs [i], NN_SOL_SOCKET, NN_RECONNECT_POLICY,
+            &opt, sizeof (opt));
+        errno_assert (rc == 0);
+        sz = sizeof (opt);
+        rc = nn_getsockopt (cs [i], NN_SOL_SOCKET, NN_RECONNECT_POLICY,
+            &opt, &sz);
+        errno_assert (rc == 0);
+        nn_assert (opt == NN_RECONNECT_FULL_JITTER + i);
+        test_connect (cs [i], SOCKET_ADDRESS);
+    }
+    nn_sleep (200);
+    test_bind (sb, SOCKET_ADDRESS);
+    for (i = 0; i != 3; ++i)
+        test_send (cs [i], "ABC");
+    for (i = 0; i != 3; ++i)
+        test_recv (sb, "ABC");
+    for (i = 0; i != 3; ++i)
+        test_close (cs [i]);
+    test_close (sb);
+
+    /*  Optional features are advertised in the reserved bytes of the protocol
+        header only if the user switches them on. Other SP implementations
+        reject the header unless the bytes are zero. */
+    sb = test_socket (AF_SP, NN_PULL);
+    test_bind (sb, SOCKET_ADDRESS);
+    test_protohdr (SOCKET_PORT, hdr);
+    nn_assert (memcmp (hdr, "\0SP\0", 4) == 0);
+    nn_assert (((hdr [4] << 8) | hdr [5]) == NN_PULL);
+    nn_assert (hdr [6] == 0 && hdr [7] == 0);
+    test_close (sb);
+
+    sb = test_socket (AF_SP, NN_PULL);
+    opt = 1;
+    rc = nn_setsockopt (sb, NN_SOL_SOCKET, NN_FLOWCTL, &opt, sizeof (opt));
+    errno_assert (rc == 0);
+    opt = 1000;
+    rc = nn_setsockopt (sb, NN_SOL_SOCKET, NN_MSGTTL, &opt, sizeof (opt));
+    errno_assert (rc == 0);
+    test_bind (sb, SOCKET_ADDRESS);
+    test_protohdr (SOCKET_PORT, hdr);
+    nn_assert (hdr [6] != 0 && hdr [7] == 0);
+    test_close (sb);
+
+    /*  Test parallel connections. The limit on their number is
+        NN_TCP_MAX_CONNECTIONS (256). */
+    sc = test_socket (AF_SP, NN_PUB);
+    opt = 257;
+    rc = nn_setsockopt (sc, NN_TCP, NN_TCP_CONNECTIONS, &opt, sizeof (opt));
+    nn_assert (rc < 0 && nn_errno () == EINVAL);
+    opt = 0;
+    rc = nn_setsockopt (sc, NN_TCP, NN_TCP_CONNECTIONS, &opt, sizeof (opt));
+    nn_assert (rc < 0 && nn_errno () == EINVAL);
+    test_tcp_opt (sc, NN_TCP_CONNECTIONS, 256);
+
+    /*  PUB socket sends each message to all of its pipes, so the subscriber
+        gets one copy per connection. */
+    test_tcp_opt (sc, NN_TCP_CONNECTIONS, 4);
+    sb = test_socket (AF_SP, NN_SUB);
+    rc = nn_setsockopt (sb, NN_SUB, NN_SUB_SUBSCRIBE, "", 0);
+    errno_assert (rc == 0);
+    opt = 100;
+    rc = nn_setsockopt (sb, NN_SOL_SOCKET, NN_RCVTIMEO, &opt, sizeof (opt));
+    errno_assert (rc == 0);
+    test_bind (sb, SOCKET_ADDRESS);
+    test_connect (sc, SOCKET_ADDRESS);
+    nn_sleep (200);
+    for (i = 0; i != 4; ++i)
+        test_send (sc, "ABC");
+    for (i = 0; i != 16; ++i)
+        test_recv (sb, "ABC");
+    rc = nn_recv (sb, hdr, sizeof (hdr), 0);
+    nn_assert (rc < 0 && nn_errno () == EAGAIN);
+    test_close (sc);
+    test_close (sb);
+
     return 0;
 }
 
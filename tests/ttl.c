@@ -0,0 +1,206 @@
+/*
+    Copyright (c) 2012 250bpm s.r.o.  All rights reserved.
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"),
+    to deal in the Software without restriction, including without limitation
+    the rights to use, copy, modify, merge, publish, distribute, sublicense,
+    and/or sell copies of the Software, and to permit persons to whom
+    the Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included
+    in all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+#include "../src/nn.h"
+#include "../src/pipeline.h"
+
+#include "testutil.h"
+
+#include <string.h>
+
+/*  Tests message deadlines. */
+
+#define SOCKET_ADDRESS_INPROC "inproc://a"
+#define SOCKET_ADDRESS_TCP "tcp://127.0.0.1:5596"
+
+/*  Receives a message and returns its time to live as reported by SP_TTL
+    property or -1 if the message doesn't expire. */
+static int recv_ttl (int s, char *data)
+{
+    int rc;
+    int ttl;
+    struct nn_msghdr hdr;
+    struct nn_iovec iovec;
+    char body [16];
+    void *ctrl;
+    struct nn_cmsghdr *cmsg;
+
+    iovec.iov_base = body;
+    iovec.iov_len = sizeof (body);
+    memset (&hdr, 0, sizeof (hdr));
+    hdr.msg_iov = &iovec;
+    hdr.msg_iovlen = 1;
+    hdr.msg_control = &ctrl;
+    hdr.msg_controllen = NN_MSG;
+    rc = nn_recvmsg (s, &hdr, 0);
+    errno_assert (rc == (int) strlen (data));
+    nn_assert (memcmp (body, data, rc) == 0);
+
+    ttl = -1;
+    cmsg = NN_CMSG_FIRSTHDR (&hdr);
+    while (cmsg) {
+        if (cmsg->cmsg_level == PROTO_SP && cmsg->cmsg_type == SP_TTL) {
+            nn_assert (cmsg->cmsg_len == sizeof (int));
+            memcpy (&ttl, NN_CMSG_DATA (cmsg), sizeof (int));
+        }
+        cmsg = NN_CMSG_NXTHDR (&hdr, cmsg);
+    }
+    nn_freemsg (ctrl);
+    return ttl;
+}
+
+/*  Sends a message with SP_TTL property. */
+static void send_ttl (int s, char *data, int ttl)
+{
+    int rc;
+    struct nn_msghdr hdr;
+    struct nn_iovec iovec;
+    unsigned char ctrl [NN_CMSG_SPACE (sizeof (int))];
+    struct nn_cmsghdr *cmsg;
+
+    iovec.iov_base = data;
+    iovec.iov_len = strlen (data);
+    memset (&hdr, 0, sizeof (hdr));
+    hdr.msg_iov = &iovec;
+    hdr.msg_iovlen = 1;
+    hdr.msg_control = ctrl;
+    hdr.msg_controllen = sizeof (ctrl);
+    cmsg = (struct nn_cmsghdr*) ctrl;
+    cmsg->cmsg_len = sizeof (int);
+    cmsg->cmsg_level = PROTO_SP;
+    cmsg->cmsg_type = SP_TTL;
+    memcpy (NN_CMSG_DATA (cmsg), &ttl, sizeof (int));
+    rc = nn_sendmsg (s, &hdr, 0);
+    errno_assert (rc == (int) strlen (data));
+}
+
+int main ()
+{
+    int rc;
+    int push;
+    int pull;
+    int val;
+    size_t sz;
+    int ttl;
+    char buf [16];
+
+    /*  Test the option itself. */
+    push = test_socket (AF_SP, NN_PUSH);
+    sz = sizeof (val);
+    rc = nn_getsockopt (push, NN_SOL_SOCKET, NN_MSGTTL, &val, &sz);
+    errno_assert (rc == 0);
+    nn_assert (sz == sizeof (val) && val == -1);
+    val = 0;
+    rc = nn_setsockopt (push, NN_SOL_SOCKET, NN_MSGTTL, &val, sizeof (val));
+    nn_assert (rc < 0 && nn_errno () == EINVAL);
+    val = 100;
+    rc = nn_setsockopt (push, NN_SOL_SOCKET, NN_MSGTTL, &val, sizeof (val));
+    errno_assert (rc == 0);
+
+    /*  Expired message is never delivered. */
+    pull = test_socket (AF_SP, NN_PULL);
+    val = 100;
+    rc = nn_setsockopt (pull, NN_SOL_SOCKET, NN_RCVTIMEO, &val, sizeof (val));
+    errno_assert (rc == 0);
+    test_bind (pull, SOCKET_ADDRESS_INPROC);
+    test_connect (push, SOCKET_ADDRESS_INPROC);
+    test_send (push, "ABC");
+    nn_sleep (200);
+    rc = nn_recv (pull, buf, sizeof (buf), 0);
+    nn_assert (rc < 0 && nn_errno () == EAGAIN);
+
+    /*  Message that is still alive is delivered along with its time to live. */
+    test_send (push, "DEF");
+    ttl = recv_ttl (pull, "DEF");
+    nn_assert (ttl > 0 && ttl <= 100);
+
+    /*  Time to live can be set for individual messages. */
+    send_ttl (push, "GHI", 10);
+    nn_sleep (100);
+    rc = nn_recv (pull, buf, sizeof (buf), 0);
+    nn_assert (rc < 0 && nn_errno () == EAGAIN);
+    send_ttl (push, "JKL", 5000);
+    ttl = recv_ttl (pull, "JKL");
+    nn_assert (ttl > 100 && ttl <= 5000);
+
+    /*  Messages without deadline don't report any. */
+    val = -1;
+    rc = nn_setsockopt (push, NN_SOL_SOCKET, NN_MSGTTL, &val, sizeof (val));
+    errno_assert (rc == 0);
+    test_send (push, "MNO");
+    ttl = recv_ttl (pull, "MNO");
+    nn_assert (ttl == -1);
+
+    test_close (push);
+    test_close (pull);
+
+    /*  The deadline is passed over TCP if both peers enable it. */
+    push = test_socket (AF_SP, NN_PUSH);
+    val = 10000;
+    rc = nn_setsockopt (push, NN_SOL_SOCKET, NN_MSGTTL, &val, sizeof (val));
+    errno_assert (rc == 0);
+    pull = test_socket (AF_SP, NN_PULL);
+    val = 100;
+    rc = nn_setsockopt (pull, NN_SOL_SOCKET, NN_RCVTIMEO, &val, sizeof (val));
+    errno_assert (rc == 0);
+    val = 10000;
+    rc = nn_setsockopt (pull, NN_SOL_SOCKET, NN_MSGTTL, &val, sizeof (val));
+    errno_assert (rc == 0);
+    test_bind (pull, SOCKET_ADDRESS_TCP);
+    test_connect (push, SOCKET_ADDRESS_TCP);
+    nn_sleep (100);
+
+    send_ttl (push, "ABC", 5000);
+    ttl = recv_ttl (pull, "ABC");
+    nn_assert (ttl > 100 && ttl <= 5000);
+
+    send_ttl (push, "DEF", 100);
+    nn_sleep (200);
+    rc = nn_recv (pull, buf, sizeof (buf), 0);
+    nn_assert (rc < 0 && nn_errno () == EAGAIN);
+
+    test_send (push, "GHI");
+    ttl = recv_ttl (pull, "GHI");
+    nn_assert (ttl > 5000 && ttl <= 10000);
+
+    test_close (push);
+    test_close (pull);
+
+    /*  Otherwise the messages are passed without deadline. */
+    push = test_socket (AF_SP, NN_PUSH);
+    val = 10000;
+    rc = nn_setsockopt (push, NN_SOL_SOCKET, NN_MSGTTL, &val, sizeof (val));
+    errno_assert (rc == 0);
+    pull = test_socket (AF_SP, NN_PULL);
+    test_bind (pull, SOCKET_ADDRESS_TCP);
+    test_connect (push, SOCKET_ADDRESS_TCP);
+    nn_sleep (100);
+
+    send_ttl (push, "ABC", 5000);
+    ttl = recv_ttl (pull, "ABC");
+    nn_assert (ttl == -1);
+
+    test_close (push);
+    test_close (pull);
+
+    return 0;
+}
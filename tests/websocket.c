@@ -23,14 +23,20 @@
 
 #include "../src/nn.h"
 #include "../src/pair.h"
+#include "../src/pubsub.h"
 #include "../src/websocket.h"
 
 #include "../src/utils/int.h"
 
 #include "testutil.h"
 
+#include <string.h>
+
 /*  Basic tests for WebSocket transport. */
 
+/*  Messages start with the header of a binary WebSocket frame. */
+#define WS_BINARY "\x82"
+
 int main ()
 {
     int rc;
@@ -38,6 +44,9 @@ int main ()
     int sc;
     int opt;
     size_t sz;
+    int i;
+    int subs [2];
+    char buf [128];
 
     /*  Try closing bound but unconnected socket. */
     sb = test_socket (AF_SP, NN_PAIR);
@@ -117,5 +126,33 @@ int main ()
 
     test_close (sc);
 
+    /*  Message sent by a connecting (i.e. masking) PUB socket is shared by
+        all the connections. Each of the subscribers must get it intact. The
+        message is large enough not to be stored inside the chunkref. */
+    subs [0] = test_socket (AF_SP, NN_SUB);
+    test_bind (subs [0], "ws://127.0.0.1:5598");
+    subs [1] = test_socket (AF_SP, NN_SUB);
+    test_bind (subs [1], "ws://127.0.0.1:5599");
+    sc = test_socket (AF_SP, NN_PUB);
+    test_connect (sc, "ws://127.0.0.1:5598");
+    test_connect (sc, "ws://127.0.0.1:5599");
+    for (i = 0; i != 2; ++i) {
+        rc = nn_setsockopt (subs [i], NN_SUB, NN_SUB_SUBSCRIBE, "", 0);
+        errno_assert (rc == 0);
+    }
+    nn_sleep (200);
+    memset (buf, 'A', sizeof (buf) - 1);
+    buf [sizeof (buf) - 1] = 0;
+    memcpy (buf, WS_BINARY, 1);
+    for (i = 0; i != 10; ++i)
+        test_send (sc, buf);
+    for (i = 0; i != 10; ++i) {
+        test_recv (subs [0], buf);
+        test_recv (subs [1], buf);
+    }
+    test_close (sc);
+    test_close (subs [0]);
+    test_close (subs [1]);
+
     return 0;
 }
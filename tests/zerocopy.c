@@ -24,6 +24,7 @@
 #include "../src/nn.h"
 #include "../src/pubsub.h"
 #include "../src/reqrep.h"
+#include "../src/pair.h"
 
 #include "testutil.h"
 
@@ -192,11 +193,144 @@ void test_reallocmsg_pubsub ()
     nn_close (pub);
 }
 
+/*  Sends small header followed by the shared payload. */
+static void test_send_chain (int s, const char *hdr, void *payload)
+{
+    int rc;
+    void *p;
+    struct nn_iovec iov [2];
+    struct nn_msghdr msghdr;
+
+    p = nn_refmsg (payload);
+    nn_assert (p == payload);
+    iov [0].iov_base = (void*) hdr;
+    iov [0].iov_len = strlen (hdr);
+    iov [1].iov_base = &p;
+    iov [1].iov_len = NN_MSG;
+    memset (&msghdr, 0, sizeof (msghdr));
+    msghdr.msg_iov = iov;
+    msghdr.msg_iovlen = 2;
+    rc = nn_sendmsg (s, &msghdr, 0);
+    errno_assert (rc == (int) (strlen (hdr) + 1000));
+}
+
+void test_chain ()
+{
+    int rc;
+    int i;
+    int sb;
+    int sc;
+    void *payload;
+    void *p;
+    void *parts [3];
+    char buf [1100];
+    struct nn_iovec iov [5];
+    struct nn_msghdr msghdr;
+
+    payload = nn_allocmsg (1000, 0);
+    nn_assert (payload);
+    memset (payload, 'x', 1000);
+
+    /*  The chain is passed as is over inproc. */
+    sb = test_socket (AF_SP, NN_PAIR);
+    test_bind (sb, "inproc://chain");
+    sc = test_socket (AF_SP, NN_PAIR);
+    test_connect (sc, "inproc://chain");
+
+    test_send_chain (sc, "HDR1", payload);
+    test_send_chain (sc, "HDR2", payload);
+
+    /*  Receiving into ordinary buffer merges the parts. */
+    rc = nn_recv (sb, buf, sizeof (buf), 0);
+    errno_assert (rc == 1004);
+    nn_assert (memcmp (buf, "HDR1", 4) == 0);
+    nn_assert (buf [4] == 'x' && buf [1003] == 'x');
+
+    /*  Receiving into zero-copy buffers yields the parts themselves. */
+    for (i = 0; i != 3; ++i) {
+        iov [i].iov_base = &parts [i];
+        iov [i].iov_len = NN_MSG;
+    }
+    memset (&msghdr, 0, sizeof (msghdr));
+    msghdr.msg_iov = iov;
+    msghdr.msg_iovlen = 3;
+    rc = nn_recvmsg (sb, &msghdr, 0);
+    errno_assert (rc == 1004);
+    nn_assert (iov [0].iov_len == 4 && memcmp (parts [0], "HDR2", 4) == 0);
+    nn_assert (iov [1].iov_len == 1000 && parts [1] == payload);
+    nn_assert (iov [2].iov_len == 0 && parts [2] == NULL);
+    nn_freemsg (parts [0]);
+    nn_freemsg (parts [1]);
+
+    /*  Mixing zero-copy and ordinary buffers on receive is not allowed. */
+    test_send_chain (sc, "HDR3", payload);
+    iov [0].iov_base = &parts [0];
+    iov [0].iov_len = NN_MSG;
+    iov [1].iov_base = buf;
+    iov [1].iov_len = sizeof (buf);
+    msghdr.msg_iovlen = 2;
+    rc = nn_recvmsg (sb, &msghdr, 0);
+    nn_assert (rc < 0 && nn_errno () == EINVAL);
+
+    test_close (sc);
+    test_close (sb);
+
+    /*  Over a wire transport the chain is written out using gather I/O. */
+    sb = test_socket (AF_SP, NN_PAIR);
+    test_bind (sb, "tcp://127.0.0.1:5591");
+    sc = test_socket (AF_SP, NN_PAIR);
+    test_connect (sc, "tcp://127.0.0.1:5591");
+    test_send_chain (sc, "HDR4", payload);
+    rc = nn_recv (sb, &p, NN_MSG, 0);
+    errno_assert (rc == 1004);
+    nn_assert (memcmp (p, "HDR4", 4) == 0);
+    nn_assert (((char*) p) [4] == 'x' && ((char*) p) [1003] == 'x');
+    nn_freemsg (p);
+
+    /*  More parts than can be chained are copied into a single buffer. */
+    for (i = 0; i != 5; ++i) {
+        iov [i].iov_base = (i % 2) ? (void*) &payload : (void*) "ab";
+        iov [i].iov_len = (i % 2) ? NN_MSG : 2;
+    }
+    nn_refmsg (payload);
+    nn_refmsg (payload);
+    memset (&msghdr, 0, sizeof (msghdr));
+    msghdr.msg_iov = iov;
+    msghdr.msg_iovlen = 5;
+    rc = nn_sendmsg (sc, &msghdr, 0);
+    errno_assert (rc == 2006);
+    rc = nn_recv (sb, &p, NN_MSG, 0);
+    errno_assert (rc == 2006);
+    nn_assert (memcmp (p, "abx", 3) == 0);
+    nn_assert (memcmp (((char*) p) + 1001, "xab", 3) == 0);
+    nn_freemsg (p);
+
+    test_close (sc);
+    test_close (sb);
+
+    /*  Failed send leaves the zero-copy part with the caller. */
+    sc = test_socket (AF_SP_RAW, NN_REQ);
+    p = payload;
+    iov [0].iov_base = "HDR5";
+    iov [0].iov_len = 4;
+    iov [1].iov_base = &p;
+    iov [1].iov_len = NN_MSG;
+    msghdr.msg_iovlen = 2;
+    rc = nn_sendmsg (sc, &msghdr, NN_DONTWAIT);
+    nn_assert (rc < 0 && nn_errno () == EAGAIN);
+    test_close (sc);
+
+    memset (payload, 0, 1000);
+    rc = nn_freemsg (payload);
+    errno_assert (rc == 0);
+}
+
 int main ()
 {
     test_allocmsg_reqrep ();
     test_reallocmsg_reqrep ();
     test_reallocmsg_pubsub ();
+    test_chain ();
     return 0;
 }
 
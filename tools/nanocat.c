@@ -31,6 +31,7 @@
 #include "options.h"
 #include "../src/utils/sleep.c"
 #include "../src/utils/clock.c"
+#include "../src/utils/stopwatch.c"
 
 #include <stdio.h>
 #include <string.h>
@@ -51,6 +52,15 @@ enum echo_format {
     NN_ECHO_HEX
 };
 
+enum record_delimiter {
+    NN_DELIM_NEWLINE,
+    NN_DELIM_LENGTH
+};
+
+/*  Size of the stdio buffers used for the streamed input and for the
+    received messages.  */
+#define NN_IO_BUFFER 65536
+
 typedef struct nn_options {
     /* Global options */
     int verbose;
@@ -68,9 +78,17 @@ typedef struct nn_options {
     float send_delay;
     float send_interval;
     struct nn_blob data_to_send;
+    char *stream_path;
+    enum record_delimiter delimiter;
+    float send_rate;
 
     /* Input options */
     enum echo_format echo_format;
+
+    /* Load options */
+    long count;
+    float duration;
+    float stats_interval;
 } nn_options_t;
 
 /*  Constants to get address of in option declaration  */
@@ -118,6 +136,12 @@ struct nn_enum_item echo_formats[] = {
     {NULL, 0},
 };
 
+struct nn_enum_item delimiters[] = {
+    {"newline", NN_DELIM_NEWLINE},
+    {"length", NN_DELIM_LENGTH},
+    {NULL, 0},
+};
+
 /*  Constants for conflict masks  */
 #define NN_MASK_SOCK 1
 #define NN_MASK_WRITEABLE 2
@@ -291,6 +315,41 @@ struct nn_option nn_options[] = {
      NN_OPT_READ_FILE, offsetof (nn_options_t, data_to_send), &echo_formats,
      NN_MASK_DATA, NN_MASK_DATA, NN_MASK_WRITEABLE,
      "Output Options", "PATH", "Same as --data but get data from file PATH"},
+    {"stream", 'S', NULL,
+     NN_OPT_STRING, offsetof (nn_options_t, stream_path), NULL,
+     NN_MASK_DATA, NN_MASK_DATA, NN_MASK_WRITEABLE,
+     "Output Options", "PATH", "Split file PATH (\"-\" for stdin) into "
+     "records and send (or reply with) one record per message until the "
+     "end of the file"},
+    {"delimiter", 0, NULL,
+     NN_OPT_ENUM, offsetof (nn_options_t, delimiter), &delimiters,
+     NN_NO_PROVIDES, NN_NO_CONFLICTS, NN_MASK_WRITEABLE,
+     "Output Options", "FORMAT", "Records in the --stream file are separated "
+     "by newlines (\"newline\", the default) or prefixed by 4-byte "
+     "big-endian length (\"length\")"},
+    {"rate", 'r', NULL,
+     NN_OPT_FLOAT, offsetof (nn_options_t, send_rate), NULL,
+     NN_NO_PROVIDES, NN_NO_CONFLICTS, NN_MASK_WRITEABLE,
+     "Output Options", "N", "Send N messages (or requests) per second. "
+     "Implies sending repeatedly"},
+
+    /* Load Options */
+    {"count", 'n', NULL,
+     NN_OPT_INT, offsetof (nn_options_t, count), NULL,
+     NN_NO_PROVIDES, NN_NO_CONFLICTS, NN_NO_REQUIRES,
+     "Load Options", "N", "Quit after sending (or receiving) N messages. "
+     "Implies sending repeatedly"},
+    {"duration", 0, NULL,
+     NN_OPT_FLOAT, offsetof (nn_options_t, duration), NULL,
+     NN_NO_PROVIDES, NN_NO_CONFLICTS, NN_NO_REQUIRES,
+     "Load Options", "SEC", "Quit after SEC seconds. "
+     "Implies sending repeatedly"},
+    {"stats", 0, NULL,
+     NN_OPT_FLOAT, offsetof (nn_options_t, stats_interval), NULL,
+     NN_NO_PROVIDES, NN_NO_CONFLICTS, NN_NO_REQUIRES,
+     "Load Options", "SEC", "Print throughput (and round-trip latency for "
+     "REQ and SURVEYOR sockets) to stderr every SEC seconds and once more "
+     "on exit"},
 
     /* Sentinel */
     {NULL, 0, NULL,
@@ -362,7 +421,7 @@ int nn_create_socket (nn_options_t *options)
         nn_assert_errno (rc == 0, "Can't set send timeout");
     }
     if (options->recv_timeout >= 0) {
-        nn_set_recv_timeout (sock, (int) options->recv_timeout);
+        nn_set_recv_timeout (sock, (int)(options->recv_timeout * 1000));
     }
     if (options->socket_name) {
         rc = nn_setsockopt (sock, NN_SOL_SOCKET, NN_SOCKET_NAME,
@@ -450,7 +509,6 @@ void nn_print_message (nn_options_t *options, char *buf, int buflen)
         break;
     
     }
-    fflush (stdout);
 }
 
 void nn_connect_socket (nn_options_t *options, int sock)
@@ -468,36 +526,351 @@ void nn_connect_socket (nn_options_t *options, int sock)
     }
 }
 
+/*  Time elapsed since the start of nanocat, in microseconds. Used for rate
+    control and statistics, where nn_clock's millisecond resolution is too
+    coarse.  */
+static struct nn_stopwatch nn_epoch;
+
+uint64_t nn_now_us ()
+{
+    return nn_stopwatch_term (&nn_epoch);
+}
+
+/*  Whether the message is sent over and over again rather than once.  */
+int nn_repeats (nn_options_t *options)
+{
+    return options->stream_path || options->send_rate > 0 ||
+        options->count > 0 || options->duration >= 0;
+}
+
+int nn_has_data (nn_options_t *options)
+{
+    return options->data_to_send.data || options->stream_path;
+}
+
+struct nn_progress {
+
+    /*  When the loop was started and the number of messages the rate limiter
+        has scheduled since then.  */
+    uint64_t start;
+    uint64_t scheduled;
+
+    /*  Totals since the start.  */
+    uint64_t sent;
+    uint64_t received;
+
+    /*  Statistics for the current reporting period.  */
+    uint64_t period_start;
+    uint64_t period_sent;
+    uint64_t period_received;
+    uint64_t period_bytes_sent;
+    uint64_t period_bytes_received;
+    uint64_t latency_sum;
+    uint64_t latency_max;
+    uint64_t latency_count;
+};
+
+void nn_progress_init (struct nn_progress *self)
+{
+    memset (self, 0, sizeof (struct nn_progress));
+    self->start = nn_now_us ();
+    self->period_start = self->start;
+}
+
+void nn_progress_report (nn_options_t *options, struct nn_progress *self,
+    uint64_t now)
+{
+    double secs;
+
+    secs = (double) (now - self->period_start) / 1000000.0;
+    if (secs <= 0)
+        secs = 1e-6;
+    fprintf (stderr, "%.3f: sent %llu (%.1f msg/s, %.3f MB/s), "
+        "received %llu (%.1f msg/s, %.3f MB/s)",
+        (double) (now - self->start) / 1000000.0,
+        (unsigned long long) self->period_sent, self->period_sent / secs,
+        self->period_bytes_sent / secs / 1000000.0,
+        (unsigned long long) self->period_received,
+        self->period_received / secs,
+        self->period_bytes_received / secs / 1000000.0);
+    if (self->latency_count) {
+        fprintf (stderr, ", latency avg %.3f ms max %.3f ms",
+            (double) self->latency_sum / self->latency_count / 1000.0,
+            (double) self->latency_max / 1000.0);
+    }
+    fputc ('\n', stderr);
+
+    self->period_start = now;
+    self->period_sent = 0;
+    self->period_received = 0;
+    self->period_bytes_sent = 0;
+    self->period_bytes_received = 0;
+    self->latency_sum = 0;
+    self->latency_max = 0;
+    self->latency_count = 0;
+}
+
+void nn_progress_tick (nn_options_t *options, struct nn_progress *self)
+{
+    uint64_t now;
+
+    if (options->stats_interval <= 0)
+        return;
+    now = nn_now_us ();
+    if (now - self->period_start >=
+          (uint64_t) (options->stats_interval * 1000000))
+        nn_progress_report (options, self, now);
+}
+
+void nn_progress_sent (nn_options_t *options, struct nn_progress *self,
+    size_t bytes)
+{
+    ++self->sent;
+    ++self->period_sent;
+    self->period_bytes_sent += bytes;
+    nn_progress_tick (options, self);
+}
+
+void nn_progress_received (nn_options_t *options, struct nn_progress *self,
+    size_t bytes, uint64_t sent_at)
+{
+    uint64_t latency;
+
+    ++self->received;
+    ++self->period_received;
+    self->period_bytes_received += bytes;
+    if (sent_at) {
+        latency = nn_now_us () - sent_at;
+        self->latency_sum += latency;
+        if (latency > self->latency_max)
+            self->latency_max = latency;
+        ++self->latency_count;
+    }
+    nn_progress_tick (options, self);
+}
+
+/*  Returns 1 once --count messages were processed or --duration elapsed.  */
+int nn_progress_done (nn_options_t *options, struct nn_progress *self,
+    uint64_t messages)
+{
+    if (options->count > 0 && messages >= (uint64_t) options->count)
+        return 1;
+    if (options->duration >= 0 && nn_now_us () - self->start >=
+          (uint64_t) (options->duration * 1000000))
+        return 1;
+    return 0;
+}
+
+/*  Milliseconds left until --duration elapses, -1 if there's no limit.  */
+int nn_progress_left (nn_options_t *options, struct nn_progress *self)
+{
+    int64_t left;
+
+    if (options->duration < 0)
+        return -1;
+    left = (int64_t) (options->duration * 1000000) -
+        (int64_t) (nn_now_us () - self->start);
+    return left > 0 ? (int) ((left + 999) / 1000) : 0;
+}
+
+/*  Waits until the next message is due according to --rate. The schedule
+    is fixed at the start, so a sender that fell behind catches up instead
+    of drifting.  */
+void nn_progress_pace (nn_options_t *options, struct nn_progress *self)
+{
+    uint64_t due;
+    uint64_t now;
+
+    if (options->send_rate <= 0)
+        return;
+    due = self->start +
+        (uint64_t) (self->scheduled * 1000000.0 / options->send_rate);
+    ++self->scheduled;
+    now = nn_now_us ();
+    if (due > now + 1000)
+        nn_sleep ((int) ((due - now) / 1000));
+}
+
+void nn_progress_term (nn_options_t *options, struct nn_progress *self)
+{
+    uint64_t now;
+    double secs;
+
+    fflush (stdout);
+    if (options->stats_interval <= 0)
+        return;
+    now = nn_now_us ();
+    if (self->period_sent || self->period_received)
+        nn_progress_report (options, self, now);
+    secs = (double) (now - self->start) / 1000000.0;
+    fprintf (stderr, "total: sent %llu, received %llu in %.3f s\n",
+        (unsigned long long) self->sent, (unsigned long long) self->received,
+        secs);
+}
+
+/*  Source of the messages to send: either the --data/--file blob, over and
+    over again, or the records read from the --stream file.  */
+struct nn_source {
+    FILE *file;
+    char *buf;
+    size_t size;
+};
+
+void nn_source_init (nn_options_t *options, struct nn_source *self)
+{
+    self->file = NULL;
+    self->buf = NULL;
+    self->size = 0;
+    if (!options->stream_path)
+        return;
+
+    if (strcmp (options->stream_path, "-") == 0) {
+        self->file = stdin;
+    } else {
+        self->file = fopen (options->stream_path, "rb");
+        nn_assert_errno (self->file != NULL, "Can't open stream file");
+    }
+    setvbuf (self->file, NULL, _IOFBF, NN_IO_BUFFER);
+}
+
+void nn_source_term (struct nn_source *self)
+{
+    if (self->file && self->file != stdin)
+        fclose (self->file);
+    free (self->buf);
+}
+
+static void nn_source_reserve (struct nn_source *self, size_t size)
+{
+    if (size <= self->size)
+        return;
+    if (size < 2 * self->size)
+        size = 2 * self->size;
+    if (size < 256)
+        size = 256;
+    self->buf = realloc (self->buf, size);
+    nn_assert_errno (self->buf != NULL, "Can't allocate record");
+    self->size = size;
+}
+
+/*  Returns 1 and the next message in 'data' and 'len', or 0 at the end of
+    the stream.  */
+int nn_source_next (nn_options_t *options, struct nn_source *self,
+    char **data, size_t *len)
+{
+    int c;
+    size_t n;
+    unsigned char hdr [4];
+
+    if (!self->file) {
+        *data = options->data_to_send.data;
+        *len = options->data_to_send.length;
+        return 1;
+    }
+
+    if (options->delimiter == NN_DELIM_LENGTH) {
+        n = fread (hdr, 1, sizeof (hdr), self->file);
+        if (n == 0)
+            return 0;
+        if (n != sizeof (hdr)) {
+            fprintf (stderr, "Truncated record length\n");
+            exit (3);
+        }
+        n = ((size_t) hdr [0] << 24) | ((size_t) hdr [1] << 16) |
+            ((size_t) hdr [2] << 8) | (size_t) hdr [3];
+        nn_source_reserve (self, n);
+        if (fread (self->buf, 1, n, self->file) != n) {
+            fprintf (stderr, "Truncated record\n");
+            exit (3);
+        }
+        *data = self->buf;
+        *len = n;
+        return 1;
+    }
+
+    n = 0;
+    while ((c = getc (self->file)) != EOF && c != '\n') {
+        nn_source_reserve (self, n + 1);
+        self->buf [n++] = (char) c;
+    }
+    if (c == EOF && n == 0)
+        return 0;
+    *data = self->buf;
+    *len = n;
+    return 1;
+}
+
+/*  Received messages are written to the fully buffered stdout, which is
+    flushed only when there's no message waiting, so that bursts of messages
+    don't cost a write per message while interactive use stays responsive.  */
+int nn_recv_buffered (int sock, void *buf, int flags)
+{
+    int rc;
+
+    rc = nn_recv (sock, buf, NN_MSG, NN_DONTWAIT);
+    if (rc >= 0 || errno != EAGAIN || (flags & NN_DONTWAIT))
+        return rc;
+    fflush (stdout);
+    return nn_recv (sock, buf, NN_MSG, flags);
+}
+
+/*  Limits the receive timeout so that a blocking receive returns by the
+    end of --duration.  */
+void nn_progress_timeout (nn_options_t *options, struct nn_progress *self,
+    int sock)
+{
+    int left;
+
+    left = nn_progress_left (options, self);
+    if (left < 0)
+        return;
+    if (options->recv_timeout >= 0 && options->recv_timeout * 1000 < left)
+        left = (int)(options->recv_timeout * 1000);
+    nn_set_recv_timeout (sock, left);
+}
+
 void nn_send_loop (nn_options_t *options, int sock)
 {
     int rc;
+    char *data;
+    size_t len;
     uint64_t start_time;
     int64_t time_to_sleep, interval;
     struct nn_clock clock;
+    struct nn_source source;
+    struct nn_progress progress;
 
     interval = (int)(options->send_interval*1000);
     nn_clock_init (&clock);
+    nn_source_init (options, &source);
+    nn_progress_init (&progress);
 
     for (;;) {
+        if (nn_progress_done (options, &progress, progress.sent))
+            break;
+        if (!nn_source_next (options, &source, &data, &len))
+            break;
+        nn_progress_pace (options, &progress);
         start_time = nn_clock_now (&clock);
-        rc = nn_send (sock,
-            options->data_to_send.data, options->data_to_send.length,
-            0);
+        rc = nn_send (sock, data, len, 0);
         if (rc < 0 && errno == EAGAIN) {
             fprintf (stderr, "Message not sent (EAGAIN)\n");
         } else {
             nn_assert_errno (rc >= 0, "Can't send");
+            nn_progress_sent (options, &progress, len);
         }
         if (interval >= 0) {
             time_to_sleep = (start_time + interval) - nn_clock_now (&clock);
             if (time_to_sleep > 0) {
                 nn_sleep ((int) time_to_sleep);
             }
-        } else {
+        } else if (!nn_repeats (options)) {
             break;
         }
     }
 
+    nn_progress_term (options, &progress);
+    nn_source_term (&source);
     nn_clock_term(&clock);
 }
 
@@ -505,18 +878,64 @@ void nn_recv_loop (nn_options_t *options, int sock)
 {
     int rc;
     void *buf;
+    struct nn_progress progress;
+
+    nn_progress_init (&progress);
 
     for (;;) {
-        rc = nn_recv (sock, &buf, NN_MSG, 0);
+        if (nn_progress_done (options, &progress, progress.received))
+            break;
+        nn_progress_timeout (options, &progress, sock);
+        rc = nn_recv_buffered (sock, &buf, 0);
         if (rc < 0 && errno == EAGAIN) {
             continue;
         } else if (rc < 0 && (errno == ETIMEDOUT || errno == EFSM)) {
-            return;  /*  No more messages possible  */
+            break;  /*  No more messages possible  */
         } else {
             nn_assert_errno (rc >= 0, "Can't recv");
         }
         nn_print_message (options, buf, rc);
         nn_freemsg (buf);
+        nn_progress_received (options, &progress, rc, 0);
+    }
+
+    nn_progress_term (options, &progress);
+}
+
+/*  Receives the replies to the message just sent when messages are sent back
+    to back rather than every --interval: a single reply for REQ, everything
+    up to the survey deadline for SURVEYOR and whatever has already arrived
+    for BUS and PAIR. 'sent_at' is used to measure the round-trip latency.  */
+void nn_recv_replies (nn_options_t *options, int sock,
+    struct nn_progress *progress, uint64_t sent_at)
+{
+    int rc;
+    int flags;
+    void *buf;
+
+    flags = 0;
+    if (options->socket_type != NN_REQ &&
+          options->socket_type != NN_SURVEYOR) {
+        flags = NN_DONTWAIT;
+        sent_at = 0;
+    }
+
+    for (;;) {
+        if (!flags)
+            nn_progress_timeout (options, progress, sock);
+        rc = nn_recv_buffered (sock, &buf, flags);
+        if (rc < 0) {
+            if (errno == EAGAIN && !flags)
+                continue;
+            if (errno == EAGAIN || errno == ETIMEDOUT || errno == EFSM)
+                return;
+            nn_assert_errno (0, "Can't recv");
+        }
+        nn_print_message (options, buf, rc);
+        nn_freemsg (buf);
+        nn_progress_received (options, progress, rc, sent_at);
+        if (options->socket_type == NN_REQ)
+            return;
     }
 }
 
@@ -524,27 +943,49 @@ void nn_rw_loop (nn_options_t *options, int sock)
 {
     int rc;
     void *buf;
+    char *data;
+    size_t len;
     uint64_t start_time;
+    uint64_t sent_at;
     int64_t time_to_sleep, interval, recv_timeout;
     struct nn_clock clock;
+    struct nn_source source;
+    struct nn_progress progress;
 
     interval = (int)(options->send_interval*1000);
     recv_timeout = (int)(options->recv_timeout*1000);
     nn_clock_init (&clock);
+    nn_source_init (options, &source);
+    nn_progress_init (&progress);
 
     for (;;) {
+        if (nn_progress_done (options, &progress, progress.sent))
+            break;
+        if (!nn_source_next (options, &source, &data, &len))
+            break;
+        nn_progress_pace (options, &progress);
         start_time = nn_clock_now (&clock);
-        rc = nn_send (sock,
-            options->data_to_send.data, options->data_to_send.length,
-            0);
+        sent_at = nn_now_us ();
+        rc = nn_send (sock, data, len, 0);
         if (rc < 0 && errno == EAGAIN) {
             fprintf (stderr, "Message not sent (EAGAIN)\n");
         } else {
             nn_assert_errno (rc >= 0, "Can't send");
+            nn_progress_sent (options, &progress, len);
         }
-        if (options->send_interval < 0) {  /*  Never send any more  */
-            nn_recv_loop (options, sock);
-            return;
+        if (options->send_interval < 0) {
+            if (!nn_repeats (options)) {  /*  Never send any more  */
+                nn_source_term (&source);
+                nn_clock_term (&clock);
+                nn_recv_loop (options, sock);
+                return;
+            }
+            nn_recv_replies (options, sock, &progress, sent_at);
+            continue;
+        }
+        if (options->socket_type != NN_REQ &&
+              options->socket_type != NN_SURVEYOR) {
+            sent_at = 0;
         }
 
         for (;;) {
@@ -557,7 +998,7 @@ void nn_rw_loop (nn_options_t *options, int sock)
                 time_to_sleep = recv_timeout;
             }
             nn_set_recv_timeout (sock, (int) time_to_sleep);
-            rc = nn_recv (sock, &buf, NN_MSG, 0);
+            rc = nn_recv_buffered (sock, &buf, 0);
             if (rc < 0) {
                 if (errno == EAGAIN) {
                     continue;
@@ -572,9 +1013,12 @@ void nn_rw_loop (nn_options_t *options, int sock)
             nn_assert_errno (rc >= 0, "Can't recv");
             nn_print_message (options, buf, rc);
             nn_freemsg (buf);
+            nn_progress_received (options, &progress, rc, sent_at);
         }
     }
 
+    nn_progress_term (options, &progress);
+    nn_source_term (&source);
     nn_clock_term(&clock);
 }
 
@@ -582,25 +1026,61 @@ void nn_resp_loop (nn_options_t *options, int sock)
 {
     int rc;
     void *buf;
+    char *data;
+    size_t len;
+    struct nn_source source;
+    struct nn_progress progress;
+
+    nn_source_init (options, &source);
+    nn_progress_init (&progress);
 
     for (;;) {
-        rc = nn_recv (sock, &buf, NN_MSG, 0);
+        if (nn_progress_done (options, &progress, progress.received))
+            break;
+        nn_progress_timeout (options, &progress, sock);
+        rc = nn_recv_buffered (sock, &buf, 0);
         if (rc < 0 && errno == EAGAIN) {
                 continue;
+        } else if (rc < 0 && errno == ETIMEDOUT &&
+              nn_progress_left (options, &progress) == 0) {
+            break;
         } else {
             nn_assert_errno (rc >= 0, "Can't recv");
         }
         nn_print_message (options, buf, rc);
         nn_freemsg (buf);
-        rc = nn_send (sock,
-            options->data_to_send.data, options->data_to_send.length,
-            0);
+        nn_progress_received (options, &progress, rc, 0);
+        if (!nn_source_next (options, &source, &data, &len))
+            break;
+        rc = nn_send (sock, data, len, 0);
         if (rc < 0 && errno == EAGAIN) {
             fprintf (stderr, "Message not sent (EAGAIN)\n");
         } else {
             nn_assert_errno (rc >= 0, "Can't send");
+            nn_progress_sent (options, &progress, len);
         }
     }
+
+    nn_progress_term (options, &progress);
+    nn_source_term (&source);
+}
+
+/*  Closing the socket drops the messages that are still queued, as the
+    library doesn't implement NN_LINGER yet. Wait for the linger period
+    after sending a stream of messages so that the tail isn't lost.  */
+void nn_linger (nn_options_t *options, int sock)
+{
+    int rc;
+    int linger;
+    size_t sz;
+
+    if (!nn_has_data (options) || !nn_repeats (options))
+        return;
+    sz = sizeof (linger);
+    rc = nn_getsockopt (sock, NN_SOL_SOCKET, NN_LINGER, &linger, &sz);
+    nn_assert_errno (rc == 0, "Can't get linger");
+    if (linger > 0)
+        nn_sleep (linger);
 }
 
 int main (int argc, char **argv)
@@ -618,10 +1098,18 @@ int main (int argc, char **argv)
         /* send_delay        */ 0.f,
         /* send_interval     */ -1.f,
         /* data_to_send      */ {NULL, 0, 0},
-        /* echo_format       */ NN_NO_ECHO
+        /* stream_path       */ NULL,
+        /* delimiter         */ NN_DELIM_NEWLINE,
+        /* send_rate         */ -1.f,
+        /* echo_format       */ NN_NO_ECHO,
+        /* count             */ 0,
+        /* duration          */ -1.f,
+        /* stats_interval    */ -1.f
     };
 
+    nn_stopwatch_init (&nn_epoch);
     nn_parse_options (&nn_cli, &options, argc, argv);
+    setvbuf (stdout, NULL, _IOFBF, NN_IO_BUFFER);
     sock = nn_create_socket (&options);
     nn_connect_socket (&options, sock);
     nn_sleep((int)(options.send_delay*1000));
@@ -636,7 +1124,7 @@ int main (int argc, char **argv)
         break;
     case NN_BUS:
     case NN_PAIR:
-        if (options.data_to_send.data) {
+        if (nn_has_data (&options)) {
             nn_rw_loop (&options, sock);
         } else {
             nn_recv_loop (&options, sock);
@@ -648,7 +1136,7 @@ int main (int argc, char **argv)
         break;
     case NN_REP:
     case NN_RESPONDENT:
-        if (options.data_to_send.data) {
+        if (nn_has_data (&options)) {
             nn_resp_loop (&options, sock);
         } else {
             nn_recv_loop (&options, sock);
@@ -656,6 +1144,8 @@ int main (int argc, char **argv)
         break;
     }
 
+    fflush (stdout);
+    nn_linger (&options, sock);
     nn_close (sock);
     nn_free_options(&nn_cli, &options);
     return 0;